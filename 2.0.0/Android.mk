@@ -151,7 +151,15 @@ LOCAL_SRC_FILES := \
 	color_histogram.cpp \
 	pq_xml_parser.cpp \
 	led_device.cpp \
-	index_buffer_generator.cpp
+	index_buffer_generator.cpp \
+	hwc_recorder.cpp \
+	mc_estimator.cpp \
+	mc_model.cpp \
+	mc_feature.cpp \
+	gles_range_policy.cpp \
+	buffer_pool.cpp \
+	memory_tracker.cpp \
+	uclamp_controller.cpp
 
 ifeq ($(MTK_DX_HDCP_SUPPORT),yes)
 LOCAL_CFLAGS += -DFT_HDCP_FEATURE
@@ -207,6 +215,7 @@ LOCAL_SRC_FILES += \
 	drm/drmmodeplane.cpp \
 	drm/drmmodeencoder.cpp \
 	drm/drmmodeconnector.cpp \
+	drm/drmedidcache.cpp \
 	drm/drmmodeutils.cpp \
 	drm/drmobject.cpp \
 	drm/drmhrt.cpp \
@@ -287,3 +296,399 @@ LOCAL_CFLAGS += -Wconversion \
 
 include $(MTK_STATIC_LIBRARY)
 
+
+#
+# host-side replayer of the HWC2 call-stream trace (vendor.debug.hwc.record_call)
+#
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_replay
+LOCAL_SRC_FILES := tools/hwc_replay.cpp
+LOCAL_CFLAGS += -Wconversion \
+	-Wsign-compare \
+	-Wall \
+	-Werror
+
+include $(BUILD_HOST_EXECUTABLE)
+
+
+#
+# on-device replay driver, it feeds a HWC2 call-stream trace into HWCMediator
+#
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_replay_driver
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_OWNER := mtk
+LOCAL_SRC_FILES := tools/hwc_replay_driver.cpp
+
+ifdef MTK_GENERIC_HAL
+LOCAL_WHOLE_STATIC_LIBRARIES := hwcomposer.mtk_common.$(MTK_HWC_VERSION)
+else
+LOCAL_WHOLE_STATIC_LIBRARIES := hwcomposer.$(TARGET_BOARD_PLATFORM).$(MTK_HWC_VERSION)
+endif
+
+LOCAL_STATIC_LIBRARIES := \
+	libarect \
+	libmath \
+	libgrallocusage \
+	libaidlcommonsupport
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libcutils \
+	liblog \
+	libui \
+	libhardware \
+	libbinder \
+	libhidlbase \
+	libdpframework \
+	libged \
+	libnativewindow \
+	android.hardware.graphics.common@1.2 \
+	android.hardware.graphics.composer@2.3 \
+	android.hardware.graphics.mapper@2.0 \
+	android.hardware.graphics.mapper@2.1 \
+	libcomposer_ext \
+	libladder \
+	libpq_prot \
+	libgralloctypes \
+	libpqparamparser \
+	libmml \
+	libdmabufheap \
+	libsync \
+	libxml2 \
+	android.hardware.graphics.composer3-V1-ndk
+
+ifeq ($(filter PQ_OFF no, $(MTK_PQ_SUPPORT)),)
+LOCAL_SHARED_LIBRARIES += \
+	libbinder_ndk \
+	vendor.mediatek.hardware.pq_aidl-V1-ndk
+endif
+
+ifeq ($(HAVE_AEE_FEATURE),yes)
+LOCAL_SHARED_LIBRARIES += libaedv
+endif
+
+LOCAL_HEADER_LIBRARIES := \
+	media_plugin_headers \
+	libgralloc_metadata_headers \
+	libhardware_headers \
+	hwcomposer_headers \
+	libpq_headers \
+	libnpagent_headers \
+	libsync_headers \
+	libgralloc_extra_headers \
+	libladder_headers
+
+LOCAL_CFLAGS := \
+	-DLOG_TAG=\"hwc_replay_driver\" \
+	-DMTK_HWC_VER_2_0 \
+	-DUSE_HWC2
+
+LOCAL_CFLAGS += -Wconversion \
+	-Wsign-compare \
+	-Wall \
+	-Werror
+
+include $(BUILD_EXECUTABLE)
+
+
+#
+# host replay driver, the same driver with HWCMediator on the stub devices of
+# tools/host, so the CPU time of a trace can be compared without a phone
+#
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_replay_host
+
+# the core sources of the static library, without the kernel and HAL backends
+LOCAL_SRC_FILES := \
+	hwc2.cpp \
+	dispatcher.cpp \
+	worker.cpp \
+	display.cpp \
+	event.cpp \
+	overlay.cpp \
+	queue.cpp \
+	sync.cpp \
+	composer.cpp \
+	bliter_async.cpp \
+	bliter_ultra.cpp \
+	glai_handler.cpp \
+	glai_controller.cpp \
+	ai_blulight_defender.cpp \
+	display_dump.cpp \
+	platform_common.cpp \
+	../utils/tools.cpp \
+	../utils/debug.cpp \
+	../utils/transform.cpp \
+	../utils/swwatchdog.cpp \
+	../utils/fpscounter.cpp \
+	../utils/mm_buf_dump.cpp \
+	../utils/perfhelper.cpp \
+	../hwc_ui/Gralloc.cpp \
+	../hwc_ui/GrallocHost.cpp \
+	../hwc_ui/GraphicBufferMapper.cpp \
+	../hwc_ui/PixelFormat.cpp \
+	../hwc_ui/Rect.cpp \
+	color.cpp \
+	asyncblitdev.cpp \
+	hwc2_defs.cpp \
+	hwcbuffer.cpp \
+	hwclayer.cpp \
+	hwcdisplay.cpp \
+	dev_interface.cpp \
+	pq_interface.cpp \
+	hrt_common.cpp \
+	platform_wrap.cpp \
+	mml_asyncblitstream.cpp \
+	data_express.cpp \
+	color_histogram.cpp \
+	pq_xml_parser.cpp \
+	led_device.cpp \
+	index_buffer_generator.cpp \
+	hwc_recorder.cpp \
+	mc_estimator.cpp \
+	mc_model.cpp \
+	mc_feature.cpp \
+	gles_range_policy.cpp \
+	buffer_pool.cpp \
+	memory_tracker.cpp \
+	uclamp_controller.cpp \
+	../ld20/platform6885.cpp \
+	../ld20/platform6983.cpp \
+	../ld20/platform6879.cpp \
+	../ld20/platform6895.cpp \
+	../ld20/platform6855.cpp \
+	../ld20/platform6886.cpp \
+	../ld20/platform6985.cpp \
+	tools/hwc_replay_driver.cpp \
+	tools/host/stub_overlay_device.cpp \
+	tools/host/stub_hrt.cpp \
+	tools/host/stub_pq_device.cpp \
+	tools/host/host_gralloc.cpp \
+	tools/host/vendor_stubs.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/.. \
+	$(LOCAL_PATH)/../hwc_ui/include \
+	$(TOP)/$(MTK_ROOT)/hardware/hwcomposer \
+	$(TOP)/$(MTK_ROOT)/hardware/hwcomposer/include \
+	$(TOP)/$(MTK_ROOT)/hardware/libhwcomposer/mtk_simple/include \
+	$(TOP)/$(MTK_ROOT)/hardware/gralloc_extra/include \
+	$(TOP)/$(MTK_ROOT)/hardware/dpframework/include \
+	$(TOP)/$(MTK_ROOT)/hardware/power/include \
+	$(TOP)/$(MTK_ROOT)/external/libudf/libladder \
+	external/libdrm \
+	external/libdrm/include/drm
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libcutils \
+	liblog \
+	libbase \
+	libprocessgroup \
+	libhidlbase \
+	libgralloctypes \
+	libxml2 \
+	android.hardware.graphics.common@1.2
+
+LOCAL_STATIC_LIBRARIES := \
+	libarect \
+	libmath
+
+LOCAL_HEADER_LIBRARIES := \
+	libhardware_headers \
+	libsync_headers \
+	media_plugin_headers \
+	libgralloc_metadata_headers \
+	libgralloc_extra_headers \
+	libnpagent_headers \
+	libladder_headers
+
+LOCAL_CFLAGS := \
+	-DLOG_TAG=\"hwc_replay_host\" \
+	-DMTK_HWC_USE_STUB_DEVICE \
+	-DMTK_GENERIC_HAL \
+	-DMTK_HWC_VER_2_0 \
+	-DUSE_HWC2 \
+	-DMTK_IN_DISPLAY_FINGERPRINT \
+	-DMTK_HDR_SET_DISPLAY_COLOR
+
+LOCAL_CFLAGS += -Wconversion \
+	-Wsign-compare \
+	-Wall \
+	-Werror
+
+include $(BUILD_HOST_EXECUTABLE)
+
+
+#
+# host unit tests, run with atest or from out/host/linux-x86/nativetest64
+#
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_cow_list_test
+LOCAL_SRC_FILES := tests/cow_list_test.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_HEADER_LIBRARIES := libutils_headers
+LOCAL_SANITIZE := thread
+LOCAL_CFLAGS += -Wconversion \
+	-Wsign-compare \
+	-Wall \
+	-Werror
+
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_gles_range_policy_test
+LOCAL_SRC_FILES := \
+	tests/gles_range_policy_test.cpp \
+	gles_range_policy.cpp
+# tests/include replaces utils/debug.h, which needs the vendor ged and aee headers
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/tests/include \
+	$(LOCAL_PATH)
+LOCAL_SHARED_LIBRARIES := libutils
+LOCAL_CFLAGS += -Wconversion \
+	-Wsign-compare \
+	-Wall \
+	-Werror
+
+include $(BUILD_HOST_NATIVE_TEST)
+
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_buffer_count_tuner_test
+LOCAL_SRC_FILES := tests/buffer_count_tuner_test.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)
+LOCAL_CFLAGS += -Wconversion \
+	-Wsign-compare \
+	-Wall \
+	-Werror
+
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_mc_model_test
+LOCAL_SRC_FILES := \
+	tests/mc_model_test.cpp \
+	mc_model.cpp
+# tests/include replaces utils/debug.h, which needs the vendor ged and aee headers
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/tests/include \
+	$(LOCAL_PATH)
+LOCAL_SHARED_LIBRARIES := libutils
+LOCAL_CFLAGS += -Wconversion \
+	-Wsign-compare \
+	-Wall \
+	-Werror
+
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_memory_tracker_test
+LOCAL_SRC_FILES := \
+	tests/memory_tracker_test.cpp \
+	memory_tracker.cpp
+# tests/include replaces utils/debug.h, which needs the vendor ged and aee headers
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/tests/include \
+	$(LOCAL_PATH)
+LOCAL_SHARED_LIBRARIES := libutils
+LOCAL_CFLAGS += -Wconversion \
+	-Wsign-compare \
+	-Wall \
+	-Werror
+
+include $(BUILD_HOST_NATIVE_TEST)
+
+#
+# device unit tests, they need the display driver, gralloc or sw_sync
+#
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_queue_test
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_OWNER := mtk
+LOCAL_SRC_FILES := tests/queue_test.cpp
+
+ifdef MTK_GENERIC_HAL
+LOCAL_WHOLE_STATIC_LIBRARIES := hwcomposer.mtk_common.$(MTK_HWC_VERSION)
+else
+LOCAL_WHOLE_STATIC_LIBRARIES := hwcomposer.$(TARGET_BOARD_PLATFORM).$(MTK_HWC_VERSION)
+endif
+
+LOCAL_STATIC_LIBRARIES := \
+	libarect \
+	libmath \
+	libgrallocusage \
+	libaidlcommonsupport
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libcutils \
+	liblog \
+	libui \
+	libhardware \
+	libbinder \
+	libhidlbase \
+	libdpframework \
+	libged \
+	libnativewindow \
+	android.hardware.graphics.common@1.2 \
+	android.hardware.graphics.composer@2.3 \
+	android.hardware.graphics.mapper@2.0 \
+	android.hardware.graphics.mapper@2.1 \
+	libcomposer_ext \
+	libladder \
+	libpq_prot \
+	libgralloctypes \
+	libpqparamparser \
+	libmml \
+	libdmabufheap \
+	libsync \
+	libxml2 \
+	android.hardware.graphics.composer3-V1-ndk
+
+ifeq ($(filter PQ_OFF no, $(MTK_PQ_SUPPORT)),)
+LOCAL_SHARED_LIBRARIES += \
+	libbinder_ndk \
+	vendor.mediatek.hardware.pq_aidl-V1-ndk
+endif
+
+ifeq ($(HAVE_AEE_FEATURE),yes)
+LOCAL_SHARED_LIBRARIES += libaedv
+endif
+
+LOCAL_HEADER_LIBRARIES := \
+	media_plugin_headers \
+	libgralloc_metadata_headers \
+	libhardware_headers \
+	hwcomposer_headers \
+	libpq_headers \
+	libnpagent_headers \
+	libsync_headers \
+	libgralloc_extra_headers \
+	libladder_headers
+
+LOCAL_C_INCLUDES := \
+	$(TOP)/system/core/libsync
+
+LOCAL_CFLAGS := \
+	-DLOG_TAG=\"hwc_queue_test\" \
+	-DMTK_HWC_VER_2_0 \
+	-DUSE_HWC2
+
+LOCAL_CFLAGS += -Wconversion \
+	-Wsign-compare \
+	-Wall \
+	-Werror
+
+include $(BUILD_NATIVE_TEST)
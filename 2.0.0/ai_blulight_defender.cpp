@@ -13,6 +13,7 @@
 
 #include <utils/String8.h>
 
+#include <algorithm>
 #include <sstream>
 #include <sys/stat.h>
 #include <vector>
@@ -45,11 +46,20 @@ AiBluLightDefender::~AiBluLightDefender()
 {
     if (m_enable)
     {
-        {
-            std::lock_guard<std::mutex> lock(m_thread_mutex);
-            m_thread_stop = true;
-            m_condition.notify_all();
-        }
+        stopThread();
+    }
+}
+
+void AiBluLightDefender::stopThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_thread_mutex);
+        m_thread_stop = true;
+        m_condition.notify_all();
+    }
+
+    if (m_thread.joinable())
+    {
         m_thread.join();
     }
 }
@@ -129,14 +139,17 @@ int AiBluLightDefender::setEnable(bool enable,
 
         if (m_enable_fail)
         {
+            // AIBLD thread consumes the job ring, so stop it before freeing the jobs
+            if (m_enable)
+            {
+                stopThread();
+                m_enable = false;
+                HWCMediator::getInstance().getHWCDisplay(HWC_DISPLAY_PRIMARY)->setWdmaEnable(HWC_WDMA_STATUS_AIBLD, false);
+            }
             freeResources();
             return -ENOMEM;
         }
     }
-    else
-    {
-        freeResources();
-    }
 
     if (m_enable != enable)
     {
@@ -154,15 +167,16 @@ int AiBluLightDefender::setEnable(bool enable,
         }
         else
         {
-            {
-                std::lock_guard<std::mutex> lock(m_thread_mutex);
-                m_thread_stop = true;
-                m_condition.notify_all();
-            }
-            m_thread.join();
+            stopThread();
         }
     }
 
+    if (!enable)
+    {
+        // AIBLD thread consumes the job ring, so free the jobs after it stopped
+        freeResources();
+    }
+
     HWCMediator::getInstance().getHWCDisplay(HWC_DISPLAY_PRIMARY)->setWdmaEnable(HWC_WDMA_STATUS_AIBLD, enable);
 
     m_enable = enable;
@@ -172,10 +186,11 @@ int AiBluLightDefender::setEnable(bool enable,
 
 void AiBluLightDefender::freeResources()
 {
-    std::unique_lock<std::mutex> lock(m_thread_mutex);
-
-    for (Job& job : m_job_list)
+    // must be called without AIBLD thread, since it pops jobs from the ring too
+    const uint32_t tail = m_job_tail.load(std::memory_order_acquire);
+    for (uint32_t head = m_job_head.load(std::memory_order_acquire); head != tail; head++)
     {
+        Job& job = m_job_ring[head % JOB_RING_SIZE];
         job.bliter_node->cancelJob(job.mdp_job_id);
 
         if (job.mdp_in_ion_fd > 0)
@@ -184,8 +199,10 @@ void AiBluLightDefender::freeResources()
         }
 
         freeDuppedBufferHandle(job.src_handle);
+        job = Job();
+        m_mdp_held--;
     }
-    m_job_list.clear();
+    m_job_head.store(tail, std::memory_order_release);
 
     m_bliter_node = nullptr;
     m_disp_queue = nullptr;
@@ -405,6 +422,15 @@ void AiBluLightDefender::onSetJob(DispatcherJob* job,
         {
             return;
         }
+
+        // AIBLD thread or PQ falls behind, drop this sample instead of waiting a free mdp buffer
+        if (m_mdp_held.load(std::memory_order_acquire) >= JOB_RING_DEPTH)
+        {
+            m_job_dropped++;
+            HWC_LOGD("mdp slots are held, drop frame, pending %u held %u", getPendingJobCount(),
+                     m_mdp_held.load(std::memory_order_relaxed));
+            return;
+        }
         // TODO: if no screen update, skip
         // TODO: secure?
 
@@ -586,26 +612,35 @@ void AiBluLightDefender::onSetJob(DispatcherJob* job,
 
         mdp_queue->queueBuffer(&mdp_buffer);
 
-        // set to job thread
-        std::lock_guard<std::mutex> l(m_thread_mutex);
-        Job aibld_job{.mdp_job_id = ai_bld_mdp_job_id,
-                      .queue = mdp_queue,
-                      .bliter_node = bliter_node,
-                      .mdp_in_ion_fd = priv_handle->ion_fd,
-                      .src_handle = outbuf_hnd,
-                      .pf_fence_idx = pf_fence_idx,
-                      .dump_enable = m_dump_enable};
+        // set to job thread, the ring is checked not full at the beginning,
+        // and only AIBLD thread can change it since then by popping jobs
+        const uint32_t tail = m_job_tail.load(std::memory_order_relaxed);
+        Job& aibld_job = m_job_ring[tail % JOB_RING_SIZE];
+        aibld_job = Job{.mdp_job_id = ai_bld_mdp_job_id,
+                        .queue = mdp_queue,
+                        .bliter_node = bliter_node,
+                        .mdp_in_ion_fd = priv_handle->ion_fd,
+                        .src_handle = outbuf_hnd,
+                        .pf_fence_idx = pf_fence_idx,
+                        .dump_enable = m_dump_enable,
+                        .queue_ts = systemTime()};
 
         if (m_dump_enable)
         {
             aibld_job.mdp_in_priv_handle = *priv_handle;
         }
-        m_job_list.push_back(aibld_job);
 
         HWC_LOGD("add job, mdp job id %d, prepare_param.fence_index %d",
                  aibld_job.mdp_job_id, prepare_param.fence_index);
 
-        m_condition.notify_all();
+        m_mdp_held++;
+        m_job_tail.store(tail + 1, std::memory_order_release);
+        m_job_queued++;
+
+        {
+            std::lock_guard<std::mutex> l(m_thread_mutex);
+            m_condition.notify_all();
+        }
     }
     else
     {
@@ -672,15 +707,37 @@ void AiBluLightDefender::onProcess(DispatcherJob* job,
     ovl_device->setOutput(&param);
 }
 
+void AiBluLightDefender::addStageStat(int stage, nsecs_t duration)
+{
+    std::lock_guard<std::mutex> lock(m_stat_mutex);
+
+    StageStat& stat = m_stage_stat[stage];
+    stat.count++;
+    stat.last = duration;
+    stat.max = std::max(stat.max, duration);
+    stat.total += duration;
+}
+
 void AiBluLightDefender::dump(String8* dump_str) const
 {
+    static const char* const stage_name[STAGE_NUM] = {
+        "mdp_invalidate", "acquire", "mdp_done", "set_pq", "total" };
+
     std::ostringstream ss;
     ss << "AiBluLightDefender:" << endl;
-/*    ss << "id: " << m_model.agent_id << endl;
-    ss << "format: in " << m_model.in_format << " out " << m_model.out_format << endl;
-    ss << "compress: in " << m_model.in_compress << " out " << m_model.out_compress << endl;
-    ss << "in: w " << m_model.in_w << " h " << m_model.in_h << " stride " << m_model.in_stride << endl;
-    ss << "out: w " << m_model.out_w << " h " << m_model.out_h << " stride " << m_model.out_stride << endl;*/
+    ss << "jobs: queued " << m_job_queued.load() << " done " << m_job_done.load()
+       << " dropped " << m_job_dropped.load() << " pending " << getPendingJobCount()
+       << " mdp_held " << m_mdp_held.load() << endl;
+    {
+        std::lock_guard<std::mutex> lock(m_stat_mutex);
+        for (int i = 0; i < STAGE_NUM; i++)
+        {
+            const StageStat& stat = m_stage_stat[i];
+            const nsecs_t avg = stat.count ? stat.total / static_cast<nsecs_t>(stat.count) : 0;
+            ss << stage_name[i] << "(us): last " << ns2us(stat.last)
+               << " avg " << ns2us(avg) << " max " << ns2us(stat.max) << endl;
+        }
+    }
     ss << endl;
 
     if (dump_str)
@@ -697,39 +754,51 @@ void AiBluLightDefender::threadLoop()
 {
     while (true)
     {
-        Job job;
         {
             ATRACE_NAME("wait_job");
             std::unique_lock<std::mutex> lock(m_thread_mutex);
 
-            if (m_job_list.empty())
-            {
-                if (m_thread_stop)
-                {
-                    break;
-                }
+            m_condition.wait(lock, [this] { return m_thread_stop || getPendingJobCount() > 0; });
 
-                m_condition.wait(lock);
-                continue;
+            if (getPendingJobCount() == 0)
+            {
+                // stopped and no job left
+                break;
             }
-
-            job = m_job_list.front();
-            m_job_list.pop_front();
         }
 
+        const uint32_t head = m_job_head.load(std::memory_order_relaxed);
+        Job job = std::move(m_job_ring[head % JOB_RING_SIZE]);
+        m_job_ring[head % JOB_RING_SIZE] = Job();
+        m_job_head.store(head + 1, std::memory_order_release);
+
         ATRACE_NAME(__FUNCTION__);
         HWC_LOGD("do mdp job %d", job.mdp_job_id);
+
+        nsecs_t stage_begin = systemTime();
         job.bliter_node->invalidate(job.mdp_job_id);
+        nsecs_t stage_end = systemTime();
+        addStageStat(STAGE_MDP_INVALIDATE, stage_end - stage_begin);
 
         // acquire and set to pq
+        stage_begin = stage_end;
         DisplayBufferQueue::DisplayBuffer* buffer = job.queue->getLastAcquiredBufEditable();
         status_t acq_status = job.queue->acquireBuffer(buffer, true);
+        stage_end = systemTime();
+        addStageStat(STAGE_ACQUIRE, stage_end - stage_begin);
         if (acq_status == NO_ERROR)
         {
-            SyncFence::waitPeriodicallyWoCloseFd(buffer->acquire_fence, 100, 1000,
-                                                 (std::string("aibld_") + std::to_string(job.mdp_job_id)).c_str());
-            protectedClose(buffer->acquire_fence);
-            buffer->acquire_fence = -1;
+            // the pq service call has no fence argument, so wait mdp done here instead of
+            // in the pq sender thread, which also sends the other pq commands
+            stage_begin = stage_end;
+            SyncFence::waitPeriodicallyWoCloseFd(buffer->acquire_fence, 100, 1000, "aibld");
+            if (buffer->acquire_fence >= 0)
+            {
+                protectedClose(buffer->acquire_fence);
+                buffer->acquire_fence = -1;
+            }
+            stage_end = systemTime();
+            addStageStat(STAGE_MDP_DONE, stage_end - stage_begin);
 
             if (job.dump_enable)
             {
@@ -759,14 +828,26 @@ void AiBluLightDefender::threadLoop()
                          false);
             }
 
-            // set to pq
-            getPqDevice()->setAiBldBuffer(buffer->out_handle, job.pf_fence_idx);
-
-            // release
-            if (job.queue->releaseBuffer(buffer->index, -1) != NO_ERROR)
-            {
-                HWC_LOGW("%s(), releaseBuffer failed, idx %d", __FUNCTION__, buffer->index);
-            }
+            // set to pq, pq has read the buffer once the call returns, so the slot goes
+            // back to the queue only then
+            const sp<DisplayBufferQueue> queue = job.queue;
+            const int index = buffer->index;
+            stage_begin = systemTime();
+            getPqDevice()->setAiBldBuffer(buffer->out_handle, job.pf_fence_idx,
+                [this, queue, index]()
+                {
+                    if (queue->releaseBuffer(index, -1) != NO_ERROR)
+                    {
+                        HWC_LOGW("releaseBuffer failed, idx %d", index);
+                    }
+                    m_mdp_held--;
+                });
+            stage_end = systemTime();
+            addStageStat(STAGE_SET_PQ, stage_end - stage_begin);
+        }
+        else
+        {
+            m_mdp_held--;
         }
 
         if (job.mdp_in_ion_fd > 0)
@@ -775,6 +856,9 @@ void AiBluLightDefender::threadLoop()
         }
 
         freeDuppedBufferHandle(job.src_handle);
+
+        addStageStat(STAGE_TOTAL, systemTime() - job.queue_ts);
+        m_job_done++;
     }
 }
 
@@ -3,6 +3,7 @@
 #include <utils/StrongPointer.h>
 #include <utils/Timers.h>
 
+#include <atomic>
 #include <mutex>
 
 #include "bliter_ultra.h"
@@ -55,6 +56,8 @@ protected:
 
     void freeResources();
 
+    void stopThread();
+
     void threadLoop();
 
 protected:
@@ -71,8 +74,37 @@ protected:
         bool dump_enable;
         // for dump, only assign if need dump
         PrivateHandle mdp_in_priv_handle;
+
+        // the time this job is put into m_job_ring
+        nsecs_t queue_ts;
+    };
+
+    enum
+    {
+        STAGE_MDP_INVALIDATE = 0,
+        STAGE_ACQUIRE,
+        STAGE_MDP_DONE,
+        STAGE_SET_PQ,
+        STAGE_TOTAL,
+        STAGE_NUM,
+    };
+
+    struct StageStat
+    {
+        uint64_t count = 0;
+        nsecs_t last = 0;
+        nsecs_t max = 0;
+        nsecs_t total = 0;
     };
 
+    void addStageStat(int stage, nsecs_t duration);
+
+    uint32_t getPendingJobCount() const
+    {
+        return m_job_tail.load(std::memory_order_acquire) -
+               m_job_head.load(std::memory_order_acquire);
+    }
+
     mutable std::mutex m_mutex;
     bool m_enable = false;
     nsecs_t m_sample_period = INT64_MAX;
@@ -90,10 +122,31 @@ protected:
     BufferConfig m_dp_config;
 
     std::thread m_thread;
+    // m_thread_mutex and m_condition are only used to put AIBLD thread to sleep,
+    // jobs are passed through m_job_ring without lock
     mutable std::mutex m_thread_mutex;
     mutable std::condition_variable m_condition;
     bool m_thread_stop = false;
-    std::list<Job> m_job_list;
+
+    // single producer (onSetJob of primary display) and single consumer (AIBLD thread) ring.
+    // m_job_tail is only advanced by producer, and m_job_head only by consumer
+    enum { JOB_RING_SIZE = 4 };
+    // the mdp queue needs a free slot for the next job, so the ring, AIBLD thread and PQ
+    // never hold all of them
+    enum { JOB_RING_DEPTH = DisplayBufferQueue::NUM_BUFFER_SLOTS - 1 };
+    Job m_job_ring[JOB_RING_SIZE];
+    std::atomic<uint32_t> m_job_head{0};
+    std::atomic<uint32_t> m_job_tail{0};
+    // the mdp slots of the jobs in the ring, the job of AIBLD thread and the buffers which
+    // PQ has not read yet
+    std::atomic<uint32_t> m_mdp_held{0};
+
+    std::atomic<uint64_t> m_job_queued{0};
+    std::atomic<uint64_t> m_job_dropped{0};
+    std::atomic<uint64_t> m_job_done{0};
+
+    mutable std::mutex m_stat_mutex;
+    StageStat m_stage_stat[STAGE_NUM];
 
     bool m_dump_enable = false;
 
@@ -1760,6 +1760,9 @@ void AsyncBliterHandler::setPhyMirror(DispatcherJob* job)
             BLOGE(ovl_id, "%s(), m_mirror_queue == nullptr", __FUNCTION__);
             return;
         }
+
+        // the mirror output feeds another display, let the queue absorb its jitter
+        m_mirror_queue->setAutoBufferCount(true);
     }
     sp<DisplayBufferQueue> queue = m_mirror_queue;
 
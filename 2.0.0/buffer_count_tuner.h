@@ -0,0 +1,93 @@
+#pragma once
+
+// BufferCountTuner decides when a DisplayBufferQueue with the auto buffer count
+// adds or removes a slot. It only looks at the free slots of each dequeue:
+// - a slot is added after grow_dequeues dequeues found no free slot, unless
+//   grow_window dequeues in a row found one in between
+// - a slot is removed after shrink_dequeues dequeues in a row found a spare one
+class BufferCountTuner
+{
+public:
+    enum Action
+    {
+        KEEP = 0,
+        GROW,
+        SHRINK,
+    };
+
+    BufferCountTuner(int grow_dequeues, int grow_window, int shrink_dequeues)
+        : m_grow_dequeues(grow_dequeues)
+        , m_grow_window(grow_window)
+        , m_shrink_dequeues(shrink_dequeues)
+        , m_starved_count(0)
+        , m_fed_count(0)
+        , m_spare_count(0)
+    { }
+
+    void reset()
+    {
+        m_starved_count = 0;
+        m_fed_count = 0;
+        m_spare_count = 0;
+    }
+
+    // onDequeue() is called once per dequeue with the free slots which it found,
+    // SHRINK is returned again at the next dequeue if the slot cannot be removed yet
+    Action onDequeue(int free_count, int buffer_count, int base_count, int max_count)
+    {
+        if (free_count == 0)
+        {
+            m_fed_count = 0;
+            m_spare_count = 0;
+            if (buffer_count >= max_count)
+            {
+                return KEEP;
+            }
+
+            m_starved_count++;
+            if (m_starved_count < m_grow_dequeues)
+            {
+                return KEEP;
+            }
+
+            m_starved_count = 0;
+            return GROW;
+        }
+
+        m_fed_count++;
+        if (m_fed_count >= m_grow_window)
+        {
+            m_starved_count = 0;
+        }
+
+        // one free slot is taken by this dequeue, the others are spare
+        if (free_count < 2 || buffer_count <= base_count)
+        {
+            m_spare_count = 0;
+            return KEEP;
+        }
+
+        m_spare_count++;
+        return m_spare_count < m_shrink_dequeues ? KEEP : SHRINK;
+    }
+
+    // onResized() restarts the spare count once a slot is added or removed
+    void onResized()
+    {
+        m_spare_count = 0;
+    }
+
+    int getStarvedCount() const { return m_starved_count; }
+
+private:
+    int m_grow_dequeues;
+    int m_grow_window;
+    int m_shrink_dequeues;
+
+    // the dequeues which found no free slot since the last grow
+    int m_starved_count;
+    // the dequeues in a row which found a free slot
+    int m_fed_count;
+    // the dequeues in a row which found a spare slot
+    int m_spare_count;
+};
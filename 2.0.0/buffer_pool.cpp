@@ -0,0 +1,321 @@
+#define DEBUG_LOG_TAG "DBP"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "buffer_pool.h"
+
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/dma-buf.h>
+
+#include <algorithm>
+
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+#include "grallocdev.h"
+
+// the bytes of the idle buffers which the pool keeps by default
+#define DISPLAY_BUFFER_POOL_DEFAULT_BUDGET (32 * 1024 * 1024)
+
+DisplayBufferPool& DisplayBufferPool::getInstance()
+{
+    static DisplayBufferPool gInstance;
+    return gInstance;
+}
+
+DisplayBufferPool::DisplayBufferPool()
+    : m_stop(false)
+    , m_idle_bytes(0)
+    , m_budget(DISPLAY_BUFFER_POOL_DEFAULT_BUDGET)
+    , m_hit_count(0)
+    , m_miss_count(0)
+    , m_prealloc_count(0)
+    , m_evict_count(0)
+    , m_saved_time(0)
+{
+    // the idle buffers go first when HWC is over its soft memory budget
+    MemoryTracker::getInstance().setTrimCallback([this](size_t bytes) { return trim(bytes); });
+}
+
+DisplayBufferPool::~DisplayBufferPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+        m_condition.notify_one();
+    }
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void DisplayBufferPool::setBudget(size_t budget)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_budget != budget)
+    {
+        HWC_LOGI("%s: %zu -> %zu", __func__, m_budget, budget);
+        m_budget = budget;
+        trimLocked(m_budget);
+    }
+}
+
+status_t DisplayBufferPool::acquire(const Key& key, Buffer* buffer, MemoryTracker::Owner owner,
+                                    int disp_id)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto iter = m_idle_buffers.begin(); iter != m_idle_buffers.end(); ++iter)
+        {
+            if (iter->key == key)
+            {
+                *buffer = *iter;
+                m_idle_bytes -= static_cast<size_t>(iter->size);
+                m_idle_buffers.erase(iter);
+                m_hit_count++;
+                m_saved_time += buffer->alloc_time;
+                GrallocDevice::getInstance().setOwner(buffer->handle, owner, disp_id);
+                return NO_ERROR;
+            }
+        }
+        m_miss_count++;
+    }
+
+    return allocate(key, buffer, owner, disp_id);
+}
+
+void DisplayBufferPool::release(Buffer* buffer, int release_fence)
+{
+    if (buffer->release_fence != -1)
+    {
+        ::protectedClose(buffer->release_fence);
+    }
+    buffer->release_fence = release_fence;
+
+    if (buffer->handle == nullptr)
+    {
+        freeBuffer(buffer);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        const size_t size = static_cast<size_t>(buffer->size);
+        if (size <= m_budget)
+        {
+            GrallocDevice::getInstance().setOwner(buffer->handle, MemoryTracker::OWNER_BUFFER_POOL, -1);
+            m_idle_buffers.push_front(*buffer);
+            m_idle_bytes += size;
+            trimLocked(m_budget);
+            *buffer = Buffer();
+            return;
+        }
+    }
+
+    freeBuffer(buffer);
+}
+
+void DisplayBufferPool::preallocate(const Key& key, size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    const size_t idle_count = countLocked(key);
+    if (m_budget == 0 || count <= idle_count)
+    {
+        return;
+    }
+
+    // the request keeps the number of buffers which are still to be allocated
+    const size_t need = count - idle_count;
+    for (auto& request : m_prealloc_requests)
+    {
+        if (request.key == key)
+        {
+            request.count = std::max(request.count, need);
+            return;
+        }
+    }
+    m_prealloc_requests.push_back({key, need});
+
+    if (!m_thread.joinable())
+    {
+        m_thread = std::thread(&DisplayBufferPool::preallocThread, this);
+        if (pthread_setname_np(m_thread.native_handle(), "DbqPrealloc"))
+        {
+            HWC_LOGI("%s: failed to set the thread name", __func__);
+        }
+    }
+    m_condition.notify_one();
+}
+
+size_t DisplayBufferPool::trim(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    const size_t idle_bytes = m_idle_bytes;
+    trimLocked(m_idle_bytes > bytes ? m_idle_bytes - bytes : 0);
+    return idle_bytes - m_idle_bytes;
+}
+
+status_t DisplayBufferPool::allocate(const Key& key, Buffer* buffer, MemoryTracker::Owner owner,
+                                     int disp_id)
+{
+    HWC_ATRACE_CALL();
+
+    const nsecs_t start = systemTime();
+
+    GrallocDevice::AllocParam param;
+    param.width  = key.width;
+    param.height = key.height;
+    param.format = key.format;
+    param.usage  = key.usage;
+    param.owner  = owner;
+    param.disp_id = disp_id;
+    if (NO_ERROR != GrallocDevice::getInstance().alloc(param))
+    {
+        HWC_LOGE("Failed to allocate memory size(w=%d,h=%d,fmt=%d,usage=%" PRIx64 ")",
+                 param.width, param.height, param.format, param.usage);
+        return -EINVAL;
+    }
+
+    PrivateHandle priv_handle;
+    status_t err = getBufferDimensionInfo(param.handle, &priv_handle);
+    err |= getPrivateHandleBuff(param.handle, &priv_handle);
+    err |= getAllocId(param.handle, &priv_handle);
+    err |= getIonSfInfo(param.handle, &priv_handle);
+    if (NO_ERROR != err)
+    {
+        GrallocDevice::getInstance().free(param.handle);
+        return -EINVAL;
+    }
+
+    // set debug name
+    if (isSupportDmaBuf())
+    {
+        if (ioctl(priv_handle.ion_fd, DMA_BUF_SET_NAME,
+                  (std::string("DBQ_") + std::to_string(priv_handle.alloc_id)).c_str()))
+        {
+            HWC_LOGI("DMA_BUF_SET_NAME fail");
+        }
+    }
+
+    buffer->key         = key;
+    buffer->handle      = param.handle;
+    buffer->ion_fd      = priv_handle.ion_fd;
+    buffer->sec_handle  = priv_handle.sec_handle;
+    buffer->format      = priv_handle.format;
+    buffer->y_stride    = priv_handle.y_stride;
+    buffer->vstride     = priv_handle.vstride;
+    buffer->usage       = priv_handle.usage;
+    buffer->alloc_id    = priv_handle.alloc_id;
+    buffer->size        = priv_handle.size;
+    buffer->is_compress = isCompressData(&priv_handle);
+    buffer->alloc_time  = systemTime() - start;
+
+    return NO_ERROR;
+}
+
+void DisplayBufferPool::freeBuffer(Buffer* buffer)
+{
+    // the consumer holds its own reference of the dma-buf until it is done,
+    // so the buffer is freed without waiting for the fence
+    if (buffer->release_fence != -1)
+    {
+        ::protectedClose(buffer->release_fence);
+    }
+
+    if (buffer->handle != nullptr)
+    {
+        GrallocDevice::getInstance().free(buffer->handle);
+    }
+    *buffer = Buffer();
+}
+
+void DisplayBufferPool::trimLocked(size_t budget)
+{
+    while (!m_idle_buffers.empty() && m_idle_bytes > budget)
+    {
+        Buffer& buffer = m_idle_buffers.back();
+        m_idle_bytes -= static_cast<size_t>(buffer.size);
+        freeBuffer(&buffer);
+        m_idle_buffers.pop_back();
+        m_evict_count++;
+    }
+}
+
+size_t DisplayBufferPool::countLocked(const Key& key) const
+{
+    size_t count = 0;
+    for (const auto& buffer : m_idle_buffers)
+    {
+        if (buffer.key == key)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+void DisplayBufferPool::preallocThread()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_stop)
+    {
+        if (m_prealloc_requests.empty())
+        {
+            m_condition.wait(lock);
+            continue;
+        }
+
+        const Key key = m_prealloc_requests.front().key;
+
+        // the queues keep acquiring and releasing while the buffer is allocated
+        lock.unlock();
+        Buffer buffer;
+        const status_t err = allocate(key, &buffer, MemoryTracker::OWNER_BUFFER_POOL, -1);
+        lock.lock();
+
+        const bool fit = err == NO_ERROR &&
+                         static_cast<size_t>(buffer.size) + m_idle_bytes <= m_budget;
+        for (auto iter = m_prealloc_requests.begin(); iter != m_prealloc_requests.end(); ++iter)
+        {
+            if (iter->key == key)
+            {
+                // no more buffer fits, give up the request
+                if (!fit || --iter->count == 0)
+                {
+                    m_prealloc_requests.erase(iter);
+                }
+                break;
+            }
+        }
+
+        if (!fit)
+        {
+            freeBuffer(&buffer);
+            continue;
+        }
+
+        // the pool prefers to evict a preallocated buffer over a released one
+        m_idle_buffers.push_back(buffer);
+        m_idle_bytes += static_cast<size_t>(buffer.size);
+        m_prealloc_count++;
+    }
+}
+
+void DisplayBufferPool::dump(android::String8* dump_str) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    dump_str->appendFormat("DisplayBufferPool(vendor.debug.hwc.dbq_pool_budget): idle:%zu %zu/%zu bytes"
+                           " hit:%" PRIu64 " miss:%" PRIu64 " prealloc:%" PRIu64 " evict:%" PRIu64
+                           " saved:%" PRId64 "us\n",
+                           m_idle_buffers.size(), m_idle_bytes, m_budget,
+                           m_hit_count, m_miss_count, m_prealloc_count, m_evict_count,
+                           ns2us(m_saved_time));
+    for (const auto& buffer : m_idle_buffers)
+    {
+        dump_str->appendFormat("  [%" PRIu64 "] %ux%u fmt:%u usage:%" PRIx64 " size:%d fence:%d\n",
+                               buffer.alloc_id, buffer.key.width, buffer.key.height,
+                               buffer.key.format, buffer.key.usage, buffer.size,
+                               buffer.release_fence);
+    }
+}
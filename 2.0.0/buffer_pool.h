@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+#include <cutils/native_handle.h>
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+
+#include "utils/tools.h"
+#include "memory_tracker.h"
+
+namespace android
+{
+class String8;
+}
+
+// DisplayBufferPool keeps the idle output buffers of every DisplayBufferQueue, so a queue
+// which needs a buffer of another size, compression or secure type borrows one instead of
+// allocating it on the dequeue path, and the buffers of a destroyed queue are reused
+class DisplayBufferPool
+{
+public:
+    // Key is the parameters of GrallocDevice::alloc(), the usage covers the compression
+    // and the secure flag
+    struct Key
+    {
+        Key()
+            : width(0), height(0), format(0), usage(0)
+        { }
+
+        unsigned int width;
+        unsigned int height;
+        unsigned int format;
+        uint64_t usage;
+
+        bool operator==(const Key& rhs) const
+        {
+            return std::tie(width, height, format, usage) ==
+                   std::tie(rhs.width, rhs.height, rhs.format, rhs.usage);
+        }
+        bool operator!=(const Key& rhs) const { return !(*this == rhs); }
+    };
+
+    // Buffer is an allocated buffer with the information queried from its handle
+    struct Buffer
+    {
+        Buffer()
+            : handle(nullptr), ion_fd(-1), sec_handle(0)
+            , format(0), y_stride(0), vstride(0), usage(0)
+            , alloc_id(UINT64_MAX), size(0), is_compress(false)
+            , alloc_time(0), release_fence(-1)
+        { }
+
+        Key key;
+        buffer_handle_t handle;
+        int ion_fd;
+        SECHAND sec_handle;
+        unsigned int format;
+        unsigned int y_stride;
+        unsigned int vstride;
+        unsigned int usage;
+        uint64_t alloc_id;
+        int size;
+        bool is_compress;
+
+        // alloc_time is the time which the allocation and the queries took
+        nsecs_t alloc_time;
+
+        // release_fence signals when the last consumer is done with the buffer,
+        // it is owned by the holder of the Buffer
+        int release_fence;
+    };
+
+    static DisplayBufferPool& getInstance();
+    ~DisplayBufferPool();
+
+    // setBudget() sets the bytes of the idle buffers which the pool keeps, 0 disables it
+    void setBudget(size_t budget);
+
+    // acquire() takes an idle buffer of the key, or allocates one if there is none,
+    // owner and disp_id tag it in MemoryTracker. buffer->release_fence is the fence
+    // which the buffer was released with, the caller must wait for it before writing
+    status_t acquire(const Key& key, Buffer* buffer, MemoryTracker::Owner owner, int disp_id);
+
+    // release() gives the buffer back to the pool with the release fence of its last
+    // consumer, the pool owns the fence. it is freed if it does not fit the budget
+    void release(Buffer* buffer, int release_fence);
+
+    // preallocate() allocates buffers of the key in the background until the pool has count
+    // idle ones
+    void preallocate(const Key& key, size_t count);
+
+    // trim() frees the least recently released idle buffers of the bytes at least,
+    // it returns the bytes which it freed
+    size_t trim(size_t bytes);
+
+    void dump(android::String8* dump_str) const;
+
+private:
+    DisplayBufferPool();
+
+    // allocate() allocates a buffer and queries its information
+    static status_t allocate(const Key& key, Buffer* buffer, MemoryTracker::Owner owner, int disp_id);
+
+    static void freeBuffer(Buffer* buffer);
+
+    // trimLocked() frees the least recently released buffers until the idle ones fit budget
+    void trimLocked(size_t budget);
+
+    size_t countLocked(const Key& key) const;
+
+    void preallocThread();
+
+private:
+    struct PreallocRequest
+    {
+        Key key;
+        size_t count;
+    };
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_condition;
+    std::thread m_thread;
+    bool m_stop;
+
+    // the most recently released buffer is at the front
+    std::list<Buffer> m_idle_buffers;
+    size_t m_idle_bytes;
+    size_t m_budget;
+
+    std::list<PreallocRequest> m_prealloc_requests;
+
+    uint64_t m_hit_count;
+    uint64_t m_miss_count;
+    uint64_t m_prealloc_count;
+    uint64_t m_evict_count;
+    // the allocation time of the buffers which acquire() took from the pool
+    nsecs_t m_saved_time;
+};
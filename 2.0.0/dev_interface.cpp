@@ -10,7 +10,9 @@
 #include "utils/tools.h"
 #include "hwc2.h"
 
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#if defined(MTK_HWC_USE_STUB_DEVICE)
+#include "tools/host/stub_overlay_device.h"
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
 #include "legacy/hwdev.h"
 #else
 #include "drm/drmdev.h"
@@ -38,7 +40,9 @@ SessionInfo::SessionInfo()
 
 unsigned int IOverlayDevice::getHwVersion()
 {
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#if defined(MTK_HWC_USE_STUB_DEVICE)
+    return StubOverlayDevice::getHwVersion();
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
     return DispDevice::getHwVersion();
 #else
     return DrmDevice::getHwVersion();
@@ -47,7 +51,9 @@ unsigned int IOverlayDevice::getHwVersion()
 
 IOverlayDevice* getHwDevice()
 {
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#if defined(MTK_HWC_USE_STUB_DEVICE)
+    return &StubOverlayDevice::getInstance();
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
     return &DispDevice::getInstance();
 #else
     return &DrmDevice::getInstance();
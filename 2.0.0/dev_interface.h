@@ -101,6 +101,7 @@ typedef enum {
     HWC_REFRESH_FOR_DISPLAY_DUMP,
     HWC_REFRESH_FOR_DEBUG,
     HWC_REFRESH_FOR_OTHER_HOTPLUG,
+    HWC_REFRESH_FOR_CURSOR,
     HWC_REFRESH_TYPE_NUM,
 } HWC_SELF_REFRESH_TYPE;
 
@@ -398,6 +399,17 @@ public:
     // waitVSync() is used to wait vsync signal for specific display device
     virtual status_t waitVSync(uint64_t dpy, uint32_t drm_id_crtc, nsecs_t *ts) = 0;
 
+    // isCursorMoveSupported() is used to query if moveCursor() is supported
+    virtual bool isCursorMoveSupported() { return false; }
+
+    // moveCursor() moves the plane of the cursor layer to frame outside the frame pipeline,
+    // frame must have the size which the plane is committed with
+    virtual status_t moveCursor(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/, uint64_t /*hwc_layer_id*/,
+                                const hwc_rect_t& /*frame*/) { return INVALID_OPERATION; }
+
+    // resetCursor() drops the moved position, the next commit uses the frame of the job again
+    virtual void resetCursor(uint64_t /*dpy*/) { }
+
     // setPowerMode() is used to switch power setting for display
     virtual void setPowerMode(uint64_t dpy, uint32_t drm_id_crtc, int mode) = 0;
 
@@ -407,6 +419,10 @@ public:
     // waitAllJobDone() use to wait driver for processing all job
     virtual status_t waitAllJobDone(const uint64_t dpy) = 0;
 
+    // dupCommitFence() returns a dup of the fence which signals when the last frame commit of dpy
+    // is applied, -1 if the commit has returned after it was applied
+    virtual int dupCommitFence(uint64_t /*dpy*/) { return -1; }
+
     // getSupportedColorMode is used to check what colormode device support
     virtual int32_t getSupportedColorMode() = 0;
 
@@ -473,6 +489,13 @@ public:
     virtual int32_t getSpportedConnectorMode(uint64_t dpy, uint32_t drm_id_crtc, uint32_t *modeinfo) = 0;
     // getConnectorEDID use for get connector's edid
     virtual int32_t getConnectorEDID(uint64_t dpy, uint32_t drm_id_crtc, uint32_t *edid) = 0;
+    // verifyConnectorEDID probes the connector again if getConnectorEDID took the modes
+    // from the edid cache, changed is set if they are stale
+    virtual int32_t verifyConnectorEDID(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/, bool* changed)
+    {
+        *changed = false;
+        return 0;
+    }
     virtual int32_t setHDMIMode(uint64_t dpy, uint32_t drm_id_crtc, uint32_t mode, uint32_t value) = 0;
     virtual int32_t getHDMIMode(uint64_t dpy, uint32_t drm_id_crtc, uint32_t mode, uint32_t *value) = 0;
     // getEthdrSupport to check hdmi ethdr feature
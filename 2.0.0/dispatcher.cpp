@@ -20,6 +20,9 @@
 #include "sync.h"
 #include "platform_wrap.h"
 #include "hwc2.h"
+#include "hwc_recorder.h"
+#include "led_device.h"
+#include "mc_estimator.h"
 #include "pq_interface.h"
 #include <cutils/properties.h>
 
@@ -162,6 +165,7 @@ void DispatcherJob::resetData()
     ovl_mc_atomic_ratio = 1.f;
     ovl_wo_atomic_work_time = -1;
     mc_info = nullptr;
+    mc_feature = MCycleFeature();
 
     aibld_enable = false;
     display_dump_enable = false;
@@ -187,8 +191,6 @@ HWCDispatcher::HWCDispatcher()
     : m_sequence(1)
     , m_session_mode_changed(0)
 {
-    m_vsync_callbacks.resize(DisplayManager::MAX_DISPLAYS);
-
     for (uint32_t i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
     {
         m_prev_createjob_time[i] = 0;
@@ -1176,7 +1178,10 @@ void HWCDispatcher::onPlugIn(uint64_t dpy, uint32_t drm_id_crtc, uint32_t drm_id
 
             if (m_workers[HWC_DISPLAY_PRIMARY].ovl_engine != NULL)
             {
-                m_workers[HWC_DISPLAY_PRIMARY].ovl_engine->createOutputQueue(format, false);
+                if (m_workers[HWC_DISPLAY_PRIMARY].ovl_engine->createOutputQueue(format, false) != NO_ERROR)
+                {
+                    HWC_LOGW("failed to initialize the output queue, its buffers are allocated at the first dequeue");
+                }
             }
         }
     }
@@ -1314,32 +1319,23 @@ void HWCDispatcher::onVSync(uint64_t dpy)
     HWC_ATRACE_CALL();
 #endif
 
+    // dispatch vsync signal to listeners
+    auto callbacks = m_vsync_callbacks[static_cast<unsigned int>(dpy)].snapshot();
+    for (const sp<HWCVSyncListener>& callback : *callbacks)
     {
-        AutoMutex l(m_vsync_lock);
-
-        // dispatch vsync signal to listeners
-        const size_t count = m_vsync_callbacks[static_cast<unsigned int>(dpy)].size();
-        for (size_t i = 0; i < count; i++)
-        {
-            const sp<HWCVSyncListener>& callback(m_vsync_callbacks[static_cast<unsigned int>(dpy)][i]);
-            callback->onVSync();
-        }
+        callback->onVSync();
     }
 }
 
 void HWCDispatcher::registerVSyncListener(uint64_t dpy, const sp<HWCVSyncListener>& listener)
 {
-    AutoMutex l(m_vsync_lock);
-
-    m_vsync_callbacks.editItemAt(static_cast<unsigned int>(dpy)).add(listener);
+    m_vsync_callbacks[static_cast<unsigned int>(dpy)].add(listener);
     HWC_LOGD("(%" PRIu64 ") register HWCVSyncListener", dpy);
 }
 
 void HWCDispatcher::removeVSyncListener(uint64_t dpy, const sp<HWCVSyncListener>& listener)
 {
-    AutoMutex l(m_vsync_lock);
-
-    m_vsync_callbacks.editItemAt(static_cast<unsigned int>(dpy)).remove(listener);
+    m_vsync_callbacks[static_cast<unsigned int>(dpy)].remove(listener);
     HWC_LOGD("(%" PRIu64 ") remove HWCVSyncListener", dpy);
 }
 
@@ -1352,6 +1348,16 @@ void HWCDispatcher::dump(String8 *dump_str)
         if (m_workers[dpy].ovl_engine != NULL && m_workers[dpy].enable)
         {
             m_workers[dpy].ovl_engine->dump(dump_str);
+
+            if (m_workers[dpy].composer != NULL)
+            {
+                m_workers[dpy].composer->dump(dump_str);
+            }
+
+            if (m_workers[dpy].dp_thread != NULL)
+            {
+                m_workers[dpy].dp_thread->dump(dump_str);
+            }
         }
     }
 }
@@ -1514,6 +1520,11 @@ DispatchThread::DispatchThread(uint64_t dpy)
     m_perf_extension_time_str = std::string("pd_extension_time_") + std::to_string(dpy);
 }
 
+void DispatchThread::dump(String8* dump_str) const
+{
+    m_uclamp_ctrl.dump(dump_str, "dispatcher");
+}
+
 void DispatchThread::onFirstRef()
 {
     run(m_thread_name.c_str(), PRIORITY_URGENT_DISPLAY);
@@ -1624,6 +1635,8 @@ void DispatchThread::calculatePerf(DispatcherJob* job)
         return;
     }
 
+    m_perf_target_work_time = 0;
+
     if ((Platform::getInstance().m_config.plat_switch & HWC_PLAT_SWITCH_USE_PERF) == 0)
     {
         return;
@@ -1689,13 +1702,13 @@ void DispatchThread::calculatePerf(DispatcherJob* job)
 
     HWC_ATRACE_INT(m_perf_target_cpu_mhz_str.c_str(), static_cast<int32_t>(target_cpu_mhz));
 
+    m_perf_start_ts = cur_time;
+    m_perf_target_work_time = remain_time;
+
     // set uclamp for dispatcher
-    if (dispatcher_uclamp != m_perf_prev_uclamp_min)
+    if (m_uclamp_ctrl.apply(m_tid, dispatcher_uclamp))
     {
-        m_perf_prev_uclamp_min = dispatcher_uclamp;
-
-        uclamp_task(m_tid, dispatcher_uclamp);
-        HWC_ATRACE_INT(m_perf_uclamp_str.c_str(), static_cast<int32_t>(dispatcher_uclamp));
+        HWC_ATRACE_INT(m_perf_uclamp_str.c_str(), static_cast<int32_t>(m_uclamp_ctrl.getUClamp()));
     }
 }
 
@@ -1766,7 +1779,41 @@ bool DispatchThread::threadLoop()
     // 3. wait until the composition of ui/mm threads is done
     // 4. clear used job
     {
+        HwcRecordScope record_scope(HWC_RECORD_STAGE, HWC_RECORD_STAGE_DISPATCH, m_disp_id);
+        MCycleEstimator& estimator = MCycleEstimator::getInstance();
+        MCycleModelManager& mc_models = MCycleModelManager::getInstance();
+        const bool learn_mc = estimator.isLearning() && job->mc_info;
+        // the models are scored on the device or offline from the recorded samples
+        const bool score_mc = (mc_models.isScoring() || HwcCallRecorder::getInstance().isEnabled()) &&
+                              job->mc_info;
+        const bool measure_mc = learn_mc || score_mc;
+        const int mc_id = job->mc_info ? job->mc_info->id : -1;
+        const nsecs_t cpu_start = measure_mc ? systemTime(SYSTEM_TIME_THREAD) : 0;
+        const uint32_t mhz_start = measure_mc ? estimator.getCurCpuMHz() : 0;
+
         HWCDispatcher::getInstance().handleJob(m_disp_id, job);
+
+        if (m_perf_target_work_time > 0)
+        {
+            m_uclamp_ctrl.onFrameDone(systemTime() - m_perf_start_ts, m_perf_target_work_time);
+        }
+
+        if (measure_mc)
+        {
+            const uint32_t mhz_end = estimator.getCurCpuMHz();
+            const nsecs_t cpu_time = systemTime(SYSTEM_TIME_THREAD) - cpu_start;
+            const uint32_t cpu_mhz = (mhz_start + mhz_end) / 2;
+            if (learn_mc)
+            {
+                estimator.addSample(mc_id, MCycleEstimator::THREAD_DISPATCHER, cpu_time, cpu_mhz);
+            }
+            if (score_mc)
+            {
+                HwcCallRecorder::getInstance().recordMCycleSample(m_disp_id, job->mc_feature,
+                        MCycleEstimator::THREAD_DISPATCHER, cpu_time, cpu_mhz);
+                mc_models.addSample(job->mc_feature, MCycleEstimator::THREAD_DISPATCHER, cpu_time, cpu_mhz);
+            }
+        }
     }
 
     {
@@ -1877,6 +1924,16 @@ void HWCDispatcher::PhyPostHandler::set(
 
     bool is_dirty = (job->post_state & HWC_POST_CONTINUE_MASK) != 0;
 
+    // a no-op frame returns the present fence of the last commit, which is only right while
+    // that commit has not reached the panel yet, otherwise commit the frame as usual
+    const bool is_noop = job->post_state == HWC_POST_INPUT_NOOP;
+    if (is_noop &&
+        (m_curr_present_fence_fd < 0 || SyncFence::queryFenceStatus(m_curr_present_fence_fd) != 0))
+    {
+        job->post_state = HWC_POST_INPUT_DIRTY;
+        is_dirty = true;
+    }
+
     HWC_ATRACE_FORMAT_NAME("BeginTransform");
     if (is_dirty)
     {
@@ -1963,6 +2020,17 @@ void HWCDispatcher::PhyPostHandler::set(
         logger->printf(" / skip composition: no dirty layers");
         // clear all layers' acquire fences
         display->clearAllFences();
+
+        if (is_noop)
+        {
+            // the panel self-refreshes the last commit, so its pending present fence
+            // signals when this frame is shown too
+            display->setRetireFenceFd(::dup(m_curr_present_fence_fd), display->isConnected());
+            display->addSkipCommitCount();
+        }
+
+        // nothing is committed, so write the staged brightness now
+        LedDevice::getInstance().onFrameCommitted(m_disp_id);
     }
 }
 
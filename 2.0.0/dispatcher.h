@@ -9,6 +9,7 @@
 #include "hwc_priv.h"
 
 #include "utils/tools.h"
+#include "utils/cow_list.h"
 
 #include "display.h"
 #include "worker.h"
@@ -19,6 +20,8 @@
 #include "overlay.h"
 #include "queue.h"
 #include "vsync_listener.h"
+#include "uclamp_controller.h"
+#include "mc_model.h"
 #include <hwc_common/pool.h>
 
 using namespace android;
@@ -148,6 +151,8 @@ enum HWC_POST_STATE
     HWC_POST_OUTBUF_ENABLE  = 0x0011,
     HWC_POST_INPUT_NOTDIRTY = 0x0100,
     HWC_POST_INPUT_DIRTY    = 0x0101,
+    // nothing changed since the last present, see HWCDisplay::isNoOpFrame()
+    HWC_POST_INPUT_NOOP     = 0x0200,
     HWC_POST_MIRROR         = 0x1001,
 
     HWC_POST_CONTINUE_MASK  = 0x0001,
@@ -607,6 +612,12 @@ public:
 
     const HwcMCycleInfo* mc_info;
 
+    // the static scenario blended with the learned cost, mc_info points here
+    HwcMCycleInfo mc_info_blended;
+
+    // the properties of this job that the mc prediction is based on
+    MCycleFeature mc_feature;
+
     bool aibld_enable;
     bool display_dump_enable;
 
@@ -750,11 +761,9 @@ private:
     // handleJob() handle dispatch job with LayerComposer::trigger() and PostHandler::process()
     void handleJob(const hwc2_display_t& dpy, sp<DispatcherJob>& job);
 
-    // access must be protected by m_vsync_lock
-    mutable Mutex m_vsync_lock;
-
-    // m_vsync_callbacks is a queue of VSyncListener registered by DispatchThread
-    Vector<SortedVector< sp<HWCVSyncListener> > > m_vsync_callbacks;
+    // m_vsync_callbacks are the VSyncListeners registered by DispatchThread,
+    // onVSync() walks a snapshot so register and remove never wait for it
+    CowList<sp<HWCVSyncListener> > m_vsync_callbacks[DisplayManager::MAX_DISPLAYS];
 
     // m_alloc_disp_ids is a bit set of displays
     // each bit index with a 1 corresponds to an valid display session
@@ -948,6 +957,9 @@ public:
 
     size_t getQueueSize();
 
+    // dump() prints the uclamp feedback statistics
+    void dump(String8* dump_str) const;
+
 private:
     virtual void onFirstRef();
     virtual bool threadLoop();
@@ -991,7 +1003,12 @@ private:
     std::string m_perf_uclamp_str;
     std::string m_perf_extension_time_str;
 
-    uint32_t m_perf_prev_uclamp_min = UINT32_MAX;
+    // feedback on the uclamp computed by calculatePerf()
+    UClampController m_uclamp_ctrl;
+
+    // start and allowed work time of the job handled now, 0 if calculatePerf() skipped it
+    nsecs_t m_perf_start_ts = 0;
+    nsecs_t m_perf_target_work_time = 0;
 
     // store the last cpu set from DispatcherJob
     unsigned int m_cpu_set = HWC_CPUSET_NONE;
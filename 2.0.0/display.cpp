@@ -104,7 +104,6 @@ void DisplayManager::genDisplayIdForDisplay(uint64_t dpy)
 DisplayManager::DisplayManager()
     : m_curr_disp_num(0)
     , m_fake_disp_num(0)
-    , m_listener(NULL)
     , m_video_hdcp(UINT_MAX)
     , m_ged_log_handle(nullptr)
     , m_active_config(0)
@@ -178,7 +177,7 @@ DisplayManager::DisplayManager()
 
 DisplayManager::~DisplayManager()
 {
-    m_listener = NULL;
+    setListener(NULL);
     for (uint32_t i = 0; i < MAX_DISPLAYS; i++)
     {
         for (auto iter: m_data[i])
@@ -231,13 +230,15 @@ int DisplayManager::getDeviceIdSize(uint64_t dpy, uint32_t* sz)
 
 void DisplayManager::initInternal(uint64_t dpy, uint32_t drm_id_crtc)
 {
+    const sp<EventListener> listener = getListener();
+
     if (dpy == HWC_DISPLAY_PRIMARY)
     {
         m_curr_disp_num++;
 
-        if (m_listener != NULL)
+        if (listener != NULL)
         {
-            m_listener->onPlugIn(dpy, true);
+            listener->onPlugIn(dpy, true);
         }
 
         createVsyncThread(dpy, drm_id_crtc);
@@ -247,7 +248,7 @@ void DisplayManager::initInternal(uint64_t dpy, uint32_t drm_id_crtc)
         printDisplayInfo(dpy);
         m_display_power_state[dpy] = true;
         m_display_connected[dpy] = true;
-        m_listener->onHotPlugExt(dpy, true);
+        listener->onHotPlugExt(dpy, true);
     }
     else
     {
@@ -257,6 +258,8 @@ void DisplayManager::initInternal(uint64_t dpy, uint32_t drm_id_crtc)
 
 void DisplayManager::initPrimaryExternal(uint64_t dpy, uint32_t drm_id_crtc)
 {
+    const sp<EventListener> listener = getListener();
+
     HWC_LOGI("Display Information: dpy: %" PRIu64 " crtc: %d", dpy, drm_id_crtc);
     HWC_LOGI("# fo current devices : %d", m_curr_disp_num.load(memory_order_relaxed));
 
@@ -284,13 +287,15 @@ void DisplayManager::initPrimaryExternal(uint64_t dpy, uint32_t drm_id_crtc)
 
     printDisplayInfo(dpy);
 
-    m_listener->onHotPlugExt(dpy, true);
+    listener->onHotPlugExt(dpy, true);
 }
 
 
 void DisplayManager::resentCallback()
 {
-    m_listener->onHotPlugExt(HWC_DISPLAY_PRIMARY, true);
+    const sp<EventListener> listener = getListener();
+
+    listener->onHotPlugExt(HWC_DISPLAY_PRIMARY, true);
 }
 
 void DisplayManager::createVsyncThread(uint64_t dpy, uint32_t drm_id_crtc)
@@ -369,7 +374,13 @@ void DisplayManager::dump(struct dump_buff* /*log*/)
 
 void DisplayManager::setListener(const sp<EventListener>& listener)
 {
-    m_listener = listener;
+    // the old listener is released outside the lock in case this is its last reference
+    sp<EventListener> old;
+    {
+        std::lock_guard<std::mutex> lock(m_listener_lock);
+        old = m_listener;
+        m_listener = listener;
+    }
 }
 
 void DisplayManager::requestVSync(uint64_t dpy, bool enabled)
@@ -390,7 +401,9 @@ void DisplayManager::requestNextVSync(uint64_t dpy)
 
 void DisplayManager::vsync(uint64_t dpy, nsecs_t timestamp, bool enabled)
 {
-    if (m_listener != NULL)
+    const sp<EventListener> listener = getListener();
+
+    if (listener != NULL)
     {
         // check if primary display needs to use external vsync source
         if (HWC_DISPLAY_PRIMARY != dpy)
@@ -398,15 +411,17 @@ void DisplayManager::vsync(uint64_t dpy, nsecs_t timestamp, bool enabled)
             Mutex::Autolock _l(m_power_lock);
 
             if (m_data[HWC_DISPLAY_PRIMARY][BASIC_CFG_IDX]->vsync_source == dpy)
-                m_listener->onVSync(HWC_DISPLAY_PRIMARY, timestamp, enabled);
+                listener->onVSync(HWC_DISPLAY_PRIMARY, timestamp, enabled);
         }
 
-        m_listener->onVSync(dpy, timestamp, enabled);
+        listener->onVSync(dpy, timestamp, enabled);
     }
 }
 
 void DisplayManager::hotplugExt(uint64_t dpy, bool connected, bool fake, bool notify)
 {
+    sp<EventListener> listener = getListener();
+
     HWC_LOGI("Hotplug external disp(%" PRIu64 ") connect(%d) fake(%d)", dpy, connected, fake);
 
     DisplayData* disp_data = m_data[dpy][BASIC_CFG_IDX];
@@ -428,13 +443,14 @@ void DisplayManager::hotplugExt(uint64_t dpy, bool connected, bool fake, bool no
 
 	    //xbh patch begin
             //if (m_listener == NULL) return;
-	    if (m_listener == NULL)
+	    if (listener == NULL)
             {
                 while (true)
                 {
 		            HWC_LOGE("[HWC][%s, %d] display(%" PRIu64 ") get null listener, try to wait 5 ms.", __func__, __LINE__, dpy);
                     usleep(5000);
-                    if (m_listener != NULL)
+                    listener = getListener();
+                    if (listener != NULL)
                         break;
                 }
             }
@@ -445,7 +461,7 @@ void DisplayManager::hotplugExt(uint64_t dpy, bool connected, bool fake, bool no
                 return;
             }
 
-            if (m_listener != NULL) m_listener->onPlugIn(dpy, false);
+            if (listener != NULL) listener->onPlugIn(dpy, false);
 
             if (fake == true)
             {
@@ -466,7 +482,7 @@ void DisplayManager::hotplugExt(uint64_t dpy, bool connected, bool fake, bool no
 
             m_display_connected[dpy] = true;
 
-            if (m_listener != NULL && notify) m_listener->onHotPlugExt(dpy, HWC2_CONNECTION_CONNECTED);
+            if (listener != NULL && notify) listener->onHotPlugExt(dpy, HWC2_CONNECTION_CONNECTED);
 
             if (disp_data->trigger_by_vsync)
             {
@@ -508,12 +524,12 @@ void DisplayManager::hotplugExt(uint64_t dpy, bool connected, bool fake, bool no
             disp_data->height = 2160;
             disp_data->refresh = 16666667;
 
-            if (m_listener != NULL)
+            if (listener != NULL)
             {
-                m_listener->onPlugOut(dpy);
+                listener->onPlugOut(dpy);
                 if (notify)
                 {
-                    m_listener->onHotPlugExt(dpy, HWC2_CONNECTION_CONNECTED);
+                    listener->onHotPlugExt(dpy, HWC2_CONNECTION_CONNECTED);
                 }
             }
 
@@ -532,7 +548,7 @@ void DisplayManager::hotplugExt(uint64_t dpy, bool connected, bool fake, bool no
                 //return;
             }
 
-            if (m_listener == NULL) return;
+            if (listener == NULL) return;
 
             if (ovlDevice->updateConnectorMode(dpy, HWCMediator::getInstance().getHWCDisplay(dpy)->getDrmIdCurCrtc()) != NO_ERROR)
             {
@@ -541,7 +557,7 @@ void DisplayManager::hotplugExt(uint64_t dpy, bool connected, bool fake, bool no
             }
 
             HWCMediator::getInstance().createExternalDisplay(dpy);
-            if (m_listener != NULL) m_listener->onPlugIn(dpy, false);
+            if (listener != NULL) listener->onPlugIn(dpy, false);
 
             if (fake == true)
             {
@@ -561,7 +577,7 @@ void DisplayManager::hotplugExt(uint64_t dpy, bool connected, bool fake, bool no
 
             m_display_connected[dpy] = true;
 
-            if (m_listener != NULL && notify) m_listener->onHotPlugExt(dpy, HWC2_CONNECTION_CONNECTED);
+            if (listener != NULL && notify) listener->onHotPlugExt(dpy, HWC2_CONNECTION_CONNECTED);
 
             if (disp_data->trigger_by_vsync)
             {
@@ -608,13 +624,13 @@ void DisplayManager::hotplugExt(uint64_t dpy, bool connected, bool fake, bool no
 
             m_display_connected[dpy] = false;
 
-            if (m_listener != NULL)
+            if (listener != NULL)
             {
-                m_listener->onPlugOut(dpy);
+                listener->onPlugOut(dpy);
                 hotplugPost(dpy, 0, DISP_PLUG_DISCONNECT, true);
                 if (notify)
                 {
-                    m_listener->onHotPlugExt(dpy, HWC2_CONNECTION_DISCONNECTED);
+                    listener->onHotPlugExt(dpy, HWC2_CONNECTION_DISCONNECTED);
                 }
             }
 
@@ -675,6 +691,8 @@ void DisplayManager::hotplugVir(
     const uint32_t& height,
     const unsigned int& format)
 {
+    const sp<EventListener> listener = getListener();
+
     if (dpy != HWC_DISPLAY_VIRTUAL)
     {
         HWC_LOGW("Failed to hotplug virtual disp(%" PRIu64 ") !", dpy);
@@ -694,13 +712,13 @@ void DisplayManager::hotplugVir(
 
         hotplugPost(dpy, 1, DISP_PLUG_CONNECT);
 
-        if (m_listener != NULL) m_listener->onPlugIn(dpy, false, width, height);
+        if (listener != NULL) listener->onPlugIn(dpy, false, width, height);
 
         // TODO: How HWC receives requests from WFD frameworks
     }
     else
     {
-        if (m_listener != NULL) m_listener->onPlugOut(dpy);
+        if (listener != NULL) listener->onPlugOut(dpy);
 
         hotplugPost(dpy, 0, DISP_PLUG_DISCONNECT);
 
@@ -735,19 +753,23 @@ bool DisplayManager::checkIsWfd(uint64_t dpy)
 
 void DisplayManager::refreshForDisplay(uint64_t dpy, unsigned int type)
 {
-    if (m_listener != NULL)
+    const sp<EventListener> listener = getListener();
+
+    if (listener != NULL)
     {
-        m_listener->onRefresh(dpy, type);
+        listener->onRefresh(dpy, type);
     }
 }
 
 void DisplayManager::refreshForDriver(uint64_t dpy, unsigned int type)
 {
-    if (m_listener != NULL)
+    const sp<EventListener> listener = getListener();
+
+    if (listener != NULL)
     {
         if (HWC_WAIT_FOR_REFRESH < type && type < HWC_REFRESH_TYPE_NUM)
         {
-            m_listener->onRefresh(dpy, type);
+            listener->onRefresh(dpy, type);
         }
     }
 }
@@ -1245,9 +1267,11 @@ void DisplayManager::updateVsyncThreadPeriod(uint64_t dpy, nsecs_t period){
 void DisplayManager::updateVsyncPeriodTimingChange(uint64_t dpy, int64_t applied_time,
         uint8_t refresh_required, int64_t refresh_time)
 {
-    if (m_listener != NULL)
+    const sp<EventListener> listener = getListener();
+
+    if (listener != NULL)
     {
-        m_listener->onVSyncPeriodTimingChange(dpy, applied_time, refresh_required, refresh_time);
+        listener->onVSyncPeriodTimingChange(dpy, applied_time, refresh_required, refresh_time);
     }
 }
 
@@ -5,6 +5,7 @@
 #include <composer_ext_intf/device_interface.h>
 
 #include <atomic>
+#include <mutex>
 
 #include <utils/Vector.h>
 #include "hwc_priv.h"
@@ -253,7 +254,13 @@ public:
     // setListener() is used for client to register listener to get event
     void setListener(const sp<EventListener>& listener);
 
-    inline sp<EventListener> getListener() const {return m_listener;}
+    // getListener() can be called from any thread while setListener() runs
+    inline sp<EventListener> getListener() const
+    {
+        std::lock_guard<std::mutex> lock(m_listener_lock);
+        return m_listener;
+    }
+
     // requestVSync() is used for client to request vsync signal
     void requestVSync(uint64_t dpy, bool enabled);
 
@@ -401,7 +408,10 @@ private:
     // amount of fake external displays
     unsigned int m_fake_disp_num;
 
-    // m_listener is used for listen vsync event
+    // m_listener gets the vsync, hotplug and refresh events. sp<> has no atomic
+    // load or store, so it is copied and swapped under m_listener_lock, which is
+    // held for nothing else. The events are sent to the copy without any lock.
+    mutable std::mutex m_listener_lock;
     sp<EventListener> m_listener;
 
     mutable Mutex m_power_lock;
@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <chrono>
 #include <string>
 
 #include <fcntl.h>
@@ -23,6 +25,7 @@
 #include <utils/Trace.h>
 #include "overlay.h"
 #include "platform_wrap.h"
+#include "sync.h"
 
 #include "ddp_ovl.h"
 #include "hdmi_interface.h"
@@ -132,6 +135,18 @@
 
 #define AFBC_COMPRESSION_NAME "arm.graphics.Compression"
 #define PVRIC_COMPRESSION_NAME "android.hardware.graphics.common.Compression"
+
+// the color transform blobs which a display keeps for reuse
+#define COLOR_TRANSFORM_BLOB_CACHE_SIZE 8
+
+// a display which has not committed for the time does not hold the commit aggregation
+#define DRM_COMMIT_AGGREGATE_IDLE_TIME ms2ns(50)
+
+// a non-blocking commit which the kernel rejects with EBUSY is retried a few times, then
+// it falls back to a blocking commit
+#define DRM_NONBLOCK_COMMIT_BUSY_RETRY 3
+#define DRM_NONBLOCK_COMMIT_BUSY_SLEEP_US 1000
+#define DRM_NONBLOCK_COMMIT_TIMEOUT_MS 100
 // ---------------------------------------------------------------------------
 
 #define DLOGD(i, x, ...) HWC_LOGD("(%" PRIu64 ") " x, i, ##__VA_ARGS__)
@@ -467,6 +482,8 @@ DrmDevice::DrmDevice()
     for (unsigned int i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
     {
         m_prev_commit_color_transform[i] = 0;
+        m_commit_state[i].call_trace_name = "CommitCall-" + std::to_string(i);
+        m_commit_state[i].depth_trace_name = "CommitDepth-" + std::to_string(i);
     }
 
     queryCapsInfo();
@@ -492,12 +509,39 @@ DrmDevice::~DrmDevice()
 
     removeFbCacheAllDisplay();
 
+    {
+        std::lock_guard<std::mutex> lock(m_color_transform_blob_mutex);
+        for (unsigned int i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
+        {
+            ColorTransformBlobCache& cache = m_color_transform_blobs[i];
+            for (std::list<ColorTransformBlob>* list : {&cache.blobs, &cache.retired})
+            {
+                for (const ColorTransformBlob& blob : *list)
+                {
+                    destroyColorTransformBlobLocked(&cache, blob.id);
+                }
+                list->clear();
+            }
+            m_prev_commit_color_transform[i] = 0;
+        }
+    }
+
     {
         std::lock_guard<std::mutex> lock(m_trash_mutex);
         m_trash_cleaner_thread_stop = true;
         m_condition.notify_all();
     }
     m_trash_cleaner_thread.join();
+
+    {
+        std::lock_guard<std::mutex> lock(m_cursor_mutex);
+        m_cursor_thread_stop = true;
+        m_cursor_condition.notify_all();
+    }
+    if (m_cursor_thread.joinable())
+    {
+        m_cursor_thread.join();
+    }
 }
 
 void DrmDevice::initOverlay()
@@ -799,6 +843,9 @@ void DrmDevice::destroyOverlaySession(uint64_t dpy, uint32_t drm_id_crtc)
 {
     CHECK_DPY_RET_VOID(dpy);
 
+    waitCommitDone(dpy);
+    dropCursorPlanes(dpy);
+
     int err = m_display_state.checkDisplayStateMachine(dpy, DISPLAY_STATE_INACTIVE);
     if (err != NO_ERROR)
     {
@@ -964,7 +1011,7 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, uint32_t drm_id_crtc, in
         {
             if (color_transform != nullptr && color_transform->dirty)
             {
-                status_t res = createColorTransformBlob(dpy, color_transform, &blob_color_transform);
+                status_t res = acquireColorTransformBlob(dpy, color_transform, &blob_color_transform);
                 if (res < 0)
                 {
                     HWC_LOGE("(%" PRIu64 ") failed to create a blob of color transform", dpy);
@@ -981,7 +1028,7 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, uint32_t drm_id_crtc, in
         ret |= crtc->addProperty(m_atomic_req[dpy], DRM_PROP_CRTC_OVL_DSI_SEQ,
                           static_cast<uint32_t>(trigger_param.ovl_seq % UINT32_MAX));
 
-        ret = m_drm->atomicCommit(m_atomic_req[dpy], flags, nullptr);
+        ret = commitAtomicRequirement(dpy, drm_id_crtc, flags);
         if (ret)
         {
 
@@ -1001,7 +1048,7 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, uint32_t drm_id_crtc, in
     }
 
     // handle pending remove cache
-    trashAddFbId(m_fb_caches[dpy].fb_caches_pending_remove);
+    trashAddFbIdAfterCommit(dpy, m_fb_caches[dpy].fb_caches_pending_remove);
     m_fb_caches[dpy].fb_caches_pending_remove.clear();
 
     // remove unused cache
@@ -1024,7 +1071,7 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, uint32_t drm_id_crtc, in
                 HWC_ATRACE_FORMAT_NAME("remove_cache, hwc_layer_id %" PRIu64 ", size %zu",
                                        cache.id, cache.fb_caches.size());
                 // no one use this cache in this frame, remove cache
-                trashAddFbId(cache.fb_caches);
+                trashAddFbIdAfterCommit(dpy, cache.fb_caches);
                 return true;
             });
     }
@@ -1035,14 +1082,10 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, uint32_t drm_id_crtc, in
                 dpy, num, getMaxOverlayInputNum());
     }
 
-    if (blob_color_transform != 0 && blob_color_transform != m_prev_commit_color_transform[dpy])
+    if (blob_color_transform != 0)
     {
-        status_t res = destroyBlob(m_prev_commit_color_transform[dpy]);
-        if (res < 0)
-        {
-            HWC_LOGE("(%" PRIu64 ") failed to destroy blob(%u) of color transform: %d",
-                    dpy, m_prev_commit_color_transform[dpy], res);
-        }
+        // the blob of the previous commit is replaced now, drop its reference
+        releaseColorTransformBlob(dpy, m_prev_commit_color_transform[dpy]);
         m_prev_commit_color_transform[dpy] = blob_color_transform;
     }
 
@@ -1426,6 +1469,22 @@ void DrmDevice::updateOverlayInputs(uint64_t dpy, uint32_t drm_id_crtc,
 
     DbgLogger logger(DbgLogger::TYPE_HWC_LOG, 'D', "(%" PRIu64 ") Input: ", dpy);
     size_t plane_size = crtc->getPlaneNum();
+
+    // a position moved by the cursor worker is newer than the frame of this job
+    uint64_t cursor_layer_id = UINT64_MAX;
+    int32_t cursor_x = 0;
+    int32_t cursor_y = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_cursor_mutex);
+        if (m_cursor[dpy].moved)
+        {
+            cursor_layer_id = m_cursor[dpy].hwc_layer_id;
+            cursor_x = m_cursor[dpy].x;
+            cursor_y = m_cursor[dpy].y;
+        }
+    }
+    m_staged_cursor_planes[dpy].clear();
+
     for (i = 0; i < num; i++)
     {
         status_t ret = NO_ERROR;
@@ -1587,11 +1646,18 @@ void DrmDevice::updateOverlayInputs(uint64_t dpy, uint32_t drm_id_crtc,
             }
             ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_FB_ID, param->fb_id) < 0;
         }
+        int32_t crtc_x = param->dst_crop.left;
+        int32_t crtc_y = param->dst_crop.top;
+        if (param->hwc_layer_id == cursor_layer_id && !param->dim)
+        {
+            crtc_x = cursor_x;
+            crtc_y = cursor_y;
+        }
         ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_ID, crtc->getId()) < 0;
         ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_X,
-                                  static_cast<uint64_t>(param->dst_crop.left)) < 0;
+                                  static_cast<uint64_t>(crtc_x)) < 0;
         ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_Y,
-                                  static_cast<uint64_t>(param->dst_crop.top)) < 0;
+                                  static_cast<uint64_t>(crtc_y)) < 0;
         ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_W,
                                   static_cast<uint64_t>(param->dst_crop.getWidth())) < 0;
         ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_H,
@@ -1632,6 +1698,12 @@ void DrmDevice::updateOverlayInputs(uint64_t dpy, uint32_t drm_id_crtc,
         }
         else
         {
+            if (!param->dim)
+            {
+                m_staged_cursor_planes[dpy].push_back({param->hwc_layer_id, i, crtc_x, crtc_y,
+                                                       param->dst_crop.getWidth(),
+                                                       param->dst_crop.getHeight()});
+            }
             logger.printf("+%zu,pid:%d,fidx:%d,fb_id:%d/ ",
                     i, plane->getId(), param->fence_index, param->fb_id);
             DbgLogger* ovl_logger = &Debugger::getInstance().m_logger->ovlInput[static_cast<size_t>(dpy)][i];
@@ -1867,11 +1939,541 @@ status_t DrmDevice::waitVSync(uint64_t dpy, uint32_t drm_id_crtc, nsecs_t* ts)
     return NO_ERROR;
 }
 
+int DrmDevice::commitAtomicRequirement(uint64_t dpy, uint32_t drm_id_crtc, uint32_t flags)
+{
+    // only one commit is in flight, the frame after it has been prepared in parallel
+    waitCommitDone(dpy);
+
+    const uint32_t mask = Platform::getInstance().m_config.commit_aggregate_mask;
+    if (dpy == HWC_DISPLAY_VIRTUAL || (mask & (1U << dpy)) == 0)
+    {
+        return commitAlone(dpy, drm_id_crtc, flags);
+    }
+
+    std::unique_lock<std::mutex> lock(m_aggregate_mutex);
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    const auto deadline = std::chrono::steady_clock::now() +
+            std::chrono::nanoseconds(Platform::getInstance().m_config.commit_aggregate_timeout);
+    AggregateSlot& slot = m_aggregate_slots[dpy];
+    slot.req = m_atomic_req[dpy];
+    slot.drm_id_crtc = drm_id_crtc;
+    slot.flags = flags;
+    slot.queued = true;
+    slot.taken = false;
+    slot.done = false;
+    slot.last_commit_time = now;
+
+    while (!slot.done)
+    {
+        if (slot.taken)
+        {
+            // the leader is committing, its commit is not bounded by the timeout
+            m_aggregate_condition.wait(lock);
+            continue;
+        }
+
+        if (isAggregateReadyLocked(mask, systemTime(SYSTEM_TIME_MONOTONIC)))
+        {
+            // the last display which comes commits for all of them
+            std::vector<uint64_t> dpys;
+            for (uint64_t i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
+            {
+                AggregateSlot& other = m_aggregate_slots[i];
+                if (other.queued && !other.taken)
+                {
+                    other.taken = true;
+                    dpys.push_back(i);
+                }
+            }
+
+            std::vector<int> results;
+            lock.unlock();
+            const int merge_ret = commitAggregate(dpys, &results);
+            lock.lock();
+
+            for (size_t i = 0; i < dpys.size(); i++)
+            {
+                AggregateSlot& other = m_aggregate_slots[dpys[i]];
+                if (merge_ret == 0)
+                {
+                    other.merge_count++;
+                }
+                else if (dpys.size() > 1)
+                {
+                    other.split_count++;
+                }
+                other.result = results[i];
+                other.done = true;
+            }
+            m_aggregate_condition.notify_all();
+            continue;
+        }
+
+        if (m_aggregate_condition.wait_until(lock, deadline) == std::cv_status::timeout &&
+            !slot.taken && !slot.done)
+        {
+            // the others are late, do not hold this display any longer
+            slot.queued = false;
+            slot.timeout_count++;
+            lock.unlock();
+            return commitAlone(dpy, drm_id_crtc, flags);
+        }
+    }
+
+    slot.queued = false;
+    slot.req = nullptr;
+    return slot.result;
+}
+
+int DrmDevice::commitAlone(uint64_t dpy, uint32_t drm_id_crtc, uint32_t flags)
+{
+    DrmModeCrtc* crtc = m_drm->getCrtc(drm_id_crtc);
+    bool nonblock = Platform::getInstance().m_config.nonblock_commit &&
+                    dpy != HWC_DISPLAY_VIRTUAL && crtc != nullptr &&
+                    crtc->getProperty(DRM_PROP_CRTC_OUT_FENCE_PTR).hasInit();
+
+    // the kernel writes the out-fence, or -1 if the commit fails
+    int out_fence = -1;
+    if (nonblock)
+    {
+        nonblock = crtc->addProperty(m_atomic_req[dpy], DRM_PROP_CRTC_OUT_FENCE_PTR,
+                static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&out_fence))) == 0;
+    }
+
+    std::lock_guard<std::mutex> commit_lock(m_commit_mutex[dpy]);
+    const nsecs_t start = systemTime();
+    int ret = m_drm->atomicCommit(m_atomic_req[dpy], nonblock ? flags | DRM_MODE_ATOMIC_NONBLOCK : flags,
+                                  nullptr);
+    uint64_t busy_count = 0;
+    if (nonblock)
+    {
+        // a cursor commit is still in flight, it is done within a vsync
+        for (int i = 0; ret == -EBUSY && i < DRM_NONBLOCK_COMMIT_BUSY_RETRY; i++)
+        {
+            busy_count++;
+            usleep(DRM_NONBLOCK_COMMIT_BUSY_SLEEP_US);
+            ret = m_drm->atomicCommit(m_atomic_req[dpy], flags | DRM_MODE_ATOMIC_NONBLOCK, nullptr);
+        }
+        if (ret == -EBUSY)
+        {
+            // the blocking commit waits for the one in flight in the kernel
+            HWC_LOGW("(%" PRIu64 ") non-blocking commit is busy, commit it blocking", dpy);
+            busy_count++;
+            nonblock = false;
+            ret = m_drm->atomicCommit(m_atomic_req[dpy], flags, nullptr);
+        }
+    }
+    const nsecs_t call_time = systemTime() - start;
+    publishCursorPlanesLocked(dpy, drm_id_crtc, ret);
+
+    std::lock_guard<std::mutex> lock(m_commit_state_mutex);
+    CommitState& state = m_commit_state[dpy];
+    HWC_ATRACE_INT(state.call_trace_name.c_str(), static_cast<int32_t>(ns2us(call_time)));
+    state.max_call_time = std::max(state.max_call_time, call_time);
+    state.busy_count += busy_count;
+    if (ret == 0 && out_fence >= 0)
+    {
+        // the fence of a commit which waitCommitDone() timed out on is replaced, the kernel applies
+        // the commits of a CRTC in order, so the new fence also covers the deferred fb of the old one
+        if (state.out_fence >= 0)
+        {
+            protectedClose(state.out_fence);
+        }
+        // waitCommitDone() closes it once it signals
+        state.out_fence = out_fence;
+        state.commit_seq++;
+        HWC_ATRACE_INT(state.depth_trace_name.c_str(), 1);
+    }
+    else if (out_fence >= 0)
+    {
+        protectedClose(out_fence);
+    }
+    if (nonblock)
+    {
+        state.nonblock_count++;
+    }
+    else
+    {
+        state.block_count++;
+    }
+    return ret;
+}
+
+void DrmDevice::waitCommitDone(uint64_t dpy)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    // wait on a dup, the out-fence stays in the state until it signals, so the other callers
+    // still see the commit in flight and wait for it too
+    int out_fence = -1;
+    uint64_t commit_seq = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_commit_state_mutex);
+        const CommitState& state = m_commit_state[dpy];
+        if (state.out_fence < 0)
+        {
+            return;
+        }
+        out_fence = ::dup(state.out_fence);
+        commit_seq = state.commit_seq;
+    }
+
+    if (out_fence < 0)
+    {
+        HWC_LOGE("(%" PRIu64 ") failed to dup the commit out-fence: %s", dpy, strerror(errno));
+        return;
+    }
+
+    HWC_ATRACE_NAME("waitCommitDone");
+    const status_t err = SyncFence::waitWithoutCloseFd(out_fence, DRM_NONBLOCK_COMMIT_TIMEOUT_MS,
+                                                       "commit_done");
+    protectedClose(out_fence);
+    if (err != NO_ERROR)
+    {
+        // the commit may still scan out the deferred fb, they wait for the next waitCommitDone()
+        return;
+    }
+
+    std::list<FbCacheEntry> trash;
+    {
+        std::lock_guard<std::mutex> lock(m_commit_state_mutex);
+        CommitState& state = m_commit_state[dpy];
+        // another caller has already cleared it, or a newer commit has replaced it
+        if (state.out_fence < 0 || state.commit_seq != commit_seq)
+        {
+            return;
+        }
+        protectedClose(state.out_fence);
+        state.out_fence = -1;
+        trash.swap(state.deferred_trash);
+        HWC_ATRACE_INT(state.depth_trace_name.c_str(), 0);
+    }
+
+    // the fb of the commit before the one in flight are not scanned out any longer
+    trashAddFbId(trash);
+}
+
+int DrmDevice::dupCommitFence(uint64_t dpy)
+{
+    if (!CHECK_DPY_VALID(dpy))
+    {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_commit_state_mutex);
+    const CommitState& state = m_commit_state[dpy];
+    return state.out_fence >= 0 ? ::dup(state.out_fence) : -1;
+}
+
+void DrmDevice::trashAddFbIdAfterCommit(uint64_t dpy, const std::list<FbCacheEntry>& fb_caches)
+{
+    if (fb_caches.empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_commit_state_mutex);
+        CommitState& state = m_commit_state[dpy];
+        if (state.out_fence >= 0)
+        {
+            state.deferred_trash.insert(state.deferred_trash.end(), fb_caches.begin(), fb_caches.end());
+            return;
+        }
+    }
+    trashAddFbId(fb_caches);
+}
+
+bool DrmDevice::isAggregateReadyLocked(uint32_t mask, nsecs_t now)
+{
+    for (uint64_t i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
+    {
+        const AggregateSlot& slot = m_aggregate_slots[i];
+        if ((mask & (1U << i)) == 0 || i == HWC_DISPLAY_VIRTUAL || slot.queued ||
+            m_display_state.getState(i) != DISPLAY_STATE_ACTIVE)
+        {
+            continue;
+        }
+
+        // an idle display does not hold the others
+        if (now - slot.last_commit_time < DRM_COMMIT_AGGREGATE_IDLE_TIME)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int DrmDevice::commitAggregate(const std::vector<uint64_t>& dpys, std::vector<int>* results)
+{
+    results->assign(dpys.size(), -ENOMEM);
+    if (dpys.empty())
+    {
+        return -ENOMEM;
+    }
+
+    HWC_ATRACE_FORMAT_NAME("commitAggregate:%zu", dpys.size());
+
+    // the commit mutexes are taken in the order of the display
+    std::vector<std::unique_lock<std::mutex>> commit_locks;
+    for (uint64_t dpy : dpys)
+    {
+        commit_locks.emplace_back(m_commit_mutex[dpy]);
+    }
+
+    int ret = -ENOMEM;
+    uint32_t flags = 0;
+    drmModeAtomicReqPtr merged = nullptr;
+    if (dpys.size() > 1)
+    {
+        merged = drmModeAtomicDuplicate(m_aggregate_slots[dpys[0]].req);
+        for (size_t i = 0; merged != nullptr && i < dpys.size(); i++)
+        {
+            const AggregateSlot& slot = m_aggregate_slots[dpys[i]];
+            flags |= slot.flags;
+            if (i > 0 && drmModeAtomicMerge(merged, slot.req) != 0)
+            {
+                drmModeAtomicFree(merged);
+                merged = nullptr;
+            }
+        }
+    }
+
+    // the properties of each CRTC, e.g. its present fence, are kept in the merged request
+    if (merged != nullptr)
+    {
+        ret = m_drm->atomicCommit(merged, flags, nullptr);
+        drmModeAtomicFree(merged);
+        if (ret)
+        {
+            HWC_LOGW("failed to commit %zu displays together: ret=%d, commit them alone",
+                     dpys.size(), ret);
+        }
+    }
+
+    for (size_t i = 0; i < dpys.size(); i++)
+    {
+        const AggregateSlot& slot = m_aggregate_slots[dpys[i]];
+        int result = ret;
+        if (ret)
+        {
+            // a display should not fail because of the others
+            result = m_drm->atomicCommit(slot.req, slot.flags, nullptr);
+        }
+        (*results)[i] = result;
+        publishCursorPlanesLocked(dpys[i], slot.drm_id_crtc, result);
+    }
+    return ret;
+}
+
+void DrmDevice::publishCursorPlanesLocked(uint64_t dpy, uint32_t drm_id_crtc, int result)
+{
+    // the cursor worker moves the planes of this commit from now on
+    std::lock_guard<std::mutex> cursor_lock(m_cursor_mutex);
+    CursorState& cursor = m_cursor[dpy];
+    if (result)
+    {
+        cursor.planes.clear();
+    }
+    else
+    {
+        cursor.drm_id_crtc = drm_id_crtc;
+        cursor.planes.swap(m_staged_cursor_planes[dpy]);
+        for (const CursorPlane& plane : cursor.planes)
+        {
+            // the commit already has the queued position
+            if (cursor.pending && plane.hwc_layer_id == cursor.hwc_layer_id &&
+                plane.x == cursor.x && plane.y == cursor.y)
+            {
+                cursor.pending = false;
+            }
+        }
+    }
+    m_staged_cursor_planes[dpy].clear();
+}
+
+status_t DrmDevice::moveCursor(uint64_t dpy, uint32_t drm_id_crtc, uint64_t hwc_layer_id,
+                               const hwc_rect_t& frame)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    std::lock_guard<std::mutex> lock(m_cursor_mutex);
+    CursorState& cursor = m_cursor[dpy];
+    cursor.move_count++;
+
+    // only a plane of the same size can be moved, a scaled cursor needs a frame commit
+    auto iter = std::find_if(cursor.planes.begin(), cursor.planes.end(),
+            [&](const CursorPlane& plane) { return plane.hwc_layer_id == hwc_layer_id; });
+    if (cursor.drm_id_crtc != drm_id_crtc || iter == cursor.planes.end() ||
+        iter->width != WIDTH(frame) || iter->height != HEIGHT(frame))
+    {
+        cursor.fallback_count++;
+        return BAD_VALUE;
+    }
+
+    if (cursor.pending)
+    {
+        cursor.coalesce_count++;
+    }
+    cursor.hwc_layer_id = hwc_layer_id;
+    cursor.x = frame.left;
+    cursor.y = frame.top;
+    cursor.moved = true;
+    cursor.pending = true;
+
+    if (!m_cursor_thread.joinable())
+    {
+        m_cursor_thread = std::thread(&DrmDevice::cursorLoop, this);
+        if (pthread_setname_np(m_cursor_thread.native_handle(), "DrmCursor"))
+        {
+            HWC_LOGI("pthread_setname_np DrmCursor fail");
+        }
+    }
+    m_cursor_condition.notify_one();
+    return NO_ERROR;
+}
+
+void DrmDevice::resetCursor(uint64_t dpy)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    std::lock_guard<std::mutex> lock(m_cursor_mutex);
+    CursorState& cursor = m_cursor[dpy];
+    cursor.hwc_layer_id = UINT64_MAX;
+    cursor.moved = false;
+    cursor.pending = false;
+}
+
+void DrmDevice::dropCursorPlanes(uint64_t dpy)
+{
+    // wait for the commit of the cursor worker
+    std::lock_guard<std::mutex> commit_lock(m_commit_mutex[dpy]);
+    resetCursor(dpy);
+
+    std::lock_guard<std::mutex> lock(m_cursor_mutex);
+    m_cursor[dpy].planes.clear();
+}
+
+void DrmDevice::cursorLoop()
+{
+    std::unique_lock<std::mutex> lock(m_cursor_mutex);
+    while (!m_cursor_thread_stop)
+    {
+        uint64_t dpy = 0;
+        for (; dpy < DisplayManager::MAX_DISPLAYS; dpy++)
+        {
+            if (m_cursor[dpy].pending)
+            {
+                break;
+            }
+        }
+        if (dpy == DisplayManager::MAX_DISPLAYS)
+        {
+            m_cursor_condition.wait(lock);
+            continue;
+        }
+        const uint32_t drm_id_crtc = m_cursor[dpy].drm_id_crtc;
+
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> commit_lock(m_commit_mutex[dpy]);
+            commitCursor(dpy);
+        }
+
+        // one cursor commit in a vsync, the moves before the next one are coalesced
+        nsecs_t ts = 0;
+        waitVSync(dpy, drm_id_crtc, &ts);
+        lock.lock();
+    }
+}
+
+void DrmDevice::commitCursor(uint64_t dpy)
+{
+    HWC_ATRACE_CALL();
+
+    uint32_t drm_id_crtc = UINT32_MAX;
+    size_t plane_idx = 0;
+    int32_t x = 0;
+    int32_t y = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_cursor_mutex);
+        CursorState& cursor = m_cursor[dpy];
+        if (!cursor.pending)
+        {
+            // a frame commit took the position or the cursor is reset
+            return;
+        }
+        cursor.pending = false;
+
+        auto iter = std::find_if(cursor.planes.begin(), cursor.planes.end(),
+                [&](const CursorPlane& plane) { return plane.hwc_layer_id == cursor.hwc_layer_id; });
+        if (iter == cursor.planes.end() || m_display_state.getState(dpy) != DISPLAY_STATE_ACTIVE)
+        {
+            cursor.fallback_count++;
+            return;
+        }
+        drm_id_crtc = cursor.drm_id_crtc;
+        plane_idx = iter->plane_idx;
+        x = cursor.x;
+        y = cursor.y;
+    }
+
+    DrmModeCrtc* crtc = m_drm->getCrtc(drm_id_crtc);
+    const DrmModePlane* plane = crtc ? crtc->getPlane(plane_idx) : nullptr;
+    drmModeAtomicReqPtr req = plane ? drmModeAtomicAlloc() : nullptr;
+    if (req == nullptr)
+    {
+        HWC_LOGE("(%" PRIu64 ") failed to prepare the cursor commit of plane[%zu]", dpy, plane_idx);
+        std::lock_guard<std::mutex> lock(m_cursor_mutex);
+        m_cursor[dpy].fail_count++;
+        return;
+    }
+
+    // the other properties of the plane keep the state of the last frame commit
+    int ret = 0;
+    ret |= plane->addProperty(req, DRM_PROP_PLANE_CRTC_X, static_cast<uint64_t>(x)) < 0;
+    ret |= plane->addProperty(req, DRM_PROP_PLANE_CRTC_Y, static_cast<uint64_t>(y)) < 0;
+    if (ret == 0)
+    {
+        ret = m_drm->atomicCommit(req, DRM_MODE_ATOMIC_NONBLOCK, nullptr);
+    }
+    drmModeAtomicFree(req);
+
+    std::lock_guard<std::mutex> lock(m_cursor_mutex);
+    CursorState& cursor = m_cursor[dpy];
+    if (ret == 0)
+    {
+        cursor.commit_count++;
+        HWC_LOGV("(%" PRIu64 ") cursor commit plane[%zu] x:%d y:%d", dpy, plane_idx, x, y);
+        return;
+    }
+
+    cursor.fail_count++;
+    if (ret == -EBUSY && cursor.moved)
+    {
+        // the last commit is not done, retry after the vsync
+        cursor.pending = true;
+    }
+    else
+    {
+        HWC_LOGW("(%" PRIu64 ") failed to commit cursor plane[%zu]: ret=%d", dpy, plane_idx, ret);
+    }
+}
+
 void DrmDevice::setPowerMode(uint64_t dpy, uint32_t drm_id_crtc, int mode)
 {
     CHECK_DPY_RET_VOID(dpy);
 
     HWC_LOGD("%s() dpy:%" PRIu64 " mode:%d", __FUNCTION__, dpy, mode);
+
+    // the display is not blanked under the commit in flight
+    waitCommitDone(dpy);
+
+    // the planes of the last commit are gone after the display is blanked
+    if (mode != HWC_POWER_MODE_NORMAL)
+    {
+        dropCursorPlanes(dpy);
+    }
 #ifdef USE_SWWATCHDOG
     AUTO_WDT(1000);
 #endif
@@ -1991,8 +2593,9 @@ unsigned int DrmDevice::getDeviceId(uint64_t dpy)
     return static_cast<unsigned int>(dpy);
 }
 
-status_t DrmDevice::waitAllJobDone(const uint64_t /*dpy*/)
+status_t DrmDevice::waitAllJobDone(const uint64_t dpy)
 {
+    waitCommitDone(dpy);
     return NO_ERROR;
 }
 
@@ -2230,6 +2833,38 @@ void DrmDevice::dump(const uint64_t& dpy, String8* dump_str)
                 m_last_color_config[dpy].color_matrix[i * COLOR_MATRIX_DIM + 2],
                 m_last_color_config[dpy].color_matrix[i * COLOR_MATRIX_DIM + 3]);
     }
+    {
+        std::lock_guard<std::mutex> lock(m_color_transform_blob_mutex);
+        const ColorTransformBlobCache& cache = m_color_transform_blobs[dpy];
+        dump_str->appendFormat("blob cached:%zu retired:%zu create:%" PRIu64 " destroy:%" PRIu64
+                " hit:%" PRIu64 " committed:%u\n",
+                cache.blobs.size(), cache.retired.size(), cache.create_count, cache.destroy_count,
+                cache.hit_count, m_prev_commit_color_transform[dpy]);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_commit_state_mutex);
+        const CommitState& state = m_commit_state[dpy];
+        dump_str->appendFormat("commit(vendor.debug.hwc.nonblock_commit) nonblock:%" PRIu64 " block:%" PRIu64
+                " busy:%" PRIu64 " max_call:%" PRId64 "us in_flight:%d deferred_fb:%zu\n",
+                state.nonblock_count, state.block_count, state.busy_count, ns2us(state.max_call_time),
+                state.out_fence >= 0, state.deferred_trash.size());
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_aggregate_mutex);
+        const AggregateSlot& slot = m_aggregate_slots[dpy];
+        dump_str->appendFormat("commit aggregate(vendor.debug.hwc.commit_aggregate_mask) merge:%" PRIu64
+                " timeout:%" PRIu64 " split:%" PRIu64 "\n",
+                slot.merge_count, slot.timeout_count, slot.split_count);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_cursor_mutex);
+        const CursorState& cursor = m_cursor[dpy];
+        dump_str->appendFormat("cursor(vendor.debug.hwc.cursor_fast_path) layer:%" PRIu64 " moved:%d x:%d y:%d"
+                " move:%" PRIu64 " commit:%" PRIu64 " coalesce:%" PRIu64 " fallback:%" PRIu64
+                " fail:%" PRIu64 "\n",
+                cursor.hwc_layer_id, cursor.moved, cursor.x, cursor.y, cursor.move_count,
+                cursor.commit_count, cursor.coalesce_count, cursor.fallback_count, cursor.fail_count);
+    }
     dump_str->appendFormat("---------------------------------------\n");
 
     for (unsigned int i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
@@ -2243,7 +2878,13 @@ void DrmDevice::dump(const uint64_t& dpy, String8* dump_str)
     return;
 }
 
-status_t DrmDevice::createColorTransformBlob(const uint64_t& dpy, sp<ColorTransform> color_transform, uint32_t* id)
+bool DrmDevice::isSameColorConfig(const disp_ccorr_config& a, const disp_ccorr_config& b)
+{
+    return a.mode == b.mode && a.feature_flag == b.feature_flag &&
+           memcmp(a.color_matrix, b.color_matrix, sizeof(a.color_matrix)) == 0;
+}
+
+status_t DrmDevice::acquireColorTransformBlob(const uint64_t& dpy, sp<ColorTransform> color_transform, uint32_t* id)
 {
     CHECK_DPY_RET_STATUS(dpy);
 
@@ -2257,10 +2898,27 @@ status_t DrmDevice::createColorTransformBlob(const uint64_t& dpy, sp<ColorTransf
             config.color_matrix[i] = transFloatToIntForCCORR(color_transform->matrix[i / 4][i % 4]);
         }
         config.feature_flag = color_transform->force_disable_color;
+
+        std::lock_guard<std::mutex> lock(m_color_transform_blob_mutex);
+        ColorTransformBlobCache& cache = m_color_transform_blobs[dpy];
+        m_last_color_config[dpy] = config;
+        for (auto it = cache.blobs.begin(); it != cache.blobs.end(); ++it)
+        {
+            if (isSameColorConfig(it->config, config))
+            {
+                it->ref_count++;
+                cache.hit_count++;
+                cache.blobs.splice(cache.blobs.begin(), cache.blobs, it);
+                *id = cache.blobs.front().id;
+                m_crtc_colortransform_res[dpy] = 0;
+                HWC_LOGV("(%" PRIu64 ") reuse blob id(%u) of color transform", dpy, *id);
+                return NO_ERROR;
+            }
+        }
+
         int res = m_drm->createPropertyBlob(&config, sizeof(config), id);
         //Keep ColorTransform result and matrix for dump
         m_crtc_colortransform_res[dpy] = res;
-        m_last_color_config[dpy] = config;
 
         DbgLogger logger(DbgLogger::TYPE_HWC_LOG, 'D', "[%s] ", DEBUG_LOG_TAG);
         logger.printf("create blob id of color transform[%s] mode=%d f=%d mat=",
@@ -2275,11 +2933,82 @@ status_t DrmDevice::createColorTransformBlob(const uint64_t& dpy, sp<ColorTransf
                     config.color_matrix[i * COLOR_MATRIX_DIM + 2],
                     config.color_matrix[i * COLOR_MATRIX_DIM + 3]);
         }
+        if (res < 0)
+        {
+            return res;
+        }
+
+        cache.create_count++;
+        ColorTransformBlob blob;
+        blob.config = config;
+        blob.id = *id;
+        blob.ref_count = 2;
+        cache.blobs.push_front(blob);
+
+        while (cache.blobs.size() > COLOR_TRANSFORM_BLOB_CACHE_SIZE)
+        {
+            auto oldest = std::prev(cache.blobs.end());
+            oldest->ref_count--;
+            if (oldest->ref_count == 0)
+            {
+                destroyColorTransformBlobLocked(&cache, oldest->id);
+                cache.blobs.erase(oldest);
+            }
+            else
+            {
+                cache.retired.splice(cache.retired.end(), cache.blobs, oldest);
+            }
+        }
         return res;
     }
     return BAD_VALUE;
 }
 
+void DrmDevice::releaseColorTransformBlob(const uint64_t& dpy, uint32_t id)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    if (id == 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_color_transform_blob_mutex);
+    ColorTransformBlobCache& cache = m_color_transform_blobs[dpy];
+    for (std::list<ColorTransformBlob>* list : {&cache.blobs, &cache.retired})
+    {
+        for (auto it = list->begin(); it != list->end(); ++it)
+        {
+            if (it->id != id)
+            {
+                continue;
+            }
+
+            if (it->ref_count > 0)
+            {
+                it->ref_count--;
+            }
+            if (it->ref_count == 0)
+            {
+                destroyColorTransformBlobLocked(&cache, id);
+                list->erase(it);
+            }
+            return;
+        }
+    }
+    HWC_LOGW("(%" PRIu64 ") %s: unknown blob(%u) of color transform", dpy, __func__, id);
+}
+
+void DrmDevice::destroyColorTransformBlobLocked(ColorTransformBlobCache* cache, uint32_t id)
+{
+    status_t res = destroyBlob(id);
+    if (res < 0)
+    {
+        HWC_LOGE("failed to destroy blob(%u) of color transform: %d", id, res);
+    }
+    cache->destroy_count++;
+}
+
 status_t DrmDevice::destroyBlob(uint32_t id)
 {
     return m_drm->destroyPropertyBlob(id);
@@ -2310,6 +3039,11 @@ int32_t DrmDevice::getConnectorEDID(uint64_t dpy, uint32_t drm_id_crtc, uint32_t
     return m_drm->getConnectorEDID(dpy, drm_id_crtc, edid);
 }
 
+int32_t DrmDevice::verifyConnectorEDID(uint64_t dpy, uint32_t drm_id_crtc, bool* changed)
+{
+    return m_drm->verifyConnectorEDID(dpy, drm_id_crtc, changed);
+}
+
 int32_t DrmDevice::setHDMIMode(uint64_t dpy, uint32_t drm_id_crtc, uint32_t mode, uint32_t value)
 {
     switch(mode)
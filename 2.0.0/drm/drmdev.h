@@ -2,7 +2,10 @@
 #define DRM_HWDEV_H_
 
 #include <stdint.h>
+#include <list>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <linux/mediatek_drm.h>
 
@@ -161,6 +164,16 @@ public:
     // waitVSync() is used to wait vsync signal for specific display device
     status_t waitVSync(uint64_t dpy, uint32_t drm_id_crtc, nsecs_t *ts);
 
+    // isCursorMoveSupported() is used to query if moveCursor() is supported
+    bool isCursorMoveSupported() { return true; }
+
+    // moveCursor() queues the position of the cursor plane, the cursor worker commits it
+    status_t moveCursor(uint64_t dpy, uint32_t drm_id_crtc, uint64_t hwc_layer_id,
+                        const hwc_rect_t& frame);
+
+    // resetCursor() drops the moved position of the cursor plane
+    void resetCursor(uint64_t dpy);
+
     // setPowerMode() is used to switch power setting for display
     void setPowerMode(uint64_t dpy, uint32_t drm_id_crtc, int mode);
 
@@ -170,6 +183,9 @@ public:
     // waitAllJobDone() use to wait driver for processing all job
     status_t waitAllJobDone(const uint64_t dpy);
 
+    // dupCommitFence() returns a dup of the out-fence of the non-blocking commit in flight
+    int dupCommitFence(uint64_t dpy);
+
     // waitRefreshRequest() is used to wait for refresh request from driver
     status_t waitRefreshRequest(unsigned int* type);
 
@@ -275,6 +291,7 @@ public:
     int32_t getSpportedConnectorMode(uint64_t dpy, uint32_t drm_id_crtc, uint32_t *modeinfo);
     // getConnectorEDID use for get connector's edid
     int32_t getConnectorEDID(uint64_t dpy, uint32_t drm_id_crtc, uint32_t *edid);
+    int32_t verifyConnectorEDID(uint64_t dpy, uint32_t drm_id_crtc, bool* changed);
 
     int32_t setHDMIMode(uint64_t dpy, uint32_t drm_id_crtc, uint32_t mode, uint32_t value);
     int32_t getHDMIMode(uint64_t dpy, uint32_t drm_id_crtc, uint32_t mode, uint32_t *value);
@@ -301,6 +318,24 @@ private:
         bool feature_flag;
     };
 
+    struct ColorTransformBlob
+    {
+        struct disp_ccorr_config config;
+        uint32_t id;
+        // one for the cache and one for each commit which uses the blob
+        uint32_t ref_count;
+    };
+
+    struct ColorTransformBlobCache
+    {
+        std::list<ColorTransformBlob> blobs;    // the most recently used one is at the front
+        std::list<ColorTransformBlob> retired;  // evicted from blobs, but still committed
+
+        uint64_t create_count = 0;
+        uint64_t destroy_count = 0;
+        uint64_t hit_count = 0;
+    };
+
     struct FbCacheEntry
     {
         uint64_t alloc_id;
@@ -342,6 +377,70 @@ private:
         void dump(String8* str);
     };
 
+    // CursorPlane is a plane which a layer is committed on, with the frame of the commit
+    struct CursorPlane
+    {
+        uint64_t hwc_layer_id;
+        size_t plane_idx;
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+
+    // CommitState is the non-blocking frame commit of a display which is still in flight
+    struct CommitState
+    {
+        int out_fence = -1;     // the CRTC out-fence of the commit in flight
+        uint64_t commit_seq = 0;    // counts the out-fences, tells a replaced one apart
+        // the fb of the commit before, they are removed when the commit in flight is done
+        std::list<FbCacheEntry> deferred_trash;
+
+        std::string call_trace_name;
+        std::string depth_trace_name;
+
+        uint64_t nonblock_count = 0;
+        uint64_t busy_count = 0;
+        uint64_t block_count = 0;
+        nsecs_t max_call_time = 0;
+    };
+
+    // AggregateSlot is the frame commit of a display which waits to be merged with the
+    // commits of the other displays of commit_aggregate_mask
+    struct AggregateSlot
+    {
+        drmModeAtomicReqPtr req = nullptr;
+        uint32_t drm_id_crtc = UINT32_MAX;
+        uint32_t flags = 0;
+        bool queued = false;
+        bool taken = false;     // a leader is committing it
+        bool done = false;
+        int result = 0;
+
+        nsecs_t last_commit_time = 0;
+        uint64_t merge_count = 0;
+        uint64_t timeout_count = 0;
+        uint64_t split_count = 0;
+    };
+
+    struct CursorState
+    {
+        uint32_t drm_id_crtc = UINT32_MAX;
+        std::vector<CursorPlane> planes;    // the planes of the last frame commit
+
+        uint64_t hwc_layer_id = UINT64_MAX;
+        int32_t x = 0;
+        int32_t y = 0;
+        bool moved = false;     // the position overrides the frame of the following commits
+        bool pending = false;   // the position is not committed yet
+
+        uint64_t move_count = 0;
+        uint64_t commit_count = 0;
+        uint64_t coalesce_count = 0;
+        uint64_t fallback_count = 0;
+        uint64_t fail_count = 0;
+    };
+
     // query hw capabilities through ioctl and store in m_caps_info
     void queryCapsInfo();
 
@@ -354,7 +453,12 @@ private:
     status_t disableCrtcOutput(drmModeAtomicReqPtr req_ptr, const DrmModeCrtc* crtc);
 
     void createFbId(OverlayPortParam* param, const uint64_t& dpy, const uint64_t& id);
-    status_t createColorTransformBlob(const uint64_t& dpy, sp<ColorTransform> color_transform, uint32_t* id);
+    // acquireColorTransformBlob() returns the cached blob of the same config, or creates one, with
+    // a reference for the commit which releaseColorTransformBlob() drops after the next commit
+    status_t acquireColorTransformBlob(const uint64_t& dpy, sp<ColorTransform> color_transform, uint32_t* id);
+    void releaseColorTransformBlob(const uint64_t& dpy, uint32_t id);
+    void destroyColorTransformBlobLocked(ColorTransformBlobCache* cache, uint32_t id);
+    static bool isSameColorConfig(const disp_ccorr_config& a, const disp_ccorr_config& b);
     status_t destroyBlob(uint32_t id);
 
     void trashCleanerLoop();
@@ -369,6 +473,28 @@ private:
     void getMSyncDefaultParamTableInternal();
 
     void activateDisplay(uint64_t dpy, uint32_t set_display_id_crtc = UINT32_MAX);
+
+    // commitAtomicRequirement() commits m_atomic_req of the display, merged with the other
+    // displays of commit_aggregate_mask if they come in time
+    int commitAtomicRequirement(uint64_t dpy, uint32_t drm_id_crtc, uint32_t flags);
+    int commitAlone(uint64_t dpy, uint32_t drm_id_crtc, uint32_t flags);
+    // waitCommitDone() waits for the non-blocking commit in flight and removes its deferred fb,
+    // they are kept if the wait times out
+    void waitCommitDone(uint64_t dpy);
+    // trashAddFbIdAfterCommit() removes the fb when no commit in flight may still scan it out
+    void trashAddFbIdAfterCommit(uint64_t dpy, const std::list<FbCacheEntry>& fb_caches);
+    // isAggregateReadyLocked() checks if every active display of the mask has queued its commit
+    bool isAggregateReadyLocked(uint32_t mask, nsecs_t now);
+    // commitAggregate() runs without m_aggregate_mutex, so it returns the result of the merged
+    // commit and the one of each display, and the caller updates the slots under the lock
+    int commitAggregate(const std::vector<uint64_t>& dpys, std::vector<int>* results);
+    // publishCursorPlanesLocked() is called with m_commit_mutex after the frame commit
+    void publishCursorPlanesLocked(uint64_t dpy, uint32_t drm_id_crtc, int result);
+
+    void cursorLoop();
+    void commitCursor(uint64_t dpy);
+    // dropCursorPlanes() stops the cursor worker from moving the planes until the next commit
+    void dropCursorPlanes(uint64_t dpy);
     status_t setOverlaySessionModeInternal(uint64_t dpy, HWC_DISP_MODE mode, uint32_t set_display_id_crtc = UINT32_MAX);
 
     mtk_drm_disp_caps_info m_caps_info;
@@ -395,6 +521,10 @@ private:
     // store the last commited blob id of color transform
     uint32_t m_prev_commit_color_transform[DisplayManager::MAX_DISPLAYS];
 
+    // night light and accessibility switch between a few matrices, keep their blobs
+    mutable std::mutex m_color_transform_blob_mutex;
+    ColorTransformBlobCache m_color_transform_blobs[DisplayManager::MAX_DISPLAYS];
+
     // CRTC color transform result
     int m_crtc_colortransform_res[DisplayManager::MAX_DISPLAYS];
     struct disp_ccorr_config m_last_color_config[DisplayManager::MAX_DISPLAYS];
@@ -415,5 +545,24 @@ private:
     MSync2Data::ParamTable m_msync_param_table;
 
     DrmHistogramDevice m_drm_histogram;
+
+    // serializes the frame commit of OverlayEngine and the commit of the cursor worker
+    std::mutex m_commit_mutex[DisplayManager::MAX_DISPLAYS];
+
+    std::mutex m_commit_state_mutex;
+    CommitState m_commit_state[DisplayManager::MAX_DISPLAYS];
+
+    std::mutex m_aggregate_mutex;
+    std::condition_variable m_aggregate_condition;
+    AggregateSlot m_aggregate_slots[DisplayManager::MAX_DISPLAYS];
+
+    // the lock order is m_commit_mutex then m_cursor_mutex
+    std::thread m_cursor_thread;
+    std::mutex m_cursor_mutex;
+    std::condition_variable m_cursor_condition;
+    bool m_cursor_thread_stop = false;
+    CursorState m_cursor[DisplayManager::MAX_DISPLAYS];
+    // the planes set by updateOverlayInputs(), only accessed by OverlayEngine thread
+    std::vector<CursorPlane> m_staged_cursor_planes[DisplayManager::MAX_DISPLAYS];
 };
 #endif // DRM_HWDEV_H_
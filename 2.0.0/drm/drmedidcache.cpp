@@ -0,0 +1,283 @@
+#define DEBUG_LOG_TAG "DRMDEV"
+#include "drmedidcache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utils/debug.h"
+
+// the number of sinks which are kept, the least recently used one is dropped
+#define EDID_CACHE_MAX_SINKS 8
+
+#define EDID_CACHE_PERSIST_HEADER "hwc_edid_cache_v1"
+
+// the largest mode count which is accepted from the persist file
+#define EDID_CACHE_MAX_MODES 256
+
+DrmEdidCache& DrmEdidCache::getInstance()
+{
+    static DrmEdidCache gInstance;
+    return gInstance;
+}
+
+DrmEdidCache::DrmEdidCache()
+    : m_hit_count(0)
+    , m_miss_count(0)
+    , m_verify_match_count(0)
+    , m_verify_mismatch_count(0)
+{
+}
+
+uint64_t DrmEdidCache::getChecksum(const void* data, size_t size)
+{
+    // FNV-1a, a zero checksum means no EDID
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+std::list<DrmEdidCache::Entry>::iterator DrmEdidCache::findLocked(uint64_t checksum)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        if (it->checksum == checksum)
+        {
+            return it;
+        }
+    }
+    return m_entries.end();
+}
+
+bool DrmEdidCache::get(uint64_t checksum, std::vector<drmModeModeInfo>* modes, bool* verified)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = findLocked(checksum);
+    if (it == m_entries.end() || it->modes.empty())
+    {
+        m_miss_count++;
+        return false;
+    }
+
+    m_hit_count++;
+    it->hit_count++;
+    m_entries.splice(m_entries.begin(), m_entries, it);
+    *modes = m_entries.front().modes;
+    *verified = m_entries.front().verified;
+    return true;
+}
+
+void DrmEdidCache::put(uint64_t checksum, const std::vector<drmModeModeInfo>& modes, bool verified)
+{
+    if (checksum == 0 || modes.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = findLocked(checksum);
+    if (it != m_entries.end())
+    {
+        m_entries.erase(it);
+    }
+
+    Entry entry;
+    entry.checksum = checksum;
+    entry.modes = modes;
+    entry.verified = verified;
+    entry.hit_count = 0;
+    m_entries.push_front(entry);
+
+    while (m_entries.size() > EDID_CACHE_MAX_SINKS)
+    {
+        m_entries.pop_back();
+    }
+
+    saveLocked();
+}
+
+void DrmEdidCache::remove(uint64_t checksum)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = findLocked(checksum);
+    if (it != m_entries.end())
+    {
+        m_entries.erase(it);
+        saveLocked();
+    }
+}
+
+void DrmEdidCache::addVerifyResult(uint64_t checksum, bool match)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (match)
+    {
+        m_verify_match_count++;
+        auto it = findLocked(checksum);
+        if (it != m_entries.end())
+        {
+            it->verified = true;
+        }
+    }
+    else
+    {
+        m_verify_mismatch_count++;
+    }
+}
+
+void DrmEdidCache::setPersistPath(const char* path)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    std::string new_path = (path == nullptr || strcmp(path, "0") == 0) ? "" : path;
+    if (new_path == m_persist_path)
+    {
+        return;
+    }
+
+    m_persist_path = new_path;
+    if (!m_persist_path.empty())
+    {
+        loadLocked();
+    }
+}
+
+void DrmEdidCache::loadLocked()
+{
+    FILE* fp = fopen(m_persist_path.c_str(), "r");
+    if (fp == nullptr)
+    {
+        HWC_LOGI("%s: no edid cache in %s", __func__, m_persist_path.c_str());
+        return;
+    }
+
+    char header[32] = {0};
+    if (fscanf(fp, "%31s", header) != 1 || strcmp(header, EDID_CACHE_PERSIST_HEADER) != 0)
+    {
+        HWC_LOGI("%s: ignore stale edid cache in %s", __func__, m_persist_path.c_str());
+        fclose(fp);
+        return;
+    }
+
+    std::list<Entry> entries;
+    unsigned long long checksum = 0;
+    unsigned int count = 0;
+    while (entries.size() < EDID_CACHE_MAX_SINKS &&
+           fscanf(fp, "%llx %u", &checksum, &count) == 2)
+    {
+        if (checksum == 0 || count == 0 || count > EDID_CACHE_MAX_MODES)
+        {
+            break;
+        }
+
+        Entry entry;
+        entry.checksum = checksum;
+        entry.verified = false;
+        entry.hit_count = 0;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            drmModeModeInfo mode;
+            memset(&mode, 0, sizeof(mode));
+            unsigned int v[13];
+            if (fscanf(fp, "%u %u %u %u %u %u %u %u %u %u %u %u %u %31s",
+                       &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8],
+                       &v[9], &v[10], &v[11], &v[12], mode.name) != 14)
+            {
+                HWC_LOGW("%s: broken edid cache in %s", __func__, m_persist_path.c_str());
+                fclose(fp);
+                return;
+            }
+            mode.clock = v[0];
+            mode.hdisplay = static_cast<uint16_t>(v[1]);
+            mode.hsync_start = static_cast<uint16_t>(v[2]);
+            mode.hsync_end = static_cast<uint16_t>(v[3]);
+            mode.htotal = static_cast<uint16_t>(v[4]);
+            mode.hskew = static_cast<uint16_t>(v[5]);
+            mode.vdisplay = static_cast<uint16_t>(v[6]);
+            mode.vsync_start = static_cast<uint16_t>(v[7]);
+            mode.vsync_end = static_cast<uint16_t>(v[8]);
+            mode.vtotal = static_cast<uint16_t>(v[9]);
+            mode.vscan = static_cast<uint16_t>(v[10]);
+            mode.vrefresh = v[11];
+            mode.flags = v[12];
+            if (strcmp(mode.name, "-") == 0)
+            {
+                mode.name[0] = '\0';
+            }
+            if (fscanf(fp, "%u", &mode.type) != 1)
+            {
+                HWC_LOGW("%s: broken edid cache in %s", __func__, m_persist_path.c_str());
+                fclose(fp);
+                return;
+            }
+            entry.modes.push_back(mode);
+        }
+        entries.push_back(entry);
+    }
+    fclose(fp);
+
+    m_entries.swap(entries);
+    HWC_LOGI("%s: load %zu sinks from %s", __func__, m_entries.size(), m_persist_path.c_str());
+}
+
+void DrmEdidCache::saveLocked()
+{
+    if (m_persist_path.empty())
+    {
+        return;
+    }
+
+    std::string tmp_path = m_persist_path + ".tmp";
+    FILE* fp = fopen(tmp_path.c_str(), "w");
+    if (fp == nullptr)
+    {
+        HWC_LOGW("%s: failed to open %s: %s", __func__, tmp_path.c_str(), strerror(errno));
+        return;
+    }
+
+    fprintf(fp, "%s\n", EDID_CACHE_PERSIST_HEADER);
+    for (const Entry& entry : m_entries)
+    {
+        fprintf(fp, "%016llx %zu\n", static_cast<unsigned long long>(entry.checksum), entry.modes.size());
+        for (const drmModeModeInfo& mode : entry.modes)
+        {
+            fprintf(fp, "%u %u %u %u %u %u %u %u %u %u %u %u %u %s %u\n",
+                    mode.clock, mode.hdisplay, mode.hsync_start, mode.hsync_end, mode.htotal,
+                    mode.hskew, mode.vdisplay, mode.vsync_start, mode.vsync_end, mode.vtotal,
+                    mode.vscan, mode.vrefresh, mode.flags,
+                    strnlen(mode.name, sizeof(mode.name)) ? mode.name : "-", mode.type);
+        }
+    }
+
+    // replace the old file only when the new one is complete
+    if (fclose(fp) != 0 || rename(tmp_path.c_str(), m_persist_path.c_str()) != 0)
+    {
+        HWC_LOGW("%s: failed to save %s: %s", __func__, m_persist_path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+    }
+}
+
+void DrmEdidCache::dump(String8* dump_str)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    dump_str->appendFormat("EDID cache(vendor.debug.hwc.edid_cache_persist): persist:%s hit:%" PRIu64
+                           " miss:%" PRIu64 " verify_match:%" PRIu64 " verify_mismatch:%" PRIu64 "\n",
+                           m_persist_path.empty() ? "none" : m_persist_path.c_str(),
+                           m_hit_count, m_miss_count, m_verify_match_count, m_verify_mismatch_count);
+    for (const Entry& entry : m_entries)
+    {
+        dump_str->appendFormat("  %016" PRIx64 " modes:%zu verified:%d hit:%u\n",
+                               entry.checksum, entry.modes.size(), entry.verified, entry.hit_count);
+    }
+}
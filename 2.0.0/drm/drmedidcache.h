@@ -0,0 +1,77 @@
+#ifndef __MTK_HWC_DRM_EDID_CACHE_H__
+#define __MTK_HWC_DRM_EDID_CACHE_H__
+
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <utils/String8.h>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsign-conversion"
+#include <xf86drmMode.h>
+#pragma clang diagnostic pop
+
+using namespace android;
+
+// DrmEdidCache keeps the connector modes which the driver parsed from the EDID
+// of a sink, keyed by the checksum of the EDID blob. A known sink gets its
+// modes from the cache when it is plugged again, without a connector probe.
+// Every hit is verified with a probe on ModeHandleThread later.
+class DrmEdidCache
+{
+public:
+    static DrmEdidCache& getInstance();
+
+    // get() returns false if the sink is unknown, verified is false if the modes are
+    // loaded from the persist file and no probe has confirmed them since boot
+    bool get(uint64_t checksum, std::vector<drmModeModeInfo>* modes, bool* verified);
+
+    // put() adds or replaces the modes of a sink, verified means they come from a probe
+    void put(uint64_t checksum, const std::vector<drmModeModeInfo>& modes, bool verified);
+
+    void remove(uint64_t checksum);
+
+    // record the result of the probe which verifies the cached modes
+    void addVerifyResult(uint64_t checksum, bool match);
+
+    // the cache is saved to path and loaded from it, "0" keeps it in memory only
+    void setPersistPath(const char* path);
+
+    void dump(String8* dump_str);
+
+    // getChecksum() hashes an EDID blob
+    static uint64_t getChecksum(const void* data, size_t size);
+
+private:
+    DrmEdidCache();
+
+    struct Entry
+    {
+        uint64_t checksum;
+        std::vector<drmModeModeInfo> modes;
+        bool verified;
+        uint32_t hit_count;
+    };
+
+    std::list<Entry>::iterator findLocked(uint64_t checksum);
+    void loadLocked();
+    void saveLocked();
+
+private:
+    std::mutex m_lock;
+
+    // the most recently used sink is at the front
+    std::list<Entry> m_entries;
+
+    std::string m_persist_path;
+
+    uint64_t m_hit_count;
+    uint64_t m_miss_count;
+    uint64_t m_verify_match_count;
+    uint64_t m_verify_mismatch_count;
+};
+
+#endif
@@ -8,6 +8,7 @@
 
 #include "utils/debug.h"
 
+#include "drmedidcache.h"
 #include "drmmodeencoder.h"
 #include "hwc2.h"
 
@@ -301,6 +302,46 @@ int DrmModeConnector::setDrmModeInfo(drmModeConnectorPtr c)
     return 0;
 }
 
+void DrmModeConnector::setModes(const std::vector<drmModeModeInfo>& modes)
+{
+    if (!modes.empty())
+    {
+        m_modes.clear();
+        for (const drmModeModeInfo& mode : modes)
+        {
+            m_modes.push_back(DrmModeInfo(const_cast<drmModeModeInfoPtr>(&mode)));
+        }
+    }
+    dump();
+}
+
+void DrmModeConnector::getModes(std::vector<drmModeModeInfo>* modes)
+{
+    modes->resize(m_modes.size());
+    for (size_t i = 0; i < m_modes.size(); i++)
+    {
+        memset(&(*modes)[i], 0, sizeof(drmModeModeInfo));
+        m_modes[i].getModeInfo(&(*modes)[i]);
+    }
+}
+
+bool DrmModeConnector::isSameModes(const std::vector<drmModeModeInfo>& a, const std::vector<drmModeModeInfo>& b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (!(DrmModeInfo(const_cast<drmModeModeInfoPtr>(&a[i])) == b[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 int32_t DrmModeConnector::getSupportedMode(uint32_t *modeinfo)
 {
     int32_t mode_id = -1;
@@ -411,6 +452,47 @@ int32_t DrmModeConnector::getEDID(int fd, uint32_t *edid)
     return res;
 }
 
+uint64_t DrmModeConnector::getEDIDChecksum(int fd, uint32_t* blob_id)
+{
+    *blob_id = 0;
+
+    // drmModeGetConnectorCurrent() returns the state of the last detect without a probe
+    drmModeConnectorPtr c = drmModeGetConnectorCurrent(fd, m_id);
+    if (c == nullptr)
+    {
+        HWC_LOGW("%s failed to get connector %d", __func__, m_id);
+        return 0;
+    }
+
+    uint64_t checksum = 0;
+    if (c->connection == DRM_MODE_CONNECTED)
+    {
+        for (int i = 0; i < c->count_props && *blob_id == 0; i++)
+        {
+            drmModePropertyPtr p = drmModeGetProperty(fd, c->props[i]);
+            if (!p)
+            {
+                continue;
+            }
+
+            if (!strcmp("EDID", p->name) && c->prop_values[i] != 0)
+            {
+                *blob_id = static_cast<uint32_t>(c->prop_values[i]);
+                drmModePropertyBlobPtr blob = drmModeGetPropertyBlob(fd, *blob_id);
+                if (blob)
+                {
+                    checksum = DrmEdidCache::getChecksum(blob->data, blob->length);
+                    drmModeFreePropertyBlob(blob);
+                }
+            }
+            drmModeFreeProperty(p);
+        }
+    }
+    drmModeFreeConnector(c);
+
+    return checksum;
+}
+
 int32_t DrmModeConnector::getColorspaceAndDepth(int fd, uint32_t *colordepth)
 {
     bool find_prop = false;
@@ -67,11 +67,18 @@ public:
     int connectEncoder(DrmModeEncoder *encoder);
 
     int setDrmModeInfo(drmModeConnectorPtr c);
+    // setModes() and getModes() exchange the mode list with the EDID cache
+    void setModes(const std::vector<drmModeModeInfo>& modes);
+    void getModes(std::vector<drmModeModeInfo>* modes);
+    static bool isSameModes(const std::vector<drmModeModeInfo>& a, const std::vector<drmModeModeInfo>& b);
 
     void dump();
 
     int32_t getSupportedMode(uint32_t *modeinfo);
     int32_t getEDID(int fd, uint32_t *edid);
+    // getEDIDChecksum() hashes the EDID blob of a connected sink without a probe, 0 if there is none.
+    // blob_id changes whenever the driver reads the EDID again
+    uint64_t getEDIDChecksum(int fd, uint32_t* blob_id);
     int32_t mapModeToEDID(const uint32_t w, const uint32_t h, const uint32_t vrefresh);
     int32_t getColorspaceAndDepth(int fd, uint32_t *colordepth);
     int32_t setColorspaceAndDepth(int fd, uint32_t colordepth);
@@ -52,6 +52,7 @@ enum DRM_PROP_CRTC_ENUM
     DRM_PROP_CRTC_OUTPUT_SCENARIO,
     DRM_PROP_CRTC_CAPS_BLOB_ID,
     DRM_PROP_CRTC_BOOTLOGO_DISABLE,
+    DRM_PROP_CRTC_OUT_FENCE_PTR,
     DRM_PROP_CRTC_MAX,
 };
 
@@ -155,6 +156,7 @@ private:
         {DRM_PROP_CRTC_OUTPUT_SCENARIO, std::string("OUTPUT_SCENARIO")},
         {DRM_PROP_CRTC_CAPS_BLOB_ID, std::string("CAPS_BLOB_ID")},
         {DRM_PROP_CRTC_BOOTLOGO_DISABLE, std::string("BOOTLOGO_DISABLE")},
+        {DRM_PROP_CRTC_OUT_FENCE_PTR, std::string("OUT_FENCE_PTR")},
     };
 
     std::vector<DrmModePlane*> m_planes;
@@ -19,7 +19,9 @@
 #include "drmmodeencoder.h"
 #include "drmmodeconnector.h"
 #include "drmmodeplane.h"
+#include "drmedidcache.h"
 #include "drmmodeutils.h"
+#include "memory_tracker.h"
 
 #ifdef USE_SWWATCHDOG
 #include "utils/swwatchdog.h"
@@ -931,6 +933,11 @@ int DrmModeResource::allocateBuffer(struct hwc_drm_bo *fb_bo)
     create_arg.width = fb_bo->width;
     create_arg.height = fb_bo->height;
     HWC_LOGD("allocateBuffer: %ux%u  format:0x%08x", fb_bo->width, fb_bo->height, fb_bo->format);
+    const size_t reserved = static_cast<size_t>(create_arg.width) * create_arg.height * create_arg.bpp / 8;
+    if (!MemoryTracker::getInstance().reserve(reserved))
+    {
+        return -ENOMEM;
+    }
     {
         ATRACE_NAME("DRM_IOCTL_MODE_CREATE_DUMB");
 #ifdef USE_SWWATCHDOG
@@ -942,12 +949,15 @@ int DrmModeResource::allocateBuffer(struct hwc_drm_bo *fb_bo)
     {
         HWC_LOGE("%s: failed to create dumb buffer: %s (wxh=%ux%u bpp=%u)",
                 __func__, strerror(errno), create_arg.width, create_arg.height, create_arg.bpp);
+        MemoryTracker::getInstance().cancel(reserved);
         return res;
     }
 
     fb_bo->pitches[0] = create_arg.pitch;
     fb_bo->gem_handles[0] = create_arg.handle;
     fb_bo->offsets[0] = 0;
+    MemoryTracker::getInstance().commit(reserved, MemoryTracker::getDumbBufferId(create_arg.handle),
+                                        MemoryTracker::OWNER_DRM_DUMB, -1, create_arg.size);
     res = addFb(fb_bo);
     if (res)
     {
@@ -956,6 +966,7 @@ int DrmModeResource::allocateBuffer(struct hwc_drm_bo *fb_bo)
         memset(&destroy_arg, 0, sizeof (destroy_arg));
         destroy_arg.handle = fb_bo->gem_handles[0];
         drmIoctl(DRM_IOCTL_MODE_DESTROY_DUMB, &destroy_arg);
+        MemoryTracker::getInstance().remove(MemoryTracker::getDumbBufferId(create_arg.handle));
         return res;
     }
 
@@ -981,6 +992,7 @@ int DrmModeResource::freeBuffer(struct hwc_drm_bo &fb_bo)
 #endif
         res = drmIoctl(DRM_IOCTL_MODE_DESTROY_DUMB, &destroy_arg);
     }
+    MemoryTracker::getInstance().remove(MemoryTracker::getDumbBufferId(destroy_arg.handle));
     return res;
 }
 
@@ -1313,58 +1325,107 @@ void DrmModeResource::dump(String8* str)
     }
 }
 
-int32_t DrmModeResource::updateConnectorModeToMaximumResolution(uint64_t dpy, uint32_t id_crtc)
+DrmModeConnector* DrmModeResource::getConnectorByCrtc(uint64_t dpy, uint32_t id_crtc, const char* func)
 {
-    int fd = getFd();
     DrmModeCrtc *crtc = getCrtc(id_crtc);
     if (crtc == nullptr)
     {
-        HWC_LOGE("(%" PRIu64 ":%u) %s crtc is nullptr", dpy, id_crtc, __func__);
-        return NO_INIT;
+        HWC_LOGE("(%" PRIu64 ":%u) %s crtc is nullptr", dpy, id_crtc, func);
+        return nullptr;
     }
 
     DrmModeEncoder *encoder = crtc->getEncoder();
     if (encoder == nullptr)
     {
-        HWC_LOGE("(%" PRIu64 ":%u) %s encoder is nullptr", dpy, id_crtc, __func__);
-        return NO_INIT;
+        HWC_LOGE("(%" PRIu64 ":%u) %s encoder is nullptr", dpy, id_crtc, func);
+        return nullptr;
     }
 
     DrmModeConnector *connector = encoder->getConnector();
     if (connector == nullptr)
     {
-        HWC_LOGE("(%" PRIu64 ":%u) %s connector is nullptr", dpy, id_crtc, __func__);
+        HWC_LOGE("(%" PRIu64 ":%u) %s connector is nullptr", dpy, id_crtc, func);
+        return nullptr;
+    }
+
+    return connector;
+}
+
+int32_t DrmModeResource::probeConnector(uint64_t dpy, DrmModeConnector* connector,
+        std::vector<drmModeModeInfo>* modes)
+{
+    ATRACE_CALL();
+
+    // drmModeGetConnector() triggers the driver to read the edid
+    drmModeConnectorPtr c = drmModeGetConnector(getFd(), connector->getId());
+    if (!c)
+    {
+        HWC_LOGW("(%" PRIu64 ") failed to probe connector %u", dpy, connector->getId());
         return NO_INIT;
     }
+    HWC_LOGI("(%" PRIu64 ") probe connector c_id:%d c_encoder_id:%d mode_count:%d",
+            dpy, c->connector_id, c->encoder_id, c->count_modes);
 
-    drmModeResPtr res = drmModeGetResources(fd);
-    if (res == nullptr)
+    modes->clear();
+    for (int i = 0; i < c->count_modes; i++)
+    {
+        modes->push_back(c->modes[i]);
+    }
+    drmModeFreeConnector(c);
+
+    return NO_ERROR;
+}
+
+int32_t DrmModeResource::updateConnectorModeToMaximumResolution(uint64_t dpy, uint32_t id_crtc)
+{
+    DrmModeCrtc *crtc = getCrtc(id_crtc);
+    DrmModeConnector *connector = getConnectorByCrtc(dpy, id_crtc, __func__);
+    if (connector == nullptr)
     {
-        HWC_LOGE("(%" PRIu64 ":%u) %s display configuration information is nullptr", dpy, id_crtc, __func__);
         return NO_INIT;
     }
 
-    for (int i = 0; i < res->count_connectors; i++)
+    // the modes are still valid if a probe has confirmed them for the edid which
+    // the driver shows now, unverified modes from the cache are probed
+    uint32_t blob_id = 0;
+    const uint64_t checksum = connector->getEDIDChecksum(getFd(), &blob_id);
+    bool need_probe = true;
     {
-        drmModeConnectorPtr c = drmModeGetConnector(fd, res->connectors[i]);
-        if (!c)
+        std::lock_guard<std::mutex> lock(m_connector_edid_lock);
+        auto it = m_connector_edid.find(connector->getId());
+        if (it != m_connector_edid.end() && checksum != 0 && it->second.verified &&
+                it->second.checksum == checksum && it->second.blob_id == blob_id)
         {
-            HWC_LOGW("failed to get connector when updateConnectorMode [%d]: %d", i, res->connectors[i]);
-            drmModeFreeConnector(c);
-            return NO_INIT;
+            need_probe = false;
         }
-        HWC_LOGI("updateConnectorMode c_id:%d c_encoder_id:%d current_id:%d mode_count:%d",
-                c->connector_id, c->encoder_id, connector->getId(),c->count_modes);
-        if (c->connector_id == connector->getId())
+    }
+
+    if (need_probe)
+    {
+        std::vector<drmModeModeInfo> modes;
+        if (probeConnector(dpy, connector, &modes) != NO_ERROR)
         {
-            connector->setDrmModeInfo(c);
-            drmModeFreeConnector(c);
-            break;
+            return NO_INIT;
         }
-        else
+        connector->setModes(modes);
+
+        // the probe may update the edid blob
+        uint32_t probed_blob_id = 0;
+        const uint64_t probed_checksum = connector->getEDIDChecksum(getFd(), &probed_blob_id);
+        if (probed_checksum != 0)
         {
-            drmModeFreeConnector(c);
+            DrmEdidCache::getInstance().put(probed_checksum, modes, true);
         }
+
+        std::lock_guard<std::mutex> lock(m_connector_edid_lock);
+        ConnectorEdidState& state = m_connector_edid[connector->getId()];
+        state.checksum = probed_checksum;
+        state.blob_id = probed_blob_id;
+        state.verified = true;
+    }
+    else
+    {
+        HWC_LOGI("(%" PRIu64 ") %s: keep the modes of edid %016" PRIx64, dpy, __func__, checksum);
     }
 
     DrmModeInfo mode;
@@ -1378,8 +1439,6 @@ int32_t DrmModeResource::updateConnectorModeToMaximumResolution(uint64_t dpy, ui
         ret = NO_INIT;
     }
 
-    drmModeFreeResources(res);
-
     return ret;
 }
 
@@ -1411,60 +1470,118 @@ int32_t DrmModeResource::getSpportedConnectorMode(uint64_t dpy, uint32_t id_crtc
 
 int32_t DrmModeResource::getConnectorEDID(uint64_t dpy, uint32_t id_crtc, uint32_t *edid)
 {
-    int fd = getFd();
-    DrmModeCrtc *crtc = getCrtc(id_crtc);
-    if (crtc == nullptr)
+    DrmModeConnector *connector = getConnectorByCrtc(dpy, id_crtc, __func__);
+    if (connector == nullptr)
     {
-        HWC_LOGE("%" PRIu64 ":%u) %s crtc is nullptr", dpy, id_crtc, __func__);
         return NO_INIT;
     }
 
-    DrmModeEncoder *encoder = crtc->getEncoder();
-    if (encoder == nullptr)
+    // the edid blob is only the key of the sink if the driver has read it again after
+    // the last detect, i.e. it is not the blob which we saw at the previous plug
+    uint32_t blob_id = 0;
+    uint64_t checksum = connector->getEDIDChecksum(getFd(), &blob_id);
     {
-        HWC_LOGE("%" PRIu64 ":%u) %s encoder is nullptr", dpy, id_crtc, __func__);
-        return NO_INIT;
+        std::lock_guard<std::mutex> lock(m_connector_edid_lock);
+        auto it = m_connector_edid.find(connector->getId());
+        if (it != m_connector_edid.end() && it->second.blob_id == blob_id)
+        {
+            checksum = 0;
+        }
     }
 
-    DrmModeConnector *connector = encoder->getConnector();
-    if (connector == nullptr)
+    // a known sink takes the modes from the cache, verifyConnectorEDID() probes it later
+    std::vector<drmModeModeInfo> modes;
+    bool verified = false;
+    const bool hit = checksum != 0 && DrmEdidCache::getInstance().get(checksum, &modes, &verified);
+    if (!hit)
     {
-        HWC_LOGE("%" PRIu64 ":%u) %s connector is nullptr", dpy, id_crtc, __func__);
-        return NO_INIT;
+        if (probeConnector(dpy, connector, &modes) != NO_ERROR)
+        {
+            return NO_INIT;
+        }
+
+        // the probe may update the edid blob
+        checksum = connector->getEDIDChecksum(getFd(), &blob_id);
+        if (checksum != 0)
+        {
+            DrmEdidCache::getInstance().put(checksum, modes, true);
+        }
     }
+    connector->setModes(modes);
 
-    drmModeResPtr res = drmModeGetResources(fd);
-    if (res == nullptr)
+    HWC_LOGI("(%" PRIu64 ") %s: edid %016" PRIx64 " blob:%u modes:%zu hit:%d verified:%d",
+            dpy, __func__, checksum, blob_id, modes.size(), hit, verified);
+    {
+        std::lock_guard<std::mutex> lock(m_connector_edid_lock);
+        ConnectorEdidState& state = m_connector_edid[connector->getId()];
+        state.checksum = checksum;
+        state.blob_id = blob_id;
+        state.verified = !hit;
+    }
+
+    return connector->getEDID(getFd(), edid);
+}
+
+int32_t DrmModeResource::verifyConnectorEDID(uint64_t dpy, uint32_t id_crtc, bool* changed)
+{
+    *changed = false;
+
+    DrmModeConnector *connector = getConnectorByCrtc(dpy, id_crtc, __func__);
+    if (connector == nullptr)
     {
-        HWC_LOGE("%" PRIu64 ":%u) %s display configuration information is nullptr", dpy, id_crtc, __func__);
         return NO_INIT;
     }
 
-    for (int i = 0; i < res->count_connectors; i++)
+    uint64_t cached_checksum = 0;
     {
-        // trigger driver read edid
-        drmModeConnectorPtr c = drmModeGetConnector(fd, res->connectors[i]);
-        if (!c)
-        {
-            HWC_LOGW("failed to get connector when updateConnectorMode [%d]: %d", i, res->connectors[i]);
-            drmModeFreeConnector(c);
-            return NO_INIT;
-        }
-        HWC_LOGI("updateConnectorMode c_id:%d c_encoder_id:%d current_id:%d mode_count:%d",
-                c->connector_id, c->encoder_id, connector->getId(),c->count_modes);
-        if (c->connector_id == connector->getId())
+        std::lock_guard<std::mutex> lock(m_connector_edid_lock);
+        auto it = m_connector_edid.find(connector->getId());
+        if (it == m_connector_edid.end() || it->second.verified)
         {
-            connector->setDrmModeInfo(c);
-            drmModeFreeConnector(c);
-            break;
+            // the modes come from a probe already
+            return NO_ERROR;
         }
-        else
+        cached_checksum = it->second.checksum;
+    }
+
+    // every cache hit is probed, the same edid blob does not prove that the driver
+    // parses the same modes from it
+    std::vector<drmModeModeInfo> modes;
+    int32_t res = probeConnector(dpy, connector, &modes);
+    if (res != NO_ERROR)
+    {
+        return res;
+    }
+    uint32_t blob_id = 0;
+    const uint64_t checksum = connector->getEDIDChecksum(getFd(), &blob_id);
+
+    std::vector<drmModeModeInfo> cached_modes;
+    connector->getModes(&cached_modes);
+    const bool match = checksum == cached_checksum && DrmModeConnector::isSameModes(modes, cached_modes);
+    DrmEdidCache::getInstance().addVerifyResult(cached_checksum, match);
+
+    {
+        std::lock_guard<std::mutex> lock(m_connector_edid_lock);
+        ConnectorEdidState& state = m_connector_edid[connector->getId()];
+        state.checksum = checksum;
+        state.blob_id = blob_id;
+        // updateConnectorMode() has to probe again if the modes are stale
+        state.verified = match;
+    }
+
+    if (!match)
+    {
+        HWC_LOGW("(%" PRIu64 ") %s: stale edid cache %016" PRIx64 " -> %016" PRIx64 " modes:%zu -> %zu",
+                dpy, __func__, cached_checksum, checksum, cached_modes.size(), modes.size());
+        DrmEdidCache::getInstance().remove(cached_checksum);
+        if (checksum != 0)
         {
-            drmModeFreeConnector(c);
+            DrmEdidCache::getInstance().put(checksum, modes, true);
         }
+        *changed = true;
     }
 
-    return connector->getEDID(getFd(), edid);
+    return NO_ERROR;
 }
 
 int32_t DrmModeResource::setHDMIMode(uint64_t dpy, uint32_t id_crtc, uint32_t enable)
@@ -12,6 +12,7 @@
 
 #include <linux/mediatek_drm.h>
 
+#include <map>
 #include <mutex>
 #include <utils/Timers.h>
 #include <unordered_set>
@@ -93,8 +94,11 @@ public:
     int32_t updateConnectorModeToMaximumResolution(uint64_t dpy, uint32_t id_crtc);
     // getSpportedConnectorMode use for get connector's supported mode for changing mode
     int32_t getSpportedConnectorMode(uint64_t dpy, uint32_t id_crtc, uint32_t *modeinfo);
-    // getConnectorEDID use for get connector's edid
+    // getConnectorEDID use for get connector's edid, a known sink takes its modes from the EDID cache
     int32_t getConnectorEDID(uint64_t dpy, uint32_t id_crtc, uint32_t *edid);
+    // verifyConnectorEDID probes the connector whose modes come from the EDID cache,
+    // changed is set if the cached modes are stale
+    int32_t verifyConnectorEDID(uint64_t dpy, uint32_t id_crtc, bool* changed);
     // setHDMIMode to turn on or off hdmi driver
     int32_t setHDMIMode(uint64_t dpy, uint32_t id_crtc, uint32_t enable);
     uint32_t getHDMIMode(uint64_t dpy, uint32_t id_crtc);
@@ -116,6 +120,10 @@ private:
     void arrangeResource();
     void initDimFbId();
 
+    DrmModeConnector* getConnectorByCrtc(uint64_t dpy, uint32_t id_crtc, const char* func);
+    // probeConnector() makes the driver read the EDID of the sink again and returns its modes
+    int32_t probeConnector(uint64_t dpy, DrmModeConnector* connector, std::vector<drmModeModeInfo>* modes);
+
 private:
     int m_fd;
 
@@ -135,6 +143,18 @@ private:
 
     mtk_drm_disp_caps_info m_caps_info;
 
+    // the EDID which the modes of a connector belong to, keyed by connector id
+    struct ConnectorEdidState
+    {
+        uint64_t checksum = 0;
+        // the edid blob seen at the last read, the driver creates a new one when it reads the edid
+        uint32_t blob_id = 0;
+        // a probe has confirmed the modes, cached modes are not verified until verifyConnectorEDID()
+        bool verified = false;
+    };
+    std::map<uint32_t, ConnectorEdidState> m_connector_edid;
+    std::mutex m_connector_edid_lock;
+
     uint32_t m_hdmi_enable;
     uint32_t m_dp_enable;
     uint32_t m_edp_enable;
@@ -3,11 +3,13 @@
 #include "glai_controller.h"
 
 #include "utils/debug.h"
+#include "utils/tools.h"
 
 #include <NpAgentShim.h>
 
 #include <utils/String8.h>
 
+#include <algorithm>
 #include <sstream>
 #include <vector>
 
@@ -27,34 +29,29 @@ GlaiController::GlaiController()
 {
 }
 
-int GlaiController::loadModel(int& agent_id, const buffer_handle_t& handle)
+void GlaiController::setModelBudget(size_t max_count, size_t mem_budget)
 {
-    HWC_ATRACE_CALL();
-#ifdef USE_SWWATCHDOG
-    SWWatchDog::AutoWDT _wdt("[GLAI_CTRL] loadModel", 500);
-#endif
-
-    HWC_LOGI("%s(), agent_id %d", __FUNCTION__, agent_id);
-
-    m_model.valid = false;
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-    m_model.agent_id = NpAgent_gpuCreate(handle);
-    if (m_model.agent_id <= 0)
-    {
-        HWC_LOGE("NpAgent_gpuCreate fail, ret %d", m_model.agent_id);
-        return -EINVAL;
-    }
+    HWC_LOGI("%s(), max_count %zu, mem_budget %zu", __FUNCTION__, max_count, mem_budget);
 
-    agent_id = m_model.agent_id;
+    // keep at least one model, otherwise no glai layer can work
+    m_max_model_count = max_count > 0 ? max_count : 1;
+    m_mem_budget = mem_budget;
+    evictModelsLocked();
+}
 
+int GlaiController::queryModelAttributesLocked(Model* model)
+{
+    const int agent_id = model->agent_id;
     NpAgentAttributes* attributes = nullptr;
     int ret = 0;
-    ret = NpAgentAttributes_create(m_model.agent_id, &attributes);
+    ret = NpAgentAttributes_create(agent_id, &attributes);
     if (ret != RESULT_NO_ERROR) {
         return ret;
     }
 
-    ret = NpAgentAttributes_getInputFormat(attributes, &m_model.in_format);
+    ret = NpAgentAttributes_getInputFormat(attributes, &model->in_format);
     if (ret != RESULT_NO_ERROR)
     {
         HWC_LOGE("NpAgentAttributes_getInputFormat, agent_id %d, ret %d", agent_id, ret);
@@ -62,7 +59,7 @@ int GlaiController::loadModel(int& agent_id, const buffer_handle_t& handle)
         return ret;
     }
 
-    ret = NpAgentAttributes_getOutputFormat(attributes, &m_model.out_format);
+    ret = NpAgentAttributes_getOutputFormat(attributes, &model->out_format);
     if (ret != RESULT_NO_ERROR)
     {
         HWC_LOGE("NpAgentAttributes_getOutputFormat, agent_id %d, ret %d", agent_id, ret);
@@ -78,7 +75,7 @@ int GlaiController::loadModel(int& agent_id, const buffer_handle_t& handle)
         NpAgentAttributes_release(attributes);
         return ret;
     }
-    m_model.in_compress = value != COMPRESSION_NONE;
+    model->in_compress = value != COMPRESSION_NONE;
 
     ret = NpAgentAttributes_getOutputCompressionMode(attributes, &value);
     if (ret != RESULT_NO_ERROR)
@@ -87,9 +84,9 @@ int GlaiController::loadModel(int& agent_id, const buffer_handle_t& handle)
         NpAgentAttributes_release(attributes);
         return ret;
     }
-    m_model.out_compress = value != COMPRESSION_NONE;
+    model->out_compress = value != COMPRESSION_NONE;
 
-    ret = NpAgentAttributes_getInputHeightWidth(attributes, &m_model.in_h, &m_model.in_w);
+    ret = NpAgentAttributes_getInputHeightWidth(attributes, &model->in_h, &model->in_w);
     if (ret != RESULT_NO_ERROR)
     {
         HWC_LOGE("NpAgentAttributes_getInputHeightWidth, agent_id %d, ret %d", agent_id, ret);
@@ -97,7 +94,7 @@ int GlaiController::loadModel(int& agent_id, const buffer_handle_t& handle)
         return ret;
     }
 
-    ret = NpAgentAttributes_getOutputHeightWidth(attributes, &m_model.out_h, &m_model.out_w);
+    ret = NpAgentAttributes_getOutputHeightWidth(attributes, &model->out_h, &model->out_w);
     if (ret != RESULT_NO_ERROR)
     {
         HWC_LOGE("NpAgentAttributes_getOutputHeightWidth, agent_id %d, ret %d", agent_id, ret);
@@ -105,7 +102,7 @@ int GlaiController::loadModel(int& agent_id, const buffer_handle_t& handle)
         return ret;
     }
 
-    ret = NpAgentAttributes_getInputStride(attributes, &m_model.in_stride);
+    ret = NpAgentAttributes_getInputStride(attributes, &model->in_stride);
     if (ret != RESULT_NO_ERROR)
     {
         HWC_LOGE("NpAgentAttributes_getInputStride, agent_id %d, ret %d", agent_id, ret);
@@ -113,7 +110,7 @@ int GlaiController::loadModel(int& agent_id, const buffer_handle_t& handle)
         return ret;
     }
 
-    ret = NpAgentAttributes_getOutputStride(attributes, &m_model.out_stride);
+    ret = NpAgentAttributes_getOutputStride(attributes, &model->out_stride);
     if (ret != RESULT_NO_ERROR)
     {
         HWC_LOGE("NpAgentAttributes_getOutputStride, agent_id %d, ret %d", agent_id, ret);
@@ -123,57 +120,194 @@ int GlaiController::loadModel(int& agent_id, const buffer_handle_t& handle)
 
     NpAgentAttributes_release(attributes);
 
-    m_model.valid = true;
-    dump(nullptr);
+    // NeuroPilot does not report the real footprint of a model, so estimate it
+    // with the size of its input and output tensors
+    model->mem_size = static_cast<size_t>(model->in_stride) * model->in_h *
+                      (getBitsPerPixel(model->in_format) / 8) +
+                      static_cast<size_t>(model->out_stride) * model->out_h *
+                      (getBitsPerPixel(model->out_format) / 8);
+    return 0;
+}
+
+int GlaiController::loadModelLocked(int& agent_id, const buffer_handle_t& handle)
+{
+    HWC_ATRACE_CALL();
+#ifdef USE_SWWATCHDOG
+    SWWatchDog::AutoWDT _wdt("[GLAI_CTRL] loadModel", 500);
+#endif
+
+    HWC_LOGI("%s(), agent_id %d", __FUNCTION__, agent_id);
+
+    // HWC cannot tell two models apart by the input buffer, so a new layer always asks
+    // NeuroPilot, which gives back the id of a resident model when it is the same one
+    const nsecs_t start = systemTime();
+
+    const int new_id = NpAgent_gpuCreate(handle);
+    if (new_id <= 0)
+    {
+        HWC_LOGE("NpAgent_gpuCreate fail, ret %d", new_id);
+        return -EINVAL;
+    }
+
+    agent_id = new_id;
+
+    auto iter = m_models.find(new_id);
+    if (iter != m_models.end())
+    {
+        // NeuroPilot gave back a model which is still resident, so the attributes
+        // we cached are still good, and there is no need to query them again
+        iter->second.create_count++;
+        iter->second.layer_ref++;
+        iter->second.valid = true;
+        m_load_stat.reuse_count++;
+        touchModelLocked(new_id);
+        return 0;
+    }
+
+    Model model;
+    model.agent_id = new_id;
+    model.create_count = 1;
+    int ret = queryModelAttributesLocked(&model);
+    if (ret)
+    {
+        NpAgent_release(new_id);
+        return ret;
+    }
+
+    const nsecs_t latency = systemTime() - start;
+    m_load_stat.load_count++;
+    m_load_stat.last_latency = latency;
+    m_load_stat.total_latency += latency;
+    m_load_stat.max_latency = std::max(m_load_stat.max_latency, latency);
+    m_load_stat.min_latency = std::min(m_load_stat.min_latency, latency);
+
+    model.valid = true;
+    model.layer_ref = 1;
+    model.load_time = latency;
+    m_mem_usage += model.mem_size;
+    m_models.emplace(new_id, model);
+    touchModelLocked(new_id);
+
+    evictModelsLocked();
+
+    dumpLocked(nullptr);
     return 0;
 }
 
-const GlaiController::Model* GlaiController::getModel(const int agent_id) const
+void GlaiController::touchModelLocked(const int agent_id)
 {
-    if (m_model.valid)
+    auto iter = m_models.find(agent_id);
+    if (iter == m_models.end())
     {
-        if (m_model.agent_id != agent_id)
+        return;
+    }
+
+    iter->second.last_used = systemTime();
+    m_lru.remove(agent_id);
+    m_lru.push_front(agent_id);
+}
+
+void GlaiController::releaseModelLocked(std::map<int, Model>::iterator iter)
+{
+    HWC_ATRACE_CALL();
+#ifdef USE_SWWATCHDOG
+    SWWatchDog::AutoWDT _wdt("[GLAI_CTRL] releaseModel", 500);
+#endif
+
+    const int agent_id = iter->first;
+    HWC_LOGI("%s(), agent_id %d, create_count %u", __FUNCTION__, agent_id, iter->second.create_count);
+
+    // release once for each NpAgent_gpuCreate() which returned this id
+    for (uint32_t i = 0; i < iter->second.create_count; i++)
+    {
+        NpAgent_release(agent_id);
+    }
+
+    m_mem_usage -= std::min(m_mem_usage, iter->second.mem_size);
+    m_models.erase(iter);
+    m_lru.remove(agent_id);
+}
+
+void GlaiController::evictModelsLocked()
+{
+    // walk from the least recently used one, and only evict idle models,
+    // because a model still referenced by a layer may be in inference now
+    auto lru_iter = m_lru.end();
+    while (lru_iter != m_lru.begin() &&
+           (m_models.size() > m_max_model_count || m_mem_usage > m_mem_budget))
+    {
+        --lru_iter;
+        auto iter = m_models.find(*lru_iter);
+        if (iter == m_models.end())
+        {
+            lru_iter = m_lru.erase(lru_iter);
+            continue;
+        }
+
+        if (iter->second.layer_ref > 0)
         {
-            HWC_LOGW("%s(), with wrong id %d", __FUNCTION__, agent_id);
-            dump(nullptr);
-            return nullptr;
+            continue;
         }
 
-        return &m_model;
+        // releaseModelLocked() erases the lru entry, so move to the next one first
+        ++lru_iter;
+        releaseModelLocked(iter);
+        m_load_stat.evict_count++;
     }
-    else
+
+    if (m_models.size() > m_max_model_count || m_mem_usage > m_mem_budget)
+    {
+        HWC_LOGW("%s(), over budget by active models, count %zu/%zu, mem %zu/%zu",
+                 __FUNCTION__, m_models.size(), m_max_model_count, m_mem_usage, m_mem_budget);
+    }
+}
+
+bool GlaiController::getModel(const int agent_id, Model* out_model) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto iter = m_models.find(agent_id);
+    if (iter == m_models.end() || !iter->second.valid)
     {
         HWC_LOGW("%s(), id %d while model not valid", __FUNCTION__, agent_id);
-        return nullptr;
+        return false;
+    }
+
+    if (out_model)
+    {
+        *out_model = iter->second;
     }
+    return true;
 }
 
 int GlaiController::cleanModel(const int agent_id)
 {
     HWC_ATRACE_CALL();
-    #ifdef USE_SWWATCHDOG
-        SWWatchDog::AutoWDT _wdt("[GLAI_CTRL] cleanModel", 500);
-    #endif
+
+    std::lock_guard<std::mutex> lock(m_mutex);
 
     HWC_LOGI("%s(), agent_id %d", __FUNCTION__, agent_id);
 
-    if (m_model.valid)
+    auto iter = m_models.find(agent_id);
+    if (iter == m_models.end())
     {
-        if (m_model.agent_id != agent_id)
-        {
-            HWC_LOGW("%s(), with wrong id %d", __FUNCTION__, agent_id);
-            dump(nullptr);
-            return -EINVAL;
-        }
+        HWC_LOGW("%s(), id %d while model not valid", __FUNCTION__, agent_id);
+        return -EINVAL;
+    }
 
-        NpAgent_release(agent_id);
-        m_model.valid = false;
+    // keep the model resident, another layer may use the same model soon.
+    // it is released when the registry needs room for other models.
+    if (iter->second.layer_ref > 0)
+    {
+        iter->second.layer_ref--;
     }
-    else
+
+    if (iter->second.layer_ref == 0)
     {
-        HWC_LOGW("%s(), id %d while model not valid", __FUNCTION__, agent_id);
-        return -EINVAL;
+        iter->second.valid = false;
     }
+
+    evictModelsLocked();
     return 0;
 }
 
@@ -189,31 +323,37 @@ int GlaiController::isGlaiLayerValid(int& agent_id,
     HWC_ATRACE_CALL();
     int val_result = VAL_FAIL;
 
-    if (m_model.valid)
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto iter = agent_id > 0 ? m_models.find(agent_id) : m_models.end();
+    if (iter != m_models.end())
     {
-        if (m_model.agent_id != agent_id)
-        {
-            HWC_LOGE("unexpected two agent_id at the same time");
-            dump(nullptr);
-            return val_result;
-        }
+        touchModelLocked(agent_id);
     }
     else
     {
         if (agent_id > 0)
         {
-            HWC_LOGE("agent_id %d already > 0? resoruce leak?", agent_id)
+            HWC_LOGW("agent_id %d is not resident, reload it", agent_id);
         }
 
-        int ret = loadModel(agent_id, handle);
+        int ret = loadModelLocked(agent_id, handle);
         if (ret)
         {
             HWC_LOGE("loadModel fail");
             return val_result;
         }
         val_result |= VAL_MODEL_LOADED;
+
+        iter = m_models.find(agent_id);
+        if (iter == m_models.end())
+        {
+            return val_result;
+        }
     }
 
+    const Model& model = iter->second;
+
 #ifdef USE_SWWATCHDOG
     SWWatchDog::AutoWDT _wdt("[GLAI_CTRL] validate", 500);
 #endif
@@ -230,30 +370,55 @@ int GlaiController::isGlaiLayerValid(int& agent_id,
 
     out_dst_roi.left = 0;
     out_dst_roi.top = 0;
-    out_dst_roi.right = static_cast<int>(m_model.out_w);
-    out_dst_roi.bottom = static_cast<int>(m_model.out_h);
-    out_fmt = m_model.out_format;
+    out_dst_roi.right = static_cast<int>(model.out_w);
+    out_dst_roi.bottom = static_cast<int>(model.out_h);
+    out_fmt = model.out_format;
     return val_result | VAL_OK;
 }
 
 void GlaiController::dump(String8* dump_str) const
 {
-    if (!m_model.valid)
+    std::lock_guard<std::mutex> lock(m_mutex);
+    dumpLocked(dump_str);
+}
+
+void GlaiController::dumpLocked(String8* dump_str) const
+{
+    std::ostringstream ss;
+    ss << "GlaiController:" << endl;
+    ss << "resident: " << m_models.size() << "/" << m_max_model_count
+       << " mem: " << m_mem_usage << "/" << m_mem_budget << endl;
+    ss << "load: count " << m_load_stat.load_count
+       << " reuse " << m_load_stat.reuse_count
+       << " evict " << m_load_stat.evict_count << endl;
+    if (m_load_stat.load_count > 0)
     {
-        if (dump_str)
+        ss << "load latency(us): last " << ns2us(m_load_stat.last_latency)
+           << " min " << ns2us(m_load_stat.min_latency)
+           << " max " << ns2us(m_load_stat.max_latency)
+           << " avg " << ns2us(m_load_stat.total_latency /
+                               static_cast<nsecs_t>(m_load_stat.load_count)) << endl;
+    }
+
+    // print in LRU order, the first one is the most recently used
+    for (const int agent_id : m_lru)
+    {
+        auto iter = m_models.find(agent_id);
+        if (iter == m_models.end())
         {
-            dump_str->appendFormat("GlaiController: model not valid");
+            continue;
         }
-        return;
-    }
 
-    std::ostringstream ss;
-    ss << "GlaiController:" << endl;
-    ss << "id: " << m_model.agent_id << endl;
-    ss << "format: in " << m_model.in_format << " out " << m_model.out_format << endl;
-    ss << "compress: in " << m_model.in_compress << " out " << m_model.out_compress << endl;
-    ss << "in: w " << m_model.in_w << " h " << m_model.in_h << " stride " << m_model.in_stride << endl;
-    ss << "out: w " << m_model.out_w << " h " << m_model.out_h << " stride " << m_model.out_stride << endl;
+        const Model& model = iter->second;
+        ss << "id: " << model.agent_id << " valid " << model.valid
+           << " layer_ref " << model.layer_ref
+           << " mem " << model.mem_size
+           << " load(us) " << ns2us(model.load_time) << endl;
+        ss << "  format: in " << model.in_format << " out " << model.out_format << endl;
+        ss << "  compress: in " << model.in_compress << " out " << model.out_compress << endl;
+        ss << "  in: w " << model.in_w << " h " << model.in_h << " stride " << model.in_stride << endl;
+        ss << "  out: w " << model.out_w << " h " << model.out_h << " stride " << model.out_stride << endl;
+    }
     ss << endl;
 
     if (dump_str)
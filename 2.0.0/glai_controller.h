@@ -2,6 +2,11 @@
 #define HWC_GLAI_CONTROLLER_H_
 
 #include <hardware/hwcomposer_defs.h>
+#include <utils/Timers.h>
+
+#include <list>
+#include <map>
+#include <mutex>
 
 // ---------------------------------------------------------------------------
 
@@ -55,6 +60,27 @@ public:
         uint32_t out_h = 0;
         uint32_t in_stride = 0;
         uint32_t out_stride = 0;
+
+        // registry bookkeeping
+        // number of hwc layers which still hold this agent_id
+        uint32_t layer_ref = 0;
+        // number of NpAgent_gpuCreate() which returned this agent_id
+        uint32_t create_count = 0;
+        // estimated memory held by the model, used for budget control
+        size_t mem_size = 0;
+        nsecs_t load_time = 0;
+        nsecs_t last_used = 0;
+    };
+
+    struct LoadStat
+    {
+        uint64_t load_count = 0;
+        uint64_t reuse_count = 0;
+        uint64_t evict_count = 0;
+        nsecs_t last_latency = 0;
+        nsecs_t max_latency = 0;
+        nsecs_t min_latency = INT64_MAX;
+        nsecs_t total_latency = 0;
     };
 
 public:
@@ -70,20 +96,43 @@ public:
 
     void dump(android::String8* dump_str) const;
 
-    const Model* getModel(const int agent_id) const;
+    // the returned model is a copy, because the registry may evict it at any time
+    bool getModel(const int agent_id, Model* out_model) const;
     int cleanModel(const int agent_id);
 
     int inference(InferenceParam& param);
 
     void setInferenceWoFence(bool in) { m_inference_wo_fence = in; }
 
+    // max_count is the number of resident models, mem_budget is in bytes.
+    // Idle models are evicted in LRU order once either limit is exceeded.
+    void setModelBudget(size_t max_count, size_t mem_budget);
+
 protected:
     GlaiController();
 
-    int loadModel(int& agent_id, const buffer_handle_t& handle);
+    int loadModelLocked(int& agent_id, const buffer_handle_t& handle);
+    int queryModelAttributesLocked(Model* model);
+
+    void touchModelLocked(const int agent_id);
+    void releaseModelLocked(std::map<int, Model>::iterator iter);
+    void evictModelsLocked();
+
+    void dumpLocked(android::String8* dump_str) const;
 
 protected:
-    Model m_model;
+    mutable std::mutex m_mutex;
+
+    // resident models, keyed by agent_id
+    std::map<int, Model> m_models;
+    // agent_id in LRU order, the front is the most recently used one
+    std::list<int> m_lru;
+
+    size_t m_max_model_count = 4;
+    size_t m_mem_budget = 64 * 1024 * 1024;
+    size_t m_mem_usage = 0;
+
+    LoadStat m_load_stat;
 
     bool m_inference_wo_fence = false;
 };
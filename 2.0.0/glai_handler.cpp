@@ -18,9 +18,13 @@
 #include "worker.h"
 #include "queue.h"
 #include "hwc2.h"
+#include "sync.h"
 
+#include <cutils/properties.h>
 #include <sync/sync.h>
 
+#include <algorithm>
+
 #include <utils/String8.h>
 
 using namespace mediatek::graphics::common;
@@ -37,9 +41,26 @@ bool force_copy = false;
 
 // ---------------------------------------------------------------------------
 
+// the number of glai frames which can be in flight for one layer, the default one lets
+// the inference of the next frame run while ovl still holds the two frames before it
+#define GLAI_PIPELINE_DEPTH_MIN 2
+#define GLAI_PIPELINE_DEPTH_DEFAULT 3
+#define GLAI_PIPELINE_DEPTH_MAX 3
+
+// keep at most this number of frames for latency statistics
+#define GLAI_MAX_TRACKED_FRAMES 8
+
 GlaiHandler::GlaiHandler(uint64_t dpy, const sp<OverlayEngine>& ovl_engine)
     : LayerHandler(dpy, ovl_engine)
+    , m_pipeline_depth(GLAI_PIPELINE_DEPTH_DEFAULT)
 {
+    char value[PROPERTY_VALUE_MAX] = {0};
+    property_get("vendor.debug.hwc.glai_pipeline_depth", value, "-1");
+    const int depth = atoi(value);
+    if (depth != -1)
+    {
+        m_pipeline_depth = std::clamp(depth, GLAI_PIPELINE_DEPTH_MIN, GLAI_PIPELINE_DEPTH_MAX);
+    }
 }
 
 GlaiHandler::~GlaiHandler()
@@ -111,6 +132,12 @@ void GlaiHandler::set(const sp<HWCDisplay>& display, DispatcherJob* job)
                                   (getBitsPerPixel(disp_buffer.data_format) / 8);
                 int inference_done_fence = -1;
 
+                // if ovl has released the output buffer, this inference can run
+                // while the previous frame is still on screen
+                const bool out_buf_free = disp_buffer.release_fence < 0 ||
+                        SyncFence::queryFenceStatus(disp_buffer.release_fence) == 1;
+                const nsecs_t issue_ts = systemTime();
+
                 GlaiController::InferenceParam param{ .agent_id = hw_layer->glai_agent_id,
                                                       .in_fd = priv_handle.ion_fd,
                                                       .in_size = in_size,
@@ -153,6 +180,13 @@ void GlaiHandler::set(const sp<HWCDisplay>& display, DispatcherJob* job)
 
                 queue->queueBuffer(&disp_buffer);
 
+                // the ovl release fence of the previous buffer signals when this frame is
+                // on screen, so keep it for the inference-to-present latency
+                const int prev_rel_fence = queue->getReleaseFence();
+                trackInference(hwc_layer, issue_ts, out_buf_free,
+                               inference_done_fence >= 0 ? dup(inference_done_fence) : -1,
+                               prev_rel_fence >= 0 ? dup(prev_rel_fence) : -1);
+
                 if (isNoDispatchThread())
                 {
                     OverlayPortParam* const* ovl_params = m_ovl_engine->getInputParams();
@@ -359,15 +393,18 @@ sp<DisplayBufferQueue> GlaiHandler::getDisplayBufferQueue(HWLayer *hw_layer)
         queue = hw_layer->queue;
         if (queue == nullptr)
         {
+            // one more buffer than the pipeline depth, for the frame on screen
             queue = new DisplayBufferQueue(DisplayBufferQueue::QUEUE_TYPE_GLAI,
-                                           hw_layer->hwc_layer->getId());
+                                           hw_layer->hwc_layer->getId(),
+                                           m_pipeline_depth + 1);
             hw_layer->queue = queue;
             hw_layer->hwc_layer->setBufferQueue(queue);
         }
     }
     else
     {
-        queue = new DisplayBufferQueue(DisplayBufferQueue::QUEUE_TYPE_GLAI);
+        queue = new DisplayBufferQueue(DisplayBufferQueue::QUEUE_TYPE_GLAI, UINT_MAX,
+                                       m_pipeline_depth + 1);
     }
 
     if (queue == nullptr)
@@ -385,19 +422,20 @@ void GlaiHandler::configDisplayBufferQueue(sp<DisplayBufferQueue> queue,
 {
     const PrivateHandle* priv_handle = &hw_layer->priv_handle;
 
-    const GlaiController::Model* model = GlaiController::getInstance().getModel(hw_layer->glai_agent_id);
+    GlaiController::Model model;
+    const bool has_model = GlaiController::getInstance().getModel(hw_layer->glai_agent_id, &model);
 
     // set buffer format to buffer queue
     DisplayBufferQueue::BufferParam buffer_param;
     buffer_param.disp_id = static_cast<int>(m_disp_id);
     buffer_param.pool_id = priv_handle->ext_info.pool_id;
 
-    if (model)
+    if (has_model)
     {
-        buffer_param.width = model->out_w;
-        buffer_param.height = model->out_h;
-        buffer_param.format = model->out_format;
-        buffer_param.compression = model->out_compress;
+        buffer_param.width = model.out_w;
+        buffer_param.height = model.out_h;
+        buffer_param.format = model.out_format;
+        buffer_param.compression = model.out_compress;
     }
     else
     {
@@ -422,64 +460,134 @@ void GlaiHandler::configDisplayBufferQueue(sp<DisplayBufferQueue> queue,
     queue->setBufferParam(buffer_param);
 }
 
-void GlaiHandler::cleanPrevLayerInfo(const std::vector<sp<HWCLayer> >* hwc_layers)
+void GlaiHandler::closeInFlightFrame(InFlightFrame* frame) const
 {
-    m_prev_layer_info.remove_if(
-        [=](PrevLayerInfo& l)
+    if (frame->done_fd >= 0)
+    {
+        protectedClose(frame->done_fd);
+        frame->done_fd = -1;
+    }
+
+    if (frame->present_fd >= 0)
+    {
+        protectedClose(frame->present_fd);
+        frame->present_fd = -1;
+    }
+}
+
+void GlaiHandler::collectInFlightFrame(PrevLayerInfo* info) const
+{
+    while (!info->in_flight.empty())
+    {
+        InFlightFrame& frame = info->in_flight.front();
+
+        const nsecs_t done_ts = static_cast<nsecs_t>(SyncFence::getSignalTime(frame.done_fd));
+        const nsecs_t present_ts = static_cast<nsecs_t>(SyncFence::getSignalTime(frame.present_fd));
+
+        if (done_ts == SIGNAL_TIME_PENDING || present_ts == SIGNAL_TIME_PENDING)
         {
-            if (hwc_layers)
+            // frames are presented in order, so the following ones are pending too
+            if (info->in_flight.size() <= GLAI_MAX_TRACKED_FRAMES)
             {
-                for (const sp<HWCLayer>& hwc_layer : *hwc_layers)
-                {
-                    if (l.id == hwc_layer->getId())
-                    {
-                        return false;
-                    }
-                }
+                break;
             }
-            protectedClose(l.job_done_fd);
-            return true;
-        });
+        }
+        else if (done_ts != SIGNAL_TIME_INVALID && present_ts != SIGNAL_TIME_INVALID &&
+                 present_ts >= frame.issue_ts)
+        {
+            const nsecs_t latency = present_ts - frame.issue_ts;
+            info->latency_count++;
+            info->latency_last = latency;
+            info->latency_max = std::max(info->latency_max, latency);
+            info->latency_total += latency;
+            info->inference_total += std::max(done_ts - frame.issue_ts, static_cast<nsecs_t>(0));
+        }
+
+        closeInFlightFrame(&frame);
+        info->in_flight.pop_front();
+    }
 }
 
-void GlaiHandler::savePrevLayerInfo(const sp<HWCLayer>& hwc_layer)
+void GlaiHandler::cleanPrevLayerInfo(const std::vector<sp<HWCLayer> >* hwc_layers)
 {
-    bool exist = false;
+    AutoMutex l(m_info_lock);
 
-    for (PrevLayerInfo& prev : m_prev_layer_info)
+    for (auto iter = m_prev_layer_info.begin(); iter != m_prev_layer_info.end();)
     {
-        if (prev.id == hwc_layer->getId())
+        bool exist = false;
+        if (hwc_layers)
         {
-            exist = true;
-            if (prev.job_done_fd >= 0)
+            for (const sp<HWCLayer>& hwc_layer : *hwc_layers)
             {
-                protectedClose(prev.job_done_fd);
+                if (iter->first == hwc_layer->getId())
+                {
+                    exist = true;
+                    break;
+                }
             }
-            prev.job_done_fd = dup(hwc_layer->getReleaseFenceFd());
-            break;
         }
+
+        if (exist)
+        {
+            ++iter;
+            continue;
+        }
+
+        protectedClose(iter->second.job_done_fd);
+        for (InFlightFrame& frame : iter->second.in_flight)
+        {
+            closeInFlightFrame(&frame);
+        }
+        iter = m_prev_layer_info.erase(iter);
     }
+}
+
+void GlaiHandler::savePrevLayerInfo(const sp<HWCLayer>& hwc_layer)
+{
+    AutoMutex l(m_info_lock);
 
-    if (!exist)
+    PrevLayerInfo& prev = m_prev_layer_info[hwc_layer->getId()];
+    if (prev.job_done_fd >= 0)
     {
-        m_prev_layer_info.push_back({ .id = hwc_layer->getId(),
-                                      .job_done_fd = dup(hwc_layer->getReleaseFenceFd()) });
+        protectedClose(prev.job_done_fd);
     }
+    prev.job_done_fd = dup(hwc_layer->getReleaseFenceFd());
 }
 
 int GlaiHandler::getPrevLayerInfoFence(const sp<HWCLayer>& hwc_layer)
 {
-    for (PrevLayerInfo& prev : m_prev_layer_info)
+    AutoMutex l(m_info_lock);
+
+    auto iter = m_prev_layer_info.find(hwc_layer->getId());
+    if (iter != m_prev_layer_info.end())
     {
-        if (prev.id == hwc_layer->getId())
-        {
-            return prev.job_done_fd;
-        }
+        return iter->second.job_done_fd;
     }
 
     return -1;
 }
 
+void GlaiHandler::trackInference(const sp<HWCLayer>& hwc_layer,
+                                 nsecs_t issue_ts,
+                                 bool out_buf_free,
+                                 int inference_done_fence,
+                                 int present_fence)
+{
+    AutoMutex l(m_info_lock);
+
+    PrevLayerInfo& info = m_prev_layer_info[hwc_layer->getId()];
+    info.frame_count++;
+    if (out_buf_free)
+    {
+        info.overlap_count++;
+    }
+
+    info.in_flight.push_back({ .issue_ts = issue_ts,
+                               .done_fd = inference_done_fence,
+                               .present_fd = present_fence });
+    collectInFlightFrame(&info);
+}
+
 void GlaiHandler::process(DispatcherJob* job)
 {
     for (uint32_t i = 0; i < job->num_layers; i++)
@@ -544,8 +652,46 @@ void GlaiHandler::cancelLayers(DispatcherJob* job)
     }
 }
 
-int GlaiHandler::dump(char* /*buff*/, int /*buff_len*/, int /*dump_level*/)
+int GlaiHandler::dump(char* buff, int buff_len, int /*dump_level*/)
 {
-    return 0;
+    if (buff == nullptr || buff_len <= 0)
+    {
+        return 0;
+    }
+
+    AutoMutex l(m_info_lock);
+
+    const size_t len = static_cast<size_t>(buff_len);
+    size_t pos = 0;
+    int ret = snprintf(buff, len, "[GLAI pipeline] dpy %" PRIu64 " depth %d\n",
+                       m_disp_id, m_pipeline_depth);
+    pos += ret > 0 ? static_cast<size_t>(ret) : 0;
+
+    for (auto& item : m_prev_layer_info)
+    {
+        if (pos >= len)
+        {
+            break;
+        }
+
+        const PrevLayerInfo& info = item.second;
+        const uint64_t overlap = info.frame_count ?
+                                 info.overlap_count * 100 / info.frame_count : 0;
+        const nsecs_t avg = info.latency_count ?
+                            info.latency_total / static_cast<nsecs_t>(info.latency_count) : 0;
+        const nsecs_t avg_inference = info.latency_count ?
+                                      info.inference_total / static_cast<nsecs_t>(info.latency_count) : 0;
+
+        ret = snprintf(buff + pos, len - pos,
+                       "  layer %" PRIu64 ": frames %" PRIu64 " in_flight %zu overlap %" PRIu64 "%%"
+                       " inference(us) avg %" PRId64 " present latency(us) last %" PRId64
+                       " avg %" PRId64 " max %" PRId64 "\n",
+                       item.first, info.frame_count, info.in_flight.size(), overlap,
+                       ns2us(avg_inference), ns2us(info.latency_last),
+                       ns2us(avg), ns2us(info.latency_max));
+        pos += ret > 0 ? static_cast<size_t>(ret) : 0;
+    }
+
+    return static_cast<int>(std::min(pos, len - 1));
 }
 
@@ -2,6 +2,10 @@
 #define HWC_GLAI_HANDLER_H_
 
 #include <utils/threads.h>
+#include <utils/Timers.h>
+
+#include <deque>
+#include <map>
 
 #include "composer.h"
 #include "dispatcher.h"
@@ -53,12 +57,52 @@ private:
     void savePrevLayerInfo(const sp<HWCLayer>& hwc_layer);
     int getPrevLayerInfoFence(const sp<HWCLayer>& hwc_layer);
 
-    struct PrevLayerInfo {
-        uint64_t id;
-        int job_done_fd;
+    // record a new inference of this layer into its pipeline statistics
+    void trackInference(const sp<HWCLayer>& hwc_layer,
+                        nsecs_t issue_ts,
+                        bool out_buf_free,
+                        int inference_done_fence,
+                        int present_fence);
+
+    struct InFlightFrame
+    {
+        nsecs_t issue_ts;
+        // signaled when the inference of this frame is finished
+        int done_fd;
+        // signaled when the ovl replaces the previous frame with this one
+        int present_fd;
     };
 
-    std::list<PrevLayerInfo> m_prev_layer_info;
+    struct PrevLayerInfo
+    {
+        int job_done_fd = -1;
+
+        // frames which are inferring or waiting for display
+        std::deque<InFlightFrame> in_flight;
+
+        uint64_t frame_count = 0;
+        // frames whose output buffer was already released by ovl when inference was issued,
+        // i.e. the inference did not wait the display of the previous frame
+        uint64_t overlap_count = 0;
+
+        uint64_t latency_count = 0;
+        nsecs_t latency_last = 0;
+        nsecs_t latency_max = 0;
+        nsecs_t latency_total = 0;
+        nsecs_t inference_total = 0;
+    };
+
+    void closeInFlightFrame(InFlightFrame* frame) const;
+    void collectInFlightFrame(PrevLayerInfo* info) const;
+
+    // m_pipeline_depth is the number of glai frames which can be in flight at the same time
+    int m_pipeline_depth;
+
+    // m_prev_layer_info is keyed by hwc layer id
+    std::map<uint64_t, PrevLayerInfo> m_prev_layer_info;
+
+    // protect m_prev_layer_info between set() and dump()
+    mutable Mutex m_info_lock;
 };
 
 #endif // HWC_GLAI_HANDLER_H_
\ No newline at end of file
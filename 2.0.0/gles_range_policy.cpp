@@ -0,0 +1,376 @@
+#define DEBUG_LOG_TAG "GLESRANGE"
+
+#include "gles_range_policy.h"
+
+#include <algorithm>
+
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+
+// the relative cost of a byte which the overlay, the GPU and MDP move, the GPU
+// reads the layer and writes the client target, MDP reads and writes the layer
+#define GLES_COST_OVL_WEIGHT 1
+#define GLES_COST_GPU_WEIGHT 3
+#define GLES_COST_MDP_WEIGHT 2
+
+// the bytes per pixel of the client target
+#define GLES_COST_FBT_BPP 4
+
+// the fixed cost of a client composition, in bytes, so that a layer which
+// costs less on the GPU than on the overlay does not start it alone
+#define GLES_COST_CLIENT_FIXED (512 * 1024)
+
+// ---------------------------------------------------------------------------
+
+GlesRangeLayer::GlesRangeLayer()
+    : left(0)
+    , top(0)
+    , right(0)
+    , bottom(0)
+    , bytes_per_pixel(0)
+    , is_mm(false)
+    , must_client(false)
+    , must_device(false)
+{
+}
+
+GlesRangeInput::GlesRangeInput()
+    : max_layer(0)
+    , gles_head(-1)
+    , gles_tail(-1)
+{
+}
+
+bool GlesRangeInput::isOverflow() const
+{
+    const bool only_hwc_comp = (gles_tail == -1) && (gles_head == -1);
+    const int num_hwc_layers = static_cast<int>(layers.size());
+    const int gles_count = only_hwc_comp ? 0 : (gles_tail - gles_head + 1);
+    const int committed_count = only_hwc_comp ? num_hwc_layers : num_hwc_layers - gles_count + 1;
+    return committed_count > max_layer;
+}
+
+void GlesRangeInput::getRequiredRange(int32_t* head, int32_t* tail) const
+{
+    *head = gles_head;
+    *tail = gles_tail;
+    for (int32_t i = 0; i < static_cast<int32_t>(layers.size()); i++)
+    {
+        if (!layers[static_cast<size_t>(i)].must_client)
+        {
+            continue;
+        }
+        *head = *head == -1 ? i : std::min(*head, i);
+        *tail = std::max(*tail, i);
+    }
+}
+
+static int64_t getArea(int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+    if (right <= left || bottom <= top)
+    {
+        return 0;
+    }
+    return static_cast<int64_t>(right - left) * static_cast<int64_t>(bottom - top);
+}
+
+static int64_t getLayerBytes(const GlesRangeLayer& layer)
+{
+    return getArea(layer.left, layer.top, layer.right, layer.bottom) * layer.bytes_per_pixel;
+}
+
+static int64_t getHwcCost(const GlesRangeLayer& layer)
+{
+    const int64_t bytes = getLayerBytes(layer);
+    return bytes * GLES_COST_OVL_WEIGHT + (layer.is_mm ? bytes * GLES_COST_MDP_WEIGHT : 0);
+}
+
+// the client target covers the bounding box of the layers in the range
+static int64_t getClientCost(int64_t range_bytes, int64_t fbt_area)
+{
+    return range_bytes * GLES_COST_GPU_WEIGHT +
+           fbt_area * GLES_COST_FBT_BPP * (GLES_COST_GPU_WEIGHT + GLES_COST_OVL_WEIGHT) +
+           GLES_COST_CLIENT_FIXED;
+}
+
+// ---------------------------------------------------------------------------
+
+bool GlesRangePolicyLegacy::choose(const GlesRangeInput& input, int32_t* head, int32_t* tail) const
+{
+    int32_t gles_head = input.gles_head;
+    int32_t gles_tail = input.gles_tail;
+
+    const bool only_hwc_comp = (gles_tail == -1) && (gles_head == -1);
+    const int num_hwc_layers = static_cast<int>(input.layers.size());
+    const int gles_count = only_hwc_comp ? 0 : (gles_tail - gles_head + 1);
+    const int hwc_count = num_hwc_layers - gles_count;
+    const int committed_count = only_hwc_comp ? hwc_count : hwc_count + 1;
+
+    if (committed_count > input.max_layer)
+    {
+        const int over_layer_count = committed_count - input.max_layer;
+        if (only_hwc_comp)
+        {
+            gles_tail = num_hwc_layers - 1;
+            gles_head = gles_tail - over_layer_count;
+        }
+        else
+        {
+            const int hwc_num_after_gles_tail = num_hwc_layers - 1 - gles_tail;
+            const int hwc_num_before_gles_head = gles_head;
+            const int excess_layer = over_layer_count > hwc_num_after_gles_tail ?
+                                     over_layer_count - hwc_num_after_gles_tail : 0;
+            if (excess_layer > hwc_num_before_gles_head)
+            {
+                HWC_LOGE("wrong GLES head range (%d,%d) (%d,%d)", gles_head, gles_tail, hwc_count, input.max_layer);
+                return false;
+            }
+            gles_tail = excess_layer == 0 ?
+                        (gles_tail + over_layer_count) : (num_hwc_layers - 1);
+            gles_head -= excess_layer;
+        }
+    }
+
+    *head = gles_head;
+    *tail = gles_tail;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+int64_t GlesRangePolicyCost::getCost(const GlesRangeInput& input, int32_t head, int32_t tail)
+{
+    const int32_t num = static_cast<int32_t>(input.layers.size());
+    const bool has_range = head != -1 || tail != -1;
+    if (has_range && (head < 0 || tail < head || tail >= num))
+    {
+        return -1;
+    }
+    int32_t req_head = -1;
+    int32_t req_tail = -1;
+    input.getRequiredRange(&req_head, &req_tail);
+    if (req_head != -1 && (!has_range || head > req_head || tail < req_tail))
+    {
+        return -1;
+    }
+
+    const int32_t gles_count = has_range ? tail - head + 1 : 0;
+    if (num - gles_count + (has_range ? 1 : 0) > input.max_layer)
+    {
+        return -1;
+    }
+
+    int64_t cost = 0;
+    int64_t range_bytes = 0;
+    int32_t left = INT32_MAX, top = INT32_MAX, right = INT32_MIN, bottom = INT32_MIN;
+    for (int32_t i = 0; i < num; i++)
+    {
+        const GlesRangeLayer& layer = input.layers[static_cast<size_t>(i)];
+        if (!has_range || i < head || i > tail)
+        {
+            cost += getHwcCost(layer);
+            continue;
+        }
+
+        if (layer.must_device)
+        {
+            return -1;
+        }
+        range_bytes += getLayerBytes(layer);
+        left = std::min(left, layer.left);
+        top = std::min(top, layer.top);
+        right = std::max(right, layer.right);
+        bottom = std::max(bottom, layer.bottom);
+    }
+
+    if (has_range)
+    {
+        cost += getClientCost(range_bytes, getArea(left, top, right, bottom));
+    }
+    return cost;
+}
+
+bool GlesRangePolicyCost::choose(const GlesRangeInput& input, int32_t* head, int32_t* tail) const
+{
+    const int32_t num = static_cast<int32_t>(input.layers.size());
+
+    int64_t total_hwc_cost = 0;
+    for (const GlesRangeLayer& layer : input.layers)
+    {
+        total_hwc_cost += getHwcCost(layer);
+    }
+
+    int32_t req_head = -1;
+    int32_t req_tail = -1;
+    input.getRequiredRange(&req_head, &req_tail);
+
+    int64_t best_cost = -1;
+    int32_t best_head = -1;
+    int32_t best_tail = -1;
+    if (req_head == -1 && num <= input.max_layer)
+    {
+        best_cost = total_hwc_cost;
+    }
+
+    // the cost of [h, t] is extended from [h, t - 1], so every range costs O(1)
+    for (int32_t h = 0; h < num; h++)
+    {
+        if (req_head != -1 && h > req_head)
+        {
+            break;
+        }
+
+        int64_t range_bytes = 0;
+        int64_t range_hwc_cost = 0;
+        int32_t left = INT32_MAX, top = INT32_MAX, right = INT32_MIN, bottom = INT32_MIN;
+        for (int32_t t = h; t < num; t++)
+        {
+            const GlesRangeLayer& layer = input.layers[static_cast<size_t>(t)];
+            if (layer.must_device)
+            {
+                break;
+            }
+
+            range_bytes += getLayerBytes(layer);
+            range_hwc_cost += getHwcCost(layer);
+            left = std::min(left, layer.left);
+            top = std::min(top, layer.top);
+            right = std::max(right, layer.right);
+            bottom = std::max(bottom, layer.bottom);
+
+            if (req_head != -1 && t < req_tail)
+            {
+                continue;
+            }
+
+            const int32_t gles_count = t - h + 1;
+            if (num - gles_count + 1 > input.max_layer)
+            {
+                continue;
+            }
+
+            const int64_t cost = total_hwc_cost - range_hwc_cost +
+                                 getClientCost(range_bytes, getArea(left, top, right, bottom));
+            // a smaller range wins a tie, then the upper one like the legacy policy
+            if (best_cost < 0 || cost < best_cost ||
+                (cost == best_cost && best_head != -1 && gles_count <= best_tail - best_head + 1))
+            {
+                best_cost = cost;
+                best_head = h;
+                best_tail = t;
+            }
+        }
+    }
+
+    if (best_cost < 0)
+    {
+        return false;
+    }
+
+    *head = best_head;
+    *tail = best_tail;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+GlesRangePolicyManager& GlesRangePolicyManager::getInstance()
+{
+    static GlesRangePolicyManager gInstance;
+    return gInstance;
+}
+
+GlesRangePolicyManager::GlesRangePolicyManager()
+    : m_policy(POLICY_LEGACY)
+    , m_choose_count(0)
+    , m_fallback_count(0)
+    , m_diff_count(0)
+    , m_saved_cost(0)
+{
+    // the order follows POLICY_*
+    m_policies.push_back(new GlesRangePolicyLegacy());
+    m_policies.push_back(new GlesRangePolicyCost());
+}
+
+GlesRangePolicyManager::~GlesRangePolicyManager()
+{
+    for (auto policy : m_policies)
+    {
+        delete policy;
+    }
+    m_policies.clear();
+}
+
+void GlesRangePolicyManager::setPolicy(int policy)
+{
+    if (policy < 0 || policy >= POLICY_NUM)
+    {
+        HWC_LOGW("%s: invalid policy %d", __func__, policy);
+        return;
+    }
+    m_policy.store(policy, std::memory_order_relaxed);
+}
+
+bool GlesRangePolicyManager::isUsedWithHrt() const
+{
+    const int policy = m_policy.load(std::memory_order_relaxed);
+    return m_policies[static_cast<size_t>(policy)]->isUsedWithHrt();
+}
+
+bool GlesRangePolicyManager::choose(const GlesRangeInput& input, int32_t* head, int32_t* tail)
+{
+    if (!input.isOverflow())
+    {
+        *head = input.gles_head;
+        *tail = input.gles_tail;
+        return true;
+    }
+
+    const int policy = m_policy.load(std::memory_order_relaxed);
+    const bool res = m_policies[static_cast<size_t>(policy)]->choose(input, head, tail);
+    if (policy == POLICY_LEGACY)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_choose_count++;
+        return res;
+    }
+
+    int32_t legacy_head = -1;
+    int32_t legacy_tail = -1;
+    const bool legacy_res = m_policies[POLICY_LEGACY]->choose(input, &legacy_head, &legacy_tail);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_choose_count++;
+    if (!res)
+    {
+        m_fallback_count++;
+        *head = legacy_head;
+        *tail = legacy_tail;
+        return legacy_res;
+    }
+
+    if (legacy_res && (*head != legacy_head || *tail != legacy_tail))
+    {
+        m_diff_count++;
+        const int64_t legacy_cost = GlesRangePolicyCost::getCost(input, legacy_head, legacy_tail);
+        if (legacy_cost >= 0)
+        {
+            m_saved_cost += legacy_cost - GlesRangePolicyCost::getCost(input, *head, *tail);
+        }
+        HWC_LOGV("%s: %s [%d,%d] legacy [%d,%d]", __func__,
+                 m_policies[static_cast<size_t>(policy)]->getName(), *head, *tail, legacy_head, legacy_tail);
+    }
+    return true;
+}
+
+void GlesRangePolicyManager::dump(android::String8* dump_str) const
+{
+    const int policy = m_policy.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    dump_str->appendFormat("GLES range policy(vendor.debug.hwc.gles_range_policy): %s choose:%" PRIu64
+                           " fallback:%" PRIu64 " diff_legacy:%" PRIu64 " saved_cost:%" PRId64 "\n",
+                           m_policies[static_cast<size_t>(policy)]->getName(),
+                           m_choose_count, m_fallback_count, m_diff_count, m_saved_cost);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+
+namespace android
+{
+class String8;
+}
+
+// GlesRangeLayer describes a visible layer with the properties that drive
+// its cost on the overlay, the GPU and MDP
+struct GlesRangeLayer
+{
+    GlesRangeLayer();
+
+    int32_t left;           // display frame
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+    uint32_t bytes_per_pixel;   // 0 if the layer has no buffer, e.g. a dim layer
+    bool is_mm;             // composed by MDP if it stays in HWC
+    bool must_client;       // HWC cannot compose it
+    bool must_device;       // GPU must not compose it, e.g. a secure buffer
+};
+
+struct GlesRangeInput
+{
+    GlesRangeInput();
+
+    std::vector<GlesRangeLayer> layers;     // sorted by z
+    int max_layer;          // the layers which a job commits, fbt included
+
+    // the range of the layer validation, -1 if there is none
+    int32_t gles_head;
+    int32_t gles_tail;
+
+    // isOverflow() returns true if the job cannot commit the layers with the range
+    // of the layer validation, a policy only runs then
+    bool isOverflow() const;
+
+    // getRequiredRange() returns the range which a policy has to cover, it holds
+    // the range of the layer validation and every must_client layer
+    void getRequiredRange(int32_t* head, int32_t* tail) const;
+};
+
+// GlesRangePolicy chooses the contiguous range of layers which GPU composes
+// into the client target, -1 for no client composition
+class GlesRangePolicy
+{
+public:
+    virtual ~GlesRangePolicy() {}
+
+    virtual const char* getName() const = 0;
+
+    // return false if no range fits input.max_layer
+    virtual bool choose(const GlesRangeInput& input, int32_t* head, int32_t* tail) const = 0;
+
+    // the range is chosen before the hrt of the driver too, not only by
+    // the simple layering rule
+    virtual bool isUsedWithHrt() const { return false; }
+};
+
+// GlesRangePolicyLegacy keeps the range of the layer validation and extends
+// it toward the top layers when there are too many layers
+class GlesRangePolicyLegacy : public GlesRangePolicy
+{
+public:
+    const char* getName() const override { return "legacy"; }
+    bool choose(const GlesRangeInput& input, int32_t* head, int32_t* tail) const override;
+};
+
+// GlesRangePolicyCost scores every feasible range with the bytes that the
+// overlay, the GPU and MDP move for a frame, and takes the cheapest one
+class GlesRangePolicyCost : public GlesRangePolicy
+{
+public:
+    const char* getName() const override { return "cost"; }
+    bool choose(const GlesRangeInput& input, int32_t* head, int32_t* tail) const override;
+    bool isUsedWithHrt() const override { return true; }
+
+    // the cost of a range, a negative value if it is not feasible
+    static int64_t getCost(const GlesRangeInput& input, int32_t head, int32_t tail);
+};
+
+// GlesRangePolicyManager owns the policies and chooses with the selected one,
+// the legacy policy is the fallback if the selected one finds no range
+class GlesRangePolicyManager
+{
+public:
+    enum
+    {
+        POLICY_LEGACY = 0,
+        POLICY_COST,
+        POLICY_NUM,
+    };
+
+    static GlesRangePolicyManager& getInstance();
+    ~GlesRangePolicyManager();
+
+    void setPolicy(int policy);
+
+    bool isUsedWithHrt() const;
+
+    // choose() keeps the range of the layer validation if the job can commit it
+    bool choose(const GlesRangeInput& input, int32_t* head, int32_t* tail);
+
+    void dump(android::String8* dump_str) const;
+
+private:
+    GlesRangePolicyManager();
+
+private:
+    std::vector<GlesRangePolicy*> m_policies;
+    std::atomic<int> m_policy;
+
+    mutable std::mutex m_lock;
+    uint64_t m_choose_count;
+    uint64_t m_fallback_count;      // the selected policy found no range
+    uint64_t m_diff_count;          // the range differs from the legacy one
+    int64_t m_saved_cost;           // sum of the legacy cost minus the chosen cost
+};
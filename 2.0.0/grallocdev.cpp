@@ -43,6 +43,11 @@ static uint32_t AHardwareBuffer_convertFromPixelFormat(unsigned int fmt) {
     return AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM;
 }
 
+static uint64_t getTrackerId(buffer_handle_t handle)
+{
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(handle));
+}
+
 GrallocDevice& GrallocDevice::getInstance()
 {
     static GrallocDevice gInstance;
@@ -90,16 +95,32 @@ status_t GrallocDevice::alloc(AllocParam& param) {
     desc.rfu0 = 0;
     desc.rfu1 = 0;
 
+    const size_t bpp = getBitsPerPixel(param.format);
+    const size_t reserved = static_cast<size_t>(param.width) * param.height * bpp / 8;
+    if (!MemoryTracker::getInstance().reserve(reserved))
+    {
+        HWC_LOGE("%s: over the memory budget (%u x %u) format %d owner %d", __func__,
+                 param.width, param.height, param.format, param.owner);
+        return NO_MEMORY;
+    }
+
     status_t error = AHardwareBuffer_allocate(&desc, &buffer);
     buffer_handle_t buffer_hnd = AHardwareBuffer_getNativeHandle(buffer);
 
     if (buffer && error == NO_ERROR && buffer_hnd != nullptr) {
+        // the stride is the padded width which gralloc really allocates
+        AHardwareBuffer_Desc out_desc;
+        AHardwareBuffer_describe(buffer, &out_desc);
+        MemoryTracker::getInstance().commit(reserved, getTrackerId(buffer_hnd), param.owner, param.disp_id,
+                static_cast<size_t>(out_desc.stride) * out_desc.height * bpp / 8);
+
         AutoMutex l(m_buffers_mutex);
         m_buffers[buffer_hnd] = buffer;
         param.handle = buffer_hnd;
         HWC_LOGV("%s: add hnd(%p) hwb(%p)", __func__, buffer_hnd, buffer);
         return NO_ERROR;
     } else {
+        MemoryTracker::getInstance().cancel(reserved);
         HWC_LOGE("%s: Failed to allocate (%u x %u) format %d error %d", __func__, param.width, param.height, param.format, error);
         return NO_MEMORY;
     }
@@ -117,6 +138,7 @@ status_t GrallocDevice::free(buffer_handle_t handle)
         HWC_LOGV("%s: rm hnd(%p) hwb(%p)", __func__, handle, buffer);
         AHardwareBuffer_release(buffer);
         m_buffers.erase(handle);
+        MemoryTracker::getInstance().remove(getTrackerId(handle));
     }
     else
     {
@@ -128,6 +150,11 @@ status_t GrallocDevice::free(buffer_handle_t handle)
     return err;
 }
 
+void GrallocDevice::setOwner(buffer_handle_t handle, MemoryTracker::Owner owner, int disp_id)
+{
+    MemoryTracker::getInstance().setOwner(getTrackerId(handle), owner, disp_id);
+}
+
 void GrallocDevice::dump() const
 {
     // TODO: dump allocated buffer record
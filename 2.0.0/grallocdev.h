@@ -1,11 +1,19 @@
 #ifndef HWC_GRALLOC_DEV_H
 #define HWC_GRALLOC_DEV_H
 
+#ifdef MTK_HWC_USE_STUB_DEVICE
+// the host replay allocates fake handles, see tools/host/host_gralloc.cpp
+#include <cutils/native_handle.h>
+struct AHardwareBuffer;
+#else
 #include <vndk/hardware_buffer.h>
+#endif
 #include <utils/Errors.h>
 #include <utils/Mutex.h>
 #include <map>
 
+#include "memory_tracker.h"
+
 using namespace android;
 
 class GrallocDevice
@@ -18,7 +26,8 @@ public:
     {
         AllocParam()
             : width(0), height(0), format(0)
-            , usage(0), handle(NULL), stride(0)
+            , usage(0), owner(MemoryTracker::OWNER_UNKNOWN), disp_id(-1)
+            , handle(NULL), stride(0)
         { }
 
         unsigned int width;
@@ -26,6 +35,10 @@ public:
         unsigned int format;
         uint64_t usage;
 
+        // owner and disp_id tag the buffer in MemoryTracker
+        MemoryTracker::Owner owner;
+        int disp_id;
+
         buffer_handle_t handle;
         int stride;
     };
@@ -36,6 +49,9 @@ public:
     // free a previously allocated buffer
     status_t free(buffer_handle_t handle);
 
+    // move a buffer to another owner in MemoryTracker
+    void setOwner(buffer_handle_t handle, MemoryTracker::Owner owner, int disp_id);
+
     // dump information of allocated buffers
     void dump() const;
 
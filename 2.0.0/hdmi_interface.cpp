@@ -51,12 +51,14 @@ Return<void> MtkHdmiCallback::onHdmiSettingsChange(int32_t mode, int32_t value)
 
 // ---------------------------------------------------------------------------
 ModeHandleThread::ModeHandleThread()
+    : m_coalesced_count(0)
 {
     for(int i = 0; i < MAX_PHY_DISP; i++)
         m_changed_hdr[i] = HDR_DV_STATUS_INVALID;
     memset(m_changed_fmt, 0, sizeof(m_changed_fmt));
     memset(m_is_hdr_change, 0, sizeof(m_is_hdr_change));
     memset(m_is_fmt_change, 0, sizeof(m_is_fmt_change));
+    memset(m_verify_type, 0, sizeof(m_verify_type));
     m_thread_name = std::string("ModeHandle");
     m_queue_name  = std::string("ModeHandleQueue");
 }
@@ -75,10 +77,7 @@ void ModeHandleThread::sendSetActiveConfig(uint64_t dpy, uint32_t config)
     modeConfig.mode_dpy    = dpy;
     modeConfig.mode_config = config;
 
-    m_config_queue.push(modeConfig);
-
-    m_state       = HWC_THREAD_TRIGGER;
-    sem_post(&m_event);
+    queueConfigLocked(modeConfig);
 }
 
 void ModeHandleThread::sendSetHdmiSetting(uint64_t dpy, uint32_t mode, uint32_t val)
@@ -98,7 +97,55 @@ void ModeHandleThread::sendSetHdmiSetting(uint64_t dpy, uint32_t mode, uint32_t
     modeConfig.set_mode      = mode;
     modeConfig.set_val       = val;
 
-    m_config_queue.push(modeConfig);
+    queueConfigLocked(modeConfig);
+}
+
+void ModeHandleThread::sendVerifyEdid(uint64_t dpy, uint32_t type)
+{
+    AutoMutex l(m_lock);
+
+    if (dpy >= MAX_PHY_DISP)
+    {
+        HWC_LOGW("%s error dpy:%" PRIu64, __func__, dpy);
+        return;
+    }
+
+    m_verify_type[dpy] = type;
+
+    m_state       = HWC_THREAD_TRIGGER;
+    sem_post(&m_event);
+}
+
+bool ModeHandleThread::isModeRequest(const HDMIModeConfig& modeConfig)
+{
+    return modeConfig.msg_type == SF_SET_ACTIVE_CONFIG ||
+           (modeConfig.msg_type == HDMI_SERVICE_SETTING && modeConfig.set_mode == VIDEO_RESOLUTION_MODE);
+}
+
+void ModeHandleThread::queueConfigLocked(const HDMIModeConfig& modeConfig)
+{
+    if (isModeRequest(modeConfig))
+    {
+        // the new request is appended, so the hdr and color format settings queued before
+        // it are still handled before the mode change
+        for (auto it = m_config_queue.begin(); it != m_config_queue.end();)
+        {
+            if (it->msg_type == modeConfig.msg_type && it->mode_dpy == modeConfig.mode_dpy &&
+                isModeRequest(*it))
+            {
+                m_coalesced_count++;
+                HWC_LOGI("%s: dpy:%" PRIu64 " drop pending mode request(type:%u config:%u val:%u) total:%" PRIu64,
+                        __func__, it->mode_dpy, it->msg_type, it->mode_config, it->set_val, m_coalesced_count);
+                it = m_config_queue.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    m_config_queue.push_back(modeConfig);
 
     m_state       = HWC_THREAD_TRIGGER;
     sem_post(&m_event);
@@ -114,13 +161,32 @@ bool ModeHandleThread::threadLoop()
         {
             AutoMutex l(m_lock);
 
-            if (m_config_queue.empty())
+            if (!m_config_queue.empty())
             {
-                HWC_LOGI("job is empty");
-                break;
+                config = m_config_queue.front();
+                m_config_queue.pop_front();
+            }
+            else
+            {
+                // the edid is verified only when no mode request is waiting
+                for (uint64_t i = 0; i < MAX_PHY_DISP; i++)
+                {
+                    if (m_verify_type[i] != 0)
+                    {
+                        config.msg_type = HDMI_VERIFY_EDID;
+                        config.mode_dpy = i;
+                        config.set_val  = m_verify_type[i];
+                        m_verify_type[i] = 0;
+                        break;
+                    }
+                }
+
+                if (config.msg_type == MODE_HANDLE_INVALID)
+                {
+                    HWC_LOGI("job is empty");
+                    break;
+                }
             }
-            config = m_config_queue.front();
-            m_config_queue.pop();
         }
 
         if (config.msg_type == SF_SET_ACTIVE_CONFIG)
@@ -128,6 +194,9 @@ bool ModeHandleThread::threadLoop()
 
         if (config.msg_type == HDMI_SERVICE_SETTING)
             handleHdmiSetting(&config);
+
+        if (config.msg_type == HDMI_VERIFY_EDID)
+            handleVerifyEdid(&config);
     }
 
 
@@ -339,6 +408,31 @@ void ModeHandleThread::handleHdmiSetting(HDMIModeConfig* modeConfig)
             break;
     }
 }
+
+void ModeHandleThread::handleVerifyEdid(HDMIModeConfig* modeConfig)
+{
+    uint64_t dpy  = modeConfig->mode_dpy;
+    uint32_t type = modeConfig->set_val;
+    bool changed  = false;
+
+    uint32_t drm_id_cur_crtc = HWCMediator::getInstance().getHWCDisplay(dpy)->getDrmIdCurCrtc();
+    HWCMediator::getInstance().getOvlDevice(dpy)->verifyConnectorEDID(dpy, drm_id_cur_crtc, &changed);
+    if (!changed)
+    {
+        return;
+    }
+
+    // the sink is not the cached one, plug it again with the probed modes
+    HWC_LOGW("%s: dpy:%" PRIu64 " edid changed, reconnect hdmi", __func__, dpy);
+    if (DisplayManager::getInstance().getDisplayConnected(dpy))
+    {
+        DisplayManager::getInstance().setHdmiChangeState(dpy, true);
+        DisplayManager::getInstance().hotplugExt(dpy, false);
+        DisplayManager::getInstance().setHdmiChangeState(dpy, false);
+    }
+    HDMIDevice::getInstance().checkHdmiEdid(dpy, type);
+}
+
 // ---------------------------------------------------------------------------
 HDMIDevice& HDMIDevice::getInstance()
 {
@@ -379,6 +473,11 @@ void HDMIDevice::getHdmiService()
 void HDMIDevice::checkHdmiEdid(uint64_t dpy, uint32_t type)
 {
     getHdmiService();
+    if (!m_isHdmiServiceAvailable)
+    {
+        // the caller retries until hdmi service is ready, read the edid only once it is
+        return;
+    }
 
     uint32_t edid[10];
     uint32_t drm_id_cur_crtc = HWCMediator::getInstance().getHWCDisplay(dpy)->getDrmIdCurCrtc();
@@ -402,6 +501,10 @@ void HDMIDevice::checkHdmiEdid(uint64_t dpy, uint32_t type)
             res.edid[5], res.edid[6], res.edid[7], res.edid[8], res.edid[9],
             res.edid[10], res.edid[11]);
     m_hdmiServer->setEDIDInfoMore(res);
+
+    // a no-op if the edid comes from a probe
+    if (m_mode_handler)
+        m_mode_handler->sendVerifyEdid(dpy, type);
 }
 
 void HDMIDevice::setActiveConfig(uint64_t dpy, uint32_t config)
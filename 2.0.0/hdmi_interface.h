@@ -1,7 +1,7 @@
 #ifndef __HWC_HDMI_DEV_H__
 #define __HWC_HDMI_DEV_H__
 
-#include <queue>
+#include <deque>
 
 #include "worker.h"
 #include <vendor/mediatek/hardware/hdmi/1.2/IMtkHdmiCallback.h>
@@ -149,6 +149,7 @@ enum
     MODE_HANDLE_INVALID,
     SF_SET_ACTIVE_CONFIG,
     HDMI_SERVICE_SETTING,
+    HDMI_VERIFY_EDID,
 };
 
 enum HDMIRX_NOTIFY_T {
@@ -316,19 +317,32 @@ public:
     ModeHandleThread();
     void sendSetActiveConfig(uint64_t dpy, uint32_t config);
     void sendSetHdmiSetting(uint64_t dpy, uint32_t mode, uint32_t val);
+    // sendVerifyEdid() probes the connector after the pending mode requests are handled
+    void sendVerifyEdid(uint64_t dpy, uint32_t type);
     void handleSetActiveConfig(HDMIModeConfig* modeConfig);
     void handleHdmiSetting(HDMIModeConfig* modeConfig);
+    void handleVerifyEdid(HDMIModeConfig* modeConfig);
 
 private:
     virtual void onFirstRef();
     virtual bool threadLoop();
+
+    // a new mode request replaces the pending one of the same display and type
+    void queueConfigLocked(const HDMIModeConfig& modeConfig);
+    bool isModeRequest(const HDMIModeConfig& modeConfig);
+
     uint32_t m_changed_hdr[MAX_PHY_DISP];
     uint32_t m_changed_fmt[MAX_PHY_DISP];
     uint32_t m_is_hdr_change[MAX_PHY_DISP];
     uint32_t m_is_fmt_change[MAX_PHY_DISP];
 
     // m_config_queue is an array which store the parameters of HDMI mode config
-    std::queue<HDMIModeConfig>m_config_queue;
+    std::deque<HDMIModeConfig>m_config_queue;
+
+    // the connector type to verify the edid of each display, 0 means none
+    uint32_t m_verify_type[MAX_PHY_DISP];
+
+    uint64_t m_coalesced_count;
 };
 
 class HDMIDevice
@@ -340,6 +354,8 @@ public:
 
     // init hdmi service and callback
     void getHdmiService();
+    // checkHdmiEdid() sends the edid of dpy to hdmi service, if it comes from the edid cache,
+    // the connector is probed by the mode handle thread later
     void checkHdmiEdid(uint64_t dpy, uint32_t type);
     bool getHdmiServiceAvaliable() { return m_isHdmiServiceAvailable; }
     void setActiveConfig(uint64_t dpy, uint32_t config);
@@ -7,8 +7,12 @@
 #include "overlay.h"
 #include "dispatcher.h"
 #include "hwc2.h"
+#include "hwc_recorder.h"
+#include "gles_range_policy.h"
 
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#if defined(MTK_HWC_USE_STUB_DEVICE)
+#include "tools/host/stub_hrt.h"
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
 #include "legacy/hrt.h"
 #else
 #include "drm/drmhrt.h"
@@ -16,6 +20,45 @@
 
 #include "utils/debug.h"
 
+static void fillGlesRangeInput(HWCDisplay* display, int max_layer, GlesRangeInput* input)
+{
+    const std::vector<sp<HWCLayer> >& layers = display->getVisibleLayersSortedByZ();
+    input->layers.resize(layers.size());
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        const sp<HWCLayer>& layer = layers[i];
+        GlesRangeLayer& info = input->layers[i];
+        const hwc_rect_t& frame = layer->getDisplayFrame();
+        const int32_t type = layer->getHwlayerType();
+        const PrivateHandle& priv_handle = layer->getPrivateHandle();
+
+        info.left = frame.left;
+        info.top = frame.top;
+        info.right = frame.right;
+        info.bottom = frame.bottom;
+        if (type == HWC_LAYER_TYPE_DIM)
+        {
+            info.bytes_per_pixel = 0;
+        }
+        else if (priv_handle.format == HAL_PIXEL_FORMAT_RGBA_FP16)
+        {
+            info.bytes_per_pixel = 8;
+        }
+        else
+        {
+            info.bytes_per_pixel = getBitsPerPixel(priv_handle.format) / 8;
+        }
+        info.is_mm = type == HWC_LAYER_TYPE_MM;
+        info.must_client = type == HWC_LAYER_TYPE_INVALID;
+        // the same rule as offloadMMtoClient()
+        info.must_device = type == HWC_LAYER_TYPE_MM &&
+                           (usageHasProtected(priv_handle.usage) || priv_handle.sec_handle != 0 ||
+                            layer->isHint(HWC_LAYER_TYPE_MM));
+    }
+    input->max_layer = max_layer;
+    display->getGlesRange(&input->gles_head, &input->gles_tail);
+}
+
 bool HrtCommon::isEnabled() const
 {
     return false;
@@ -187,37 +230,62 @@ void HrtCommon::simpleLayeringRule()
                     break;
             }
 
-            const int over_layer_count = committed_count - max_layer;
             if (has_clear_client_layers)
             {
                 gles_tail = static_cast<int>(layers.size()) - 1;
                 gles_head = 0;
+                hwc_display->setGlesRange(gles_head, gles_tail);
+                continue;
             }
-            else if (only_hwc_comp)
-            {
-                gles_tail = num_hwc_layers - 1;
-                gles_head = gles_tail - over_layer_count;
-            }
-            else
+
+            GlesRangeInput input;
+            fillGlesRangeInput(hwc_display, max_layer, &input);
+            if (!GlesRangePolicyManager::getInstance().choose(input, &gles_head, &gles_tail))
             {
-                const int hwc_num_after_gles_tail = num_hwc_layers - 1 - gles_tail;
-                const int hwc_num_before_gles_head = gles_head;
-                const int excess_layer = over_layer_count > hwc_num_after_gles_tail ?
-                                         over_layer_count - hwc_num_after_gles_tail : 0;
-                if (excess_layer > hwc_num_before_gles_head)
-                {
-                    HWC_LOGE("wrong GLES head range (%d,%d) (%d,%d)", gles_head, gles_tail, hwc_count, max_layer);
-                    abort();
-                }
-                gles_tail = excess_layer == 0 ?
-                            (gles_tail + over_layer_count) : (num_hwc_layers - 1);
-                gles_head -= excess_layer;
+                abort();
             }
             hwc_display->setGlesRange(gles_head, gles_tail);
         }
     }
 }
 
+void HrtCommon::updateGlesRangeByPolicy()
+{
+    for (uint64_t disp_id : m_disp_id_list)
+    {
+        HWCDisplay* hwc_display = m_displays[disp_id].get();
+        if (CC_UNLIKELY(hwc_display == nullptr))
+        {
+            HWC_LOGE("%s(): Failed to get display %" PRIu64, __FUNCTION__, disp_id);
+            HWC_ASSERT(0);
+            continue;
+        }
+
+        if (!hwc_display->isValid() || hwc_display->getMirrorSrc() != -1)
+            continue;
+
+        IOverlayDevice* ovl_dev = m_disp_devs[disp_id].get();
+        if (ovl_dev == nullptr || ovl_dev->getType() != OVL_DEVICE_TYPE_OVL)
+            continue;
+
+        DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(disp_id);
+        if (NULL == job)
+            continue;
+
+        // the hrt of the driver still extends the range if the bandwidth is not enough
+        int32_t gles_head = -1, gles_tail = -1;
+        GlesRangeInput input;
+        fillGlesRangeInput(hwc_display, static_cast<int>(job->num_layers), &input);
+        if (!input.isOverflow())
+            continue;
+
+        if (GlesRangePolicyManager::getInstance().choose(input, &gles_head, &gles_tail))
+        {
+            hwc_display->setGlesRange(gles_head, gles_tail);
+        }
+    }
+}
+
 void HrtCommon::fillLayerInfoOfDispatcherJob()
 {
     static unsigned int hrt_idx = 0;
@@ -422,6 +490,11 @@ void HrtCommon::run(const bool& is_skip_validate)
         return;
     }
 
+    if (GlesRangePolicyManager::getInstance().isUsedWithHrt())
+    {
+        updateGlesRangeByPolicy();
+    }
+
     fillLayerConfigList();
 
     fillDispLayer();
@@ -538,7 +611,9 @@ void HrtHelper::init(const std::vector<sp<HWCDisplay>>& displays, const std::vec
     {
         for (size_t i = m_hrt.size(); i < DisplayManager::MAX_DISPLAYS; ++i)
         {
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#if defined(MTK_HWC_USE_STUB_DEVICE)
+            m_hrt.push_back(sp<HrtCommon>(new StubHrt()));
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
             m_hrt.push_back(sp<HrtCommon>(new Hrt()));
 #else
             m_hrt.push_back(sp<HrtCommon>(new DrmHrt()));
@@ -564,7 +639,9 @@ void HrtHelper::init(const std::vector<sp<HWCDisplay>>& displays, const std::vec
     {
         for (size_t i = m_hrt.size(); i < HRT_TYPE_NUM; ++i)
         {
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#if defined(MTK_HWC_USE_STUB_DEVICE)
+            m_hrt.push_back(sp<HrtCommon>(new StubHrt()));
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
             m_hrt.push_back(sp<HrtCommon>(new Hrt()));
 #else
             m_hrt.push_back(sp<HrtCommon>(new DrmHrt()));
@@ -583,6 +660,7 @@ void HrtHelper::run(const bool& is_skip_validate)
         HWC_ASSERT(0);
         return;
     }
+    HwcRecordScope record_scope(HWC_RECORD_STAGE, HWC_RECORD_STAGE_HRT, HWC_DISPLAY_PRIMARY);
     m_hrt[HRT_TYPE_OVL]->run(is_skip_validate);
     m_hrt[HRT_TYPE_BLITDEV]->run(is_skip_validate);
 }
@@ -597,6 +675,7 @@ void HrtHelper::run(uint64_t disp_id, const bool& is_skip_validate)
     }
     if (disp_id < m_hrt.size())
     {
+        HwcRecordScope record_scope(HWC_RECORD_STAGE, HWC_RECORD_STAGE_HRT, disp_id);
         m_hrt[static_cast<size_t>(disp_id)]->run(is_skip_validate);
     }
     else
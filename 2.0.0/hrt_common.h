@@ -49,6 +49,9 @@ public:
 
     void simpleLayeringRule();
 
+    // let a cost based GlesRangePolicy choose the gles range before the hrt of the driver
+    void updateGlesRangeByPolicy();
+
     virtual void fillLayerConfigList() = 0;
 
     virtual void fillDispLayer() = 0;
@@ -33,6 +33,15 @@
 #include "display_dump.h"
 #include "glai_controller.h"
 #include "grallocdev.h"
+#include "hwc_recorder.h"
+#include "mc_estimator.h"
+#include "mc_model.h"
+#include "gles_range_policy.h"
+#include "buffer_pool.h"
+#include "memory_tracker.h"
+#ifdef MTK_HWC_USE_DRM_DEVICE
+#include "drm/drmedidcache.h"
+#endif
 
 #include "utils/transform.h"
 #include "ui/gralloc_extra.h"
@@ -85,13 +94,18 @@ void DisplayListener::onVSync(uint64_t dpy, nsecs_t timestamp, bool enabled)
     std::lock_guard<std::mutex> lock(m_vsync_lock);
     if (dpy != HWC_DISPLAY_EXTERNAL && dpy != HWC_DISPLAY_EXTERNAL_1 && dpy != HWC_DISPLAY_VIRTUAL && enabled)
     {
+        sp<HWCDisplay> hwc_display = HWCMediator::getInstance().getHWCDisplay(dpy);
+        if (hwc_display != nullptr)
+        {
+            hwc_display->updateVsyncFps(timestamp);
+        }
+
         if (m_callback_vsync)
         {
             m_callback_vsync(m_callback_vsync_data, dpy, timestamp);
         }
         else if (m_callback_vsync_2_4)
         {
-            sp<HWCDisplay> hwc_display = HWCMediator::getInstance().getHWCDisplay(dpy);
             hwc2_vsync_period_t period = static_cast<hwc2_vsync_period_t>(
                     hwc_display->getNextVsyncPeriod(timestamp));
             m_callback_vsync_2_4(m_callback_vsync_2_4_data, dpy, timestamp, period);
@@ -1138,6 +1152,11 @@ void HWCMediator::deviceDump(hwc2_device_t* /*device*/, uint32_t* outSize, char*
         dump_str.appendFormat("  cache_CT_private_hnd(vendor.debug.hwc.cache_CT_private_hnd):%d\n", Platform::getInstance().m_config.cache_CT_private_hnd);
         dump_str.appendFormat("  tolerance_time_to_refresh(vendor.debug.hwc.tolerance_time_to_refresh):%" PRId64"\n", Platform::getInstance().m_config.tolerance_time_to_refresh);
         dump_str.appendFormat("  check_skip_client_color_transform(vendor.debug.hwc.check_skip_client_color_transform):%d\n", Platform::getInstance().m_config.check_skip_client_color_transform);
+        dump_str.appendFormat("  skip_noop_commit(vendor.debug.hwc.skip_noop_commit):%d\n", Platform::getInstance().m_config.skip_noop_commit);
+        dump_str.appendFormat("  cursor_fast_path(vendor.debug.hwc.cursor_fast_path):%d\n", Platform::getInstance().m_config.cursor_fast_path);
+        dump_str.appendFormat("  commit_aggregate_mask(vendor.debug.hwc.commit_aggregate_mask):0x%x\n", Platform::getInstance().m_config.commit_aggregate_mask);
+        dump_str.appendFormat("  commit_aggregate_timeout(vendor.debug.hwc.commit_aggregate_timeout):%" PRId64 "\n", Platform::getInstance().m_config.commit_aggregate_timeout);
+        dump_str.appendFormat("  nonblock_commit(vendor.debug.hwc.nonblock_commit):%d\n", Platform::getInstance().m_config.nonblock_commit);
         dump_str.appendFormat("  plat_switch(vendor.debug.hwc.plat_switch):0x%x\n", Platform::getInstance().m_config.plat_switch);
         dump_str.appendFormat("  dbg_switch(vendor.debug.hwc.dbg_switch):0x%x\n", Platform::getInstance().m_config.dbg_switch);
         dump_str.appendFormat("  mml_switch(vendor.debug.hwc.mml_switch):%d\n", Platform::getInstance().m_config.mml_switch);
@@ -1149,6 +1168,7 @@ void HWCMediator::deviceDump(hwc2_device_t* /*device*/, uint32_t* outSize, char*
                 m_present_idx_height, m_present_idx_x, m_present_idx_y);
         dump_str.appendFormat("  is_bw_monitor_support(vendor.debug.hwc.is_bw_monitor_support):%d\n", Platform::getInstance().m_config.is_bw_monitor_support);
         dump_str.appendFormat("  is_smart_composition_support(vendor.debug.hwc.is_smart_composition_support):%d\n", Platform::getInstance().m_config.is_smart_composition_support);
+        dump_str.appendFormat("  is_inactive_set_support(vendor.debug.hwc.is_inactive_set_support):%d\n", Platform::getInstance().m_config.is_inactive_set_support);
         dump_str.appendFormat("  inactive_set_expired_cnt(vendor.debug.hwc.inactive_set_expired_cnt):%d\n", Platform::getInstance().m_config.inactive_set_expired_cnt);
         dump_str.appendFormat("  inactive_set_expired_duration(vendor.debug.hwc.inactive_set_expired_duration):%" PRId64 "\n", Platform::getInstance().m_config.inactive_set_expired_duration);
         dump_str.appendFormat("  is_validate_separate(vendor.debug.sf.validate_separate):%d\n", m_is_validate_separate);
@@ -1230,12 +1250,13 @@ void HWCMediator::deviceDump(hwc2_device_t* /*device*/, uint32_t* outSize, char*
                 m_present_idx_action, m_present_idx_display_id, m_present_idx_width,
                 m_present_idx_height, m_present_idx_x, m_present_idx_y);
 
-        dump_str.appendFormat(" ,%d,%d,%d,%" PRId64 ",%d",
+        dump_str.appendFormat(" ,%d,%d,%d,%" PRId64 ",%d,%d",
                 Platform::getInstance().m_config.is_bw_monitor_support,
                 Platform::getInstance().m_config.is_smart_composition_support,
                 Platform::getInstance().m_config.inactive_set_expired_cnt,
                 Platform::getInstance().m_config.inactive_set_expired_duration,
-                Platform::getInstance().m_config.bwm_skip_hrt_calc);
+                Platform::getInstance().m_config.bwm_skip_hrt_calc,
+                Platform::getInstance().m_config.is_inactive_set_support);
 
         dump_str.appendFormat(" ,%d\n\n",
                 m_is_validate_separate);
@@ -1301,6 +1322,21 @@ void HWCMediator::deviceDump(hwc2_device_t* /*device*/, uint32_t* outSize, char*
         {
             GlaiController::getInstance().dump(&dump_str);
         }
+        AiBluLightDefender::getInstance().dump(&dump_str);
+        getPqDevice()->dump(&dump_str);
+        HwcCallRecorder::getInstance().dump(&dump_str);
+        if (!Platform::getInstance().m_config.hwc_mcycle_table.empty())
+        {
+            MCycleEstimator::getInstance().dump(&dump_str);
+            MCycleModelManager::getInstance().dump(&dump_str);
+            MCycleEstimator::getInstance().save();
+        }
+        GlesRangePolicyManager::getInstance().dump(&dump_str);
+        DisplayBufferPool::getInstance().dump(&dump_str);
+        MemoryTracker::getInstance().dump(&dump_str);
+#ifdef MTK_HWC_USE_DRM_DEVICE
+        DrmEdidCache::getInstance().dump(&dump_str);
+#endif
         dump_str.appendFormat("\n");
 
         dump_str.appendFormat("[ComposerExt]\n");
@@ -1336,6 +1372,79 @@ void HWCMediator::updatePlatformConfig(bool is_init)
         }
     }
 
+    // 0: static hwc_mcycle_table only, 1: learn mc only (default), 2: learn mc and blend it into the table
+    property_get("vendor.debug.hwc.mc_learn", value, "-1");
+    if (-1 != atoi(value))
+    {
+        MCycleEstimator::getInstance().setMode(atoi(value));
+    }
+
+    // 0: hwc_mcycle_table, 1: the table extrapolated past its largest scenarios,
+    // 2: the extrapolated table corrected by the learned pixel/secure/mirror/dirty terms
+    property_get("vendor.debug.hwc.mc_model", value, "-1");
+    if (-1 != atoi(value))
+    {
+        MCycleModelManager::getInstance().setModel(atoi(value));
+    }
+
+    // 0: no scoring (default), 1: score every mc model against the measured cost in dumpsys,
+    // the linear model only learns while it is on
+    property_get("vendor.debug.hwc.mc_model_score", value, "-1");
+    if (-1 != atoi(value))
+    {
+        MCycleModelManager::getInstance().setScoring(atoi(value) != 0);
+    }
+
+    // 0: extend the gles range of the layer validation, 1: choose the cheapest range by cost
+    property_get("vendor.debug.hwc.gles_range_policy", value, "-1");
+    if (-1 != atoi(value))
+    {
+        GlesRangePolicyManager::getInstance().setPolicy(atoi(value));
+    }
+
+    // the KB of the idle output buffers which DisplayBufferPool keeps, 0 to disable it
+    property_get("vendor.debug.hwc.dbq_pool_budget", value, "-1");
+    if (atoi(value) >= 0)
+    {
+        DisplayBufferPool::getInstance().setBudget(static_cast<size_t>(atoi(value)) * 1024);
+    }
+
+    // the KB of the graphics memory which HWC allocates, over the soft budget the idle pool
+    // buffers and then the queues idle for 1s are trimmed, over the hard one the allocation
+    // fails, 0 means no limit
+    property_get("vendor.debug.hwc.mem_soft_budget", value, "0");
+    const int mem_soft_budget = atoi(value);
+    property_get("vendor.debug.hwc.mem_hard_budget", value, "0");
+    const int mem_hard_budget = atoi(value);
+    if (mem_soft_budget >= 0 && mem_hard_budget >= 0)
+    {
+        MemoryTracker::getInstance().setBudget(static_cast<size_t>(mem_soft_budget) * 1024,
+                                               static_cast<size_t>(mem_hard_budget) * 1024);
+    }
+
+    // path to persist the learned mc across boots, "0" to disable
+    property_get("vendor.debug.hwc.mc_learn_persist", value, "-1");
+    if (strcmp(value, "-1") != 0)
+    {
+        MCycleEstimator::getInstance().setPersistPath(value);
+    }
+
+#ifdef MTK_HWC_USE_DRM_DEVICE
+    // path to persist the modes of known hdmi sinks, "0" to keep them in memory only
+    property_get("vendor.debug.hwc.edid_cache_persist", value, "-1");
+    if (strcmp(value, "-1") != 0)
+    {
+        DrmEdidCache::getInstance().setPersistPath(value);
+    }
+#endif
+
+    // 0: set the open-loop uclamp of calculatePerf(), 1: correct it by the measured work time
+    property_get("vendor.debug.hwc.uclamp_feedback", value, "-1");
+    if (-1 != atoi(value))
+    {
+        UClampController::setFeedbackEnable(atoi(value) != 0);
+    }
+
     // if the property only update when someone call dump function, add it in below section
     if (!is_init)
     {
@@ -1687,6 +1796,37 @@ void HWCMediator::updatePlatformConfig(bool is_init)
                 static_cast<uint32_t>(atoi(value));
         }
 
+        property_get("vendor.debug.hwc.skip_noop_commit", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.skip_noop_commit = atoi(value);
+        }
+
+        property_get("vendor.debug.hwc.cursor_fast_path", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.cursor_fast_path = atoi(value);
+        }
+
+        property_get("vendor.debug.hwc.commit_aggregate_mask", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.commit_aggregate_mask =
+                static_cast<uint32_t>(atoi(value));
+        }
+
+        property_get("vendor.debug.hwc.commit_aggregate_timeout", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.commit_aggregate_timeout = atoi(value);
+        }
+
+        property_get("vendor.debug.hwc.nonblock_commit", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.nonblock_commit = atoi(value);
+        }
+
         property_get("vendor.debug.hwc.mml_switch", value, "-1");
         if (-1 != atoi(value))
         {
@@ -1707,12 +1847,31 @@ void HWCMediator::updatePlatformConfig(bool is_init)
             GlaiController::getInstance().setInferenceWoFence(atoi(value));
         }
 
+        // format: <max model count>,<memory budget in KB>
+        property_get("vendor.debug.hwc.glai_model_budget", value, "-1");
+        if (-1 != atoi(value))
+        {
+            size_t max_count = 0;
+            size_t budget_kb = 0;
+            if (sscanf(value, "%zu,%zu", &max_count, &budget_kb) == 2)
+            {
+                GlaiController::getInstance().setModelBudget(max_count, budget_kb * 1024);
+            }
+        }
+
         property_get("vendor.debug.hwc.aibld_dump_enable", value, "-1");
         if (-1 != atoi(value))
         {
             AiBluLightDefender::getInstance().setDumpEnable(atoi(value) != 0);
         }
 
+        // path of the HWC2 call-stream trace, "0" to stop recording
+        property_get("vendor.debug.hwc.record_call", value, "-1");
+        if (strcmp(value, "-1") != 0)
+        {
+            HwcCallRecorder::getInstance().setOutputPath(value);
+        }
+
         property_get("vendor.debug.hwc.useColorTransformIoctl", value, "-1");
         if (atoi(value) != -1)
         {
@@ -1855,6 +2014,13 @@ void HWCMediator::updatePlatformConfig(bool is_init)
             Platform::getInstance().m_config.is_smart_composition_support = atoi(value);
         }
 
+        // 0: keep the inactive layers on the planes, 1: move a stable inactive layerset to the client target
+        property_get("vendor.debug.hwc.is_inactive_set_support", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.is_inactive_set_support = atoi(value);
+        }
+
         property_get("vendor.debug.hwc.inactive_set_expired_cnt", value, "-1");
         if (-1 != atoi(value))
         {
@@ -2145,6 +2311,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayAcceptChanges(
 {
     CHECK_DISP_CONNECT(display);
 
+    HWC_RECORD_CALL(HWC_RECORD_ACCEPT_CHANGES, display, 0, nullptr, 0);
     getHWCDisplay(display)->acceptChanges();
 
     return HWC2_ERROR_NONE;
@@ -2157,7 +2324,12 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayCreateLayer(
 {
     CHECK_DISP_CONNECT(display);
 
-    return getHWCDisplay(display)->createLayer(out_layer, false);
+    int32_t err = getHWCDisplay(display)->createLayer(out_layer, false);
+    if (err == HWC2_ERROR_NONE)
+    {
+        HWC_RECORD_CALL(HWC_RECORD_CREATE_LAYER, display, *out_layer, nullptr, 0);
+    }
+    return err;
 }
 
 int32_t /*hwc2_error_t*/ HWCMediator::displayDestroyLayer(
@@ -2176,6 +2348,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayDestroyLayer(
         return HWC2_ERROR_BAD_LAYER;
     }
 
+    HWC_RECORD_CALL(HWC_RECORD_DESTROY_LAYER, display, layer, nullptr, 0);
     return hwc_display->destroyLayer(layer);
 }
 
@@ -2525,6 +2698,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayPresent(
 {
     CHECK_DISP(display);
 
+    HwcRecordScope record_scope(HWC_RECORD_PRESENT, HWC_RECORD_STAGE_PRESENT, display);
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
 
     HWC_LOGV("(%" PRIu64 ") %s", display, __func__);
@@ -2675,11 +2849,11 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayPresent(
     }
 
     HWC_LOGV("(%" PRIu64 ") %s out_retire_fence:%d", display, __func__, *out_retire_fence);
+    record_scope.setResult(*out_retire_fence >= 0 ? 1 : 0);
 
     hwc_display->afterPresent();
     hwc_display->setValiPresentState(HWC_VALI_PRESENT_STATE_PRESENT_DONE, __LINE__);
     notifyHwbinderTid();
-    getPqDevice()->afterPresent();
     return HWC2_ERROR_NONE;
 }
 
@@ -2719,7 +2893,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetClientTarget(
     hwc2_display_t display,
     buffer_handle_t handle,
     int32_t acquire_fence,
-    int32_t /*dataspace*/,
+    int32_t dataspace,
     hwc_region_t damage)
 {
     CHECK_DISP_CONNECT(display);
@@ -2727,6 +2901,12 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetClientTarget(
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
     sp<HWCLayer> ct = hwc_display->getClientTarget();
 
+    if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled()))
+    {
+        HwcCallRecorder::getInstance().recordClientTarget(display, systemTime(), handle, acquire_fence,
+                                                          dataspace, damage, ct->getId());
+    }
+
     ct->setHandle(handle);
     ct->setAcquireFenceFd(acquire_fence);
     ct->setDataspace(mapColorMode2DataSpace(hwc_display->getColorMode()));
@@ -2770,6 +2950,15 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetColorTransform(
 
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
 
+    if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled()) && matrix != nullptr)
+    {
+        HwcRecordColorTransform record_transform;
+        memcpy(record_transform.matrix, matrix, sizeof(record_transform.matrix));
+        record_transform.hint = hint;
+        HwcCallRecorder::getInstance().record(HWC_RECORD_SET_COLOR_TRANSFORM, display, 0, systemTime(),
+                                              &record_transform, sizeof(record_transform));
+    }
+
     return getHWCDisplay(display)->setColorTransform(matrix, hint);
 
 }
@@ -2815,6 +3004,11 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetPowerMode(
         case HWC2_POWER_MODE_DOZE:
         case HWC2_POWER_MODE_DOZE_SUSPEND:
             getHWCDisplay(display)->setPowerMode(mode);
+            if (mode == HWC2_POWER_MODE_OFF && display == HWC_DISPLAY_PRIMARY)
+            {
+                // no frame is composed while the screen is off, a good time to write the file
+                MCycleEstimator::getInstance().save();
+            }
             break;
 
         default:
@@ -3062,6 +3256,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayValidateDisplay(
 {
     CHECK_DISP(display);
 
+    HwcRecordScope record_scope(HWC_RECORD_VALIDATE, HWC_RECORD_STAGE_VALIDATE, display);
     if (m_present_idx_action >= 0)
     {
         sp<HWCDisplay> hwc_display = getHWCDisplay(m_present_idx_display_id);
@@ -3307,6 +3502,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayValidateDisplay(
     hwc_display->moveChangedHWCRequests(&hwclayer_requests);
     *out_num_types = static_cast<uint32_t>(changed_comp_types.size());
     *out_num_requests = static_cast<uint32_t>(hwclayer_requests.size());
+    record_scope.setResult(static_cast<int32_t>(*out_num_types));
 
     hwc_display->setValiPresentState(HWC_VALI_PRESENT_STATE_VALIDATE_DONE, __LINE__);
     m_gpuc_skip_validate = false;
@@ -3590,6 +3786,13 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerSetCursorPosition(
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
     sp<HWCLayer> ct = hwc_display->getClientTarget();
 
+    if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled()))
+    {
+        HwcRecordPoint record_point = {x, y};
+        HwcCallRecorder::getInstance().record(HWC_RECORD_SET_CURSOR_POSITION, display, layer,
+                                              systemTime(), &record_point, sizeof(record_point));
+    }
+
     // when set with client target, it is for present_after_ts
     // new API add for this on Android T, from google comment
     if (ct->getId() == layer)
@@ -3598,8 +3801,14 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerSetCursorPosition(
         ts = static_cast<nsecs_t>(static_cast<uint64_t>(x) << 32 | static_cast<uint32_t>(y));
 
         hwc_display->setSfTargetTs(ts);
+        return HWC2_ERROR_NONE;
     }
 
+    sp<HWCLayer> hwc_layer = hwc_display->getLayer(layer);
+    CHECK_DISP_LAYER(display, layer, hwc_layer);
+
+    hwc_display->moveCursor(hwc_layer, x, y);
+
     return HWC2_ERROR_NONE;
 }
 
@@ -3627,6 +3836,11 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerSetBuffer(
         hwc_display->editSetBufFromSfLog().printf("%" PRIu64 ",null", layer);
     }
 
+    if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled()))
+    {
+        HwcCallRecorder::getInstance().recordBuffer(display, layer, systemTime(), buffer, acquire_fence);
+    }
+
     hwc_layer->setHandle(buffer);
     hwc_layer->setAcquireFenceFd(acquire_fence);
 
@@ -3644,6 +3858,11 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerSetSurfaceDamage(
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
     CHECK_DISP_LAYER(display, layer_id, layer);
 
+    if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled()))
+    {
+        HwcCallRecorder::getInstance().recordRegion(HWC_RECORD_SET_DAMAGE, display, layer_id, systemTime(), damage);
+    }
+
     layer->setDamage(damage);
 
     return HWC2_ERROR_NONE;
@@ -3661,6 +3880,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetBlendMode(
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
     CHECK_DISP_LAYER(display, layer_id, layer);
 
+    HWC_RECORD_CALL(HWC_RECORD_SET_BLEND, display, layer_id, &mode, sizeof(mode));
     switch (mode)
     {
         case HWC2_BLEND_MODE_NONE:
@@ -3686,6 +3906,8 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetColor(
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
     CHECK_DISP_LAYER(display, layer_id, layer);
 
+    HwcRecordColor record_color = {color.r, color.g, color.b, color.a};
+    HWC_RECORD_CALL(HWC_RECORD_SET_COLOR, display, layer_id, &record_color, sizeof(record_color));
     layer->setLayerColor(color);
 
     return HWC2_ERROR_NONE;
@@ -3708,6 +3930,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetCompositionType(
     auto&& layer = hwc_display->getLayer(layer_id);
     CHECK_DISP_LAYER(display, layer_id, layer);
 
+    HWC_RECORD_CALL(HWC_RECORD_SET_COMP_TYPE, display, layer_id, &type, sizeof(type));
     int32_t previous_compoition_type = layer->getReturnedCompositionType();
     switch (type)
     {
@@ -3762,6 +3985,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetDataSpace(
     CHECK_DISP_LAYER(display, layer, hwc_layer);
 
     HWC_LOGV("(%" PRIu64 ") layerSetDataSpace() layer id:%" PRIu64 " dataspace:%d", display, layer, dataspace);
+    HWC_RECORD_CALL(HWC_RECORD_SET_DATASPACE, display, layer, &dataspace, sizeof(dataspace));
 
     int32_t layer_dataspace = dataspace;
     if ((dataspace & HAL_DATASPACE_STANDARD_MASK) == HAL_DATASPACE_STANDARD_UNSPECIFIED)
@@ -3829,6 +4053,15 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetDisplayFrame(
     HWC_LOGV("%s: (%" PRIu64 ") layer id:%" PRIu64 " frame[%d,%d,%d,%d] ",
         __func__, display, layer_id, frame.left, frame.top, frame.right, frame.bottom);
 
+    HwcRecordRect record_frame = {frame.left, frame.top, frame.right, frame.bottom};
+    HWC_RECORD_CALL(HWC_RECORD_SET_DISPLAY_FRAME, display, layer_id, &record_frame, sizeof(record_frame));
+
+    // the frame from SF is newer than the position which the cursor worker moved to
+    if (layer->getReturnedCompositionType() == HWC2_COMPOSITION_CURSOR &&
+        memcmp(&layer->getDisplayFrame(), &frame, sizeof(hwc_rect_t)) != 0)
+    {
+        getOvlDevice(display)->resetCursor(display);
+    }
     layer->setDisplayFrame(frame);
 
     return HWC2_ERROR_NONE;
@@ -3845,6 +4078,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetPlaneAlpha(
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
     CHECK_DISP_LAYER(display, layer_id, layer);
 
+    HWC_RECORD_CALL(HWC_RECORD_SET_PLANE_ALPHA, display, layer_id, &alpha, sizeof(alpha));
     layer->setPlaneAlpha(alpha);
 
     return HWC2_ERROR_NONE;
@@ -3852,10 +4086,19 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetPlaneAlpha(
 
 int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetSidebandStream(
     hwc2_device_t* /*device*/,
-    hwc2_display_t /*display*/,
-    hwc2_layer_t /*layer*/,
-    const native_handle_t* /*stream*/)
+    hwc2_display_t display,
+    hwc2_layer_t layer,
+    const native_handle_t* stream)
 {
+    if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled()))
+    {
+        HwcRecordSideband record_sideband;
+        record_sideband.handle = reinterpret_cast<uint64_t>(stream);
+        record_sideband.num_fds = stream ? stream->numFds : 0;
+        record_sideband.num_ints = stream ? stream->numInts : 0;
+        HwcCallRecorder::getInstance().record(HWC_RECORD_SET_SIDEBAND_STREAM, display, layer, systemTime(),
+                                              &record_sideband, sizeof(record_sideband));
+    }
     return HWC2_ERROR_NONE;
 }
 
@@ -3874,6 +4117,8 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetSourceCrop(
         return HWC2_ERROR_BAD_LAYER;
     }
 
+    HwcRecordFRect record_crop = {crop.left, crop.top, crop.right, crop.bottom};
+    HWC_RECORD_CALL(HWC_RECORD_SET_SOURCE_CROP, display, layer_id, &record_crop, sizeof(record_crop));
     layer->setSourceCrop(crop);
     return HWC2_ERROR_NONE;
 }
@@ -3889,6 +4134,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetTransform(
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
     CHECK_DISP_LAYER(display, layer_id, layer);
 
+    HWC_RECORD_CALL(HWC_RECORD_SET_TRANSFORM, display, layer_id, &transform, sizeof(transform));
     switch (transform)
     {
         case 0:
@@ -3922,6 +4168,10 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetVisibleRegion(
     CHECK_DISP_LAYER(display, layer_id, layer);
 
     HWC_LOGV("(%" PRIu64 ") layerSetVisibleRegion() layer id:%" PRIu64, display, layer_id);
+    if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled()))
+    {
+        HwcCallRecorder::getInstance().recordRegion(HWC_RECORD_SET_VISIBLE_REGION, display, layer_id, systemTime(), visible);
+    }
     layer->setVisibleRegion(visible);
     layer->setVisible(true);
 
@@ -3939,6 +4189,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetZOrder(
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
     CHECK_DISP_LAYER(display, layer_id, layer);
 
+    HWC_RECORD_CALL(HWC_RECORD_SET_Z_ORDER, display, layer_id, &z, sizeof(z));
     layer->setZOrder(z);
     return HWC2_ERROR_NONE;
 }
@@ -3962,6 +4213,12 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetPerFrameMetadata(
         return HWC2_ERROR_BAD_PARAMETER;
     }
 
+    if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled()))
+    {
+        HwcCallRecorder::getInstance().recordPerFrameMetadata(display, layer_id, systemTime(),
+                                                              numElements, keys, metadata);
+    }
+
     std::map<int32_t, float> per_frame_metadata;
     for (uint32_t i = 0; i < numElements; ++i)
     {
@@ -3991,6 +4248,12 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetPerFrameMetadataBlobs(
         return HWC2_ERROR_BAD_PARAMETER;
     }
 
+    if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled()))
+    {
+        HwcCallRecorder::getInstance().recordPerFrameMetadataBlobs(display, layer_id, systemTime(),
+                                                                   numElements, keys, sizes, metadata);
+    }
+
     std::map<int32_t, std::vector<uint8_t> > per_frame_metadata_blobs;
     uint32_t shift = 0;
     for (uint32_t i = 0; i < numElements; ++i)
@@ -4021,6 +4284,14 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetLayerColorTransform(
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
     CHECK_DISP_LAYER(display, layer_id, layer);
+
+    if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled()) && matrix != nullptr)
+    {
+        HwcRecordMatrix record_matrix;
+        memcpy(record_matrix.matrix, matrix, sizeof(record_matrix.matrix));
+        HwcCallRecorder::getInstance().record(HWC_RECORD_SET_LAYER_COLOR_TRANSFORM, display, layer_id,
+                                              systemTime(), &record_matrix, sizeof(record_matrix));
+    }
     layer->setColorTransform(matrix);
     return HWC2_ERROR_NONE;
 }
@@ -4035,6 +4306,8 @@ int32_t HWCMediator::layerSetLayerBrightness(
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
     CHECK_DISP_LAYER(display, layer_id, layer);
+
+    HWC_RECORD_CALL(HWC_RECORD_SET_LAYER_BRIGHTNESS, display, layer_id, &brightness, sizeof(brightness));
     return layer->setBrightness(brightness);
 }
 
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <stdint.h>
+
+// On-disk layout of the HWC2 call-stream trace written by HwcCallRecorder.
+// This header must stay free of Android dependencies, it is shared with the
+// host-side decoder in tools/hwc_replay.cpp.
+//
+// file   := HwcRecordFileHeader record*
+// record := HwcRecordHeader payload[HwcRecordHeader.size]
+//
+// All values are little-endian, as written by the device.
+
+#define HWC_RECORD_MAGIC 0x52435748 // "HWCR"
+#define HWC_RECORD_VERSION 3
+// oldest version the decoder still reads, version 1 has no record after STAGE
+#define HWC_RECORD_MIN_VERSION 1
+
+#define HWC_RECORD_MAX_RECTS 32
+#define HWC_RECORD_MAX_METADATA 32
+#define HWC_RECORD_MAX_BLOB_BYTES 1024
+#define HWC_RECORD_MAX_MC_ENTRIES 32
+
+enum HwcRecordType
+{
+    HWC_RECORD_CREATE_LAYER = 1,
+    HWC_RECORD_DESTROY_LAYER,
+    HWC_RECORD_SET_BUFFER,
+    HWC_RECORD_SET_DAMAGE,
+    HWC_RECORD_SET_BLEND,
+    HWC_RECORD_SET_COLOR,
+    HWC_RECORD_SET_COMP_TYPE,
+    HWC_RECORD_SET_DATASPACE,
+    HWC_RECORD_SET_DISPLAY_FRAME,
+    HWC_RECORD_SET_PLANE_ALPHA,
+    HWC_RECORD_SET_SOURCE_CROP,
+    HWC_RECORD_SET_TRANSFORM,
+    HWC_RECORD_SET_VISIBLE_REGION,
+    HWC_RECORD_SET_Z_ORDER,
+    HWC_RECORD_VALIDATE,
+    HWC_RECORD_PRESENT,
+    HWC_RECORD_ACCEPT_CHANGES,
+    HWC_RECORD_STAGE,
+    // added in version 2
+    HWC_RECORD_SET_CURSOR_POSITION,
+    HWC_RECORD_SET_SIDEBAND_STREAM,
+    HWC_RECORD_SET_PER_FRAME_METADATA,
+    HWC_RECORD_SET_PER_FRAME_METADATA_BLOBS,
+    HWC_RECORD_SET_LAYER_COLOR_TRANSFORM,
+    HWC_RECORD_SET_LAYER_BRIGHTNESS,
+    HWC_RECORD_SET_CLIENT_TARGET,
+    HWC_RECORD_SET_COLOR_TRANSFORM,
+    // added in version 3
+    HWC_RECORD_MC_TABLE,
+    HWC_RECORD_MC_FEATURE,
+    HWC_RECORD_TYPE_NUM,
+};
+
+// stages reported by HWC_RECORD_STAGE, VALIDATE and PRESENT carry their own
+// timing so they are not repeated as stage records
+enum HwcRecordStage
+{
+    HWC_RECORD_STAGE_VALIDATE = 0,
+    HWC_RECORD_STAGE_HRT,
+    HWC_RECORD_STAGE_DISPATCH,
+    HWC_RECORD_STAGE_OVL_COMMIT,
+    HWC_RECORD_STAGE_PRESENT,
+    HWC_RECORD_STAGE_NUM,
+};
+
+struct __attribute__((packed)) HwcRecordFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;   // sizeof(HwcRecordFileHeader) of the writer
+    int64_t start_ts;       // systemTime() when the recording was started
+};
+
+struct __attribute__((packed)) HwcRecordHeader
+{
+    uint16_t type;          // HwcRecordType
+    uint16_t size;          // payload bytes following this header
+    uint32_t display;
+    uint64_t layer;
+    int64_t ts;             // systemTime() when the call was entered
+};
+
+struct __attribute__((packed)) HwcRecordRect
+{
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+};
+
+struct __attribute__((packed)) HwcRecordFRect
+{
+    float left;
+    float top;
+    float right;
+    float bottom;
+};
+
+// payload of SET_DAMAGE and SET_VISIBLE_REGION, followed by num_rects rects
+struct __attribute__((packed)) HwcRecordRegion
+{
+    uint32_t num_rects;     // rects stored, capped to HWC_RECORD_MAX_RECTS
+    uint32_t total_rects;   // rects passed by SurfaceFlinger
+};
+
+// payload of SET_BUFFER, filled from PrivateHandle
+struct __attribute__((packed)) HwcRecordBuffer
+{
+    uint64_t handle;        // buffer_handle_t value, only used as an identity
+    uint64_t alloc_id;
+    uint32_t width;
+    uint32_t height;
+    uint32_t y_stride;
+    uint32_t vstride;
+    uint32_t format;
+    uint32_t usage;
+    int32_t size;
+    int32_t acquire_fence;  // the fd is not usable offline, only -1 or not matters
+};
+
+struct __attribute__((packed)) HwcRecordColor
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a;
+};
+
+// payload of VALIDATE, PRESENT and STAGE
+struct __attribute__((packed)) HwcRecordTiming
+{
+    uint32_t stage;         // HwcRecordStage
+    int32_t result;         // VALIDATE: changed types, PRESENT: 1 if a retire fence is returned,
+                            // -1 if the call returned early
+    int64_t wall_ns;
+    int64_t cpu_ns;         // CPU time of the calling thread
+};
+
+// payload of SET_CURSOR_POSITION, the layer is the client target when
+// SurfaceFlinger passes its expected present time
+struct __attribute__((packed)) HwcRecordPoint
+{
+    int32_t x;
+    int32_t y;
+};
+
+// payload of SET_SIDEBAND_STREAM
+struct __attribute__((packed)) HwcRecordSideband
+{
+    uint64_t handle;        // native_handle_t value, only used as an identity
+    int32_t num_fds;
+    int32_t num_ints;
+};
+
+// payload of SET_PER_FRAME_METADATA, followed by num_keys HwcRecordMetadataValue,
+// and of SET_PER_FRAME_METADATA_BLOBS, followed by num_keys HwcRecordMetadataBlob
+// and then the stored blob bytes
+struct __attribute__((packed)) HwcRecordMetadata
+{
+    uint32_t num_keys;      // keys stored, capped to HWC_RECORD_MAX_METADATA
+    uint32_t total_keys;    // keys passed by SurfaceFlinger
+};
+
+struct __attribute__((packed)) HwcRecordMetadataValue
+{
+    int32_t key;
+    float value;
+};
+
+struct __attribute__((packed)) HwcRecordMetadataBlob
+{
+    int32_t key;
+    uint32_t size;          // blob size passed by SurfaceFlinger
+    uint32_t stored;        // bytes stored, HWC_RECORD_MAX_BLOB_BYTES in total
+};
+
+// payload of SET_LAYER_COLOR_TRANSFORM
+struct __attribute__((packed)) HwcRecordMatrix
+{
+    float matrix[16];
+};
+
+// payload of SET_COLOR_TRANSFORM
+struct __attribute__((packed)) HwcRecordColorTransform
+{
+    float matrix[16];
+    int32_t hint;
+};
+
+// payload of SET_CLIENT_TARGET, followed by the damage as a HwcRecordRegion
+// and its rects. The record layer is the id of the client target layer.
+struct __attribute__((packed)) HwcRecordClientTarget
+{
+    HwcRecordBuffer buffer;
+    int32_t dataspace;
+};
+
+// payload of MC_TABLE, followed by num_entries HwcRecordMCycleEntry. It is the
+// hwc_mcycle_table of the platform, recorded once when the recording starts.
+struct __attribute__((packed)) HwcRecordMCycleTable
+{
+    uint32_t num_entries;   // entries stored, capped to HWC_RECORD_MAX_MC_ENTRIES
+};
+
+struct __attribute__((packed)) HwcRecordMCycleEntry
+{
+    int32_t id;
+    float main_mc;
+    float dispatcher_mc;
+    float ovl_mc;
+};
+
+// flags of HwcRecordMCycleFeature
+#define HWC_RECORD_MC_FBT 0x1
+#define HWC_RECORD_MC_SECURE 0x2
+#define HWC_RECORD_MC_MIRROR_SRC 0x4
+#define HWC_RECORD_MC_MIRROR_DST 0x8
+#define HWC_RECORD_MC_VIRTUAL 0x10
+
+// payload of MC_FEATURE, the MCycleFeature of a frame and the CPU that one
+// HWC thread spent on it, so the mega-cycle models can be scored offline
+struct __attribute__((packed)) HwcRecordMCycleFeature
+{
+    uint32_t thread;        // MCycleEstimator::THREAD_*
+    uint32_t cpu_mhz;       // average frequency of the CPU over the frame
+    int64_t cpu_ns;         // CPU time of the thread
+    int32_t num_ui_layers;
+    int32_t num_mdp_layers;
+    int32_t num_mml_layers;
+    int32_t num_glai_layers;
+    int32_t num_dirty_layers;
+    uint32_t flags;         // HWC_RECORD_MC_*
+    uint32_t pixels;
+};
@@ -0,0 +1,529 @@
+#define DEBUG_LOG_TAG "RECORDER"
+
+#include "hwc_recorder.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+#include "mc_model.h"
+#include "platform_wrap.h"
+
+// ---------------------------------------------------------------------------
+
+HwcCallRecorder& HwcCallRecorder::getInstance()
+{
+    static HwcCallRecorder gInstance;
+    return gInstance;
+}
+
+HwcCallRecorder::HwcCallRecorder()
+    : m_enabled(false)
+    , m_fd(-1)
+    , m_pending_bytes(0)
+    , m_writer_stop(false)
+    , m_record_count(0)
+    , m_record_bytes(0)
+    , m_write_errors(0)
+    , m_drop_count(0)
+{
+}
+
+HwcCallRecorder::~HwcCallRecorder()
+{
+    std::lock_guard<std::mutex> control_lock(m_control_lock);
+    close();
+}
+
+void HwcCallRecorder::setOutputPath(const char* path)
+{
+    std::lock_guard<std::mutex> control_lock(m_control_lock);
+
+    const bool stop = (path == nullptr || path[0] == '\0' || strcmp(path, "0") == 0);
+    if (!stop)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_fd >= 0 && m_path == path)
+        {
+            return;
+        }
+    }
+
+    close();
+    if (!stop)
+    {
+        open(path);
+        recordMCycleTable();
+    }
+}
+
+void HwcCallRecorder::open(const char* path)
+{
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0660);
+    if (fd < 0)
+    {
+        HWC_LOGE("%s: failed to open %s: %s", __func__, path, strerror(errno));
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_fd = fd;
+    m_path = path;
+    m_record_count = 0;
+    m_record_bytes = 0;
+    m_write_errors = 0;
+    m_drop_count = 0;
+    m_pending_bytes = 0;
+    m_writer_stop = false;
+    m_buffer.clear();
+    m_buffer.reserve(FLUSH_THRESHOLD * 2);
+
+    HwcRecordFileHeader header;
+    header.magic = HWC_RECORD_MAGIC;
+    header.version = HWC_RECORD_VERSION;
+    header.header_size = static_cast<uint16_t>(sizeof(HwcRecordFileHeader));
+    header.start_ts = systemTime();
+    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(&header);
+    m_buffer.insert(m_buffer.end(), ptr, ptr + sizeof(header));
+
+    m_writer = std::thread(&HwcCallRecorder::writerLoop, this, fd);
+    if (pthread_setname_np(m_writer.native_handle(), "HwcRecorder"))
+    {
+        HWC_LOGI("pthread_setname_np HwcRecorder fail");
+    }
+
+    m_enabled.store(true, std::memory_order_relaxed);
+    HWC_LOGI("%s: start to record HWC2 calls into %s", __func__, path);
+}
+
+void HwcCallRecorder::close()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_enabled.store(false, std::memory_order_relaxed);
+    if (m_fd < 0)
+    {
+        return;
+    }
+
+    // the writer drains everything queued before it stops
+    queueBufferLocked();
+    m_writer_stop = true;
+    m_cond.notify_one();
+    std::thread writer = std::move(m_writer);
+    lock.unlock();
+    if (writer.joinable())
+    {
+        writer.join();
+    }
+    lock.lock();
+
+    protectedClose(m_fd);
+    m_fd = -1;
+    m_free.clear();
+    HWC_LOGI("%s: stop recording, %" PRIu64 " records %" PRIu64 " bytes (%" PRIu64 " dropped) into %s",
+             __func__, m_record_count, m_record_bytes, m_drop_count, m_path.c_str());
+}
+
+void HwcCallRecorder::queueBufferLocked()
+{
+    if (m_buffer.empty())
+    {
+        return;
+    }
+
+    m_pending_bytes += m_buffer.size();
+    m_pending.push_back(std::move(m_buffer));
+    if (m_free.empty())
+    {
+        m_buffer = std::vector<uint8_t>();
+        m_buffer.reserve(FLUSH_THRESHOLD * 2);
+    }
+    else
+    {
+        m_buffer = std::move(m_free.back());
+        m_free.pop_back();
+    }
+    m_cond.notify_one();
+}
+
+void HwcCallRecorder::writerLoop(int fd)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (true)
+    {
+        m_cond.wait(lock, [this] { return m_writer_stop || !m_pending.empty(); });
+        if (m_pending.empty())
+        {
+            break;
+        }
+
+        std::vector<std::vector<uint8_t> > chunks;
+        chunks.swap(m_pending);
+        lock.unlock();
+
+        uint64_t written = 0;
+        uint64_t errors = 0;
+        size_t queued = 0;
+        for (auto& chunk : chunks)
+        {
+            size_t offset = 0;
+            while (errors == 0 && offset < chunk.size())
+            {
+                ssize_t res = write(fd, chunk.data() + offset, chunk.size() - offset);
+                if (res < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    errors++;
+                    HWC_LOGE("%s: failed to write %s: %s", __func__, m_path.c_str(), strerror(errno));
+                    break;
+                }
+                offset += static_cast<size_t>(res);
+            }
+            written += offset;
+            queued += chunk.size();
+            chunk.clear();
+        }
+
+        lock.lock();
+        m_record_bytes += written;
+        m_write_errors += errors;
+        m_pending_bytes -= queued;
+        // keep the capacity of two chunks, it is enough to ping-pong with record()
+        for (auto& chunk : chunks)
+        {
+            if (m_free.size() >= 2)
+            {
+                break;
+            }
+            m_free.push_back(std::move(chunk));
+        }
+    }
+}
+
+void HwcCallRecorder::record(uint16_t type, uint64_t dpy, uint64_t layer, nsecs_t ts,
+                             const void* payload, size_t size)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    if (size > UINT16_MAX)
+    {
+        HWC_LOGW("%s: drop record type %u with payload %zu", __func__, type, size);
+        return;
+    }
+
+    HwcRecordHeader header;
+    header.type = type;
+    header.size = static_cast<uint16_t>(size);
+    header.display = static_cast<uint32_t>(dpy);
+    header.layer = layer;
+    header.ts = ts;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_fd < 0)
+    {
+        return;
+    }
+
+    // never block the caller on a slow storage, drop instead
+    if (m_pending_bytes >= MAX_PENDING_BYTES)
+    {
+        m_drop_count++;
+        return;
+    }
+
+    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(&header);
+    m_buffer.insert(m_buffer.end(), ptr, ptr + sizeof(header));
+    if (size > 0)
+    {
+        ptr = static_cast<const uint8_t*>(payload);
+        m_buffer.insert(m_buffer.end(), ptr, ptr + size);
+    }
+    m_record_count++;
+
+    if (m_buffer.size() >= FLUSH_THRESHOLD)
+    {
+        queueBufferLocked();
+    }
+}
+
+namespace
+{
+
+void fillRecordBuffer(buffer_handle_t handle, int32_t acquire_fence, HwcRecordBuffer* buf)
+{
+    memset(buf, 0, sizeof(*buf));
+    buf->handle = reinterpret_cast<uint64_t>(handle);
+    buf->alloc_id = UINT64_MAX;
+    buf->acquire_fence = acquire_fence;
+
+    if (handle != nullptr)
+    {
+        // only the gralloc attributes are queried, no fd or metadata is kept
+        PrivateHandle priv_handle;
+        if (getPrivateHandleInfo(handle, &priv_handle, nullptr) == 0)
+        {
+            buf->width = priv_handle.width;
+            buf->height = priv_handle.height;
+            buf->y_stride = priv_handle.y_stride;
+            buf->vstride = priv_handle.vstride;
+            buf->format = priv_handle.format;
+            buf->usage = priv_handle.usage;
+            buf->size = priv_handle.size;
+        }
+        if (getAllocId(handle, &priv_handle) == 0)
+        {
+            buf->alloc_id = priv_handle.alloc_id;
+        }
+    }
+}
+
+// fill a HwcRecordRegion followed by its capped rects, returns the bytes used
+size_t fillRecordRegion(const hwc_region_t& region, uint8_t* out)
+{
+    HwcRecordRegion* header = reinterpret_cast<HwcRecordRegion*>(out);
+    HwcRecordRect* rects = reinterpret_cast<HwcRecordRect*>(out + sizeof(HwcRecordRegion));
+
+    const size_t num = region.rects ? std::min(region.numRects, static_cast<size_t>(HWC_RECORD_MAX_RECTS)) : 0;
+    header->num_rects = static_cast<uint32_t>(num);
+    header->total_rects = static_cast<uint32_t>(region.numRects);
+    for (size_t i = 0; i < num; i++)
+    {
+        rects[i].left = region.rects[i].left;
+        rects[i].top = region.rects[i].top;
+        rects[i].right = region.rects[i].right;
+        rects[i].bottom = region.rects[i].bottom;
+    }
+    return sizeof(HwcRecordRegion) + sizeof(HwcRecordRect) * num;
+}
+
+} // namespace
+
+void HwcCallRecorder::recordBuffer(uint64_t dpy, uint64_t layer, nsecs_t ts,
+                                   buffer_handle_t handle, int32_t acquire_fence)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    HwcRecordBuffer buf;
+    fillRecordBuffer(handle, acquire_fence, &buf);
+    record(HWC_RECORD_SET_BUFFER, dpy, layer, ts, &buf, sizeof(buf));
+}
+
+void HwcCallRecorder::recordRegion(uint16_t type, uint64_t dpy, uint64_t layer, nsecs_t ts,
+                                   const hwc_region_t& region)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    uint8_t payload[sizeof(HwcRecordRegion) + sizeof(HwcRecordRect) * HWC_RECORD_MAX_RECTS];
+    const size_t size = fillRecordRegion(region, payload);
+    record(type, dpy, layer, ts, payload, size);
+}
+
+void HwcCallRecorder::recordMCycleTable()
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    uint8_t payload[sizeof(HwcRecordMCycleTable) + sizeof(HwcRecordMCycleEntry) * HWC_RECORD_MAX_MC_ENTRIES];
+    HwcRecordMCycleTable* header = reinterpret_cast<HwcRecordMCycleTable*>(payload);
+    HwcRecordMCycleEntry* entries = reinterpret_cast<HwcRecordMCycleEntry*>(payload + sizeof(HwcRecordMCycleTable));
+
+    uint32_t num = 0;
+    for (auto& p : Platform::getInstance().m_config.hwc_mcycle_table)
+    {
+        if (num >= HWC_RECORD_MAX_MC_ENTRIES)
+        {
+            break;
+        }
+        entries[num].id = p.id;
+        entries[num].main_mc = p.main_mc;
+        entries[num].dispatcher_mc = p.dispatcher_mc;
+        entries[num].ovl_mc = p.ovl_mc;
+        num++;
+    }
+    header->num_entries = num;
+    record(HWC_RECORD_MC_TABLE, 0, 0, systemTime(), payload,
+           sizeof(HwcRecordMCycleTable) + sizeof(HwcRecordMCycleEntry) * num);
+}
+
+void HwcCallRecorder::recordMCycleSample(uint64_t dpy, const MCycleFeature& feature, int thread,
+                                         nsecs_t cpu_time, uint32_t cpu_mhz)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    HwcRecordMCycleFeature sample;
+    sample.thread = static_cast<uint32_t>(thread);
+    sample.cpu_mhz = cpu_mhz;
+    sample.cpu_ns = cpu_time;
+    sample.num_ui_layers = feature.num_ui_layers;
+    sample.num_mdp_layers = feature.num_mdp_layers;
+    sample.num_mml_layers = feature.num_mml_layers;
+    sample.num_glai_layers = feature.num_glai_layers;
+    sample.num_dirty_layers = feature.num_dirty_layers;
+    sample.flags = (feature.fbt_exist ? HWC_RECORD_MC_FBT : 0) |
+                   (feature.secure ? HWC_RECORD_MC_SECURE : 0) |
+                   (feature.mirror_src ? HWC_RECORD_MC_MIRROR_SRC : 0) |
+                   (feature.mirror_dst ? HWC_RECORD_MC_MIRROR_DST : 0) |
+                   (feature.is_virtual ? HWC_RECORD_MC_VIRTUAL : 0);
+    sample.pixels = feature.pixels;
+    record(HWC_RECORD_MC_FEATURE, dpy, 0, systemTime(), &sample, sizeof(sample));
+}
+
+void HwcCallRecorder::recordClientTarget(uint64_t dpy, nsecs_t ts, buffer_handle_t handle,
+                                         int32_t acquire_fence, int32_t dataspace,
+                                         const hwc_region_t& damage, uint64_t layer)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    uint8_t payload[sizeof(HwcRecordClientTarget) + sizeof(HwcRecordRegion) +
+                    sizeof(HwcRecordRect) * HWC_RECORD_MAX_RECTS];
+    HwcRecordClientTarget* target = reinterpret_cast<HwcRecordClientTarget*>(payload);
+    HwcRecordBuffer buf;
+    fillRecordBuffer(handle, acquire_fence, &buf);
+    memcpy(&target->buffer, &buf, sizeof(buf));
+    target->dataspace = dataspace;
+    const size_t size = sizeof(HwcRecordClientTarget) +
+                        fillRecordRegion(damage, payload + sizeof(HwcRecordClientTarget));
+
+    record(HWC_RECORD_SET_CLIENT_TARGET, dpy, layer, ts, payload, size);
+}
+
+void HwcCallRecorder::recordPerFrameMetadata(uint64_t dpy, uint64_t layer, nsecs_t ts, uint32_t num,
+                                             const int32_t* keys, const float* values)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    uint8_t payload[sizeof(HwcRecordMetadata) + sizeof(HwcRecordMetadataValue) * HWC_RECORD_MAX_METADATA];
+    HwcRecordMetadata* header = reinterpret_cast<HwcRecordMetadata*>(payload);
+    HwcRecordMetadataValue* entries =
+        reinterpret_cast<HwcRecordMetadataValue*>(payload + sizeof(HwcRecordMetadata));
+
+    const uint32_t stored = (keys && values) ? std::min(num, static_cast<uint32_t>(HWC_RECORD_MAX_METADATA)) : 0;
+    header->num_keys = stored;
+    header->total_keys = num;
+    for (uint32_t i = 0; i < stored; i++)
+    {
+        entries[i].key = keys[i];
+        entries[i].value = values[i];
+    }
+
+    record(HWC_RECORD_SET_PER_FRAME_METADATA, dpy, layer, ts, payload,
+           sizeof(HwcRecordMetadata) + sizeof(HwcRecordMetadataValue) * stored);
+}
+
+void HwcCallRecorder::recordPerFrameMetadataBlobs(uint64_t dpy, uint64_t layer, nsecs_t ts, uint32_t num,
+                                                  const int32_t* keys, const uint32_t* sizes,
+                                                  const uint8_t* blobs)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    uint8_t payload[sizeof(HwcRecordMetadata) + sizeof(HwcRecordMetadataBlob) * HWC_RECORD_MAX_METADATA +
+                    HWC_RECORD_MAX_BLOB_BYTES];
+    HwcRecordMetadata* header = reinterpret_cast<HwcRecordMetadata*>(payload);
+    HwcRecordMetadataBlob* entries =
+        reinterpret_cast<HwcRecordMetadataBlob*>(payload + sizeof(HwcRecordMetadata));
+
+    const uint32_t stored = (keys && sizes && blobs) ? std::min(num, static_cast<uint32_t>(HWC_RECORD_MAX_METADATA)) : 0;
+    header->num_keys = stored;
+    header->total_keys = num;
+
+    uint8_t* data = payload + sizeof(HwcRecordMetadata) + sizeof(HwcRecordMetadataBlob) * stored;
+    size_t data_size = 0;
+    size_t src_offset = 0;
+    for (uint32_t i = 0; i < stored; i++)
+    {
+        const size_t copy = std::min(static_cast<size_t>(sizes[i]),
+                                     static_cast<size_t>(HWC_RECORD_MAX_BLOB_BYTES) - data_size);
+        memcpy(data + data_size, blobs + src_offset, copy);
+        entries[i].key = keys[i];
+        entries[i].size = sizes[i];
+        entries[i].stored = static_cast<uint32_t>(copy);
+        data_size += copy;
+        src_offset += sizes[i];
+    }
+
+    record(HWC_RECORD_SET_PER_FRAME_METADATA_BLOBS, dpy, layer, ts, payload,
+           sizeof(HwcRecordMetadata) + sizeof(HwcRecordMetadataBlob) * stored + data_size);
+}
+
+void HwcCallRecorder::dump(android::String8* dump_str) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_fd < 0 && m_record_count == 0)
+    {
+        return;
+    }
+
+    dump_str->appendFormat("Call recorder(vendor.debug.hwc.record_call): %s path:%s\n",
+                           m_fd >= 0 ? "on" : "off", m_path.c_str());
+    dump_str->appendFormat("  records:%" PRIu64 " written:%" PRIu64 " buffered:%zu pending:%zu"
+                           " dropped:%" PRIu64 " write_err:%" PRIu64 "\n",
+                           m_record_count, m_record_bytes, m_buffer.size(), m_pending_bytes,
+                           m_drop_count, m_write_errors);
+}
+
+// ---------------------------------------------------------------------------
+
+HwcRecordScope::HwcRecordScope(uint16_t type, uint32_t stage, uint64_t dpy)
+    : m_enabled(HwcCallRecorder::getInstance().isEnabled())
+    , m_type(type)
+    , m_stage(stage)
+    , m_dpy(dpy)
+    , m_result(-1)
+    , m_start(0)
+    , m_cpu_start(0)
+{
+    if (m_enabled)
+    {
+        m_start = systemTime();
+        m_cpu_start = systemTime(SYSTEM_TIME_THREAD);
+    }
+}
+
+HwcRecordScope::~HwcRecordScope()
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    HwcRecordTiming timing;
+    timing.stage = m_stage;
+    timing.result = m_result;
+    timing.wall_ns = systemTime() - m_start;
+    timing.cpu_ns = systemTime(SYSTEM_TIME_THREAD) - m_cpu_start;
+    HwcCallRecorder::getInstance().record(m_type, m_dpy, 0, m_start, &timing, sizeof(timing));
+}
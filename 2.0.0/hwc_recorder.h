@@ -0,0 +1,147 @@
+#pragma once
+
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hwc2_defs.h"
+#include "hwc_record_format.h"
+
+// ---------------------------------------------------------------------------
+
+namespace android
+{
+class String8;
+}
+
+struct MCycleFeature;
+
+// HwcCallRecorder serializes the HWC2 calls seen by HWCMediator into a compact
+// binary trace (see hwc_record_format.h), so a composition performance issue
+// can be inspected offline. It is enabled by vendor.debug.hwc.record_call,
+// which holds the output path, and costs one atomic load per call when off.
+// The calling thread only copies the record into memory, the file is written
+// by a writer thread.
+class HwcCallRecorder
+{
+public:
+    static HwcCallRecorder& getInstance();
+    ~HwcCallRecorder();
+
+    // start to record into path, or stop the recording if path is empty
+    void setOutputPath(const char* path);
+
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // append one record, the payload is copied
+    void record(uint16_t type, uint64_t dpy, uint64_t layer, nsecs_t ts,
+                const void* payload = nullptr, size_t size = 0);
+
+    // record SET_BUFFER with the metadata queried from the buffer handle
+    void recordBuffer(uint64_t dpy, uint64_t layer, nsecs_t ts,
+                      buffer_handle_t handle, int32_t acquire_fence);
+
+    // record SET_DAMAGE, SET_VISIBLE_REGION or the damage of SET_CLIENT_TARGET
+    void recordRegion(uint16_t type, uint64_t dpy, uint64_t layer, nsecs_t ts,
+                      const hwc_region_t& region);
+
+    // record SET_CLIENT_TARGET with the metadata queried from the buffer handle,
+    // layer is the id of the client target layer
+    void recordClientTarget(uint64_t dpy, nsecs_t ts, buffer_handle_t handle,
+                            int32_t acquire_fence, int32_t dataspace,
+                            const hwc_region_t& damage, uint64_t layer);
+
+    // record SET_PER_FRAME_METADATA
+    void recordPerFrameMetadata(uint64_t dpy, uint64_t layer, nsecs_t ts, uint32_t num,
+                                const int32_t* keys, const float* values);
+
+    // record SET_PER_FRAME_METADATA_BLOBS, the blob bytes are capped
+    void recordPerFrameMetadataBlobs(uint64_t dpy, uint64_t layer, nsecs_t ts, uint32_t num,
+                                     const int32_t* keys, const uint32_t* sizes,
+                                     const uint8_t* blobs);
+
+    // record MC_FEATURE, the features of a frame and the CPU that thread, one
+    // of MCycleEstimator::THREAD_*, spent on it
+    void recordMCycleSample(uint64_t dpy, const MCycleFeature& feature, int thread,
+                            nsecs_t cpu_time, uint32_t cpu_mhz);
+
+    void dump(android::String8* dump_str) const;
+
+private:
+    HwcCallRecorder();
+
+    // record MC_TABLE, the models of the MC_FEATURE records are scored on it
+    void recordMCycleTable();
+
+    void open(const char* path);
+    void close();
+
+    // hand the buffered records to the writer thread
+    void queueBufferLocked();
+
+    void writerLoop(int fd);
+
+private:
+    // hand the buffered records to the writer once they exceed this size
+    enum { FLUSH_THRESHOLD = 64 * 1024 };
+
+    // drop records instead of queueing more than this while the writer is behind
+    enum { MAX_PENDING_BYTES = 4 * 1024 * 1024 };
+
+    std::atomic<bool> m_enabled;
+
+    // serializes open and close, which join the writer without m_lock
+    std::mutex m_control_lock;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_cond;
+    int m_fd;
+    std::string m_path;
+    std::vector<uint8_t> m_buffer;
+
+    // buffers waiting for the writer, and written buffers kept for reuse
+    std::vector<std::vector<uint8_t> > m_pending;
+    std::vector<std::vector<uint8_t> > m_free;
+    size_t m_pending_bytes;
+    bool m_writer_stop;
+    std::thread m_writer;
+
+    uint64_t m_record_count;
+    uint64_t m_record_bytes;
+    uint64_t m_write_errors;
+    uint64_t m_drop_count;
+};
+
+// HwcRecordScope measures the wall and thread CPU time of a scope and records
+// it when the scope ends. type is HWC_RECORD_VALIDATE, HWC_RECORD_PRESENT or
+// HWC_RECORD_STAGE.
+class HwcRecordScope
+{
+public:
+    HwcRecordScope(uint16_t type, uint32_t stage, uint64_t dpy);
+    ~HwcRecordScope();
+
+    void setResult(int32_t result) { m_result = result; }
+
+private:
+    const bool m_enabled;
+    const uint16_t m_type;
+    const uint32_t m_stage;
+    const uint64_t m_dpy;
+    int32_t m_result;
+    nsecs_t m_start;
+    nsecs_t m_cpu_start;
+};
+
+// record one HWC2 call with the current time if the recorder is enabled
+#define HWC_RECORD_CALL(type, dpy, layer, payload, size)                                      \
+    do {                                                                                      \
+        if (CC_UNLIKELY(HwcCallRecorder::getInstance().isEnabled())) {                        \
+            HwcCallRecorder::getInstance().record(type, dpy, layer, systemTime(), payload, size); \
+        }                                                                                     \
+    } while (0)
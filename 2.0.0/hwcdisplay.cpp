@@ -16,12 +16,17 @@
 #include "data_express.h"
 #include "led_device.h"
 #include "ai_blulight_defender.h"
+#include "mc_estimator.h"
+#include "mc_model.h"
 
 #ifdef MTK_HDR_SET_DISPLAY_COLOR
 // The flag must be sync with kernel source code
 #define MTK_HDR10P_PROPERTY_FLAG 2
 #endif
 
+// an inactive layerset frees a plane only if it has two layers at least
+#define INACTIVE_SET_MIN_LAYERS 2
+
 bool operator< (const SwitchConfigInfo& info1, const SwitchConfigInfo& info2)
 {
     return info1.index < info2.index;
@@ -139,6 +144,7 @@ HWCDisplay::HWCDisplay(const uint64_t& disp_id, const CreateDisplayInfo& create_
     , m_wdma_format(HAL_PIXEL_FORMAT_RGB_888)
     , m_wdma_dump_point(0)
     , m_fbt_unchanged_hint(false)
+    , m_inactive_set_job_id(UINT64_MAX)
     , m_refresh_changed(0)
     , m_other_hotplug_changed(0)
     , m_gpuc_skip_validate(false)
@@ -183,6 +189,7 @@ HWCDisplay::HWCDisplay(const uint64_t& disp_id, const CreateDisplayInfo& create_
     m_current_set.last_update = 0;
     m_current_set.cycle_last_update = 0;
     m_current_set.is_confirmed_caps = false;
+    memset(&m_inactive_set_stats, 0, sizeof(m_inactive_set_stats));
 
 #ifdef MTK_HWC_USE_DRM_DEVICE
     if (!ovl->isDisplayHrtSupport())
@@ -743,6 +750,18 @@ void HWCDisplay::validate()
     clearConfigChanged();
     m_client_clear_layer_num = 0;
 
+#ifdef USES_PQSERVICE
+    // PQ service has given up the matrix which setColorTransform() queued,
+    // so compose with GPU and apply the identity matrix as a failed call does
+    if (m_color_transform_ok && m_color_transform_hint != HAL_COLOR_TRANSFORM_IDENTITY &&
+        isSupportDispPq() && getPqDevice()->isColorTransformFailed())
+    {
+        HWC_LOGW("(%" PRIu64 ") %s: PQ service fails to apply the color transform", getId(), __func__);
+        m_color_transform_ok = false;
+        m_color_transform = new ColorTransform(HAL_COLOR_TRANSFORM_IDENTITY, true, false);
+    }
+#endif
+
     auto&& layers = getVisibleLayersSortedByZ();
 
     m_hdr_type = MTK_METADATA_TYPE_NONE;
@@ -1163,8 +1182,11 @@ void HWCDisplay::calculatePerf(DispatcherJob* job)
         return;
     }
 
-    const HwcMCycleInfo& info = getScenarioMCInfo(job);
-    job->mc_info = &info;
+    extractMCycleFeature(job, &job->mc_feature);
+    job->mc_info_blended = MCycleEstimator::getInstance().getMCInfo(
+            MCycleModelManager::getInstance().predict(job->mc_feature));
+    job->mc_info = &job->mc_info_blended;
+    const HwcMCycleInfo& info = job->mc_info_blended;
 
     // when no prefer below cpu mhz
     // &&
@@ -1606,6 +1628,9 @@ void HWCDisplay::beforePresent(const unsigned int num_plugin_display)
 
         HWCDispatcher::getInstance().fillPrevHwLayers(this, job);
 
+        // setColorTransformForJob() clears the dirty flag of the color transform
+        const bool color_transform_dirty = m_color_transform != nullptr && m_color_transform->dirty;
+        const CCORR_STATE ccorr_state = m_ccorr_state;
         setColorTransformForJob(job);
 
         if (job->layer_info.max_overlap_layer_num == -1)
@@ -1656,6 +1681,16 @@ void HWCDisplay::beforePresent(const unsigned int num_plugin_display)
             m_presented_pq_mode_id = m_pq_mode_id;
         }
 
+        m_present_count++;
+        if (isNoOpFrame(job, color_transform_dirty || ccorr_state != m_ccorr_state))
+        {
+            // the dispatcher skips the commit while the last present fence is pending
+            job->post_state = HWC_POST_INPUT_NOOP;
+        }
+        m_noop_last_config = job->active_config;
+        m_noop_last_color_mode = m_color_mode;
+        m_noop_last_render_intent = m_render_intent;
+
         HWC_LOGD("(%" PRIu64 ") VAL list=%zu/max=%u/fbt=%d[%d,%d:%d,%d]/hrt=%d,%d/ui=%d/mm=%d/glai=%d/"
                     "inv=%zu/ovlp=%d/fi=%d/mir=%d/pq_mode_id=%d",
                 getId(), getVisibleLayersSortedByZ().size(), job->num_layers,
@@ -1694,6 +1729,54 @@ void HWCDisplay::beforePresent(const unsigned int num_plugin_display)
     }
 }
 
+bool HWCDisplay::isNoOpFrame(const DispatcherJob* job, const bool& color_transform_changed)
+{
+    if (!Platform::getInstance().m_config.skip_noop_commit ||
+        getId() == HWC_DISPLAY_VIRTUAL ||
+        !HWCMediator::getInstance().getOvlDevice(getId())->isDispSelfRefreshSupported())
+    {
+        return false;
+    }
+
+    // the mirror, the writeback, the black fill and GLAI still need the engine to run
+    if (getMirrorSrc() != -1 || job->disp_mir_id != HWC_MIRROR_SOURCE_INVALID ||
+        job->need_output_buffer || job->wdma_status != HWC_WDMA_STATUS_DISABLE ||
+        job->is_black_job || job->num_glai_layers != 0)
+    {
+        return false;
+    }
+
+    // the crtc properties
+    if (color_transform_changed || job->dirty_pq_mode_id ||
+        job->active_config != m_noop_last_config ||
+        m_color_mode != m_noop_last_color_mode ||
+        m_render_intent != m_noop_last_render_intent ||
+        HWCDispatcher::getInstance().getOvlEnginePowerModeChanged(getId()) > 0)
+    {
+        return false;
+    }
+
+    // the layers, isGeometryChanged() compares them with the last committed ones
+    const auto& committed_layers = getCommittedLayers();
+    if (committed_layers.empty() || isVisibleLayerChanged() || isGeometryChanged())
+    {
+        return false;
+    }
+    for (auto& layer : committed_layers)
+    {
+        if (layer->isBufferChanged() || layer->isPerFrameMetadataChanged())
+        {
+            return false;
+        }
+    }
+    if (job->fbt_exist && getClientTarget() != nullptr && getClientTarget()->isBufferChanged())
+    {
+        return false;
+    }
+
+    return true;
+}
+
 void HWCDisplay::present()
 {
     setValiPresentState(HWC_VALI_PRESENT_STATE_PRESENT, __LINE__);
@@ -2447,6 +2530,11 @@ void HWCDisplay::setPowerMode(const int32_t& mode)
 
 void HWCDisplay::setVsyncEnabled(const int32_t& enabled)
 {
+    if (enabled)
+    {
+        // the vsync-off time is not a vsync interval, see updateVsyncFps()
+        m_vsync_fps_restart.store(true, std::memory_order_relaxed);
+    }
     DisplayManager::getInstance().requestVSync(m_disp_id, enabled);
 }
 
@@ -2787,8 +2875,17 @@ void HWCDisplay::dump(String8* dump_str)
         {
             clearCurrentSet();
         }
-        dump_str->appendFormat("m_current_set, isValid:%d stable_cnt:%d cycle_stable_cnt:%d \n",
-                hasValidCurrentSet(), m_current_set.stable_cnt, m_current_set.cycle_stable_cnt);
+        dump_str->appendFormat("m_current_set, isValid:%d stable_cnt:%d cycle_stable_cnt:%d confirmed:%d\n",
+                hasValidCurrentSet(), m_current_set.stable_cnt, m_current_set.cycle_stable_cnt,
+                m_current_set.is_confirmed_caps);
+        const LayerSetStats& stats = m_inactive_set_stats;
+        dump_str->appendFormat("inactive set: frames:%" PRIu64 " hit:%" PRIu64 "(%.1f%%) fbt_unchanged:%" PRIu64
+                " freed_planes:%.2f/hit saved:%" PRIu64 "KB/hit\n",
+                stats.frames, stats.hit_frames,
+                stats.frames ? static_cast<double>(stats.hit_frames) * 100.0 / static_cast<double>(stats.frames) : 0.0,
+                stats.fbt_unchanged_frames,
+                stats.hit_frames ? static_cast<double>(stats.freed_planes) / static_cast<double>(stats.hit_frames) : 0.0,
+                stats.hit_frames ? stats.saved_bytes / stats.hit_frames / 1024 : 0);
         for (size_t j = 0; j < m_current_set.set_ids.size(); ++j)// for debug
         {
             dump_str->appendFormat("    m_current_set[%zu]-id:%" PRIu64 " \n", j, m_current_set.set_ids[j]);
@@ -2829,7 +2926,10 @@ void HWCDisplay::dump(String8* dump_str)
 
     m_color_transform->dump(dump_str);
     HWCMediator::getInstance().getOvlDevice(m_disp_id)->dump(m_disp_id, dump_str);
-    mFpsCounter.dump(dump_str, "    ");
+    mFpsCounter.dump(dump_str, "    ", "present FPS");
+    dump_str->appendFormat("    skip commit(vendor.debug.hwc.skip_noop_commit): %" PRIu64 "/%" PRIu64 "\n",
+            m_skip_commit_count, m_present_count);
+    mVsyncFpsCounter.dump(dump_str, "    ", "vsync FPS");
 }
 
 bool HWCDisplay::needDoAvGrouping(const unsigned int num_plugin_display)
@@ -3009,6 +3109,8 @@ void HWCDisplay::setValiPresentState(HWC_VALI_PRESENT_STATE val, const int32_t&
 
 void HWCDisplay::updateFps()
 {
+    // a frame which misses a vsync is over budget
+    mFpsCounter.setBudget(getVsyncPeriod(m_active_config) * 3 / 2);
     if (mFpsCounter.update())
     {
         int32_t type = 0;
@@ -3019,6 +3121,17 @@ void HWCDisplay::updateFps()
     }
 }
 
+void HWCDisplay::updateVsyncFps(nsecs_t timestamp)
+{
+    // the first vsync after vsync is enabled again starts a new interval
+    if (m_vsync_fps_restart.exchange(false, std::memory_order_relaxed))
+    {
+        mVsyncFpsCounter.restart();
+    }
+    mVsyncFpsCounter.setBudget(getVsyncPeriod(m_active_config) * 3 / 2);
+    mVsyncFpsCounter.update(timestamp);
+}
+
 void HWCDisplay::addUnpresentCount()
 {
     m_prev_unpresent_count = m_unpresent_count;
@@ -4065,6 +4178,288 @@ void HWCDisplay::clearCurrentSet()
     }
 }
 
+void HWCDisplay::preRecognitionInactiveSet(const uint64_t& job_id, const bool& is_validate_call)
+{
+    // smart composition is on for some platforms, but the inactive set has its own switch
+    if (!Platform::getInstance().m_config.is_inactive_set_support)
+    {
+        if (m_current_set.stable_cnt > 0)
+        {
+            clearCurrentSet();
+        }
+        return;
+    }
+
+    if (is_validate_call)
+    {
+        applyInactiveSet();
+        return;
+    }
+
+    if (job_id == UINT64_MAX || job_id == m_inactive_set_job_id)// do it by per-job
+    {
+        return;
+    }
+    m_inactive_set_job_id = job_id;
+
+    updateInactiveSetStats();
+
+    auto&& layers = getVisibleLayersSortedByZ();
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        layers[i]->handleInactiveLayer(job_id);
+    }
+    recognizeInactiveSet();
+}
+
+void HWCDisplay::postRecognitionInactiveSet(int32_t gles_head, int32_t gles_tail, uint32_t disp_caps)
+{
+    if (disp_caps & HWC_DISP_CLIENT_LAYER)
+    {
+        m_current_set.is_confirmed_caps = true;
+    }
+    HWC_LOGV("(%" PRIu64 ") %s() gles[%d,%d] disp_caps:0x%x stable_cnt:%d", m_disp_id, __func__,
+             gles_head, gles_tail, disp_caps, m_current_set.stable_cnt);
+}
+
+void HWCDisplay::recognizeInactiveSet()
+{
+    auto&& layers = getVisibleLayersSortedByZ();
+
+    m_layer_sets.clear();
+    LayerSet layer_set;
+    layer_set.stable_cnt = 0;
+    layer_set.cycle_stable_cnt = 0;
+    layer_set.last_update = 0;
+    layer_set.cycle_last_update = 0;
+    layer_set.is_confirmed_caps = false;
+    for (size_t i = 0; i <= layers.size(); ++i)
+    {
+        if (i < layers.size() && layers[i]->isValidInactiveLayer())
+        {
+            layer_set.set_ids.push_back(layers[i]->getId());
+            continue;
+        }
+
+        if (layer_set.set_ids.size() >= INACTIVE_SET_MIN_LAYERS)
+        {
+            m_layer_sets.push_back(layer_set);
+        }
+        layer_set.set_ids.clear();
+    }
+
+    if (m_layer_sets.empty())
+    {
+        clearCurrentSet();
+        return;
+    }
+
+    // the set with most layers frees most planes
+    const LayerSet* best = &m_layer_sets[0];
+    for (const LayerSet& set : m_layer_sets)
+    {
+        if (set.set_ids.size() > best->set_ids.size())
+        {
+            best = &set;
+        }
+    }
+
+    const nsecs_t now = systemTime();
+    if (best->set_ids != m_current_set.set_ids)
+    {
+        clearCurrentSet();
+        m_current_set.set_ids = best->set_ids;
+        m_current_set.stable_cnt = 1;
+        m_current_set.cycle_stable_cnt = 1;
+        m_current_set.last_update = now;
+        m_current_set.cycle_last_update = now;
+        m_current_set.is_confirmed_caps = false;
+        return;
+    }
+
+    m_current_set.stable_cnt++;
+    m_current_set.cycle_stable_cnt++;
+    m_current_set.last_update = now;
+
+    // the driver confirms the set again after a life cycle
+    if (m_current_set.cycle_stable_cnt > Platform::getInstance().m_config.inactive_set_expired_cnt ||
+        now - m_current_set.cycle_last_update > Platform::getInstance().m_config.inactive_set_expired_duration)
+    {
+        m_current_set.cycle_stable_cnt = 0;
+        m_current_set.cycle_last_update = now;
+        m_current_set.is_confirmed_caps = false;
+    }
+}
+
+int32_t HWCDisplay::findCurrentSet() const
+{
+    auto&& layers = getVisibleLayersSortedByZ();
+    const std::vector<uint64_t>& ids = m_current_set.set_ids;
+    if (ids.empty())
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i + ids.size() <= layers.size(); ++i)
+    {
+        if (layers[i]->getId() != ids[0])
+        {
+            continue;
+        }
+
+        for (size_t j = 1; j < ids.size(); ++j)
+        {
+            if (layers[i + j]->getId() != ids[j])
+            {
+                return -1;
+            }
+        }
+        return static_cast<int32_t>(i);
+    }
+    return -1;
+}
+
+void HWCDisplay::applyInactiveSet()
+{
+    auto&& layers = getVisibleLayersSortedByZ();
+    const int32_t set_size = static_cast<int32_t>(m_current_set.set_ids.size());
+    int32_t set_head = hasValidCurrentSet() ? findCurrentSet() : -1;
+
+    if (set_head != -1)
+    {
+        for (int32_t i = set_head; i < set_head + set_size; ++i)
+        {
+            const int32_t type = layers[static_cast<size_t>(i)]->getHwlayerType();
+            if (type != HWC_LAYER_TYPE_UI && type != HWC_LAYER_TYPE_INVALID)
+            {
+                set_head = -1;
+                break;
+            }
+        }
+    }
+
+    // the gles range is contiguous, so the set is only moved to the client target if it does
+    // not pull the hwc layers between it and the other client layers into the range
+    if (set_head != -1)
+    {
+        int32_t gles_head = -1, gles_tail = -1;
+        findGlesRange(layers, &gles_head, &gles_tail);
+        if (gles_head != -1)
+        {
+            const int32_t head = std::min(gles_head, set_head);
+            const int32_t tail = std::max(gles_tail, set_head + set_size - 1);
+            for (int32_t i = head; i <= tail; ++i)
+            {
+                if ((i < set_head || i >= set_head + set_size) &&
+                    layers[static_cast<size_t>(i)]->getHwlayerType() != HWC_LAYER_TYPE_INVALID)
+                {
+                    HWC_LOGV("(%" PRIu64 ") %s() set[%d,%d] is apart from gles[%d,%d]", m_disp_id, __func__,
+                             set_head, set_head + set_size - 1, gles_head, gles_tail);
+                    set_head = -1;
+                    break;
+                }
+            }
+        }
+    }
+
+    setFbtUnchangedHint(set_head != -1 && getClientTarget()->getPrivateHandle().fbt_unchanged);
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        auto& layer = layers[i];
+        const int32_t z = static_cast<int32_t>(i);
+        const bool in_set = set_head != -1 && z >= set_head && z < set_head + set_size;
+        if (in_set)
+        {
+            layer->setHwlayerType(HWC_LAYER_TYPE_INVALID, __LINE__, HWC_COMP_FILE_HWCD);
+        }
+        layer->setInactiveClientLayer(in_set);
+        layer->setInactiveHint(in_set, in_set && isFbtUnchanged());
+    }
+}
+
+void HWCDisplay::updateInactiveSetStats()
+{
+    DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(m_disp_id);
+    if (job == nullptr)
+    {
+        return;
+    }
+    m_inactive_set_stats.frames++;
+
+    const int32_t set_head = hasValidCurrentSet() ? findCurrentSet() : -1;
+    if (set_head == -1 || !job->fbt_exist)
+    {
+        return;
+    }
+
+    auto&& layers = getVisibleLayersSortedByZ();
+    const int32_t set_size = static_cast<int32_t>(m_current_set.set_ids.size());
+    const int32_t set_tail = set_head + set_size - 1;
+    if (set_head < job->layer_info.gles_head || set_tail > job->layer_info.gles_tail ||
+        !layers[static_cast<size_t>(set_head)]->isInactiveClientLayer())
+    {
+        return;
+    }
+
+    uint64_t set_bytes = 0;
+    int32_t left = INT32_MAX, top = INT32_MAX, right = INT32_MIN, bottom = INT32_MIN;
+    for (int32_t i = set_head; i <= set_tail; ++i)
+    {
+        const sp<HWCLayer>& layer = layers[static_cast<size_t>(i)];
+        const hwc_rect_t& frame = layer->getDisplayFrame();
+        set_bytes += static_cast<uint64_t>(std::max(WIDTH(frame), 0)) *
+                     static_cast<uint64_t>(std::max(HEIGHT(frame), 0)) *
+                     (getBitsPerPixel(layer->getPrivateHandle().format) / 8);
+        left = std::min(left, frame.left);
+        top = std::min(top, frame.top);
+        right = std::max(right, frame.right);
+        bottom = std::max(bottom, frame.bottom);
+    }
+
+    m_inactive_set_stats.hit_frames++;
+    if (getClientTarget()->getPrivateHandle().fbt_unchanged)
+    {
+        m_inactive_set_stats.fbt_unchanged_frames++;
+    }
+
+    // the client target takes a plane only if the set is the whole gles range
+    const bool whole_range = job->layer_info.gles_head == set_head && job->layer_info.gles_tail == set_tail;
+    m_inactive_set_stats.freed_planes += static_cast<uint64_t>(whole_range ? set_size - 1 : set_size);
+    const uint64_t fbt_bytes = whole_range && right > left && bottom > top ?
+            static_cast<uint64_t>(right - left) * static_cast<uint64_t>(bottom - top) * 4 : 0;
+    m_inactive_set_stats.saved_bytes += set_bytes > fbt_bytes ? set_bytes - fbt_bytes : 0;
+}
+
+void HWCDisplay::moveCursor(const sp<HWCLayer>& layer, int32_t x, int32_t y)
+{
+    HWC_ATRACE_CALL();
+
+    const hwc_rect_t& frame = layer->getDisplayFrame();
+    if (frame.left == x && frame.top == y)
+    {
+        return;
+    }
+    const hwc_rect_t moved = {x, y, x + WIDTH(frame), y + HEIGHT(frame)};
+
+    // the next composition follows the cursor as well
+    layer->setDisplayFrame(moved);
+
+    if (!isConnected() || getPowerMode() == HWC2_POWER_MODE_OFF ||
+        layer->getReturnedCompositionType() != HWC2_COMPOSITION_CURSOR)
+    {
+        return;
+    }
+
+    sp<IOverlayDevice> ovl = HWCMediator::getInstance().getOvlDevice(getId());
+    if (ovl->moveCursor(getId(), m_drm_id_cur_crtc, layer->getId(), moved) != NO_ERROR)
+    {
+        // the plane is scaled or not committed yet, SF has to compose the move
+        HWC_LOGV("(%" PRIu64 ") %s: layer id:%" PRIu64 " falls back to a refresh", getId(), __func__,
+                 layer->getId());
+        DisplayManager::getInstance().refreshForDisplay(getId(), HWC_REFRESH_FOR_CURSOR);
+    }
+}
+
 void HWCDisplay::onRefresh(unsigned int type)
 {
     // Display Dump don't need HRT for next repaint
@@ -98,6 +98,16 @@ struct LayerSet
     bool is_confirmed_caps;
 };
 
+// the frames which the client target replaced an inactive layerset in
+struct LayerSetStats
+{
+    uint64_t frames;
+    uint64_t hit_frames;
+    uint64_t fbt_unchanged_frames;
+    uint64_t freed_planes;
+    uint64_t saved_bytes;       // the layerset reads minus the client target read
+};
+
 class HWCDisplay : public RefBase
 {
 public:
@@ -280,6 +290,9 @@ public:
     void checkVisibleLayerChange(const std::vector<sp<HWCLayer> > &prev_visible_layers);
     void setColorTransformForJob(DispatcherJob* const job);
 
+    // addSkipCommitCount() counts a present which the dispatcher did not commit
+    void addSkipCommitCount() { m_skip_commit_count++; }
+
     void setJobVideoTimeStamp();
 
     bool isGpuComposition() const { return m_use_gpu_composition; }
@@ -359,6 +372,10 @@ public:
 
     void setSfTargetTs(nsecs_t ts) { m_sf_target_ts = ts; }
 
+    // moveCursor() moves the cursor layer to (x, y) through the device without a composition,
+    // or requests a refresh if the device cannot move it alone
+    void moveCursor(const sp<HWCLayer>& layer, int32_t x, int32_t y);
+
     void calculatePerf(DispatcherJob* job);
 
     // follow the scenario or platform switch to choose cpu set
@@ -442,8 +459,10 @@ public:
     bool isSupportSmartComposition() const;
 
     void preRecognitionUnchangedLayer(const uint64_t& job_id);
-    void preRecognitionInactiveSet(const uint64_t& /*job_id*/, const bool& /*is_validate_call*/) { return; }
-    void postRecognitionInactiveSet(int32_t /*gles_head*/, int32_t /*gles_tail*/, uint32_t /*disp_caps*/) { return; }
+    // preRecognitionInactiveSet() counts the inactive layers of each job, and the validate call
+    // moves the stable layerset to the client target, which GPU keeps while the set is unchanged
+    void preRecognitionInactiveSet(const uint64_t& job_id, const bool& is_validate_call);
+    void postRecognitionInactiveSet(int32_t gles_head, int32_t gles_tail, uint32_t disp_caps);
     bool hasValidCurrentSet() const { return (m_current_set.stable_cnt > STABLE_INACTIVE_SET_THRESHOLD); }
     int32_t getCurrentSetStableCnt() const { return m_current_set.stable_cnt; }
     void clearCurrentSet();
@@ -506,12 +525,26 @@ public:
     CONNECTION_STATE getPlugState(uint32_t type);
     uint32_t detectConnectorTypeByPlugState(CONNECTION_STATE state);
 
+    // updateVsyncFps() is called on every vsync sent to SurfaceFlinger
+    void updateVsyncFps(nsecs_t timestamp);
+
 private:
     bool needDoAvGrouping(const unsigned int num_plugin_display);
+
+    // isNoOpFrame() checks if the job shows the same content as the last present, so the
+    // panel can keep it by self-refresh without a commit
+    bool isNoOpFrame(const DispatcherJob* job, const bool& color_transform_changed);
     void updateFps();
     void updateLayerPrevInfo();
     void offloadMMtoClient();
 
+    // recognizeInactiveSet() picks the largest contiguous inactive layerset as m_current_set
+    void recognizeInactiveSet();
+    void applyInactiveSet();
+    // return the z index of m_current_set in the visible layers, -1 if it is not contiguous
+    int32_t findCurrentSet() const;
+    void updateInactiveSetStats();
+
     void setLastAppGamePQ(const bool& on) { m_last_app_game_pq = on; }
     bool getLastAppGamePQ() const { return m_last_app_game_pq; }
 
@@ -669,6 +702,9 @@ private:
     bool m_is_visible_layer_changed;
 
     FpsCounter mFpsCounter;
+    FpsCounter mVsyncFpsCounter;
+    // set when vsync is enabled, so updateVsyncFps() drops the vsync-off gap
+    std::atomic<bool> m_vsync_fps_restart{false};
 
     // display ID map to mirror count
     // TODO: m_unpresent_count should only be used when single validate,
@@ -724,6 +760,14 @@ private:
     // store the previous extending sf target time
     nsecs_t m_prev_extend_sf_target_time;
 
+    // the display state of the last present, a no-op frame must keep it
+    hwc2_config_t m_noop_last_config = UINT32_MAX;
+    int32_t m_noop_last_color_mode = -1;
+    int32_t m_noop_last_render_intent = -1;
+    // the presents and the ones which skipped the commit since nothing changed
+    uint64_t m_present_count = 0;
+    uint64_t m_skip_commit_count = 0;
+
     std::shared_ptr<DisplayDump> m_disp_dump;
 
     // store the layer id of present index layer
@@ -758,6 +802,8 @@ private:
     LayerSet m_current_set;
     //if the fbt buf is unchanged
     bool m_fbt_unchanged_hint;
+    uint64_t m_inactive_set_job_id;
+    LayerSetStats m_inactive_set_stats;
 
     std::atomic_int m_refresh_changed;
 
@@ -764,8 +764,17 @@ void HWCLayer::updateReturnedCompositionType()
             break;
 
         case HWC_LAYER_TYPE_CURSOR:
-            //TODO we do not support setCursorPosition, so we should not return type with CURSOR
-            m_returned_comp_type = HWC2_COMPOSITION_DEVICE;
+            // setCursorPosition() moves the plane only when the device can commit it alone
+            if (Platform::getInstance().m_config.cursor_fast_path &&
+                m_disp_id != HWC_DISPLAY_VIRTUAL &&
+                HWCMediator::getInstance().getOvlDevice(m_disp_id)->isCursorMoveSupported())
+            {
+                m_returned_comp_type = HWC2_COMPOSITION_CURSOR;
+            }
+            else
+            {
+                m_returned_comp_type = HWC2_COMPOSITION_DEVICE;
+            }
             break;
 
         default:
@@ -1610,6 +1619,7 @@ void HWCPresentIdxLayer::initialState(const uint32_t width, const uint32_t heigh
     param.format = HAL_PIXEL_FORMAT_RGBA_8888;
     param.usage  = static_cast<uint64_t>(BufferUsage::COMPOSER_OVERLAY);
     param.usage |= BufferUsage::CPU_READ_OFTEN | BufferUsage::CPU_WRITE_OFTEN;
+    param.owner = MemoryTracker::OWNER_DEBUG_LAYER;
     if (NO_ERROR != GrallocDevice::getInstance().alloc(param))
     {
         HWC_LOGE("Failed to allocate memory size(w=%d,h=%d,fmt=%d,usage=%" PRIx64 ")",
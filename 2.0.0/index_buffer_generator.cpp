@@ -7,6 +7,8 @@
 #include "hwc2.h"
 #include "grallocdev.h"
 
+#include <algorithm>
+
 #define COLOR_BLACK 0xff000000
 #define COLOR_GRAY 0xff808080
 #define COLOR_WHITE 0xffffffff
@@ -38,6 +40,9 @@ IndexBufferGenerator::~IndexBufferGenerator()
 
 void IndexBufferGenerator::start()
 {
+    // render the glyphs before the first request, so no request needs to wait it
+    getGlyphAtlas(HAL_PIXEL_FORMAT_RGBA_8888);
+
     std::lock_guard<std::mutex> lock(m_lock);
     m_stop = false;
     m_thread = std::thread(&IndexBufferGenerator::gereratorThread, this);
@@ -59,59 +64,67 @@ void IndexBufferGenerator::stop()
 void IndexBufferGenerator::getBuffer(int index, uint32_t width, uint32_t height, int* fd,
         uint64_t* alloc_id)
 {
-    std::lock_guard<std::mutex> lock(m_lock);
+    std::unique_lock<std::mutex> lock(m_lock);
     bool miss = true;
-    while (!m_ready_list.empty())
+
+    // the ready buffers are ordered by index, recycle the ones before the request
+    // and pick the one exactly matching the request
+    for (auto iter = m_ready_buffers.begin(); iter != m_ready_buffers.end();)
     {
-        auto info = m_ready_list.front();
-        if (info.index < index)
+        const BufferKey& key = iter->first;
+        if (key.index > index)
         {
-            if (width == info.width && height == info.height)
-            {
-                m_ready_list.pop_front();
-                m_free_list.emplace_back(info);
-            }
-            else
-            {
-                freeBuffer(info);
-                m_ready_list.pop_front();
-                m_free_buffer++;
-            }
+            break;
         }
-        else if (info.index == index)
+
+        BufferInfo info = iter->second;
+        const bool same_size = width == key.width && height == key.height;
+        if (key.index == index && same_size && miss)
         {
-            if (width == info.width && height == info.height)
-            {
-                miss = false;
-                m_ready_list.pop_front();
-                m_used_list.emplace_back(info);
-                if (*fd > -1)
-                {
-                    protectedClose(*fd);
-                }
-                *fd = dup(info.fd);
-                *alloc_id = info.alloc_id;
-            }
-            else
+            miss = false;
+            m_used_list.emplace_back(info);
+            if (*fd > -1)
             {
-                freeBuffer(info);
-                m_ready_list.pop_front();
-                m_free_buffer++;
+                protectedClose(*fd);
             }
+            *fd = dup(info.fd);
+            *alloc_id = info.alloc_id;
+        }
+        else if (same_size)
+        {
+            m_free_list.emplace_back(info);
         }
         else
         {
-            break;
+            freeBuffer(info);
+            m_free_buffer++;
         }
+        iter = m_ready_buffers.erase(iter);
     }
 
+    BufferInfo old_miss_buffer;
+    initialBufferInfo(&old_miss_buffer);
     if (miss)
     {
         if (m_miss_buffer.width != width || m_miss_buffer.height != height)
         {
-            freeBuffer(m_miss_buffer);
-            m_miss_buffer = generateBuffer(width, height);
-            drawBuffer(m_miss_buffer, 0);
+            // allocate and draw it without the lock, so the generator thread and the other
+            // displays are not blocked by the miss
+            lock.unlock();
+            BufferInfo info = generateBuffer(width, height);
+            drawBuffer(info, 0);
+            lock.lock();
+
+            if (m_miss_buffer.width == width && m_miss_buffer.height == height)
+            {
+                // another caller has replaced it in the meantime
+                old_miss_buffer = info;
+            }
+            else
+            {
+                old_miss_buffer = m_miss_buffer;
+                m_miss_buffer = info;
+            }
         }
         *fd = dup(m_miss_buffer.fd);
         *alloc_id = m_miss_buffer.alloc_id;
@@ -130,6 +143,9 @@ void IndexBufferGenerator::getBuffer(int index, uint32_t width, uint32_t height,
             m_free_buffer++;
         }
     }
+    lock.unlock();
+
+    freeBuffer(old_miss_buffer);
 }
 
 void IndexBufferGenerator::cancelBuffer(int index)
@@ -188,6 +204,7 @@ IndexBufferGenerator::BufferInfo IndexBufferGenerator::generateBuffer(uint32_t w
     param.format = HAL_PIXEL_FORMAT_RGBA_8888;
     param.usage = static_cast<uint64_t>(BufferUsage::COMPOSER_OVERLAY);
     param.usage |= BufferUsage::CPU_READ_OFTEN | BufferUsage::CPU_WRITE_OFTEN;
+    param.owner = MemoryTracker::OWNER_INDEX_BUFFER;
     if (NO_ERROR != GrallocDevice::getInstance().alloc(param))
     {
         HWC_LOGE("Failed to allocate memory size(w=%d,h=%d,fmt=%d,usage=%" PRIx64 ")",
@@ -220,21 +237,76 @@ void IndexBufferGenerator::freeBuffer(BufferInfo& info)
 }
 
 void IndexBufferGenerator::drawBackground(void* addr, uint32_t /*width*/, uint32_t height,
-        uint32_t stride, unsigned int /*format*/, uint32_t color)
+        uint32_t stride, unsigned int format, uint32_t color)
 {
-    uint32_t* ptr = reinterpret_cast<uint32_t*>(addr);
-    for (uint32_t h = 0; h < height; h++)
+    if (height == 0 || stride == 0)
+    {
+        return;
+    }
+
+    // fill the first row, and then copy it to the others
+    const size_t row_bytes = static_cast<size_t>(stride) * (getBitsPerPixel(format) / 8);
+    uint32_t* first_row = reinterpret_cast<uint32_t*>(addr);
+    std::fill_n(first_row, stride, color);
+
+    uint8_t* ptr = reinterpret_cast<uint8_t*>(addr);
+    for (uint32_t h = 1; h < height; h++)
     {
-        for (uint32_t w = 0; w < stride; w++)
+        memcpy(ptr + row_bytes * h, ptr, row_bytes);
+    }
+}
+
+const IndexBufferGenerator::GlyphAtlas& IndexBufferGenerator::getGlyphAtlas(unsigned int format)
+{
+    std::lock_guard<std::mutex> lock(m_atlas_lock);
+
+    auto iter = m_atlas.find(format);
+    if (iter != m_atlas.end())
+    {
+        return iter->second;
+    }
+
+    HWC_ATRACE_NAME("renderGlyphAtlas");
+
+    GlyphAtlas& atlas = m_atlas[format];
+    atlas.format = format;
+    atlas.bpp = getBitsPerPixel(format) / 8;
+    atlas.glyph_size = m_digit_size;
+
+    const size_t glyph_bytes = static_cast<size_t>(atlas.glyph_size) * atlas.glyph_size * atlas.bpp;
+    atlas.pixels.resize(glyph_bytes * m_num_bar * 10);
+
+    for (uint32_t background = 0; background < m_num_bar; background++)
+    {
+        uint32_t color = COLOR_BLACK;
+        switch (background)
         {
-            *ptr = color;
-            ptr++;
+            case 0:
+                color = COLOR_BLACK;
+                break;
+            case 1:
+                color = COLOR_GRAY;
+                break;
+            case 2:
+                color = COLOR_WHITE;
+                break;
+        }
+
+        for (int digit = 0; digit < 10; digit++)
+        {
+            void* glyph = const_cast<uint8_t*>(atlas.getGlyph(background, digit));
+            drawBackground(glyph, atlas.glyph_size, atlas.glyph_size, atlas.glyph_size,
+                    format, color);
+            drawDigit(glyph, atlas.glyph_size, atlas.glyph_size, atlas.glyph_size,
+                    format, COLOR_RED, 0, 0, digit);
         }
     }
+
+    return atlas;
 }
 
 void IndexBufferGenerator::drawIndex(void* addr, uint32_t width, uint32_t height, uint32_t stride,
-        unsigned int format, uint32_t color, uint32_t left, uint32_t top, int index)
+        const GlyphAtlas& atlas, uint32_t background, uint32_t left, uint32_t top, int index)
 {
     int temp = index;
     uint32_t count = 0;
@@ -247,11 +319,34 @@ void IndexBufferGenerator::drawIndex(void* addr, uint32_t width, uint32_t height
     {
         int digit = temp % 10;
         uint32_t left_offset = (m_digit_size + m_digit_interval_size) * (i - 1);
-        drawDigit(addr, width, height, stride, format, color, left + left_offset, top, digit);
+        drawGlyph(addr, width, height, stride, atlas, background, left + left_offset, top, digit);
         temp /= 10;
     }
 }
 
+void IndexBufferGenerator::drawGlyph(void* addr, uint32_t width, uint32_t height, uint32_t stride,
+        const GlyphAtlas& atlas, uint32_t background, uint32_t left, uint32_t top, int digit)
+{
+    if (digit < 0 || digit > 9 || left >= width || top >= height)
+    {
+        return;
+    }
+
+    const uint32_t copy_w = std::min(atlas.glyph_size, width - left);
+    const uint32_t copy_h = std::min(atlas.glyph_size, height - top);
+    const size_t glyph_pitch = static_cast<size_t>(atlas.glyph_size) * atlas.bpp;
+    const size_t dst_pitch = static_cast<size_t>(stride) * atlas.bpp;
+
+    const uint8_t* src = atlas.getGlyph(background, digit);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(addr) + dst_pitch * top + left * atlas.bpp;
+    for (uint32_t y = 0; y < copy_h; y++)
+    {
+        memcpy(dst, src, copy_w * atlas.bpp);
+        src += glyph_pitch;
+        dst += dst_pitch;
+    }
+}
+
 #define DrawLine(segment) drawLine(addr, width, height, stride, format, color, left, top, segment)
 
 void IndexBufferGenerator::drawDigit(void* addr, uint32_t width, uint32_t height, uint32_t stride,
@@ -414,11 +509,14 @@ void IndexBufferGenerator::drawRegion(void* addr, uint32_t width, uint32_t heigh
 
 void IndexBufferGenerator::drawBuffer(BufferInfo& info, int index)
 {
+    HWC_ATRACE_CALL();
+
+    const GlyphAtlas& atlas = getGlyphAtlas(info.format);
+    const uint32_t remainder = m_draw_count.fetch_add(1) % m_num_bar;
     void* ptr = mmap(nullptr, info.allocate_size, PROT_READ | PROT_WRITE, MAP_SHARED, info.fd, 0);
-    if (ptr)
+    if (ptr != MAP_FAILED)
     {
         uint32_t color = 0;
-        uint32_t remainder = m_draw_count % m_num_bar;
         switch (remainder)
         {
             case 0:
@@ -434,12 +532,10 @@ void IndexBufferGenerator::drawBuffer(BufferInfo& info, int index)
         uint32_t left = m_digit_interval_size;
         uint32_t top = m_digit_interval_size + (m_digit_interval_size + m_digit_size) * remainder;
         drawBackground(ptr, info.width, info.height, info.stride, info.format, color);
-        color = COLOR_RED;
-        drawIndex(ptr, info.width, info.height, info.stride, info.format, color, left, top, index);
+        drawIndex(ptr, info.width, info.height, info.stride, atlas, remainder, left, top, index);
         munmap(ptr, info.allocate_size);
     }
     info.index = index;
-    m_draw_count++;
 }
 
 void IndexBufferGenerator::gereratorThread()
@@ -490,7 +586,7 @@ void IndexBufferGenerator::gereratorThread()
 
         {
             std::lock_guard<std::mutex> lock(m_lock);
-            m_ready_list.emplace_back(info);
+            m_ready_buffers[{ info.index, info.width, info.height }] = info;
         }
     }
 }
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <unistd.h>
+#include <atomic>
 #include <thread>
 #include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
 
 #include <cutils/native_handle.h>
 
@@ -42,6 +47,37 @@ private:
         unsigned int format;
     };
 
+    // BufferKey identifies a ready buffer, the index goes first, so the ready buffers are
+    // ordered by index, and the first one is also the least recently generated one
+    struct BufferKey
+    {
+        int index;
+        uint32_t width;
+        uint32_t height;
+
+        bool operator<(const BufferKey& rhs) const
+        {
+            return std::tie(index, width, height) < std::tie(rhs.index, rhs.width, rhs.height);
+        }
+    };
+
+    // GlyphAtlas keeps all digits pre-rendered on each background color of one format,
+    // an index buffer is composed by copying rows of the glyphs
+    struct GlyphAtlas
+    {
+        unsigned int format = 0;
+        uint32_t bpp = 0;
+        uint32_t glyph_size = 0;
+        // glyphs are stored as [background][digit], each one is glyph_size x glyph_size
+        std::vector<uint8_t> pixels;
+
+        const uint8_t* getGlyph(uint32_t background, int digit) const
+        {
+            const size_t glyph_bytes = static_cast<size_t>(glyph_size) * glyph_size * bpp;
+            return pixels.data() + (background * 10 + static_cast<uint32_t>(digit)) * glyph_bytes;
+        }
+    };
+
     enum {
         SEVEN_SEGMEMT_UP = 0,
         SEVEN_SEGMEMT_UP_LEFT,
@@ -68,9 +104,16 @@ private:
     void drawBackground(void* addr, uint32_t width, uint32_t height, uint32_t stride,
             unsigned int format, uint32_t color);
 
-    // draw the index on the buffer
+    // get the glyph atlas of the format, it is rendered at the first time
+    const GlyphAtlas& getGlyphAtlas(unsigned int format);
+
+    // draw the index on the buffer by copying the glyphs of the atlas
     void drawIndex(void* addr, uint32_t width, uint32_t height, uint32_t stride,
-            unsigned int format, uint32_t color, uint32_t left, uint32_t top, int index);
+            const GlyphAtlas& atlas, uint32_t background, uint32_t left, uint32_t top, int index);
+
+    // copy one glyph of the atlas to the buffer
+    void drawGlyph(void* addr, uint32_t width, uint32_t height, uint32_t stride,
+            const GlyphAtlas& atlas, uint32_t background, uint32_t left, uint32_t top, int digit);
 
     // draw the assigned digit on the buffer
     void drawDigit(void* addr, uint32_t width, uint32_t height, uint32_t stride,
@@ -89,11 +132,12 @@ private:
 
 private:
     typedef std::list<BufferInfo> BufferList;
+    typedef std::map<BufferKey, BufferInfo> BufferMap;
     std::mutex m_lock;
     std::condition_variable m_condition;
     std::thread m_thread;
     bool m_stop;
-    BufferList m_ready_list;
+    BufferMap m_ready_buffers;
     BufferList m_free_list;
     BufferList m_used_list;
     BufferInfo m_miss_buffer;
@@ -103,11 +147,17 @@ private:
     int m_index;
     uint32_t m_width;
     uint32_t m_height;
-    uint32_t m_draw_count;
+    // drawBuffer() runs on both the generator thread and the miss path without m_lock
+    std::atomic<uint32_t> m_draw_count;
 
     const uint32_t m_digit_size = 64;
     const uint32_t m_digit_interval_size = 10;
     const uint32_t m_digit_line_size = 10;
     const uint32_t m_num_bar = 3;
     const int m_index_interval = 3;
+
+    // m_atlas_lock protects m_atlas, since the atlas is used by both generator thread
+    // and the miss path of getBuffer()
+    std::mutex m_atlas_lock;
+    std::map<unsigned int, GlyphAtlas> m_atlas;
 };
@@ -6,14 +6,25 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <string>
 
+#include "utils/debug.h"
 #include "utils/tools.h"
 
+#include "sync.h"
+
 #define PRIMARY_LED_PATH "/sys/class/leds/lcd-backlight/brightness"
 #define PRIMARY_LED_MAX_PATH "/sys/class/leds/lcd-backlight/max_brightness"
 #define PRIMARY_LED_MIN_PATH "/sys/class/leds/lcd-backlight/min_brightness"
 
+// a staged brightness is written without a present after this time, e.g. the
+// display is idle or off
+#define LED_SYNC_TIMEOUT_NS ms2ns(50)
+
+// the writer does not wait longer than this for the frame after the staged value to be applied
+#define LED_COMMIT_FENCE_TIMEOUT_MS 50
+
 #define CHECK_DPY_RET_BAD_DISP(dpy)                                  \
     do {                                                             \
         if (dpy >= DisplayManager::MAX_DISPLAYS) {                   \
@@ -69,11 +80,16 @@ LedDevice& LedDevice::getInstance()
 }
 
 LedDevice::LedDevice()
+    : m_writer_stop(false)
+    , m_pending_mask(0)
 {
+    static_assert(DisplayManager::MAX_DISPLAYS <= 32, "m_pending_mask is too small");
+
     memset(m_led, 0, sizeof(m_led));
     for (size_t i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
     {
         m_led[i].fd = -1;
+        m_led[i].pending_fence = -1;
         // the defination of brightness as below.
         // max:1.0f  min:0.0f  off:-1.0f
         // we wish the first value of brightness always can be applied, so we set its default
@@ -96,16 +112,36 @@ LedDevice::LedDevice()
                 break;
         }
     }
+
+    m_writer_thread = std::thread(&LedDevice::writerLoop, this);
+    if (pthread_setname_np(m_writer_thread.native_handle(), "LedWriter"))
+    {
+        HWC_LOGI("pthread_setname_np LedWriter fail");
+    }
 }
 
 LedDevice::~LedDevice()
 {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_writer_stop = true;
+        m_cond.notify_all();
+    }
+    if (m_writer_thread.joinable())
+    {
+        m_writer_thread.join();
+    }
+
     for (size_t i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
     {
         if (m_led[i].fd >= 0)
         {
             protectedClose(m_led[i].fd);
         }
+        if (m_led[i].pending_fence >= 0)
+        {
+            protectedClose(m_led[i].pending_fence);
+        }
     }
 }
 
@@ -201,7 +237,10 @@ int32_t LedDevice::setBrightness(uint64_t dpy, float brightness)
         return HWC2_ERROR_UNSUPPORTED;
     }
 
-    if (m_led[dpy].brightness == brightness)
+    std::lock_guard<std::mutex> lock(m_lock);
+    DisplayLedState& state = m_led[dpy];
+
+    if (state.brightness == brightness)
     {
         HWC_LOGD("(%" PRIu64 ") set brightness with the same brightness(%f)", dpy, brightness);
         return HWC2_ERROR_NONE;
@@ -220,42 +259,190 @@ int32_t LedDevice::setBrightness(uint64_t dpy, float brightness)
     }
     else
     {
-        val = static_cast<int>((m_led[dpy].max_brightness - m_led[dpy].min_brightness) * brightness);
-        val += m_led[dpy].min_brightness;
+        val = static_cast<int>((state.max_brightness - state.min_brightness) * brightness);
+        val += state.min_brightness;
     }
 
-    if (val == m_led[dpy].cur_brightness)
+    const int target = state.pending ? state.pending_brightness : state.cur_brightness;
+    if (val == target)
     {
         HWC_LOGD("(%" PRIu64 ") set brightness with the same config value(%d, %f->%f)",
-                dpy, val, m_led[dpy].brightness, brightness);
+                dpy, val, state.brightness, brightness);
+        state.brightness = brightness;
         return HWC2_ERROR_NONE;
     }
 
-    ssize_t size = writeInt(m_led[dpy].fd, val);
-    if (size <= 0)
+    HWC_LOGD("(%" PRIu64 ") stage brightness[float:%f->%f | int:%d->%d]", dpy, state.brightness,
+            brightness, target, val);
+    state.brightness = brightness;
+    state.request_count++;
+
+    if (val == state.cur_brightness)
     {
-        HWC_LOGW("(%" PRIu64 ")failed to set brightness[%d]", dpy, val);
-        return HWC2_ERROR_NO_RESOURCES;
+        // back to the written value before the staged one is applied
+        state.pending = false;
+        state.coalesced_count++;
+        m_pending_mask.fetch_and(~(1U << dpy), std::memory_order_relaxed);
+        return HWC2_ERROR_NONE;
+    }
+
+    if (state.pending)
+    {
+        // latest wins, keep the stage time and readiness of the replaced value
+        state.coalesced_count++;
+    }
+    else
+    {
+        state.pending = true;
+        state.pending_ready = false;
+        state.pending_ts = systemTime();
+        if (state.pending_fence >= 0)
+        {
+            protectedClose(state.pending_fence);
+            state.pending_fence = -1;
+        }
+        m_pending_mask.fetch_or(1U << dpy, std::memory_order_release);
     }
-    HWC_LOGD("(%" PRIu64 ") set brightness[float:%f->%f | int:%d->%d]", dpy, m_led[dpy].brightness,
-            brightness, m_led[dpy].cur_brightness, val);
-    m_led[dpy].brightness = brightness;
-    m_led[dpy].cur_brightness = val;
+    state.pending_brightness = val;
+
+    // the writer thread waits for the timeout of the new value
+    m_cond.notify_all();
 
     return HWC2_ERROR_NONE;
 }
 
+void LedDevice::onFrameCommitted(uint64_t dpy, int commit_fence)
+{
+    if (dpy >= DisplayManager::MAX_DISPLAYS ||
+        !(m_pending_mask.load(std::memory_order_acquire) & (1U << dpy)))
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    DisplayLedState& state = m_led[dpy];
+    if (state.pending && !state.pending_ready)
+    {
+        // the value goes with the first frame after it is staged
+        state.pending_ready = true;
+        state.pending_fence = commit_fence >= 0 ? ::dup(commit_fence) : -1;
+        m_cond.notify_all();
+    }
+}
+
+void LedDevice::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_writer_stop)
+    {
+        const nsecs_t now = systemTime();
+        nsecs_t next_timeout = 0;
+        bool written = false;
+
+        for (size_t i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
+        {
+            DisplayLedState& state = m_led[i];
+            if (!state.pending)
+            {
+                continue;
+            }
+
+            const nsecs_t deadline = state.pending_ts + LED_SYNC_TIMEOUT_NS;
+            if (!state.pending_ready && now < deadline)
+            {
+                if (next_timeout == 0 || deadline < next_timeout)
+                {
+                    next_timeout = deadline;
+                }
+                continue;
+            }
+
+            const int val = state.pending_brightness;
+            const int fd = state.fd;
+            const int pending_fence = state.pending_fence;
+            state.pending_fence = -1;
+            if (!state.pending_ready)
+            {
+                state.timeout_count++;
+            }
+            state.max_delay = std::max(state.max_delay, now - state.pending_ts);
+            state.pending = false;
+            m_pending_mask.fetch_and(~(1U << i), std::memory_order_relaxed);
+
+            // the sysfs write may be slow, do not block setBrightness() and onFrameCommitted()
+            lock.unlock();
+            if (pending_fence >= 0)
+            {
+                // the frame is committed without blocking, write when it reaches the panel
+                SyncFence::waitWithoutCloseFd(pending_fence, LED_COMMIT_FENCE_TIMEOUT_MS, "led_commit");
+                protectedClose(pending_fence);
+            }
+            HWC_ATRACE_INT("LedBrightness", val);
+            ssize_t size = writeInt(fd, val);
+            lock.lock();
+
+            written = true;
+            state.write_count++;
+            if (size <= 0)
+            {
+                HWC_LOGW("(%zu) failed to set brightness[%d]", i, val);
+                state.write_fail_count++;
+                // forget the requested value, so the same value can be set again to retry,
+                // unless a newer one has been staged meanwhile
+                if (!state.pending)
+                {
+                    state.brightness = -2.0f;
+                }
+            }
+            else
+            {
+                state.cur_brightness = val;
+            }
+        }
+
+        // the lock was dropped to write, so scan again for the changes made meanwhile
+        if (written)
+        {
+            continue;
+        }
+
+        if (next_timeout != 0)
+        {
+            m_cond.wait_for(lock, std::chrono::nanoseconds(next_timeout - now));
+        }
+        else
+        {
+            m_cond.wait(lock);
+        }
+    }
+}
+
 void LedDevice::dump(String8* dump_str)
 {
+    std::lock_guard<std::mutex> lock(m_lock);
     dump_str->appendFormat("[LED state]\n");
     for (size_t i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
     {
-        dump_str->appendFormat("\tdisplay_%zu: support[%d]\n", i, m_led[i].is_support);
-        if (m_led[i].is_support)
+        const DisplayLedState& state = m_led[i];
+        dump_str->appendFormat("\tdisplay_%zu: support[%d]\n", i, state.is_support);
+        if (state.is_support)
         {
-            dump_str->appendFormat("\t             brightness[%f] range[%d~%d] current[%d]\n",
-                    m_led[i].brightness, m_led[i].min_brightness, m_led[i].max_brightness,
-                    m_led[i].cur_brightness);
+            dump_str->appendFormat("\t             brightness[%f] range[%d~%d] current[%d]",
+                    state.brightness, state.min_brightness, state.max_brightness,
+                    state.cur_brightness);
+            if (state.pending)
+            {
+                dump_str->appendFormat(" pending[%d]", state.pending_brightness);
+            }
+            dump_str->appendFormat("\n");
+
+            const double coalesced_ratio = state.request_count ?
+                    static_cast<double>(state.coalesced_count) / static_cast<double>(state.request_count) : 0.0;
+            dump_str->appendFormat("\t             request[%" PRIu64 "] coalesced[%" PRIu64 "](%.1f%%)"
+                    " write[%" PRIu64 "] fail[%" PRIu64 "] timeout[%" PRIu64 "] max_delay[%" PRId64 "us]\n",
+                    state.request_count, state.coalesced_count, coalesced_ratio * 100.0,
+                    state.write_count, state.write_fail_count, state.timeout_count,
+                    ns2us(state.max_delay));
         }
     }
     dump_str->appendFormat("\n");
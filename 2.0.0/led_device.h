@@ -2,6 +2,12 @@
 
 #include <utils/RefBase.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include "hwc2_defs.h"
 #include "display.h"
@@ -13,6 +19,22 @@ struct DisplayLedState {
     int cur_brightness;
     int max_brightness;
     int min_brightness;
+
+    // the staged value which is written after the next present of the display
+    bool pending;
+    bool pending_ready;
+    int pending_brightness;
+    nsecs_t pending_ts;
+    // the fence which signals when the frame after the staged value is applied
+    int pending_fence;
+
+    // statistics
+    uint64_t request_count;
+    uint64_t coalesced_count;
+    uint64_t write_count;
+    uint64_t write_fail_count;
+    uint64_t timeout_count;
+    nsecs_t max_delay;
 };
 
 class LedDevice : public RefBase
@@ -24,9 +46,14 @@ public:
     // getBrightnessSupport() is used to get the brightness capability which can adjust backlight
     int32_t getBrightnessSupport(uint64_t dpy, bool* support);
 
-    // setBrightness() is used to change the brightness
+    // setBrightness() is used to change the brightness, the new value is staged and written
+    // after the next present of the display, only the latest one is written
     int32_t setBrightness(uint64_t dpy, float brightness);
 
+    // onFrameCommitted() is called by the overlay thread after a frame of dpy is committed,
+    // commit_fence signals when the frame is applied, -1 if it is already, it is not taken
+    void onFrameCommitted(uint64_t dpy, int commit_fence = -1);
+
     // print the led state
     void dump(String8* dump_str);
 
@@ -40,6 +67,18 @@ private:
     // read a integer from the assigned path
     ssize_t readIntFromPath(const char* path, int* val);
 
+    // write the staged brightness after present, or after a timeout when no frame comes
+    void writerLoop();
+
 private:
+    // m_lock protects m_led except fd, is_support and the range which are fixed after init
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::thread m_writer_thread;
+    bool m_writer_stop;
+
+    // a bit per display with a staged value, it keeps onFrameCommitted() lock free
+    std::atomic<uint32_t> m_pending_mask;
+
     struct DisplayLedState m_led[DisplayManager::MAX_DISPLAYS];
 };
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <algorithm>
 
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -516,6 +517,9 @@ DispDevice::DispDevice()
     memset(m_layer_config_list, 0, sizeof(layer_config*) * DisplayManager::MAX_DISPLAYS);
     memset(m_input_config, 0, sizeof(disp_session_input_config) * DisplayManager::MAX_DISPLAYS);
     memset(m_output_config, 0, sizeof(disp_session_output_config) * DisplayManager::MAX_DISPLAYS);
+    memset(m_input_shadow, 0, sizeof(disp_session_input_config) * DisplayManager::MAX_DISPLAYS);
+    memset(m_input_shadow_valid, 0, sizeof(bool) * DisplayManager::MAX_DISPLAYS);
+    memset(m_ioctl_stats, 0, sizeof(IoctlStats) * DisplayManager::MAX_DISPLAYS);
 
     // get device multi configs info
     memset(m_multi_cfgs, 0, sizeof(struct multi_configs) * DisplayManager::MAX_DISPLAYS);
@@ -593,9 +597,17 @@ status_t DispDevice::queryCapsInfo()
     const bool isSelfRefreshSupported = isDispSelfRefreshSupported();
     HWC_LOGD("CapsInfo [%d]isDispSelfRefreshSupported", isSelfRefreshSupported);
 
+    updateCaps();
+
     return NO_ERROR;
 }
 
+void DispDevice::updateCaps()
+{
+    m_caps.frame_cfg_ioctl = m_caps_info.is_support_frame_cfg_ioctl;
+    m_caps.constant_alpha_rgba = 0 == (m_caps_info.disp_feature & DISP_FEATURE_NO_PARGB);
+}
+
 bool DispDevice::isDispRszSupported()
 {
     return (0 != (m_caps_info.disp_feature & DISP_FEATURE_RSZ));
@@ -640,7 +652,7 @@ bool DispDevice::isFenceWaitSupported()
 
 bool DispDevice::isConstantAlphaForRGBASupported()
 {
-    return  (0 == (m_caps_info.disp_feature & DISP_FEATURE_NO_PARGB));
+    return m_caps.constant_alpha_rgba;
 }
 
 bool DispDevice::isDispSelfRefreshSupported()
@@ -700,11 +712,13 @@ uint32_t DispDevice::getRszMaxHeightInput()
 void DispDevice::enableDisplayFeature(uint32_t flag)
 {
     m_caps_info.disp_feature |= mapHwcFeatureFlag(flag);
+    updateCaps();
 }
 
 void DispDevice::disableDisplayFeature(uint32_t flag)
 {
     m_caps_info.disp_feature &= ~mapHwcFeatureFlag(flag);
+    updateCaps();
 }
 
 status_t DispDevice::createOverlaySession(uint64_t dpy, uint32_t /*drm_id_crtc*/, uint32_t /*width*/, uint32_t /*height*/,
@@ -739,6 +753,7 @@ status_t DispDevice::createOverlaySession(uint64_t dpy, uint32_t /*drm_id_crtc*/
 
     m_frame_cfg[dpy].session_id = config.session_id;
     m_frame_cfg[dpy].mode = config.mode;
+    m_input_shadow_valid[dpy] = false;
 
     DLOGD(dpy, "Create Session (%s)", getSessionModeString(mode).string());
 
@@ -771,31 +786,92 @@ void DispDevice::destroyOverlaySession(uint64_t dpy, uint32_t /*drm_id_crtc*/)
 
     m_frame_cfg[dpy].session_id = DISP_INVALID_SESSION;
     m_frame_cfg[dpy].mode = DISP_INVALID_SESSION_MODE;
+    m_input_shadow_valid[dpy] = false;
 
     DLOGD(dpy, "Destroy DispSession");
 }
 
+status_t DispDevice::legacySubmitFrame(uint64_t dpy, int pf_idx)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    // a failed config does not stop the trigger, so the fences of the frame still signal
+    legacySetInputBuffer(dpy);
+    if (m_frame_cfg[dpy].output_en)
+    {
+        legacySetOutputBuffer(dpy);
+    }
+    return legacyTriggerSession(dpy, pf_idx);
+}
+
+bool DispDevice::isInputChanged(uint64_t dpy, unsigned int layer) const
+{
+    const disp_input_config& input = m_frame_cfg[dpy].input_cfg[layer];
+
+    // the dirty rects are behind a pointer which is the same every frame
+    if (!m_input_shadow_valid[dpy] || (input.layer_enable && input.dirty_roi_num != 0))
+    {
+        return true;
+    }
+    return memcmp(&input, &m_input_shadow[dpy].config[layer], sizeof(disp_input_config)) != 0;
+}
+
 status_t DispDevice::legacySetInputBuffer(uint64_t dpy)
 {
     CHECK_DPY_RET_STATUS(dpy);
 
-    if (m_caps_info.is_support_frame_cfg_ioctl)
+    if (m_caps.frame_cfg_ioctl)
         return NO_ERROR;
 
     memset(&m_input_config[dpy], 0, sizeof(disp_session_input_config));
 
     m_input_config[dpy].session_id = m_frame_cfg[dpy].session_id;
-    m_input_config[dpy].config_layer_num = m_frame_cfg[dpy].input_layer_num;
-    size_t size = m_input_config[dpy].config_layer_num * sizeof(disp_input_config);
-    memcpy(m_input_config[dpy].config, m_frame_cfg[dpy].input_cfg, size);
+
+    // the driver keeps the config of a layer, so only the changed layers are sent
+    const unsigned int layer_num = m_frame_cfg[dpy].input_layer_num;
+    unsigned int changed_num = 0;
+    for (unsigned int i = 0; i < layer_num; i++)
+    {
+        if (isInputChanged(dpy, i))
+        {
+            memcpy(&m_input_config[dpy].config[changed_num], &m_frame_cfg[dpy].input_cfg[i],
+                   sizeof(disp_input_config));
+            changed_num++;
+        }
+    }
+    const bool ccorr_changed = !m_input_shadow_valid[dpy] ||
+            memcmp(&m_input_shadow[dpy].ccorr_config, &m_frame_cfg[dpy].ccorr_config,
+                   sizeof(m_frame_cfg[dpy].ccorr_config)) != 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_stats_lock);
+        m_ioctl_stats[dpy].skip_layer_count += layer_num - changed_num;
+        if (changed_num == 0 && !ccorr_changed)
+        {
+            m_ioctl_stats[dpy].skip_input_count++;
+        }
+    }
+    if (changed_num == 0 && !ccorr_changed)
+    {
+        return NO_ERROR;
+    }
+
+    m_input_config[dpy].config_layer_num = changed_num;
     memcpy(&m_input_config[dpy].ccorr_config, &m_frame_cfg[dpy].ccorr_config, sizeof(m_frame_cfg[dpy].ccorr_config));
 
+    countIoctl(dpy);
     int err = WDT_IOCTL(m_dev_fd, DISP_IOCTL_SET_INPUT_BUFFER, &m_input_config[dpy]);
     if (err < 0)
     {
         IOLOGE(dpy, err, "DISP_IOCTL_SET_INPUT_BUFFER");
+        m_input_shadow_valid[dpy] = false;
+        return err;
     }
 
+    memcpy(m_input_shadow[dpy].config, m_frame_cfg[dpy].input_cfg, layer_num * sizeof(disp_input_config));
+    memcpy(&m_input_shadow[dpy].ccorr_config, &m_frame_cfg[dpy].ccorr_config, sizeof(m_frame_cfg[dpy].ccorr_config));
+    m_input_shadow_valid[dpy] = true;
+
     return err;
 }
 
@@ -803,7 +879,7 @@ status_t DispDevice::legacySetOutputBuffer(uint64_t dpy)
 {
     CHECK_DPY_RET_STATUS(dpy);
 
-    if (m_caps_info.is_support_frame_cfg_ioctl)
+    if (m_caps.frame_cfg_ioctl)
         return NO_ERROR;
 
     memset(&m_output_config[dpy], 0, sizeof(disp_session_output_config));
@@ -811,6 +887,7 @@ status_t DispDevice::legacySetOutputBuffer(uint64_t dpy)
     m_output_config[dpy].session_id = m_frame_cfg[dpy].session_id;
     memcpy(&m_output_config[dpy].config, &m_frame_cfg[dpy].output_cfg, sizeof(disp_output_config));
 
+    countIoctl(dpy);
     int err = WDT_IOCTL(m_dev_fd, DISP_IOCTL_SET_OUTPUT_BUFFER, &m_output_config[dpy]);
     if (err < 0)
     {
@@ -824,7 +901,7 @@ status_t DispDevice::legacyTriggerSession(uint64_t dpy, int pf_idx)
 {
     CHECK_DPY_RET_STATUS(dpy);
 
-    if (m_caps_info.is_support_frame_cfg_ioctl)
+    if (m_caps.frame_cfg_ioctl)
         return NO_ERROR;
 
     disp_session_config config;
@@ -835,6 +912,7 @@ status_t DispDevice::legacyTriggerSession(uint64_t dpy, int pf_idx)
     config.session_id = m_frame_cfg[dpy].session_id;
     config.present_fence_idx = static_cast<unsigned int>(pf_idx);
 
+    countIoctl(dpy);
     int err = WDT_IOCTL(m_dev_fd, DISP_IOCTL_TRIGGER_SESSION, &config);
     if (err < 0)
     {
@@ -883,6 +961,7 @@ status_t DispDevice::frameConfig(uint64_t dpy, int pf_idx, int ovlp_layer_num,
 #endif
 
     HWC_ATRACE_FORMAT_NAME("active_config(%d)", config);
+    countIoctl(dpy);
     int err = WDT_IOCTL(m_dev_fd, DISP_IOCTL_FRAME_CONFIG, &m_frame_cfg[dpy]);
     if (err < 0)
     {
@@ -934,15 +1013,18 @@ status_t DispDevice::triggerOverlaySession(uint64_t dpy, uint32_t /*drm_id_crtc*
     }
 
     HWC_ATRACE_FORMAT_NAME("TrigerOVL:%d", present_fence_idx);
-    if (!m_caps_info.is_support_frame_cfg_ioctl)
-        return legacyTriggerSession(dpy, present_fence_idx);
+    status_t err = NO_ERROR;
+    if (!m_caps.frame_cfg_ioctl)
+        err = legacySubmitFrame(dpy, present_fence_idx);
     else
-       return frameConfig(dpy, present_fence_idx, ovlp_layer_num, prev_present_fence_fd, config,
+        err = frameConfig(dpy, present_fence_idx, ovlp_layer_num, prev_present_fence_fd, config,
 #ifdef MTK_IN_DISPLAY_FINGERPRINT
                           hrt_weight, hrt_idx, trigger_param.is_HBM);
 #else
                           hrt_weight, hrt_idx);
 #endif
+    countFrame(dpy);
+    return err;
 }
 
 void DispDevice::disableOverlaySession(
@@ -978,9 +1060,6 @@ void DispDevice::disableOverlaySession(
         m_frame_cfg[dpy].input_layer_num = (num < m_ovl_input_num) ? num : m_ovl_input_num;
     }
 
-    if (!m_caps_info.is_support_frame_cfg_ioctl)
-        legacySetInputBuffer(dpy);
-
     disableOverlayOutput(dpy, UINT32_MAX);
     triggerOverlaySession(dpy, UINT32_MAX, -1, 0, -1, 0, 0, 0, 0, nullptr, nullptr, {});
 
@@ -1096,6 +1175,7 @@ void DispDevice::prepareOverlayInput(
     buffer.index      = UINT_MAX;
     buffer.fence_fd   = -1;
 
+    countIoctl(dpy);
     int err = WDT_IOCTL(m_dev_fd, DISP_IOCTL_PREPARE_INPUT_BUFFER, &buffer);
     if (err < 0)
     {
@@ -1252,7 +1332,7 @@ void DispDevice::updateOverlayInputs(uint64_t dpy, uint32_t /*drm_id_crtc*/,
             input->dirty_roi_num = static_cast<__u16>(params[i]->ovl_dirty_rect_cnt);
         }
 
-        if (!isConstantAlphaForRGBASupported())
+        if (!m_caps.constant_alpha_rgba)
         {
             if (params[i]->blending == HWC2_BLEND_MODE_PREMULTIPLIED)
             {
@@ -1342,9 +1422,6 @@ void DispDevice::updateOverlayInputs(uint64_t dpy, uint32_t /*drm_id_crtc*/,
     }
 
     HWC_LOGV("- updateOverlayInputs");
-
-    if (!m_caps_info.is_support_frame_cfg_ioctl)
-        legacySetInputBuffer(dpy);
 }
 
 void DispDevice::prepareOverlayOutput(uint64_t dpy, OverlayPrepareParam* param)
@@ -1369,6 +1446,7 @@ void DispDevice::prepareOverlayOutput(uint64_t dpy, OverlayPrepareParam* param)
     buffer.index      = UINT_MAX;
     buffer.fence_fd   = -1;
 
+    countIoctl(dpy);
     int err = WDT_IOCTL(m_dev_fd, DISP_IOCTL_PREPARE_OUTPUT_BUFFER, &buffer);
     if (err < 0)
     {
@@ -1435,9 +1513,6 @@ void DispDevice::enableOverlayOutput(uint64_t dpy, uint32_t /*drm_id_crtc*/, Ove
              param->pitch, param->dataspace);
 
     m_frame_cfg[dpy].output_en = true;
-
-    if (!m_caps_info.is_support_frame_cfg_ioctl)
-        legacySetOutputBuffer(dpy);
 }
 
 void DispDevice::prepareOverlayPresentFence(uint64_t dpy, OverlayPrepareParam* param)
@@ -1456,6 +1531,7 @@ void DispDevice::prepareOverlayPresentFence(uint64_t dpy, OverlayPrepareParam* p
 
         fence.session_id = session_id;
 
+        countIoctl(dpy);
         int err = WDT_IOCTL(m_dev_fd, DISP_IOCTL_GET_PRESENT_FENCE, &fence);
         if (err < 0)
         {
@@ -1644,8 +1720,41 @@ uint32_t DispDevice::getNumConfigs(uint64_t dpy, uint32_t /*drm_id_connector*/)
 }
 
 
-void DispDevice::dump(const uint64_t& /*dpy*/, String8* /*dump_str*/)
+void DispDevice::countIoctl(uint64_t dpy)
+{
+    std::lock_guard<std::mutex> lock(m_stats_lock);
+    m_ioctl_stats[dpy].ioctl_count++;
+    m_ioctl_stats[dpy].frame_ioctl++;
+}
+
+void DispDevice::countFrame(uint64_t dpy)
+{
+    std::lock_guard<std::mutex> lock(m_stats_lock);
+    IoctlStats& stats = m_ioctl_stats[dpy];
+    stats.frame_count++;
+    stats.last_frame_ioctl = stats.frame_ioctl;
+    stats.max_frame_ioctl = std::max(stats.max_frame_ioctl, stats.frame_ioctl);
+    stats.frame_ioctl = 0;
+}
+
+void DispDevice::dump(const uint64_t& dpy, String8* dump_str)
 {
+    CHECK_DPY_RET_VOID(dpy);
+
+    std::lock_guard<std::mutex> lock(m_stats_lock);
+    const IoctlStats& stats = m_ioctl_stats[dpy];
+    dump_str->appendFormat("----------DISPDEV %s----------\n",
+                           m_caps.frame_cfg_ioctl ? "frame config" : "legacy");
+    dump_str->appendFormat("frame:%" PRIu64 " ioctl:%" PRIu64 " avg:%.2f last:%u max:%u\n",
+                           stats.frame_count, stats.ioctl_count,
+                           stats.frame_count ?
+                               static_cast<double>(stats.ioctl_count) / static_cast<double>(stats.frame_count) : 0.0,
+                           stats.last_frame_ioctl, stats.max_frame_ioctl);
+    if (!m_caps.frame_cfg_ioctl)
+    {
+        dump_str->appendFormat("skip input:%" PRIu64 " layer:%" PRIu64 "\n",
+                               stats.skip_input_count, stats.skip_layer_count);
+    }
 }
 
 
@@ -3,6 +3,8 @@
 
 #include <linux/disp_session.h>
 
+#include <mutex>
+
 #include "dev_interface.h"
 
 // ---------------------------------------------------------------------------
@@ -195,11 +197,16 @@ public:
 private:
     DispDevice();
 
-    // for lagacy driver API
+    // for lagacy driver API, the inputs and the output are staged in m_frame_cfg and
+    // submitted together with the trigger
+    status_t legacySubmitFrame(uint64_t dpy, int present_fence_idx);
     status_t legacySetInputBuffer(uint64_t dpy);
     status_t legacySetOutputBuffer(uint64_t dpy);
     status_t legacyTriggerSession(uint64_t dpy, int present_fence_idx);
 
+    // isInputChanged() checks the staged input layer against the last submitted one
+    bool isInputChanged(uint64_t dpy, unsigned int layer) const;
+
     // for new driver API from MT6755
     status_t frameConfig(uint64_t dpy, int present_fence_idx, int ovlp_layer_num,
                          int prev_present_fence_fd, hwc2_config_t config,
@@ -213,6 +220,15 @@ private:
     // query hw capabilities through ioctl and store in m_caps_info
     status_t queryCapsInfo();
 
+    // updateCaps() derives m_caps from m_caps_info, which changes only with the feature flags
+    void updateCaps();
+
+    // countIoctl() counts an ioctl of the frame which is being built
+    void countIoctl(uint64_t dpy);
+
+    // countFrame() closes the ioctl count of the frame
+    void countFrame(uint64_t dpy);
+
     // get the correct device id for extension display when enable dual display
     unsigned int getDeviceId(uint64_t dpy);
 
@@ -239,6 +255,31 @@ private:
 
     disp_caps_info m_caps_info;
 
+    // the capabilities which the frame path checks
+    struct Caps
+    {
+        bool frame_cfg_ioctl;
+        bool constant_alpha_rgba;
+    };
+    Caps m_caps;
+
+    // the input config which the legacy driver has, the unchanged layers are not sent again
+    disp_session_input_config m_input_shadow[DisplayManager::MAX_DISPLAYS];
+    bool m_input_shadow_valid[DisplayManager::MAX_DISPLAYS];
+
+    struct IoctlStats
+    {
+        uint64_t frame_count;
+        uint64_t ioctl_count;
+        uint64_t skip_input_count;
+        uint64_t skip_layer_count;
+        unsigned int frame_ioctl;
+        unsigned int last_frame_ioctl;
+        unsigned int max_frame_ioctl;
+    };
+    std::mutex m_stats_lock;
+    IoctlStats m_ioctl_stats[DisplayManager::MAX_DISPLAYS];
+
     layer_config* m_layer_config_list[DisplayManager::MAX_DISPLAYS];
 
     layer_dirty_roi** m_hwdev_dirty_rect[DisplayManager::MAX_DISPLAYS];
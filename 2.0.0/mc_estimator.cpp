@@ -0,0 +1,397 @@
+#define DEBUG_LOG_TAG "MCEST"
+
+#include "mc_estimator.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+#include "platform_wrap.h"
+
+#define CPU_FREQ_PATH "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq"
+#define MC_PERSIST_HEADER "hwc_mc_learned"
+
+// the learned weight never goes above this, so the prior keeps bounding
+// a learned value that drifts because of a bad sample stream
+#define MC_MAX_LEARNED_WEIGHT 0.9f
+
+// a sample is dropped if it is this many times larger than the prior
+#define MC_MAX_SAMPLE_RATIO 10.f
+
+// ---------------------------------------------------------------------------
+
+MCycleEstimator& MCycleEstimator::getInstance()
+{
+    static MCycleEstimator gInstance;
+    return gInstance;
+}
+
+MCycleEstimator::Learned::Learned()
+{
+    for (int i = 0; i < THREAD_NUM; i++)
+    {
+        mc[i] = 0.f;
+        dev[i] = 0.f;
+        samples[i] = 0;
+    }
+}
+
+MCycleEstimator::MCycleEstimator()
+    : m_mode(MODE_LEARN)
+    , m_unsaved_samples(0)
+    , m_dropped_samples(0)
+{
+    long num_cpu = sysconf(_SC_NPROCESSORS_CONF);
+    for (long i = 0; i < num_cpu; i++)
+    {
+        char path[128];
+        int fd = -1;
+        if (snprintf(path, sizeof(path), CPU_FREQ_PATH, static_cast<int>(i)) > 0)
+        {
+            fd = open(path, O_RDONLY | O_CLOEXEC);
+        }
+        m_freq_fd.push_back(fd);
+    }
+}
+
+MCycleEstimator::~MCycleEstimator()
+{
+    for (int fd : m_freq_fd)
+    {
+        if (fd >= 0)
+        {
+            protectedClose(fd);
+        }
+    }
+}
+
+void MCycleEstimator::setMode(int mode)
+{
+    if (mode < MODE_OFF || mode > MODE_APPLY)
+    {
+        HWC_LOGW("%s: invalid mode %d", __func__, mode);
+        return;
+    }
+    m_mode.store(mode, std::memory_order_relaxed);
+}
+
+void MCycleEstimator::setPersistPath(const char* path)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    std::string new_path = (path == nullptr || strcmp(path, "0") == 0) ? "" : path;
+    if (new_path == m_persist_path)
+    {
+        return;
+    }
+
+    m_persist_path = new_path;
+    if (!m_persist_path.empty())
+    {
+        loadLocked();
+    }
+}
+
+float MCycleEstimator::learnedMCLocked(const Learned& learned, int thread) const
+{
+    // keep one mean absolute deviation as headroom, the mc is used to meet a deadline
+    return learned.mc[thread] + learned.dev[thread];
+}
+
+float MCycleEstimator::blendMCLocked(const Learned& learned, int thread, float prior) const
+{
+    const float samples = static_cast<float>(learned.samples[thread]);
+    if (samples <= 0.f)
+    {
+        return prior;
+    }
+
+    const float weight = std::min(samples / (samples + static_cast<float>(PRIOR_SAMPLES)), MC_MAX_LEARNED_WEIGHT);
+    return weight * learnedMCLocked(learned, thread) + (1.f - weight) * prior;
+}
+
+HwcMCycleInfo MCycleEstimator::getMCInfo(const HwcMCycleInfo& prior) const
+{
+    if (m_mode.load(std::memory_order_relaxed) != MODE_APPLY)
+    {
+        return prior;
+    }
+
+    HwcMCycleInfo info = prior;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_learned.find(prior.id);
+    if (it != m_learned.end())
+    {
+        info.dispatcher_mc = blendMCLocked(it->second, THREAD_DISPATCHER, prior.dispatcher_mc);
+        info.ovl_mc = blendMCLocked(it->second, THREAD_OVL, prior.ovl_mc);
+    }
+    return info;
+}
+
+void MCycleEstimator::addSample(int id, int thread, nsecs_t cpu_time, uint32_t cpu_mhz)
+{
+    if (!isLearning() || thread < 0 || thread >= THREAD_NUM)
+    {
+        return;
+    }
+
+    if (cpu_time <= 0 || cpu_mhz == 0)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_dropped_samples++;
+        return;
+    }
+
+    // mega cycles = seconds * MHz
+    const float mc = static_cast<float>(cpu_time) * static_cast<float>(cpu_mhz) / 1e9f;
+
+    float prior_mc = 0.f;
+    for (auto& p : Platform::getInstance().m_config.hwc_mcycle_table)
+    {
+        if (p.id == id)
+        {
+            prior_mc = thread == THREAD_DISPATCHER ? p.dispatcher_mc : p.ovl_mc;
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    // a frame stalled by something out of our control, e.g. preemption in
+    // the driver, must not teach the estimator
+    if (prior_mc > 0.f && mc > prior_mc * MC_MAX_SAMPLE_RATIO)
+    {
+        m_dropped_samples++;
+        return;
+    }
+
+    Learned& learned = m_learned[id];
+    uint32_t& samples = learned.samples[thread];
+    if (samples < UINT32_MAX)
+    {
+        samples++;
+    }
+
+    // plain average for the first samples, then an EWMA to follow the
+    // governor and thermal changes
+    const float window = static_cast<float>(std::min(samples, static_cast<uint32_t>(EWMA_WINDOW)));
+    const float diff = mc - learned.mc[thread];
+    learned.mc[thread] += diff / window;
+    learned.dev[thread] += (fabsf(diff) - learned.dev[thread]) / window;
+
+    m_unsaved_samples++;
+}
+
+uint32_t MCycleEstimator::getCurCpuMHz() const
+{
+    int cpu = sched_getcpu();
+    if (cpu < 0 || static_cast<size_t>(cpu) >= m_freq_fd.size() || m_freq_fd[static_cast<size_t>(cpu)] < 0)
+    {
+        return 0;
+    }
+
+    char buf[16] = {0};
+    ssize_t res = pread(m_freq_fd[static_cast<size_t>(cpu)], buf, sizeof(buf) - 1, 0);
+    if (res <= 0)
+    {
+        return 0;
+    }
+
+    // scaling_cur_freq is in KHz
+    return static_cast<uint32_t>(strtoul(buf, nullptr, 10) / 1000);
+}
+
+std::string MCycleEstimator::getSignature() const
+{
+    // the learned cost is only valid for the same prior and the same kernel
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const void* data, size_t size)
+    {
+        const uint8_t* ptr = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ ptr[i]) * 16777619u;
+        }
+    };
+
+    for (auto& p : Platform::getInstance().m_config.hwc_mcycle_table)
+    {
+        mix(&p.id, sizeof(p.id));
+        mix(&p.dispatcher_mc, sizeof(p.dispatcher_mc));
+        mix(&p.ovl_mc, sizeof(p.ovl_mc));
+    }
+
+    struct utsname name;
+    if (uname(&name) == 0)
+    {
+        mix(name.release, strlen(name.release));
+    }
+
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%08x", hash);
+    return buf;
+}
+
+void MCycleEstimator::loadLocked()
+{
+    FILE* fp = fopen(m_persist_path.c_str(), "r");
+    if (fp == nullptr)
+    {
+        HWC_LOGI("%s: no learned cost in %s", __func__, m_persist_path.c_str());
+        return;
+    }
+
+    char header[32] = {0};
+    char signature[16] = {0};
+    if (fscanf(fp, "%31s %15s", header, signature) != 2 ||
+        strcmp(header, MC_PERSIST_HEADER) != 0 ||
+        getSignature() != signature)
+    {
+        HWC_LOGI("%s: ignore stale learned cost in %s", __func__, m_persist_path.c_str());
+        fclose(fp);
+        return;
+    }
+
+    int id = 0;
+    int thread = 0;
+    float mc = 0.f;
+    float dev = 0.f;
+    uint32_t samples = 0;
+    size_t count = 0;
+    while (fscanf(fp, "%d %d %f %f %u", &id, &thread, &mc, &dev, &samples) == 5)
+    {
+        if (thread < 0 || thread >= THREAD_NUM || !std::isfinite(mc) || !std::isfinite(dev))
+        {
+            continue;
+        }
+        Learned& learned = m_learned[id];
+        learned.mc[thread] = mc;
+        learned.dev[thread] = dev;
+        learned.samples[thread] = samples;
+        count++;
+    }
+    fclose(fp);
+
+    m_unsaved_samples = 0;
+    HWC_LOGI("%s: load %zu learned cost from %s", __func__, count, m_persist_path.c_str());
+}
+
+void MCycleEstimator::save()
+{
+    // one writer at a time for the tmp file, addSample() only waits for the copy below
+    std::lock_guard<std::mutex> save_lock(m_save_lock);
+
+    std::string persist_path;
+    std::map<int, Learned> learned;
+    uint32_t saving_samples = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_persist_path.empty() || m_unsaved_samples == 0)
+        {
+            return;
+        }
+        persist_path = m_persist_path;
+        learned = m_learned;
+        saving_samples = m_unsaved_samples;
+        m_unsaved_samples = 0;
+    }
+
+    if (!writeLearned(persist_path, learned))
+    {
+        // keep the samples unsaved, so the next save() tries again
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (persist_path == m_persist_path)
+        {
+            m_unsaved_samples += saving_samples;
+        }
+    }
+}
+
+bool MCycleEstimator::writeLearned(const std::string& path, const std::map<int, Learned>& learned) const
+{
+    std::string tmp_path = path + ".tmp";
+    FILE* fp = fopen(tmp_path.c_str(), "w");
+    if (fp == nullptr)
+    {
+        HWC_LOGW("%s: failed to open %s: %s", __func__, tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    fprintf(fp, "%s %s\n", MC_PERSIST_HEADER, getSignature().c_str());
+    for (auto& it : learned)
+    {
+        for (int i = 0; i < THREAD_NUM; i++)
+        {
+            if (it.second.samples[i] == 0)
+            {
+                continue;
+            }
+            fprintf(fp, "%d %d %f %f %u\n", it.first, i,
+                    static_cast<double>(it.second.mc[i]), static_cast<double>(it.second.dev[i]),
+                    it.second.samples[i]);
+        }
+    }
+
+    // replace the old file only when the new one is complete
+    if (fclose(fp) != 0 || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        HWC_LOGW("%s: failed to save %s: %s", __func__, path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void MCycleEstimator::dump(android::String8* dump_str) const
+{
+    const int mode = m_mode.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    dump_str->appendFormat("MCycle estimator(vendor.debug.hwc.mc_learn): mode:%d persist:%s unsaved:%u dropped:%" PRIu64 "\n",
+                           mode, m_persist_path.empty() ? "none" : m_persist_path.c_str(),
+                           m_unsaved_samples, m_dropped_samples);
+    if (mode == MODE_OFF)
+    {
+        return;
+    }
+
+    dump_str->appendFormat("  %4s | %8s %8s %8s %6s | %8s %8s %8s %6s\n",
+                           "id", "disp_tbl", "learned", "blended", "n",
+                           "ovl_tbl", "learned", "blended", "n");
+    for (auto& p : Platform::getInstance().m_config.hwc_mcycle_table)
+    {
+        auto it = m_learned.find(p.id);
+        if (it == m_learned.end())
+        {
+            dump_str->appendFormat("  %4d | %8.3f %8s %8s %6d | %8.3f %8s %8s %6d\n",
+                                   p.id, static_cast<double>(p.dispatcher_mc), "-", "-", 0,
+                                   static_cast<double>(p.ovl_mc), "-", "-", 0);
+            continue;
+        }
+
+        const Learned& learned = it->second;
+        dump_str->appendFormat("  %4d | %8.3f %8.3f %8.3f %6u | %8.3f %8.3f %8.3f %6u\n",
+                               p.id,
+                               static_cast<double>(p.dispatcher_mc),
+                               static_cast<double>(learnedMCLocked(learned, THREAD_DISPATCHER)),
+                               static_cast<double>(blendMCLocked(learned, THREAD_DISPATCHER, p.dispatcher_mc)),
+                               learned.samples[THREAD_DISPATCHER],
+                               static_cast<double>(p.ovl_mc),
+                               static_cast<double>(learnedMCLocked(learned, THREAD_OVL)),
+                               static_cast<double>(blendMCLocked(learned, THREAD_OVL, p.ovl_mc)),
+                               learned.samples[THREAD_OVL]);
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "hwc2_defs.h"
+
+// ---------------------------------------------------------------------------
+
+namespace android
+{
+class String8;
+}
+
+// MCycleEstimator learns the mega-cycle cost of each HwcMCycleInfo scenario
+// from the thread CPU time and CPU frequency observed for every frame, and
+// blends it with the static hwc_mcycle_table of the platform as a prior.
+class MCycleEstimator
+{
+public:
+    enum
+    {
+        THREAD_DISPATCHER = 0,
+        THREAD_OVL,
+        THREAD_NUM,
+    };
+
+    enum
+    {
+        // use the static table only
+        MODE_OFF = 0,
+        // learn the cost, but keep using the static table
+        MODE_LEARN,
+        // learn the cost and blend it into the returned HwcMCycleInfo
+        MODE_APPLY,
+    };
+
+    static MCycleEstimator& getInstance();
+    ~MCycleEstimator();
+
+    void setMode(int mode);
+    bool isLearning() const { return m_mode.load(std::memory_order_relaxed) != MODE_OFF; }
+
+    // load the learned cost from path and save it back there on save(),
+    // an empty path disables the persistence
+    void setPersistPath(const char* path);
+
+    // return the static prior blended with the learned cost of its scenario
+    HwcMCycleInfo getMCInfo(const HwcMCycleInfo& prior) const;
+
+    // feed the CPU time that a thread spent on one frame of the scenario
+    void addSample(int id, int thread, nsecs_t cpu_time, uint32_t cpu_mhz);
+
+    // current frequency of the CPU running the calling thread, 0 if unknown
+    uint32_t getCurCpuMHz() const;
+
+    // write the learned cost to the persist path if it has new samples
+    void save();
+
+    void dump(android::String8* dump_str) const;
+
+private:
+    MCycleEstimator();
+
+    struct Learned
+    {
+        Learned();
+
+        float mc[THREAD_NUM];
+        float dev[THREAD_NUM];  // mean absolute deviation of mc
+        uint32_t samples[THREAD_NUM];
+    };
+
+    float learnedMCLocked(const Learned& learned, int thread) const;
+    float blendMCLocked(const Learned& learned, int thread, float prior) const;
+
+    void loadLocked();
+    bool writeLearned(const std::string& path, const std::map<int, Learned>& learned) const;
+    std::string getSignature() const;
+
+private:
+    // the prior counts as this many samples when blending
+    enum { PRIOR_SAMPLES = 60 };
+    // the EWMA window once enough samples are collected
+    enum { EWMA_WINDOW = 32 };
+
+    mutable std::mutex m_lock;
+    // serializes save(), which does its file I/O without m_lock
+    std::mutex m_save_lock;
+    std::atomic<int> m_mode;
+    std::map<int, Learned> m_learned;
+    uint32_t m_unsaved_samples;
+    uint64_t m_dropped_samples;
+    std::string m_persist_path;
+
+    // fd of scaling_cur_freq of each cpu, opened in constructor
+    std::vector<int> m_freq_fd;
+};
@@ -0,0 +1,66 @@
+#define DEBUG_LOG_TAG "MCMODEL"
+
+#include "mc_model.h"
+
+#include <algorithm>
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+#include "dispatcher.h"
+#include "platform_wrap.h"
+
+// the parts of the mega-cycle models which need HWC itself, mc_model.cpp
+// stays free of them so the host test can score the models on a trace
+
+// ---------------------------------------------------------------------------
+
+void extractMCycleFeature(const DispatcherJob* job, MCycleFeature* feature)
+{
+    *feature = MCycleFeature();
+    if (job == nullptr)
+    {
+        return;
+    }
+
+    const int mml_caps = HWC_MML_DISP_DIRECT_LINK_LAYER |
+                         HWC_MML_DISP_DIRECT_DECOUPLE_LAYER |
+                         HWC_MML_DISP_DECOUPLE_LAYER |
+                         HWC_MML_DISP_MDP_LAYER;
+
+    int num_mml = 0;
+    for (unsigned int i = 0; i < job->num_layers; ++i)
+    {
+        const HWLayer& hw_layer = job->hw_layers[i];
+        if (!hw_layer.enable)
+        {
+            continue;
+        }
+
+        if (hw_layer.dirty)
+        {
+            feature->num_dirty_layers++;
+        }
+        if (hw_layer.type == HWC_LAYER_TYPE_MM && (hw_layer.layer_caps & mml_caps))
+        {
+            num_mml++;
+        }
+    }
+
+    feature->num_ui_layers = job->num_ui_layers + (job->fbt_exist ? 1 : 0);
+    feature->num_mml_layers = num_mml;
+    feature->num_mdp_layers = std::max(job->num_mm_layers - num_mml, 0);
+    feature->num_glai_layers = job->num_glai_layers;
+    feature->fbt_exist = job->fbt_exist;
+    feature->secure = job->secure;
+    feature->mirror_src = job->mirrored;
+    feature->mirror_dst = job->disp_mir_id != HWC_MIRROR_SOURCE_INVALID;
+    feature->is_virtual = job->disp_ori_id == HWC_DISPLAY_VIRTUAL;
+    feature->pixels = job->disp_data ? job->disp_data->pixels : 0;
+}
+
+MCycleModelManager& MCycleModelManager::getInstance()
+{
+    static MCycleModelManager gInstance(Platform::getInstance().m_config.hwc_mcycle_table);
+    return gInstance;
+}
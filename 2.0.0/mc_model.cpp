@@ -0,0 +1,387 @@
+#define DEBUG_LOG_TAG "MCMODEL"
+
+#include "mc_model.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+
+// the largest ui count of the table, without and with a mm layer
+#define MC_TABLE_MAX_UI 6
+#define MC_TABLE_MAX_UI_WITH_MM 5
+
+// step size of the normalized LMS of MCycleModelLinear
+#define MC_LINEAR_LEARNING_RATE 0.05f
+
+// ---------------------------------------------------------------------------
+
+MCycleFeature::MCycleFeature()
+    : num_ui_layers(0)
+    , num_mdp_layers(0)
+    , num_mml_layers(0)
+    , num_glai_layers(0)
+    , num_dirty_layers(0)
+    , fbt_exist(false)
+    , secure(false)
+    , mirror_src(false)
+    , mirror_dst(false)
+    , is_virtual(false)
+    , pixels(0)
+{
+}
+
+const HwcMCycleInfo& lookupScenarioMCInfo(const std::list<HwcMCycleInfo>& table, int num_ui, int num_mm)
+{
+    int cur_id;
+
+    if (num_mm)
+    {
+        switch (num_ui)
+        {
+            case 0:
+                cur_id = HWC_MC_0U_1M;
+                break;
+            case 1:
+                cur_id = HWC_MC_1U_1M;
+                break;
+            case 2:
+                cur_id = HWC_MC_2U_1M;
+                break;
+            case 3:
+                cur_id = HWC_MC_3U_1M;
+                break;
+            case 4:
+                cur_id = HWC_MC_4U_1M;
+                break;
+            case 5:
+                cur_id = HWC_MC_5U_1M;
+                break;
+            default:
+                cur_id = HWC_MC_5U_1M;
+                break;
+        }
+    }
+    else
+    {
+        switch (num_ui)
+        {
+            case 1:
+                cur_id = HWC_MC_1U;
+                break;
+            case 2:
+                cur_id = HWC_MC_2U;
+                break;
+            case 3:
+                cur_id = HWC_MC_3U;
+                break;
+            case 4:
+                cur_id = HWC_MC_4U;
+                break;
+            case 5:
+                cur_id = HWC_MC_5U;
+                break;
+            case 6:
+                cur_id = HWC_MC_6U;
+                break;
+            default:
+                cur_id = HWC_MC_6U;
+                break;
+        }
+    }
+
+    for (auto& p : table)
+    {
+        if (p.id != cur_id)
+        {
+            continue;
+        }
+
+        return p;
+    }
+
+    return table.back();
+}
+
+// ---------------------------------------------------------------------------
+
+HwcMCycleInfo MCycleModelTable::predict(const MCycleFeature& feature) const
+{
+    const int num_mm = feature.num_mdp_layers + feature.num_mml_layers + feature.num_glai_layers;
+    return getScenario(feature.num_ui_layers, num_mm);
+}
+
+// add count times the cost difference of two table entries to info, an entry
+// missing in the table is returned as the last one and adds nothing
+static void addMCDiff(HwcMCycleInfo* info, const HwcMCycleInfo& large, const HwcMCycleInfo& small, int count)
+{
+    if (large.id == small.id || count <= 0)
+    {
+        return;
+    }
+
+    const float n = static_cast<float>(count);
+    info->main_mc += std::max(large.main_mc - small.main_mc, 0.f) * n;
+    info->dispatcher_mc += std::max(large.dispatcher_mc - small.dispatcher_mc, 0.f) * n;
+    info->ovl_mc += std::max(large.ovl_mc - small.ovl_mc, 0.f) * n;
+}
+
+HwcMCycleInfo MCycleModelExtrapolate::predict(const MCycleFeature& feature) const
+{
+    const int num_ui = feature.num_ui_layers;
+    const int num_mm = feature.num_mdp_layers + feature.num_mml_layers + feature.num_glai_layers;
+    HwcMCycleInfo info = getScenario(num_ui, num_mm);
+
+    const int max_ui = num_mm ? MC_TABLE_MAX_UI_WITH_MM : MC_TABLE_MAX_UI;
+    if (num_ui > max_ui)
+    {
+        addMCDiff(&info, getScenario(max_ui, num_mm), getScenario(max_ui - 1, num_mm),
+                  num_ui - max_ui);
+    }
+
+    if (num_mm > 1)
+    {
+        // the table has no 0U scenario without mm, so take the mm cost at 1U or more
+        const int ui = std::min(std::max(num_ui, 1), MC_TABLE_MAX_UI_WITH_MM);
+        addMCDiff(&info, getScenario(ui, 1), getScenario(ui, 0), num_mm - 1);
+    }
+
+    return info;
+}
+
+MCycleModelLinear::MCycleModelLinear(const std::list<HwcMCycleInfo>& table)
+    : MCycleModel(table)
+    , m_base(table)
+{
+    for (int t = 0; t < MCycleEstimator::THREAD_NUM; t++)
+    {
+        for (int i = 0; i < INPUT_NUM; i++)
+        {
+            m_weights[t][i] = 0.f;
+        }
+    }
+}
+
+void MCycleModelLinear::getInputs(const MCycleFeature& feature, float* inputs)
+{
+    inputs[INPUT_BIAS] = 1.f;
+    inputs[INPUT_MEGA_PIXELS] = static_cast<float>(feature.pixels) / 1e6f;
+    inputs[INPUT_SECURE] = feature.secure ? 1.f : 0.f;
+    inputs[INPUT_MIRROR_SRC] = feature.mirror_src ? 1.f : 0.f;
+    inputs[INPUT_MIRROR_DST] = feature.mirror_dst ? 1.f : 0.f;
+    inputs[INPUT_VIRTUAL] = feature.is_virtual ? 1.f : 0.f;
+    inputs[INPUT_DIRTY_LAYERS] = static_cast<float>(feature.num_dirty_layers);
+}
+
+float MCycleModelLinear::correction(int thread, const float* inputs) const
+{
+    float sum = 0.f;
+    for (int i = 0; i < INPUT_NUM; i++)
+    {
+        sum += m_weights[thread][i] * inputs[i];
+    }
+    return sum;
+}
+
+HwcMCycleInfo MCycleModelLinear::predict(const MCycleFeature& feature) const
+{
+    HwcMCycleInfo info = m_base.predict(feature);
+
+    float inputs[INPUT_NUM];
+    getInputs(feature, inputs);
+
+    // main_mc is not measured, it stays the one of the table
+    std::lock_guard<std::mutex> lock(m_lock);
+    info.dispatcher_mc = std::max(info.dispatcher_mc + correction(MCycleEstimator::THREAD_DISPATCHER, inputs), 0.f);
+    info.ovl_mc = std::max(info.ovl_mc + correction(MCycleEstimator::THREAD_OVL, inputs), 0.f);
+    return info;
+}
+
+void MCycleModelLinear::learn(const MCycleFeature& feature, int thread, float mc)
+{
+    const HwcMCycleInfo base = m_base.predict(feature);
+    const float base_mc = thread == MCycleEstimator::THREAD_DISPATCHER ? base.dispatcher_mc : base.ovl_mc;
+
+    float inputs[INPUT_NUM];
+    getInputs(feature, inputs);
+    float norm = 1e-3f;
+    for (int i = 0; i < INPUT_NUM; i++)
+    {
+        norm += inputs[i] * inputs[i];
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    const float error = mc - (base_mc + correction(thread, inputs));
+    for (int i = 0; i < INPUT_NUM; i++)
+    {
+        m_weights[thread][i] += MC_LINEAR_LEARNING_RATE * error * inputs[i] / norm;
+    }
+}
+
+void MCycleModelLinear::dump(android::String8* dump_str) const
+{
+    static const char* const thread_name[MCycleEstimator::THREAD_NUM] = {"disp", "ovl"};
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    dump_str->appendFormat("  linear weights(mc): bias mpix secure mir_src mir_dst virtual dirty\n");
+    for (int t = 0; t < MCycleEstimator::THREAD_NUM; t++)
+    {
+        dump_str->appendFormat("    %-5s", thread_name[t]);
+        for (int i = 0; i < INPUT_NUM; i++)
+        {
+            dump_str->appendFormat(" %+.3f", static_cast<double>(m_weights[t][i]));
+        }
+        dump_str->appendFormat("\n");
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+MCycleModelManager::Score::Score()
+{
+    for (int i = 0; i < MCycleEstimator::THREAD_NUM; i++)
+    {
+        samples[i] = 0;
+        abs_error[i] = 0.0;
+        error[i] = 0.0;
+    }
+}
+
+MCycleModelManager::MCycleModelManager(const std::list<HwcMCycleInfo>& table)
+    : m_model(MODEL_TABLE)
+    , m_scoring(false)
+{
+    // the order follows MODEL_*
+    m_models.push_back(new MCycleModelTable(table));
+    m_models.push_back(new MCycleModelExtrapolate(table));
+    m_models.push_back(new MCycleModelLinear(table));
+    m_scores.resize(m_models.size());
+}
+
+MCycleModelManager::~MCycleModelManager()
+{
+    for (auto model : m_models)
+    {
+        delete model;
+    }
+}
+
+void MCycleModelManager::setModel(int model)
+{
+    if (model < 0 || model >= MODEL_NUM)
+    {
+        HWC_LOGW("%s: invalid model %d", __func__, model);
+        return;
+    }
+    m_model.store(model, std::memory_order_relaxed);
+}
+
+HwcMCycleInfo MCycleModelManager::predict(const MCycleFeature& feature) const
+{
+    const int model = m_model.load(std::memory_order_relaxed);
+    return m_models[static_cast<size_t>(model)]->predict(feature);
+}
+
+void MCycleModelManager::addSample(const MCycleFeature& feature, int thread, nsecs_t cpu_time, uint32_t cpu_mhz)
+{
+    if (!isScoring())
+    {
+        return;
+    }
+
+    if (thread < 0 || thread >= MCycleEstimator::THREAD_NUM || cpu_time <= 0 || cpu_mhz == 0)
+    {
+        return;
+    }
+
+    // mega cycles = seconds * MHz
+    const double mc = static_cast<double>(cpu_time) * static_cast<double>(cpu_mhz) / 1e9;
+
+    // predict outside the lock, the models only read the platform table
+    double predicted[MODEL_NUM];
+    for (size_t i = 0; i < m_models.size(); i++)
+    {
+        const HwcMCycleInfo info = m_models[i]->predict(feature);
+        predicted[i] = static_cast<double>(thread == MCycleEstimator::THREAD_DISPATCHER ?
+                                           info.dispatcher_mc : info.ovl_mc);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (size_t i = 0; i < m_models.size(); i++)
+        {
+            Score& score = m_scores[i];
+            const double diff = predicted[i] - mc;
+            score.samples[thread]++;
+            score.abs_error[thread] += fabs(diff);
+            score.error[thread] += diff;
+        }
+    }
+
+    // score before learning, so the error is the one of an unseen sample
+    for (auto model : m_models)
+    {
+        model->learn(feature, thread, static_cast<float>(mc));
+    }
+}
+
+uint64_t MCycleModelManager::getScore(int model, int thread, double* mae, double* bias) const
+{
+    *mae = 0.0;
+    *bias = 0.0;
+    if (model < 0 || model >= MODEL_NUM || thread < 0 || thread >= MCycleEstimator::THREAD_NUM)
+    {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    const Score& score = m_scores[static_cast<size_t>(model)];
+    if (score.samples[thread] == 0)
+    {
+        return 0;
+    }
+
+    const double n = static_cast<double>(score.samples[thread]);
+    *mae = score.abs_error[thread] / n;
+    *bias = score.error[thread] / n;
+    return score.samples[thread];
+}
+
+const char* MCycleModelManager::getModelName(int model) const
+{
+    if (model < 0 || model >= MODEL_NUM)
+    {
+        return "unknown";
+    }
+    return m_models[static_cast<size_t>(model)]->getName();
+}
+
+void MCycleModelManager::dump(android::String8* dump_str) const
+{
+    const int model = m_model.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    dump_str->appendFormat("MCycle model(vendor.debug.hwc.mc_model): %s scoring(vendor.debug.hwc.mc_model_score):%d\n",
+                           m_models[static_cast<size_t>(model)]->getName(), isScoring());
+    dump_str->appendFormat("  %-12s | %8s %8s %8s | %8s %8s %8s\n",
+                           "model", "disp_n", "mae", "bias", "ovl_n", "mae", "bias");
+    for (size_t i = 0; i < m_models.size(); i++)
+    {
+        const Score& score = m_scores[i];
+        dump_str->appendFormat("%c %-12s", static_cast<int>(i) == model ? '*' : ' ', m_models[i]->getName());
+        for (int t = 0; t < MCycleEstimator::THREAD_NUM; t++)
+        {
+            const double n = static_cast<double>(std::max(score.samples[t], static_cast<uint64_t>(1)));
+            dump_str->appendFormat(" | %8" PRIu64 " %8.3f %+8.3f",
+                                   score.samples[t], score.abs_error[t] / n, score.error[t] / n);
+        }
+        dump_str->appendFormat("\n");
+    }
+
+    for (auto model : m_models)
+    {
+        model->dump(dump_str);
+    }
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include "hwc2_defs.h"
+#include "mc_estimator.h"
+
+// ---------------------------------------------------------------------------
+
+namespace android
+{
+class String8;
+}
+
+class DispatcherJob;
+
+// MCycleFeature describes a DispatcherJob with the properties that drive its
+// CPU cost in the dispatcher and OVL threads
+struct MCycleFeature
+{
+    MCycleFeature();
+
+    int num_ui_layers;      // fbt included
+    int num_mdp_layers;     // mm layers composed by MDP
+    int num_mml_layers;     // mm layers composed by MML
+    int num_glai_layers;
+    int num_dirty_layers;   // layers with a new buffer, each may miss the fb cache
+    bool fbt_exist;
+    bool secure;
+    bool mirror_src;        // the job provides a mirror buffer to another display
+    bool mirror_dst;        // the job composes the buffer of a mirror source
+    bool is_virtual;
+    uint32_t pixels;        // pixels of the active config
+};
+
+void extractMCycleFeature(const DispatcherJob* job, MCycleFeature* feature);
+
+// the scenario of table for num_ui ui layers and num_mm mm layers, the last
+// entry if the table has no such scenario. table must not be empty.
+const HwcMCycleInfo& lookupScenarioMCInfo(const std::list<HwcMCycleInfo>& table, int num_ui, int num_mm);
+
+// MCycleModel predicts the mega cycles that a job costs each HWC thread
+class MCycleModel
+{
+public:
+    explicit MCycleModel(const std::list<HwcMCycleInfo>& table) : m_table(table) {}
+    virtual ~MCycleModel() {}
+
+    virtual const char* getName() const = 0;
+
+    // the id of the returned info is the hwc_mcycle_table scenario that the
+    // prediction is based on, callers keep using it for the scenario checks
+    virtual HwcMCycleInfo predict(const MCycleFeature& feature) const = 0;
+
+    // learn from the mega cycles that a thread, one of MCycleEstimator::THREAD_*,
+    // spent on a frame, the static models ignore it
+    virtual void learn(const MCycleFeature& /*feature*/, int /*thread*/, float /*mc*/) {}
+
+    virtual void dump(android::String8* /*dump_str*/) const {}
+
+protected:
+    const HwcMCycleInfo& getScenario(int num_ui, int num_mm) const
+    {
+        return lookupScenarioMCInfo(m_table, num_ui, num_mm);
+    }
+
+private:
+    const std::list<HwcMCycleInfo>& m_table;
+};
+
+// MCycleModelTable is the hwc_mcycle_table lookup of getScenarioMCInfo()
+class MCycleModelTable : public MCycleModel
+{
+public:
+    explicit MCycleModelTable(const std::list<HwcMCycleInfo>& table) : MCycleModel(table) {}
+    const char* getName() const override { return "table"; }
+    HwcMCycleInfo predict(const MCycleFeature& feature) const override;
+};
+
+// MCycleModelExtrapolate extends the table past its largest scenarios with
+// the cost difference of the last two table entries, instead of capping at
+// 6U and 5U_1M, and charges each mm and glai layer after the first one
+class MCycleModelExtrapolate : public MCycleModel
+{
+public:
+    explicit MCycleModelExtrapolate(const std::list<HwcMCycleInfo>& table) : MCycleModel(table) {}
+    const char* getName() const override { return "extrapolate"; }
+    HwcMCycleInfo predict(const MCycleFeature& feature) const override;
+};
+
+// MCycleModelLinear corrects the extrapolated table with a linear term of the
+// features the table does not describe: the display pixels, secure, mirror and
+// virtual jobs and the number of dirty layers. The weights of the dispatcher
+// and OVL threads are learned online by normalized LMS from the measured cost,
+// so the model only moves away from the extrapolated table while scoring is on.
+class MCycleModelLinear : public MCycleModel
+{
+public:
+    explicit MCycleModelLinear(const std::list<HwcMCycleInfo>& table);
+
+    const char* getName() const override { return "linear"; }
+    HwcMCycleInfo predict(const MCycleFeature& feature) const override;
+    void learn(const MCycleFeature& feature, int thread, float mc) override;
+    void dump(android::String8* dump_str) const override;
+
+private:
+    enum
+    {
+        INPUT_BIAS = 0,
+        INPUT_MEGA_PIXELS,
+        INPUT_SECURE,
+        INPUT_MIRROR_SRC,
+        INPUT_MIRROR_DST,
+        INPUT_VIRTUAL,
+        INPUT_DIRTY_LAYERS,
+        INPUT_NUM,
+    };
+
+    static void getInputs(const MCycleFeature& feature, float* inputs);
+    float correction(int thread, const float* inputs) const;
+
+private:
+    MCycleModelExtrapolate m_base;
+
+    mutable std::mutex m_lock;
+    float m_weights[MCycleEstimator::THREAD_NUM][INPUT_NUM];
+};
+
+// MCycleModelManager owns the models, predicts with the selected one, and
+// scores every model against the cost measured by the HWC threads. Scoring
+// predicts with every model per frame and thread, so it is off by default
+// (vendor.debug.hwc.mc_model_score).
+class MCycleModelManager
+{
+public:
+    enum
+    {
+        MODEL_TABLE = 0,
+        MODEL_EXTRAPOLATE,
+        MODEL_LINEAR,
+        MODEL_NUM,
+    };
+
+    // the instance of HWC, on the hwc_mcycle_table of the platform
+    static MCycleModelManager& getInstance();
+
+    // the host test scores the models on the table of a recorded trace
+    explicit MCycleModelManager(const std::list<HwcMCycleInfo>& table);
+    ~MCycleModelManager();
+
+    void setModel(int model);
+
+    void setScoring(bool enable) { m_scoring.store(enable, std::memory_order_relaxed); }
+    bool isScoring() const { return m_scoring.load(std::memory_order_relaxed); }
+
+    HwcMCycleInfo predict(const MCycleFeature& feature) const;
+
+    // compare the prediction of every model with the cost that a thread, one
+    // of MCycleEstimator::THREAD_*, spent on a frame, and let the models learn it,
+    // nothing is done while scoring is off
+    void addSample(const MCycleFeature& feature, int thread, nsecs_t cpu_time, uint32_t cpu_mhz);
+
+    // the mean absolute error and the mean error of a model for a thread,
+    // returns the number of scored samples
+    uint64_t getScore(int model, int thread, double* mae, double* bias) const;
+
+    const char* getModelName(int model) const;
+
+    void dump(android::String8* dump_str) const;
+
+private:
+    struct Score
+    {
+        Score();
+
+        uint64_t samples[MCycleEstimator::THREAD_NUM];
+        double abs_error[MCycleEstimator::THREAD_NUM];   // sum of |predicted - measured|
+        double error[MCycleEstimator::THREAD_NUM];       // sum of predicted - measured
+    };
+
+private:
+    std::vector<MCycleModel*> m_models;
+    std::atomic<int> m_model;
+    std::atomic<bool> m_scoring;
+
+    mutable std::mutex m_lock;
+    std::vector<Score> m_scores;
+};
@@ -0,0 +1,206 @@
+#define DEBUG_LOG_TAG "MEMTRACK"
+
+#include "memory_tracker.h"
+
+#include <algorithm>
+
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+
+MemoryTracker& MemoryTracker::getInstance()
+{
+    static MemoryTracker gInstance;
+    return gInstance;
+}
+
+MemoryTracker::MemoryTracker()
+    : m_total(0)
+    , m_reserved(0)
+    , m_peak(0)
+    , m_soft_budget(0)
+    , m_hard_budget(0)
+    , m_trim_count(0)
+    , m_idle_trim_count(0)
+    , m_refuse_count(0)
+    , m_next_callback_id(0)
+{
+}
+
+void MemoryTracker::setBudget(size_t soft_budget, size_t hard_budget)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_soft_budget != soft_budget || m_hard_budget != hard_budget)
+    {
+        HWC_LOGI("%s: soft %zu -> %zu, hard %zu -> %zu", __func__,
+                 m_soft_budget, soft_budget, m_hard_budget, hard_budget);
+        m_soft_budget = soft_budget;
+        m_hard_budget = hard_budget;
+    }
+}
+
+void MemoryTracker::setTrimCallback(std::function<size_t(size_t)> callback)
+{
+    std::lock_guard<std::mutex> trim_lock(m_trim_lock);
+    m_trim_callback = callback;
+}
+
+int MemoryTracker::addIdleTrimCallback(std::function<void()> callback)
+{
+    std::lock_guard<std::mutex> trim_lock(m_trim_lock);
+    const int id = m_next_callback_id++;
+    m_idle_trim_callbacks[id] = callback;
+    return id;
+}
+
+void MemoryTracker::removeIdleTrimCallback(int id)
+{
+    std::lock_guard<std::mutex> trim_lock(m_trim_lock);
+    m_idle_trim_callbacks.erase(id);
+}
+
+bool MemoryTracker::reserve(size_t bytes)
+{
+    std::lock_guard<std::mutex> trim_lock(m_trim_lock);
+
+    size_t over = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        const size_t used = m_total + m_reserved + bytes;
+        if (m_soft_budget != 0 && used > m_soft_budget)
+        {
+            over = used - m_soft_budget;
+            m_trim_count++;
+        }
+    }
+
+    // the callbacks free buffers, which calls remove(), so m_lock is not held here.
+    // the idle queues give their buffers to the pool, which then frees the rest
+    if (over > 0 && m_trim_callback)
+    {
+        const size_t freed = m_trim_callback(over);
+        if (freed < over && !m_idle_trim_callbacks.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_idle_trim_count++;
+            }
+            for (auto& callback : m_idle_trim_callbacks)
+            {
+                callback.second();
+            }
+            m_trim_callback(over - freed);
+        }
+    }
+
+    // the check and the reservation are done under one lock, so two allocations
+    // cannot pass the hard budget together
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_hard_budget != 0 && m_total + m_reserved + bytes > m_hard_budget)
+    {
+        m_refuse_count++;
+        HWC_LOGE("%s: refuse %zu bytes, total %zu reserved %zu hard budget %zu", __func__,
+                 bytes, m_total, m_reserved, m_hard_budget);
+        return false;
+    }
+    m_reserved += bytes;
+    return true;
+}
+
+void MemoryTracker::commit(size_t reserved, uint64_t id, Owner owner, int disp_id, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_reserved -= std::min(m_reserved, reserved);
+
+    auto iter = m_records.find(id);
+    if (iter != m_records.end())
+    {
+        HWC_LOGW("%s: id %" PRIx64 " is added again", __func__, id);
+        m_total -= iter->second.bytes;
+    }
+    m_records[id] = {owner, disp_id, bytes};
+    m_total += bytes;
+    m_peak = std::max(m_peak, m_total);
+}
+
+void MemoryTracker::cancel(size_t reserved)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_reserved -= std::min(m_reserved, reserved);
+}
+
+void MemoryTracker::remove(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto iter = m_records.find(id);
+    if (iter == m_records.end())
+    {
+        return;
+    }
+    m_total -= iter->second.bytes;
+    m_records.erase(iter);
+}
+
+void MemoryTracker::setOwner(uint64_t id, Owner owner, int disp_id)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto iter = m_records.find(id);
+    if (iter != m_records.end())
+    {
+        iter->second.owner = owner;
+        iter->second.disp_id = disp_id;
+    }
+}
+
+const char* MemoryTracker::getOwnerName(Owner owner)
+{
+    switch (owner)
+    {
+        case OWNER_BUFFER_POOL:
+            return "buffer_pool";
+        case OWNER_BLT_QUEUE:
+            return "blt_queue";
+        case OWNER_OVL_QUEUE:
+            return "ovl_queue";
+        case OWNER_GLAI_QUEUE:
+            return "glai_queue";
+        case OWNER_AI_BLD_QUEUE:
+            return "ai_bld_queue";
+        case OWNER_FILL_BUFFER:
+            return "fill_buffer";
+        case OWNER_INDEX_BUFFER:
+            return "index_buffer";
+        case OWNER_DEBUG_LAYER:
+            return "debug_layer";
+        case OWNER_DRM_DUMB:
+            return "drm_dumb";
+        default:
+            return "unknown";
+    }
+}
+
+void MemoryTracker::dump(android::String8* dump_str) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    // the owners are split by display, the buffers without a display use -1
+    std::map<std::pair<int, int>, std::pair<size_t, size_t>> usage;
+    for (const auto& record : m_records)
+    {
+        auto& entry = usage[{record.second.owner, record.second.disp_id}];
+        entry.first++;
+        entry.second += record.second.bytes;
+    }
+
+    dump_str->appendFormat("HWC memory(vendor.debug.hwc.mem_soft_budget/mem_hard_budget): %zu KB"
+                           " reserved:%zu KB peak:%zu KB soft:%zu KB hard:%zu KB trim:%" PRIu64
+                           " idle_trim:%" PRIu64 " refuse:%" PRIu64 "\n",
+                           m_total / 1024, m_reserved / 1024, m_peak / 1024, m_soft_budget / 1024,
+                           m_hard_budget / 1024, m_trim_count, m_idle_trim_count, m_refuse_count);
+    for (const auto& entry : usage)
+    {
+        dump_str->appendFormat("  %-12s dpy:%2d count:%zu %zu KB\n",
+                               getOwnerName(static_cast<Owner>(entry.first.first)),
+                               entry.first.second, entry.second.first, entry.second.second / 1024);
+    }
+}
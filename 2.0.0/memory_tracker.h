@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+
+namespace android
+{
+class String8;
+}
+
+// MemoryTracker accounts the graphics memory which HWC allocates by itself, tagged by the
+// owner and the display, and keeps the total within a soft and a hard budget
+class MemoryTracker
+{
+public:
+    enum Owner
+    {
+        OWNER_UNKNOWN = 0,
+        OWNER_BUFFER_POOL,      // idle buffers of DisplayBufferPool
+        OWNER_BLT_QUEUE,
+        OWNER_OVL_QUEUE,
+        OWNER_GLAI_QUEUE,
+        OWNER_AI_BLD_QUEUE,
+        OWNER_FILL_BUFFER,      // BlackBuffer and WhiteBuffer
+        OWNER_INDEX_BUFFER,
+        OWNER_DEBUG_LAYER,
+        OWNER_DRM_DUMB,
+        OWNER_NUM,
+    };
+
+    // the id of a dumb buffer, so it does not collide with the gralloc handles
+    static uint64_t getDumbBufferId(uint32_t gem_handle) { return (1ULL << 63) | gem_handle; }
+
+    static MemoryTracker& getInstance();
+
+    // setBudget() sets the budgets in bytes, 0 means no limit. over the soft budget the
+    // idle buffers are trimmed, over the hard one reserve() refuses the allocation
+    void setBudget(size_t soft_budget, size_t hard_budget);
+
+    // setTrimCallback() sets the function which frees idle pool buffers of the given
+    // bytes and returns the bytes which it freed
+    void setTrimCallback(std::function<size_t(size_t)> callback);
+
+    // addIdleTrimCallback() adds a function which gives the buffers of an idle queue
+    // back, it runs when the pool alone cannot get under the soft budget. it must not
+    // block on a lock which an allocating thread may hold
+    int addIdleTrimCallback(std::function<void()> callback);
+
+    // removeIdleTrimCallback() returns after the callback has finished if it is running
+    void removeIdleTrimCallback(int id);
+
+    // reserve() is called before an allocation of the bytes, it returns false if the
+    // allocation would exceed the hard budget. otherwise the bytes count toward the
+    // budget until commit() or cancel()
+    bool reserve(size_t bytes);
+
+    // commit() replaces the reserved bytes with the record of the allocated buffer
+    void commit(size_t reserved, uint64_t id, Owner owner, int disp_id, size_t bytes);
+
+    // cancel() gives the reserved bytes back if the allocation failed
+    void cancel(size_t reserved);
+
+    void remove(uint64_t id);
+
+    // setOwner() moves a buffer to another owner, e.g. from a queue to the pool
+    void setOwner(uint64_t id, Owner owner, int disp_id);
+
+    void dump(android::String8* dump_str) const;
+
+private:
+    MemoryTracker();
+
+    static const char* getOwnerName(Owner owner);
+
+private:
+    struct Record
+    {
+        Owner owner;
+        int disp_id;
+        size_t bytes;
+    };
+
+    mutable std::mutex m_lock;
+    std::map<uint64_t, Record> m_records;
+    size_t m_total;
+    // the bytes of the allocations between reserve() and commit()
+    size_t m_reserved;
+    size_t m_peak;
+    size_t m_soft_budget;
+    size_t m_hard_budget;
+    uint64_t m_trim_count;
+    uint64_t m_idle_trim_count;
+    uint64_t m_refuse_count;
+
+    // m_trim_lock serializes the trims and guards the callbacks, it is taken before m_lock
+    std::mutex m_trim_lock;
+    std::function<size_t(size_t)> m_trim_callback;
+    std::map<int, std::function<void()>> m_idle_trim_callbacks;
+    int m_next_callback_id;
+};
@@ -18,6 +18,9 @@
 #include "sync.h"
 #include "platform_wrap.h"
 #include "index_buffer_generator.h"
+#include "hwc_recorder.h"
+#include "mc_estimator.h"
+#include "led_device.h"
 
 
 #define OLOGV(x, ...) HWC_LOGV("(%" PRIu64 ") " x, m_disp_id, ##__VA_ARGS__)
@@ -112,6 +115,12 @@ OverlayEngine::~OverlayEngine()
     m_frame_queue.clear();
     delete m_pool;
 
+    if (m_perf_pending_fence >= 0)
+    {
+        protectedClose(m_perf_pending_fence);
+        m_perf_pending_fence = -1;
+    }
+
     for (unsigned int id = 0; id < m_max_inputs; id++)
     {
         delete m_inputs[id];
@@ -349,16 +358,29 @@ status_t OverlayEngine::createOutputQueueLocked(unsigned int format, bool secure
         // allocate buffers
         const size_t buffer_slots = DisplayBufferQueue::NUM_BUFFER_SLOTS;
         DisplayBufferQueue::DisplayBuffer mir_buffer[buffer_slots];
-        for (size_t i = 0; i < buffer_slots; i++)
+        size_t dequeued = 0;
+        status_t err = NO_ERROR;
+        for (; dequeued < buffer_slots; dequeued++)
         {
-            m_output.queue->dequeueBuffer(&mir_buffer[i], false, secure);
+            err = m_output.queue->dequeueBuffer(&mir_buffer[dequeued], false, secure);
+            if (NO_ERROR != err)
+            {
+                OLOGE("Failed to allocate output buffer %zu: %d", dequeued, err);
+                break;
+            }
         }
 
-        for (size_t i = 0; i < buffer_slots; i++)
+        // only cancel the dequeued slots, the index of the others is invalid
+        for (size_t i = 0; i < dequeued; i++)
         {
             m_output.queue->cancelBuffer(mir_buffer[i].index);
         }
 
+        if (NO_ERROR != err)
+        {
+            return err;
+        }
+
         OLOGD("Initialize buffers for output queue");
     }
 
@@ -528,6 +550,7 @@ void OverlayEngine::trigger(const unsigned int& present_fence_idx,
 
 status_t OverlayEngine::loopHandler(sp<FrameInfo>& info)
 {
+    HwcRecordScope record_scope(HWC_RECORD_STAGE, HWC_RECORD_STAGE_OVL_COMMIT, m_disp_id);
     if (m_disp_id == HWC_DISPLAY_VIRTUAL)
     {
         if (info->overlay_info.enable_output == false)
@@ -726,6 +749,7 @@ void OverlayEngine::dump(String8* dump_str)
     }
 
     dump_str->appendFormat("  Total size: %d bytes\n", total_size);
+    m_uclamp_ctrl.dump(dump_str, "ovl");
 }
 
 bool OverlayEngine::threadLoop()
@@ -770,6 +794,18 @@ bool OverlayEngine::threadLoop()
 
     const nsecs_t config_period = DisplayManager::getInstance().getDisplayData(m_disp_id, frame_info->active_config)->refresh;
 
+    MCycleEstimator& estimator = MCycleEstimator::getInstance();
+    MCycleModelManager& mc_models = MCycleModelManager::getInstance();
+    const bool learn_mc = estimator.isLearning() && frame_info->mc_id >= 0;
+    // the models are scored on the device or offline from the recorded samples
+    const bool score_mc = (mc_models.isScoring() || HwcCallRecorder::getInstance().isEnabled()) &&
+                          frame_info->mc_id >= 0;
+    const bool measure_mc = learn_mc || score_mc;
+    const nsecs_t mc_cpu_start = measure_mc ? systemTime(SYSTEM_TIME_THREAD) : 0;
+    const uint32_t mc_mhz_start = measure_mc ? estimator.getCurCpuMHz() : 0;
+
+    const nsecs_t frame_start_ts = systemTime();
+    m_perf_deadline_ts = 0;
     calculatePerf(frame_info, config_period, tid, false);
     // change the cpu set after set the uclamp. it can avoid that use little core with
     // high frequence.
@@ -889,6 +925,49 @@ bool OverlayEngine::threadLoop()
     loopHandler(frame_info);
     releasePresentIndexBuffer(frame_info);
 
+    // the commit of this frame has waited for the commit fence of the previous one
+    feedPendingFrameDone();
+
+    // a frame committed without blocking is applied when its commit fence signals,
+    // the hooks which need the frame on the panel follow that fence
+    const int commit_fence = HWCMediator::getInstance().getOvlDevice(m_disp_id)->dupCommitFence(m_disp_id);
+
+    // the staged brightness goes with the frame which has just been committed
+    LedDevice::getInstance().onFrameCommitted(m_disp_id, commit_fence);
+
+    if (m_perf_deadline_ts > 0 && commit_fence < 0)
+    {
+        m_uclamp_ctrl.onFrameDone(systemTime() - frame_start_ts, m_perf_deadline_ts - frame_start_ts);
+    }
+    else if (m_perf_deadline_ts > 0)
+    {
+        m_perf_pending_fence = commit_fence;
+        m_perf_pending_start_ts = frame_start_ts;
+        m_perf_pending_target_time = m_perf_deadline_ts - frame_start_ts;
+    }
+    else if (commit_fence >= 0)
+    {
+        protectedClose(commit_fence);
+    }
+
+    // the cpu time of this thread, it does not include the wait for a commit in either mode
+    if (measure_mc)
+    {
+        const uint32_t mc_mhz_end = estimator.getCurCpuMHz();
+        const nsecs_t mc_cpu_time = systemTime(SYSTEM_TIME_THREAD) - mc_cpu_start;
+        const uint32_t mc_cpu_mhz = (mc_mhz_start + mc_mhz_end) / 2;
+        if (learn_mc)
+        {
+            estimator.addSample(frame_info->mc_id, MCycleEstimator::THREAD_OVL, mc_cpu_time, mc_cpu_mhz);
+        }
+        if (score_mc)
+        {
+            HwcCallRecorder::getInstance().recordMCycleSample(m_disp_id, frame_info->mc_feature,
+                    MCycleEstimator::THREAD_OVL, mc_cpu_time, mc_cpu_mhz);
+            mc_models.addSample(frame_info->mc_feature, MCycleEstimator::THREAD_OVL, mc_cpu_time, mc_cpu_mhz);
+        }
+    }
+
     checkPresentAfterTs(frame_info, config_period);
 
     if (HWCMediator::getInstance().getOvlDevice(m_disp_id)->isFenceWaitSupported())
@@ -1215,6 +1294,8 @@ void OverlayEngine::packageFrameInfo(sp<FrameInfo>& info, const unsigned int& pr
     info->ovl_mc = m_handling_job->ovl_mc;
     info->ovl_mc_atomic_ratio = m_handling_job->ovl_mc_atomic_ratio;
     info->ovl_wo_atomic_work_time = m_handling_job->ovl_wo_atomic_work_time;
+    info->mc_id = m_handling_job->mc_info ? m_handling_job->mc_info->id : -1;
+    info->mc_feature = m_handling_job->mc_feature;
     info->cpu_set = m_handling_job->cpu_set;
     info->drm_id_crtc = m_handling_job->drm_id_cur_crtc;
     info->mm_ion_fd = -1;
@@ -1391,6 +1472,27 @@ void OverlayEngine::waitPresentAfterTs(sp<FrameInfo>& info)
     }
 }
 
+void OverlayEngine::feedPendingFrameDone()
+{
+    if (m_perf_pending_fence < 0)
+    {
+        return;
+    }
+
+    // the fence is still pending only if the wait for it has timed out, count the frame done now
+    const uint64_t signal_ts = SyncFence::getSignalTime(m_perf_pending_fence);
+    nsecs_t done_ts = static_cast<nsecs_t>(signal_ts);
+    if (signal_ts == static_cast<uint64_t>(SIGNAL_TIME_PENDING) ||
+        signal_ts == static_cast<uint64_t>(SIGNAL_TIME_INVALID))
+    {
+        done_ts = systemTime();
+    }
+    protectedClose(m_perf_pending_fence);
+    m_perf_pending_fence = -1;
+
+    m_uclamp_ctrl.onFrameDone(done_ts - m_perf_pending_start_ts, m_perf_pending_target_time);
+}
+
 void OverlayEngine::checkPresentAfterTs(sp<FrameInfo>& info, nsecs_t period)
 {
     if (info->present_after_ts <= 0 || m_disp_id == HWC_DISPLAY_VIRTUAL)
@@ -1467,27 +1569,17 @@ void OverlayEngine::calculatePerf(sp<FrameInfo>& info, nsecs_t period, pid_t tid
         HWC_ATRACE_INT(m_perf_target_cpu_mhz_str.c_str(), static_cast<int32_t>(target_cpu_mhz));
     }
 
-    // set uclamp for overlay
-    if (ovl_uclamp != m_prev_uclamp_min)
+    // the feedback covers the whole frame, up to the deadline of the atomic commit
+    if (is_atomic)
     {
-        bool apply_uclamp = true;
-        if (!is_atomic)
-        {
-            // non atomic part is small, we want to avoid keep setting uclamp_task, if only small changes
-            if (ovl_uclamp < m_prev_uclamp_min &&
-                m_prev_uclamp_min - ovl_uclamp < 25)
-            {
-                apply_uclamp = false;
-            }
-        }
-
-        if (apply_uclamp)
-        {
-            m_prev_uclamp_min = ovl_uclamp;
+        m_perf_deadline_ts = cur_time + remain_time;
+    }
 
-            uclamp_task(tid, ovl_uclamp);
-            HWC_ATRACE_INT(m_perf_uclamp_str.c_str(), static_cast<int32_t>(ovl_uclamp));
-        }
+    // set uclamp for overlay, the controller holds the bucket for small drops
+    // of the non atomic part, so uclamp_task is not called twice per frame
+    if (m_uclamp_ctrl.apply(tid, ovl_uclamp))
+    {
+        HWC_ATRACE_INT(m_perf_uclamp_str.c_str(), static_cast<int32_t>(m_uclamp_ctrl.getUClamp()));
     }
 }
 
@@ -1626,6 +1718,8 @@ void FrameInfo::initData()
     ovl_mc = FLT_MAX;
     ovl_mc_atomic_ratio = 1.f;
     ovl_wo_atomic_work_time = -1;
+    mc_id = -1;
+    mc_feature = MCycleFeature();
     cpu_set = HWC_CPUSET_NONE;
     drm_id_crtc = UINT32_MAX;
 }
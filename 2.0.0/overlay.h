@@ -12,6 +12,8 @@
 #include "hwc_ui/Rect.h"
 #include "hwc2_defs.h"
 #include "vsync_listener.h"
+#include "uclamp_controller.h"
+#include "mc_model.h"
 #include "worker.h"
 #include "mtk-mml.h"
 
@@ -364,6 +366,8 @@ public:
     float ovl_mc;
     float ovl_mc_atomic_ratio;
     nsecs_t ovl_wo_atomic_work_time;
+    int mc_id; // HwcMCycleInfo id of this frame, -1 if unknown
+    MCycleFeature mc_feature;
     unsigned int cpu_set;
     uint32_t drm_id_crtc;
     int mm_ion_fd;
@@ -571,6 +575,9 @@ private:
     // release the present index layer
     void releasePresentIndexBuffer(sp<FrameInfo>& info);
 
+    // feedPendingFrameDone() feeds m_uclamp_ctrl with the frame whose commit fence was kept
+    void feedPendingFrameDone();
+
     // m_condition is used to wait (block) for a certain condition to become true
     mutable Condition m_cond;
 
@@ -638,7 +645,16 @@ private:
     std::string m_trace_decoulpe_delay_name;
     std::string m_trace_decoulpe_delay_ns_name;
 
-    uint32_t m_prev_uclamp_min = UINT32_MAX;
+    // feedback on the uclamp computed by calculatePerf()
+    UClampController m_uclamp_ctrl;
+
+    // deadline of the frame handled now, 0 if calculatePerf() skipped it
+    nsecs_t m_perf_deadline_ts = 0;
+    // a frame committed without blocking is done when its commit fence signals, the next
+    // frame waits for the fence before it commits and then feeds it to m_uclamp_ctrl
+    int m_perf_pending_fence = -1;
+    nsecs_t m_perf_pending_start_ts = 0;
+    nsecs_t m_perf_pending_target_time = 0;
     std::string m_perf_remain_time_str;
     std::string m_perf_target_cpu_mhz_str;
     std::string m_perf_uclamp_str;
@@ -952,6 +952,11 @@ PlatformCommon::PlatformConfig::PlatformConfig()
     , is_ovl_support_odd_size(true)
     , force_mdp_output_format(0)
     , check_skip_client_color_transform(true)
+    , skip_noop_commit(true)
+    , cursor_fast_path(true)
+    , commit_aggregate_mask(0)
+    , commit_aggregate_timeout(2 * 1000 * 1000)
+    , nonblock_commit(false)
     , plat_switch(0)
     , dbg_switch(0)
     , mml_switch(true)
@@ -962,6 +967,7 @@ PlatformCommon::PlatformConfig::PlatformConfig()
     , perf_reserve_time_for_wait_fence(us2ns(100))
     , is_bw_monitor_support(false)
     , is_smart_composition_support(false)
+    , is_inactive_set_support(false)
     , inactive_set_expired_cnt(1000)
     , inactive_set_expired_duration(s2ns(2))
     , bwm_skip_hrt_calc(false)
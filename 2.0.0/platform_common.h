@@ -312,6 +312,24 @@ public:
         // color transform or not.
         bool check_skip_client_color_transform;
 
+        // If true, a frame in which nothing changed is not committed when the display
+        // supports self-refresh, the pending present fence of the last commit is returned for it
+        bool skip_noop_commit;
+
+        // If true, a cursor layer on its own plane is returned as CURSOR and the position set by
+        // setCursorPosition() is committed by a small worker, without a whole composition
+        bool cursor_fast_path;
+
+        // the displays in the mask share a vsync source, their frame commits are merged into
+        // one atomic commit, a display which waits for the others longer than
+        // commit_aggregate_timeout commits alone
+        uint32_t commit_aggregate_mask;
+        nsecs_t commit_aggregate_timeout;
+
+        // If true, the frame commit does not block OverlayEngine, the next frame is prepared
+        // while the commit is in flight and waits for its CRTC out-fence before it is committed
+        bool nonblock_commit;
+
         // store multiple swtich option
         unsigned int plat_switch;
 
@@ -343,6 +361,8 @@ public:
         // this is for SmartComposition feature option
         bool is_smart_composition_support;
 
+        // move a stable inactive layerset to the client target, it needs smart composition
+        bool is_inactive_set_support;
         int inactive_set_expired_cnt;
         nsecs_t inactive_set_expired_duration;
         bool bwm_skip_hrt_calc;
@@ -20,7 +20,9 @@
 #include <aidlcommonsupport/NativeHandle.h>
 #endif
 
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#if defined(MTK_HWC_USE_STUB_DEVICE)
+#include "tools/host/stub_pq_device.h"
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
 #include "legacy/pqdev_legacy.h"
 #else
 #include "drm/drmpq.h"
@@ -42,20 +44,81 @@ static bool getPqServiceName(std::string& pq_service_name)
         return true;
     }
 }
+
+// a failed color transform is sent again before the display falls back to identity
+#define PQ_COLOR_TRANSFORM_RETRY_MAX 2
 #endif
 
+static const char* getPqCommandName(int type)
+{
+    static const char* names[] = {"color_transform", "game_pq", "aibld_buffer", "pq_mode"};
+    if (type < 0 || static_cast<size_t>(type) >= sizeof(names) / sizeof(names[0]))
+    {
+        return "unknown";
+    }
+    return names[type];
+}
+
 IPqDevice::IPqDevice()
     : m_pq_fd(-1)
     , m_use_ioctl(false)
+#ifdef USES_PQSERVICE
+    , m_service_notification(nullptr)
+#endif
 {
 #ifdef USES_PQSERVICE
-    Mutex::Autolock lock(m_lock);
-    m_pq_service = getPqServiceLocked(true, 0);
+    m_sender_thread = std::thread(&IPqDevice::senderLoop, this);
+    if (pthread_setname_np(m_sender_thread.native_handle(), "PqSender"))
+    {
+        HWC_LOGI("pthread_setname_np PqSender fail");
+    }
+
+    // the callback is also called at once if the service is already registered
+    std::string pq_service_name;
+    if (HwcFeatureList::getInstance().getFeature().is_support_pq > 0 &&
+        getPqServiceName(pq_service_name))
+    {
+        m_service_notification = AServiceManager_registerForNotifications(
+                pq_service_name.c_str(), onServiceRegistered, this);
+        if (m_service_notification == nullptr)
+        {
+            HWC_LOGE("%s: failed to register for %s", __func__, pq_service_name.c_str());
+        }
+    }
 #endif
 }
 
 IPqDevice::~IPqDevice()
 {
+#ifdef USES_PQSERVICE
+    if (m_service_notification != nullptr)
+    {
+        AServiceManager_NotificationRegistration_delete(m_service_notification);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_cmd_mutex);
+        m_sender_stop = true;
+        m_cmd_cond.notify_all();
+    }
+    if (m_sender_thread.joinable())
+    {
+        m_sender_thread.join();
+    }
+
+    for (auto& cmd : m_aibld_cmds)
+    {
+        if (cmd.aibld_done)
+        {
+            cmd.aibld_done();
+        }
+    }
+    if (m_last_game_pq_fd >= 0)
+    {
+        protectedClose(m_last_game_pq_fd);
+    }
+#endif
+
     if (m_pq_fd != -1)
     {
         protectedClose(m_pq_fd);
@@ -84,6 +147,21 @@ bool IPqDevice::isColorTransformIoctl()
     return m_use_ioctl;
 }
 
+bool IPqDevice::isColorTransformFailed()
+{
+#ifdef USES_PQSERVICE
+    if (isColorTransformIoctl())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_cmd_mutex);
+    return m_color_transform_seq != 0 && m_color_transform_failed_seq == m_color_transform_seq;
+#else
+    return false;
+#endif
+}
+
 void IPqDevice::useColorTransformIoctl(int32_t useIoctl)
 {
     Mutex::Autolock lock(m_lock);
@@ -93,30 +171,25 @@ void IPqDevice::useColorTransformIoctl(int32_t useIoctl)
 void IPqDevice::setGamePQHandle(const buffer_handle_t& handle)
 {
 #ifdef USES_PQSERVICE
-    Mutex::Autolock lock(m_lock);
+    std::lock_guard<std::mutex> lock(m_cmd_mutex);
 
-    std::shared_ptr<IPictureQuality_AIDL> pq_service = getPqServiceLocked();
-    if (pq_service == nullptr)
+    if (m_last_game_pq_fd >= 0)
     {
-        HWC_LOGE("%s: cannot find PQ service!", __func__);
-        return;
+        protectedClose(m_last_game_pq_fd);
+        m_last_game_pq_fd = -1;
     }
-    else
+
+    if (handle == nullptr)
     {
-        if (handle == nullptr)
-        {
-            HWC_LOGW("%s: handle is null", __func__);
-            return;
-        }
-        ATRACE_NAME("call gamePQHandle impl");
-        Result result = Result::NOT_SUPPORTED;
-        ndk::ScopedFileDescriptor fd = ndk::ScopedFileDescriptor(dup(handle->data[0]));
-        ScopedAStatus status = pq_service->setGamePQHandle(fd, &result);
-        if (!status.isOk() || result != Result::OK)
-        {
-            HWC_LOGW("%s: fail, res %d, status: %d", __func__, result, status.getStatus());
-        }
+        HWC_LOGW("%s: handle is null", __func__);
+        return;
     }
+
+    m_last_game_pq_fd = dup(handle->data[0]);
+
+    PqCommand cmd;
+    cmd.game_pq_fd = ndk::ScopedFileDescriptor(dup(m_last_game_pq_fd));
+    queueCommandLocked(PQ_CMD_GAME_PQ, cmd);
 #else
     (void) handle;
 #endif
@@ -140,59 +213,38 @@ int IPqDevice::setDisplayPqMode(const uint64_t disp_id, const uint32_t disp_uniq
 
 #ifdef USES_PQSERVICE
 
-std::shared_ptr<IPictureQuality_AIDL> IPqDevice::getPqServiceLocked(bool timeout_break, int retry_limit)
+std::shared_ptr<IPictureQuality_AIDL> IPqDevice::getPqService()
 {
-    if (HwcFeatureList::getInstance().getFeature().is_support_pq <= 0)
-    {
-        return nullptr;
-    }
+    Mutex::Autolock lock(m_lock);
+    return m_pq_service;
+}
+
+void IPqDevice::onServiceRegistered(const char* instance, AIBinder* binder, void* cookie)
+{
+    HWC_LOGI("%s: %s", __func__, instance);
 
-    if (m_pq_service)
+    if (cookie == nullptr || binder == nullptr)
     {
-        return m_pq_service;
+        return;
     }
 
-    int retryCount = 0;
-    std::string pq_service_name;
+    // SpAIBinder takes over a strong reference, but the registered binder is borrowed
+    AIBinder_incStrong(binder);
+    std::shared_ptr<IPictureQuality_AIDL> service = IPictureQuality_AIDL::fromBinder(::ndk::SpAIBinder(binder));
+    static_cast<IPqDevice*>(cookie)->connectPqService(service);
+}
 
-    if (getPqServiceName(pq_service_name))
-    {
-        m_pq_service = IPictureQuality_AIDL::fromBinder(::ndk::SpAIBinder(
-                           AServiceManager_checkService(pq_service_name.c_str())));
-    }
-    else
+void IPqDevice::connectPqService(const std::shared_ptr<IPictureQuality_AIDL>& service)
+{
+    if (service == nullptr)
     {
-        HWC_LOGI("%s(), PQ service is not ready", __FUNCTION__);
-        m_pq_service = nullptr;
+        return;
     }
 
-    while (m_pq_service == nullptr)
     {
-        if (retryCount >= retry_limit)
-        {
-            HWC_LOGE("Can't get PQ service tried (%d) times", retryCount);
-            if (timeout_break)
-            {
-                break;
-            }
-        }
-        usleep(100000); //sleep 100 ms to wait for next get service
-
-        if (getPqServiceName(pq_service_name))
-        {
-            m_pq_service = IPictureQuality_AIDL::fromBinder(::ndk::SpAIBinder(
-                               AServiceManager_checkService(pq_service_name.c_str())));
-        }
-        else
-        {
-            HWC_LOGI("%s(), PQ service is not ready, retryCount %d", __FUNCTION__, retryCount);
-            m_pq_service = nullptr;
-        }
-        retryCount++;
-    }
+        Mutex::Autolock lock(m_lock);
+        m_pq_service = service;
 
-    if (m_pq_service)
-    {
         m_aibld_callback = ndk::SharedRefBase::make<AiBldCallback>();
         ScopedAStatus status = m_pq_service->registerAIBldCb(m_aibld_callback);
         if (!status.isOk())
@@ -204,100 +256,347 @@ std::shared_ptr<IPictureQuality_AIDL> IPqDevice::getPqServiceLocked(bool timeout
         m_hal_death_recipint->linkToDeath(m_pq_service->asBinder().get());
     }
 
-    return m_pq_service;
+    std::lock_guard<std::mutex> lock(m_cmd_mutex);
+    m_service_connected = true;
+    m_service_connect_count++;
+    if (m_service_connect_count > 1)
+    {
+        replayLocked();
+    }
+    m_cmd_cond.notify_all();
 }
 
-bool IPqDevice::setColorTransformViaService(const float* matrix, const int32_t& hint)
+void IPqDevice::queueCommandLocked(int type, PqCommand& cmd)
 {
-    Mutex::Autolock lock(m_lock);
+    PqCommandStat& stat = m_cmd_stats[type];
+    stat.queued++;
 
-    bool res = false;
+    if (type == PQ_CMD_AIBLD_BUFFER)
+    {
+        m_aibld_cmds.push_back(std::move(cmd));
+        m_aibld_cmds.back().pending = true;
+        m_aibld_cmds.back().queue_ts = systemTime();
+        m_cmd_pending_num++;
+        m_cmd_pending_max = std::max(m_cmd_pending_max, m_cmd_pending_num);
+        m_cmd_cond.notify_all();
+        return;
+    }
 
-    std::shared_ptr<IPictureQuality_AIDL> pq_service = getPqServiceLocked();
-    if (pq_service == nullptr)
+    PqCommand& pending = m_cmds[type];
+    if (pending.pending)
     {
-        HWC_LOGE("%s: cannot find PQ service!", __func__);
-        res = false;
+        // latest wins, the replaced command is never sent
+        stat.coalesced++;
+    }
+    else
+    {
+        m_cmd_pending_num++;
+        m_cmd_pending_max = std::max(m_cmd_pending_max, m_cmd_pending_num);
+    }
+
+    pending = std::move(cmd);
+    pending.pending = true;
+    pending.queue_ts = systemTime();
+
+    m_cmd_cond.notify_all();
+}
+
+void IPqDevice::takeCommandLocked(int type, PqCommand& cmd)
+{
+    if (type == PQ_CMD_AIBLD_BUFFER)
+    {
+        cmd = std::move(m_aibld_cmds.front());
+        m_aibld_cmds.pop_front();
     }
     else
     {
-        const unsigned int dimension = 4;
-        std::array<std::array<float, 4>, 4> send_matrix;
-        for (unsigned int i = 0; i < dimension; ++i)
+        cmd = std::move(m_cmds[type]);
+        m_cmds[type] = PqCommand();
+    }
+    m_cmd_pending_num--;
+
+    const nsecs_t wait = systemTime() - cmd.queue_ts;
+    m_cmd_stats[type].max_wait = std::max(m_cmd_stats[type].max_wait, wait);
+}
+
+void IPqDevice::replayLocked()
+{
+    HWC_LOGI("%s: color_transform:%d game_pq:%d pq_mode:%zu", __func__,
+             m_last_color_transform_valid, m_last_game_pq_fd >= 0, m_last_pq_mode.size());
+
+    // a newer pending command is sent anyway, so only fill the empty slots
+    if (m_last_color_transform_valid && !m_cmds[PQ_CMD_COLOR_TRANSFORM].pending)
+    {
+        PqCommand cmd;
+        cmd.matrix = m_last_matrix;
+        cmd.hint = m_last_hint;
+        cmd.seq = ++m_color_transform_seq;
+        queueCommandLocked(PQ_CMD_COLOR_TRANSFORM, cmd);
+    }
+
+    if (m_last_game_pq_fd >= 0 && !m_cmds[PQ_CMD_GAME_PQ].pending)
+    {
+        PqCommand cmd;
+        cmd.game_pq_fd = ndk::ScopedFileDescriptor(dup(m_last_game_pq_fd));
+        queueCommandLocked(PQ_CMD_GAME_PQ, cmd);
+    }
+
+    m_replay_pq_mode = !m_last_pq_mode.empty();
+}
+
+void IPqDevice::senderLoop()
+{
+    std::unique_lock<std::mutex> lock(m_cmd_mutex);
+    while (true)
+    {
+        m_cmd_cond.wait(lock, [this]
         {
-            DbgLogger logger(DbgLogger::TYPE_HWC_LOG, 'D', "matrix ");
-            for (unsigned int j = 0; j < dimension; ++j)
-            {
-                send_matrix[i][j] = matrix[i * dimension + j];
-                logger.printf("%f,", send_matrix[i][j]);
-            }
+            return m_sender_stop ||
+                   (m_service_connected && (m_cmd_pending_num > 0 || m_replay_pq_mode));
+        });
+        if (m_sender_stop)
+        {
+            break;
         }
-        Result result = Result::INVALID_STATE;
-        ScopedAStatus status = pq_service->setColorTransform(send_matrix, hint, 1, &result);
-        if (!status.isOk() || result != Result::OK)
+
+        for (int type = 0; type < PQ_CMD_QUEUE_NUM; type++)
         {
-            HWC_LOGW("%s: fail, result: %d, status: %d", __func__, result, status.getStatus());
-            res = false;
+            while (type == PQ_CMD_AIBLD_BUFFER ? !m_aibld_cmds.empty() : m_cmds[type].pending)
+            {
+                PqCommand cmd;
+                takeCommandLocked(type, cmd);
+
+                lock.unlock();
+                sendCommand(type, cmd);
+                lock.lock();
+
+                if (type != PQ_CMD_AIBLD_BUFFER)
+                {
+                    break;
+                }
+            }
         }
-        else
+
+        if (m_replay_pq_mode)
         {
-            res = true;
+            m_replay_pq_mode = false;
+            auto pq_modes = m_last_pq_mode;
+
+            lock.unlock();
+            std::shared_ptr<IPictureQuality_AIDL> service = getPqService();
+            for (auto& it : pq_modes)
+            {
+                int pq_fence_fd = -1;
+                sendPqMode(service, it.first, it.second.first, it.second.second, -1, &pq_fence_fd);
+                if (pq_fence_fd >= 0)
+                {
+                    protectedClose(pq_fence_fd);
+                }
+            }
+            lock.lock();
         }
     }
-
-    return res;
 }
 
-int IPqDevice::setDisplayPqModeViaService(const uint64_t disp_id, const uint32_t disp_unique_id,
-        const int32_t pq_mode_id, const int prev_present_fence)
+void IPqDevice::sendCommand(int type, PqCommand& cmd)
 {
-    Mutex::Autolock lock(m_lock);
-
-    int pq_fence_fd = -1;
-
-    std::shared_ptr<IPictureQuality_AIDL> pq_service = getPqServiceLocked();
-    if (pq_service == nullptr)
+    std::shared_ptr<IPictureQuality_AIDL> service = getPqService();
+    if (service == nullptr)
     {
-        HWC_LOGE("%s: cannot find PQ service!", __func__);
+        // the last state is replayed when the service comes back
+        HWC_LOGW("%s: drop %s, PQ service is gone", __func__, getPqCommandName(type));
+        dropCommand(type, cmd);
+        return;
     }
-    else
+
+    Result result = Result::INVALID_STATE;
+    ScopedAStatus status = ScopedAStatus::ok();
+    const nsecs_t start = systemTime();
+    switch (type)
     {
-        if (disp_unique_id == 0)
+        case PQ_CMD_COLOR_TRANSFORM:
         {
-            HWC_LOGW("%s: set pq mode with a dubious unique id[%u]", __func__, disp_unique_id);
+            ATRACE_NAME("call pq setColorTransform");
+            status = service->setColorTransform(cmd.matrix, cmd.hint, 1, &result);
+            break;
         }
-        uint64_t di = disp_id;
-        int32_t pmi = pq_mode_id;
 
-        ndk::ScopedFileDescriptor tmpHandle;
-        if (prev_present_fence >= 0)
+        case PQ_CMD_GAME_PQ:
         {
-            tmpHandle = ndk::ScopedFileDescriptor(dup(prev_present_fence));
+            ATRACE_NAME("call gamePQHandle impl");
+            result = Result::NOT_SUPPORTED;
+            status = service->setGamePQHandle(cmd.game_pq_fd, &result);
+            break;
         }
 
-        parcelable_setColorModeWithFence _aidl_return;
+        case PQ_CMD_AIBLD_BUFFER:
+        {
+            ATRACE_NAME("call pq setAIBldBuffer");
+            status = service->setAIBldBuffer(cmd.aibld_handle, cmd.pf_fence_idx, &result);
+            break;
+        }
 
-        ScopedAStatus status = pq_service->setColorModeWithFence(pmi, tmpHandle,
-                    static_cast<int32_t>(di), static_cast<int32_t>(disp_unique_id), &_aidl_return);
-        if (!status.isOk())
+        default:
+            return;
+    }
+    const nsecs_t latency = systemTime() - start;
+
+    // PQ has read the buffer in the call, so the caller can reuse it now
+    if (cmd.aibld_done)
+    {
+        cmd.aibld_done();
+    }
+
+    const bool ok = status.isOk() && result == Result::OK;
+    if (!ok)
+    {
+        HWC_LOGW("%s: %s fail, result: %d, status: %d", __func__, getPqCommandName(type),
+                 result, status.getStatus());
+    }
+
+    std::lock_guard<std::mutex> lock(m_cmd_mutex);
+    addCommandStatLocked(type, ok, latency);
+    if (type == PQ_CMD_COLOR_TRANSFORM && !ok)
+    {
+        if (!m_cmds[PQ_CMD_COLOR_TRANSFORM].pending && cmd.retry < PQ_COLOR_TRANSFORM_RETRY_MAX)
         {
-            HWC_LOGW("%s: fail, status: %d", __func__, status.getStatus());
+            // nothing newer has been set, so send it again
+            cmd.retry++;
+            queueCommandLocked(PQ_CMD_COLOR_TRANSFORM, cmd);
         }
-        if (_aidl_return.retval == Result::OK)
+        else if (m_color_transform_seq == cmd.seq)
         {
-            // the release (ParcelFileDescriptor) is to change ownership (move)
-            // unique_fd's move operator will call its release()
-            // so it won't be close when exit scoped
-            // therefore, there is no need to dup it
-            pq_fence_fd = _aidl_return.pqFenceHdl.release();
-            HWC_LOGD("%s: success, pq_fence_fd: %d", __func__, pq_fence_fd);
+            // give up, the display applies the identity matrix on its next frame,
+            // so do not replay this one either
+            m_color_transform_failed_seq = cmd.seq;
+            m_last_color_transform_valid = false;
         }
-        else
+    }
+}
+
+void IPqDevice::dropCommand(int type, PqCommand& cmd)
+{
+    // the last color transform and game pq are replayed at reconnection
+    if (cmd.aibld_done)
+    {
+        cmd.aibld_done();
+    }
+}
+
+void IPqDevice::addCommandStatLocked(int type, bool ok, nsecs_t latency)
+{
+    PqCommandStat& stat = m_cmd_stats[type];
+    stat.sent++;
+    stat.failed += ok ? 0 : 1;
+    stat.last = latency;
+    stat.max = std::max(stat.max, latency);
+    stat.total += latency;
+}
+
+bool IPqDevice::setColorTransformViaService(const float* matrix, const int32_t& hint)
+{
+    std::lock_guard<std::mutex> lock(m_cmd_mutex);
+
+    if (!m_service_connected)
+    {
+        // the caller falls back to the identity matrix, so there is nothing to replay
+        HWC_LOGE("%s: cannot find PQ service!", __func__);
+        m_last_color_transform_valid = false;
+        return false;
+    }
+
+    const unsigned int dimension = 4;
+    PqCommand cmd;
+    for (unsigned int i = 0; i < dimension; ++i)
+    {
+        DbgLogger logger(DbgLogger::TYPE_HWC_LOG, 'D', "matrix ");
+        for (unsigned int j = 0; j < dimension; ++j)
         {
-            HWC_LOGI("%s: result: %d, pq_fence_fd: %d", __func__, _aidl_return.retval, pq_fence_fd);
+            cmd.matrix[i][j] = matrix[i * dimension + j];
+            logger.printf("%f,", cmd.matrix[i][j]);
         }
     }
+    cmd.hint = hint;
+
+    m_last_color_transform_valid = true;
+    m_last_matrix = cmd.matrix;
+    m_last_hint = hint;
 
+    // do not wait for the binder call, the sender retries a failed call and
+    // isColorTransformFailed() tells the display when it has given up
+    cmd.seq = ++m_color_transform_seq;
+    queueCommandLocked(PQ_CMD_COLOR_TRANSFORM, cmd);
+    return true;
+}
+
+void IPqDevice::sendPqMode(const std::shared_ptr<IPictureQuality_AIDL>& service, uint64_t disp_id,
+        uint32_t disp_unique_id, int32_t pq_mode_id, int prev_present_fence, int* pq_fence_fd)
+{
+    if (service == nullptr)
+    {
+        return;
+    }
+
+    ndk::ScopedFileDescriptor tmpHandle;
+    if (prev_present_fence >= 0)
+    {
+        tmpHandle = ndk::ScopedFileDescriptor(dup(prev_present_fence));
+    }
+
+    parcelable_setColorModeWithFence _aidl_return;
+
+    const nsecs_t start = systemTime();
+    ScopedAStatus status = service->setColorModeWithFence(pq_mode_id, tmpHandle,
+                static_cast<int32_t>(disp_id), static_cast<int32_t>(disp_unique_id), &_aidl_return);
+    const nsecs_t latency = systemTime() - start;
+    if (!status.isOk())
+    {
+        HWC_LOGW("%s: fail, status: %d", __func__, status.getStatus());
+    }
+    if (_aidl_return.retval == Result::OK)
+    {
+        // the release (ParcelFileDescriptor) is to change ownership (move)
+        // unique_fd's move operator will call its release()
+        // so it won't be close when exit scoped
+        // therefore, there is no need to dup it
+        *pq_fence_fd = _aidl_return.pqFenceHdl.release();
+        HWC_LOGD("%s: success, pq_fence_fd: %d", __func__, *pq_fence_fd);
+    }
+    else
+    {
+        HWC_LOGI("%s: result: %d, pq_fence_fd: %d", __func__, _aidl_return.retval, *pq_fence_fd);
+    }
+
+    std::lock_guard<std::mutex> lock(m_cmd_mutex);
+    addCommandStatLocked(PQ_CMD_PQ_MODE, status.isOk() && _aidl_return.retval == Result::OK, latency);
+}
+
+int IPqDevice::setDisplayPqModeViaService(const uint64_t disp_id, const uint32_t disp_unique_id,
+        const int32_t pq_mode_id, const int prev_present_fence)
+{
+    int pq_fence_fd = -1;
+
+    if (disp_unique_id == 0)
+    {
+        HWC_LOGW("%s: set pq mode with a dubious unique id[%u]", __func__, disp_unique_id);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_cmd_mutex);
+        m_last_pq_mode[disp_id] = std::make_pair(disp_unique_id, pq_mode_id);
+        m_cmd_stats[PQ_CMD_PQ_MODE].queued++;
+    }
+
+    // present needs the pq fence, so this call stays synchronous, but it
+    // never waits for the service or for the other pq commands
+    std::shared_ptr<IPictureQuality_AIDL> pq_service = getPqService();
+    if (pq_service == nullptr)
+    {
+        HWC_LOGE("%s: cannot find PQ service!", __func__);
+        return pq_fence_fd;
+    }
+
+    sendPqMode(pq_service, disp_id, disp_unique_id, pq_mode_id, prev_present_fence, &pq_fence_fd);
     return pq_fence_fd;
 }
 #endif
@@ -317,60 +616,80 @@ int IPqDevice::getCcorrIdentityValue()
     return DEFAULT_IDENTITY_VALUE;
 }
 
-void IPqDevice::setAiBldBuffer(const buffer_handle_t& handle, uint32_t pf_fence_idx)
+void IPqDevice::setAiBldBuffer(const buffer_handle_t& handle, uint32_t pf_fence_idx,
+                               const std::function<void()>& on_done)
 {
 #ifdef USES_PQSERVICE
-    Mutex::Autolock lock(m_lock);
-
-    std::shared_ptr<IPictureQuality_AIDL> pq_service = getPqServiceLocked();
-    if (pq_service == nullptr)
     {
-        HWC_LOGE("%s: cannot find PQ service!", __func__);
-    }
-    else
-    {
-        ATRACE_NAME("call pq setAIBldBuffer");
-        Result result = Result::INVALID_STATE;
+        std::lock_guard<std::mutex> lock(m_cmd_mutex);
 
-        ScopedAStatus status = pq_service->setAIBldBuffer(::android::dupToAidl(handle),
-                                                          static_cast<int32_t>(pf_fence_idx), &result);
-        if (!status.isOk() || result != Result::OK)
+        if (m_service_connected)
         {
-            HWC_LOGW("%s: fail, result: %d, status: %d", __func__, result, status.getStatus());
+            // the caller keeps the buffer until on_done
+            PqCommand cmd;
+            cmd.aibld_handle = ::android::dupToAidl(handle);
+            cmd.pf_fence_idx = static_cast<int32_t>(pf_fence_idx);
+            cmd.aibld_done = on_done;
+            queueCommandLocked(PQ_CMD_AIBLD_BUFFER, cmd);
+            return;
         }
     }
+
+    HWC_LOGE("%s: cannot find PQ service!", __func__);
 #else
     (void) handle;
     (void) pf_fence_idx;
 #endif
+    if (on_done)
+    {
+        on_done();
+    }
 }
 
-void IPqDevice::afterPresent()
+void IPqDevice::resetPqService()
 {
 #ifdef USES_PQSERVICE
-    if (HwcFeatureList::getInstance().getFeature().is_support_pq > 0)
+    AiBluLightDefender::getInstance().setEnable(false);
     {
         Mutex::Autolock lock(m_lock);
-        if (!m_pq_service)
-        {
-            getPqServiceLocked(true, 0);
-        }
+        m_pq_service = nullptr;
     }
+
+    // the service notification connects it again and replays the last state
+    std::lock_guard<std::mutex> lock(m_cmd_mutex);
+    m_service_connected = false;
 #endif
 }
 
-void IPqDevice::resetPqService()
+void IPqDevice::dump(String8* dump_str)
 {
 #ifdef USES_PQSERVICE
-    AiBluLightDefender::getInstance().setEnable(false);
-    Mutex::Autolock lock(m_lock);
-    m_pq_service = nullptr;
+    std::lock_guard<std::mutex> lock(m_cmd_mutex);
+    dump_str->appendFormat("PQ service: connected:%d connect_count:%u pending:%u (aibld:%zu) max_pending:%u\n",
+                           m_service_connected, m_service_connect_count,
+                           m_cmd_pending_num, m_aibld_cmds.size(), m_cmd_pending_max);
+    dump_str->appendFormat("  %-16s %8s %9s %8s %6s %9s %9s %9s %9s\n", "cmd", "queued", "coalesced",
+                           "sent", "failed", "last(us)", "avg(us)", "max(us)", "wait(us)");
+    for (int type = 0; type < PQ_CMD_NUM; type++)
+    {
+        const PqCommandStat& stat = m_cmd_stats[type];
+        dump_str->appendFormat("  %-16s %8" PRIu64 " %9" PRIu64 " %8" PRIu64 " %6" PRIu64
+                               " %9" PRId64 " %9" PRId64 " %9" PRId64 " %9" PRId64 "\n",
+                               getPqCommandName(type), stat.queued, stat.coalesced,
+                               stat.sent, stat.failed, ns2us(stat.last),
+                               stat.sent ? ns2us(stat.total) / static_cast<nsecs_t>(stat.sent) : 0,
+                               ns2us(stat.max), ns2us(stat.max_wait));
+    }
+#else
+    (void) dump_str;
 #endif
 }
 
 IPqDevice* getPqDevice()
 {
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#if defined(MTK_HWC_USE_STUB_DEVICE)
+    return &StubPqDevice::getInstance();
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
     return &PqDeviceLegacy::getInstance();
 #else
     return &PqDeviceDrm::getInstance();
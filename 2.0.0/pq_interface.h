@@ -3,17 +3,31 @@
 
 #include <utils/Mutex.h>
 #include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
 #include <cutils/native_handle.h>
 
+#include <functional>
+
 #include "pq_xml_parser.h"
 
 #ifdef USES_PQSERVICE
 #include <aidl/vendor/mediatek/hardware/pq_aidl/IPictureQuality_AIDL.h>
 #include <aidl/vendor/mediatek/hardware/pq_aidl/BnAiBldCallback.h>
 
+#include <aidl/android/hardware/common/NativeHandle.h>
+
 #include <android/binder_manager.h>
 #include <android/binder_process.h>
 
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
 using ndk::ScopedAStatus;
 using ::aidl::vendor::mediatek::hardware::pq_aidl::IPictureQuality_AIDL;
 using ::aidl::vendor::mediatek::hardware::pq_aidl::Ai_bld_config;
@@ -33,7 +47,10 @@ public:
     IPqDevice();
     ~IPqDevice();
 
+    // the service call is asynchronous, isColorTransformFailed() tells whether the sender
+    // has given up the last matrix, so the display has to apply the identity one instead
     virtual bool setColorTransform(const float* matrix, const int32_t& hint);
+    virtual bool isColorTransformFailed();
 
     virtual bool isColorTransformIoctl();
     virtual void useColorTransformIoctl(int32_t useIoctl);
@@ -49,15 +66,79 @@ public:
 
     virtual int getCcorrIdentityValue();
 
-    virtual void setAiBldBuffer(const buffer_handle_t& handle, uint32_t pf_fence_idx);
-
-    virtual void afterPresent();
+    // the content of handle must be ready, the sender thread never waits for a fence.
+    // PQ reads the buffer in the service call, so on_done is called once the call has returned,
+    // or the buffer is dropped, and the caller may reuse the buffer after that.
+    virtual void setAiBldBuffer(const buffer_handle_t& handle, uint32_t pf_fence_idx,
+                                const std::function<void()>& on_done);
 
     virtual void resetPqService();
 
+    virtual void dump(String8* dump_str);
+
 #ifdef USES_PQSERVICE
 private:
     static void onBinderDied(void* cookie);
+    static void onServiceRegistered(const char* instance, AIBinder* binder, void* cookie);
+
+    // commands sent by the sender thread, a new request replaces the pending
+    // one of the same type, except AI-BLD buffers which are all sent in order
+    enum
+    {
+        PQ_CMD_COLOR_TRANSFORM = 0,
+        PQ_CMD_GAME_PQ,
+        PQ_CMD_AIBLD_BUFFER,
+        PQ_CMD_QUEUE_NUM,
+        // setDisplayPqMode() returns the pq fence to present, so it is sent
+        // by the caller and only shares the statistics
+        PQ_CMD_PQ_MODE = PQ_CMD_QUEUE_NUM,
+        PQ_CMD_NUM,
+    };
+
+    struct PqCommand
+    {
+        bool pending = false;
+        nsecs_t queue_ts = 0;
+
+        // PQ_CMD_COLOR_TRANSFORM, seq tells whether a newer matrix has been set
+        std::array<std::array<float, 4>, 4> matrix;
+        int32_t hint = 0;
+        uint64_t seq = 0;
+        uint32_t retry = 0;
+
+        // PQ_CMD_GAME_PQ
+        ndk::ScopedFileDescriptor game_pq_fd;
+
+        // PQ_CMD_AIBLD_BUFFER
+        aidl::android::hardware::common::NativeHandle aibld_handle;
+        int32_t pf_fence_idx = 0;
+        std::function<void()> aibld_done;
+    };
+
+    struct PqCommandStat
+    {
+        uint64_t queued = 0;
+        uint64_t coalesced = 0;
+        uint64_t sent = 0;
+        uint64_t failed = 0;
+        nsecs_t last = 0;
+        nsecs_t max = 0;
+        nsecs_t total = 0;
+        nsecs_t max_wait = 0;
+    };
+
+    void connectPqService(const std::shared_ptr<IPictureQuality_AIDL>& service);
+    std::shared_ptr<IPictureQuality_AIDL> getPqService();
+
+    void queueCommandLocked(int type, PqCommand& cmd);
+    void replayLocked();
+    void senderLoop();
+    void sendCommand(int type, PqCommand& cmd);
+    void dropCommand(int type, PqCommand& cmd);
+    void takeCommandLocked(int type, PqCommand& cmd);
+    void sendPqMode(const std::shared_ptr<IPictureQuality_AIDL>& service, uint64_t disp_id,
+            uint32_t disp_unique_id, int32_t pq_mode_id, int prev_present_fence, int* pq_fence_fd);
+    void addCommandStatLocked(int type, bool ok, nsecs_t latency);
 
 protected:
     class AiBldCallback : public BnAiBldCallback
@@ -92,7 +173,6 @@ protected:
 
     virtual bool setColorTransformViaIoctl(const float* matrix, const int32_t& hint) = 0;
 #ifdef USES_PQSERVICE
-    virtual std::shared_ptr<IPictureQuality_AIDL> getPqServiceLocked(bool timeout_break = false, int retry_limit = 10);
     virtual bool setColorTransformViaService(const float* matrix, const int32_t& hint);
     virtual int setDisplayPqModeViaService(const uint64_t disp_id, const uint32_t disp_unique_id,
             const int32_t pq_mode_id, const int prev_present_fence);
@@ -105,9 +185,40 @@ protected:
     bool m_use_ioctl;
 
 #ifdef USES_PQSERVICE
+    // m_pq_service is set by the service notification and cleared when the
+    // service dies, nobody polls the service manager for it
     std::shared_ptr<IPictureQuality_AIDL> m_pq_service;
     std::shared_ptr<AiBldCallback> m_aibld_callback;
     std::unique_ptr<ScopedDeathRecipient> m_hal_death_recipint;
+    AServiceManager_NotificationRegistration* m_service_notification;
+
+    // the commands below are protected by m_cmd_mutex, binder calls are made
+    // by m_sender_thread without any lock
+    std::thread m_sender_thread;
+    std::mutex m_cmd_mutex;
+    std::condition_variable m_cmd_cond;
+    bool m_sender_stop = false;
+    bool m_service_connected = false;
+    uint32_t m_service_connect_count = 0;
+    PqCommand m_cmds[PQ_CMD_QUEUE_NUM];
+    // every AI-BLD buffer carries its own pf_fence_idx, so none is dropped
+    std::deque<PqCommand> m_aibld_cmds;
+    uint32_t m_cmd_pending_num = 0;
+    uint32_t m_cmd_pending_max = 0;
+    PqCommandStat m_cmd_stats[PQ_CMD_NUM];
+
+    // the seq of the last color transform which the sender has given up
+    uint64_t m_color_transform_seq = 0;
+    uint64_t m_color_transform_failed_seq = 0;
+
+    // the last state, it is replayed when the service is connected again
+    bool m_last_color_transform_valid = false;
+    std::array<std::array<float, 4>, 4> m_last_matrix;
+    int32_t m_last_hint = 0;
+    int m_last_game_pq_fd = -1;
+    // display id to <unique id, pq mode id>
+    std::map<uint64_t, std::pair<uint32_t, int32_t> > m_last_pq_mode;
+    bool m_replay_pq_mode = false;
 #endif
 
     PqXmlParser m_pq_xml_parser;
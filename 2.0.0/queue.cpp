@@ -2,9 +2,7 @@
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
 #include <fcntl.h>
-#include <sys/ioctl.h>
 #include <linux/fb.h>
-#include <linux/dma-buf.h>
 
 #include <cutils/properties.h>
 
@@ -50,18 +48,81 @@ using namespace mediatek::graphics::common;
         }                                                                     \
     }
 
+// the longest time for a blocking dequeueBuffer() to wait for a free slot
+#define DEQUEUE_FREE_SLOT_TIMEOUT_MS 1000
+
+// the auto buffer count adds a slot after this many dequeues found no free one,
+// the count restarts after AUTO_BUFFER_GROW_WINDOW dequeues in a row found one
+#define AUTO_BUFFER_GROW_DEQUEUES 3
+#define AUTO_BUFFER_GROW_WINDOW 60
+
+// the auto buffer count removes a slot after this many dequeues did not need it,
+// about two seconds at 120 fps
+#define AUTO_BUFFER_SHRINK_DEQUEUES 240
+
+// a queue is idle for the memory trim if nothing has been dequeued for this long
+#define QUEUE_IDLE_TRIM_MS 1000
+
 // ---------------------------------------------------------------------------
 
-DisplayBufferQueue::DisplayBufferQueue(int type, uint64_t id)
+// clearFrameInfo() resets what the producer fills for each frame, the rest
+// of the buffer belongs to the slot
+static void clearFrameInfo(DisplayBufferQueue::DisplayBuffer* buffer)
+{
+    buffer->src_handle    = NULL;
+    buffer->data_info     = DisplayBufferQueue::QueuedExtraInfo();
+    buffer->alpha_enable  = 0;
+    buffer->alpha         = 0xFF;
+    buffer->blending      = 0;
+    buffer->sequence      = 0;
+    buffer->acquire_fence = -1;
+    buffer->ext_sel_layer = -1;
+    buffer->dataspace     = HAL_DATASPACE_UNKNOWN;
+    buffer->hwc_layer_id  = UINT64_MAX;
+}
+
+static MemoryTracker::Owner getMemoryOwner(int queue_type)
+{
+    switch (queue_type)
+    {
+        case DisplayBufferQueue::QUEUE_TYPE_BLT:
+            return MemoryTracker::OWNER_BLT_QUEUE;
+        case DisplayBufferQueue::QUEUE_TYPE_OVL:
+            return MemoryTracker::OWNER_OVL_QUEUE;
+        case DisplayBufferQueue::QUEUE_TYPE_GLAI:
+            return MemoryTracker::OWNER_GLAI_QUEUE;
+        case DisplayBufferQueue::QUEUE_TYPE_AI_BLD_DISP:
+        case DisplayBufferQueue::QUEUE_TYPE_AI_BLD_MDP:
+            return MemoryTracker::OWNER_AI_BLD_QUEUE;
+        default:
+            return MemoryTracker::OWNER_UNKNOWN;
+    }
+}
+
+DisplayBufferQueue::DisplayBufferQueue(int type, uint64_t id, int buffer_count)
     : m_queue_type(type)
+    , m_buffer_count(NUM_BUFFER_SLOTS)
+    , m_base_buffer_count(NUM_BUFFER_SLOTS)
+    , m_auto_buffer_count(false)
+    , m_count_tuner(AUTO_BUFFER_GROW_DEQUEUES, AUTO_BUFFER_GROW_WINDOW, AUTO_BUFFER_SHRINK_DEQUEUES)
     , m_is_synchronous(true)
     , m_frame_counter(0)
     , m_last_acquire_idx(INVALID_BUFFER_SLOT)
     , m_rel_fence_fd(-1)
     , m_listener(NULL)
     , m_id(id)
+    , m_last_dequeue_time(0)
+    , m_trim_callback_id(-1)
 {
-    m_buffer_count = NUM_BUFFER_SLOTS;
+    if (buffer_count >= MIN_BUFFER_SLOTS && buffer_count <= MAX_BUFFER_SLOTS)
+    {
+        m_buffer_count = buffer_count;
+        m_base_buffer_count = buffer_count;
+    }
+    else
+    {
+        QLOGE("Initialize with invalid buffer count (%d), use %d", buffer_count, m_buffer_count);
+    }
 
     if (m_queue_type <= QUEUE_TYPE_NONE || m_queue_type >= QUEUE_TYPE_NUM)
     {
@@ -120,12 +181,17 @@ DisplayBufferQueue::DisplayBufferQueue(int type, uint64_t id)
         QLOGI("Buffer queue is created with size(%d), m_id(%" PRIu64 "), %s",
               m_buffer_count, m_id, m_client_name.c_str());
     }
+
+    m_trim_callback_id = MemoryTracker::getInstance().addIdleTrimCallback([this]() { trimIdle(); });
 }
 
 DisplayBufferQueue::~DisplayBufferQueue()
 {
     QLOGI("Buffer queue is destroyed, m_id(%" PRIu64 ")", m_id);
 
+    // it waits for a running trimIdle()
+    MemoryTracker::getInstance().removeIdleTrimCallback(m_trim_callback_id);
+
     if (m_last_acquired_buf.index != INVALID_BUFFER_SLOT)
     {
         QLOGI("%s(), m_id(%" PRIu64 "), release buf", __FUNCTION__, m_id);
@@ -141,20 +207,18 @@ DisplayBufferQueue::~DisplayBufferQueue()
     {
         BufferSlot* slot = &m_slots[i];
 
-        if (NULL == slot->out_handle) continue;
-
-        if (slot->release_fence != -1) ::protectedClose(slot->release_fence);
-
-        if (slot->out_handle != nullptr)
+        if (slot->buffer.out_handle != nullptr)
         {
             QLOGI("Free Slot(%d), handle=%p, %u -> 0",
-                i, slot->out_handle, slot->data_size);
-
-            GrallocDevice::getInstance().free(slot->out_handle);
+                i, slot->buffer.out_handle, slot->buffer.data_size);
         }
 
-        slot->out_handle = NULL;
-        slot->data_size = 0;
+        // the next owner of the buffer waits for the release fence
+        DisplayBufferPool::getInstance().release(&slot->pool_buffer, slot->buffer.release_fence);
+        slot->buffer.release_fence = -1;
+
+        slot->buffer.out_handle = NULL;
+        slot->buffer.data_size = 0;
     }
 
     m_listener = NULL;
@@ -188,118 +252,111 @@ status_t DisplayBufferQueue::reallocate(unsigned int idx, bool is_secure)
 {
     BufferSlot* slot = &m_slots[idx];
 
-    slot->data_format = m_buffer_param.format;
-    slot->data_width = m_buffer_param.width;
-    slot->data_height = m_buffer_param.height;
+    slot->buffer.data_format = m_buffer_param.format;
+    slot->buffer.data_width = m_buffer_param.width;
+    slot->buffer.data_height = m_buffer_param.height;
 
-    if (slot->out_handle &&
-        slot->data_size == m_buffer_param.size &&
-        slot->compression == m_buffer_param.compression &&
-        slot->secure == is_secure)
+    if (slot->buffer.out_handle &&
+        slot->buffer.data_size == m_buffer_param.size &&
+        slot->buffer.compression == m_buffer_param.compression &&
+        slot->buffer.secure == is_secure)
     {
         return NO_ERROR;
     }
 
     QLOGI("Reallocate Slot(%u), pool(%d -> %d) size(%d -> %d) secure(%d -> %d)",
           idx, slot->pool_id, m_buffer_param.pool_id,
-          slot->data_size, m_buffer_param.size,
-          slot->secure, is_secure);
+          slot->buffer.data_size, m_buffer_param.size,
+          slot->buffer.secure, is_secure);
 
     // allocate new buffer
     {
         HWC_ATRACE_CALL();
 
-        // release old buffer
-        if (slot->out_handle)
+        // give the old buffer back to the pool with its release fence, another queue may use it
+        if (slot->buffer.out_handle)
         {
-            QLOGD("Free Old Slot(%d), handle=%p", idx, slot->out_handle);
+            QLOGD("Free Old Slot(%d), handle=%p", idx, slot->buffer.out_handle);
 
-            GrallocDevice::getInstance().free(slot->out_handle);
-            slot->out_handle = NULL;
+            DisplayBufferPool::getInstance().release(&slot->pool_buffer, slot->buffer.release_fence);
+            slot->buffer.release_fence = -1;
+            slot->buffer.out_handle = NULL;
         }
 
+        DisplayBufferPool::Key key;
+        key.width  = m_buffer_param.width;
+        key.height = m_buffer_param.height;
+        key.format = m_buffer_param.format;
+        key.usage  = static_cast<uint64_t>(BufferUsage::COMPOSER_OVERLAY);
+        // this buffer will be accessed by SW, so add SW flag
+        key.usage |= m_buffer_param.sw_usage ? (BufferUsage::CPU_READ_OFTEN | BufferUsage::CPU_WRITE_OFTEN) : 0;
+        key.usage |= m_buffer_param.compression ? (BufferUsage::GPU_RENDER_TARGET | BufferUsage::GPU_TEXTURE) : 0;
+        key.usage |= is_secure ? static_cast<unsigned int>(BufferUsage::PROTECTED) : 0;
+        key.usage |= is_secure ? static_cast<unsigned int>(GM_BUFFER_USAGE_PRIVATE_SECURE_DISPLAY) : 0;
+        if (key.format == HAL_PIXEL_FORMAT_YCBCR_P010)
         {
-            GrallocDevice::AllocParam param;
-            param.width  = m_buffer_param.width;
-            param.height = m_buffer_param.height;
-            param.format = m_buffer_param.format;
-            param.usage  = static_cast<uint64_t>(BufferUsage::COMPOSER_OVERLAY);
-            // this buffer will be accessed by SW, so add SW flag
-            param.usage |= m_buffer_param.sw_usage ? (BufferUsage::CPU_READ_OFTEN | BufferUsage::CPU_WRITE_OFTEN) : 0;
-            param.usage |= m_buffer_param.compression ? (BufferUsage::GPU_RENDER_TARGET | BufferUsage::GPU_TEXTURE) : 0;
-            param.usage |= is_secure ? static_cast<unsigned int>(BufferUsage::PROTECTED) : 0;
-            param.usage |= is_secure ? static_cast<unsigned int>(GM_BUFFER_USAGE_PRIVATE_SECURE_DISPLAY) : 0;
-            if (param.format == HAL_PIXEL_FORMAT_YCBCR_P010)
-            {
-                param.usage |= BufferUsage::VIDEO_DECODER;
-            }
+            key.usage |= BufferUsage::VIDEO_DECODER;
+        }
 
-            if (NO_ERROR != GrallocDevice::getInstance().alloc(param))
+        if (NO_ERROR != DisplayBufferPool::getInstance().acquire(key, &slot->pool_buffer,
+                getMemoryOwner(m_queue_type), m_buffer_param.disp_id))
+        {
+            slot->buffer.out_handle = NULL;
+            slot->buffer.data_size = 0;
+            return -EINVAL;
+        }
+
+        // the other slots move to the same buffer at their next dequeue,
+        // let the pool allocate theirs in the background
+        size_t pending = 0;
+        for (unsigned int i = 0; i < static_cast<unsigned int>(m_buffer_count); i++)
+        {
+            if (i != idx && (!m_slots[i].buffer.out_handle || m_slots[i].pool_buffer.key != key))
             {
-                QLOGE("Failed to allocate memory size(w=%d,h=%d,fmt=%d,usage=%" PRIx64 ")",
-                    param.width, param.height, param.format, param.usage);
-                slot->out_handle = NULL;
-                slot->data_size = 0;
-                return -EINVAL;
+                pending++;
             }
-
-            slot->out_handle = param.handle;
-            slot->pool_id = m_buffer_param.pool_id;
         }
+        DisplayBufferPool::getInstance().preallocate(key, pending);
 
-        slot->data_size = m_buffer_param.size;
-        slot->protect = m_buffer_param.protect;
-
-        slot->out_ion_fd = -1;
-        slot->out_sec_handle = 0;
-
-        PrivateHandle priv_handle;
-        status_t err = getBufferDimensionInfo(slot->out_handle, &priv_handle);
-        err |= getPrivateHandleBuff(slot->out_handle, &priv_handle);
-        err |= getAllocId(slot->out_handle, &priv_handle);
-        err |= getIonSfInfo(slot->out_handle, &priv_handle);
-        if (NO_ERROR != err)
+        // a buffer from the pool may still be read by the consumer of its previous queue,
+        // dequeueBuffer() hands its release fence to the producer
+        if (slot->buffer.release_fence != -1)
         {
-            GrallocDevice::getInstance().free(slot->out_handle);
-            slot->out_handle = NULL;
-            slot->data_size = 0;
-            return -EINVAL;
+            ::protectedClose(slot->buffer.release_fence);
         }
+        slot->buffer.release_fence = slot->pool_buffer.release_fence;
+        slot->pool_buffer.release_fence = -1;
+
+        const DisplayBufferPool::Buffer& buffer = slot->pool_buffer;
+        slot->buffer.out_handle = buffer.handle;
+        slot->pool_id = m_buffer_param.pool_id;
+
+        slot->buffer.data_size = m_buffer_param.size;
+        slot->buffer.protect = m_buffer_param.protect;
 
-        slot->out_ion_fd = priv_handle.ion_fd;
-        slot->out_sec_handle = priv_handle.sec_handle;
-        slot->secure = is_secure;
+        slot->buffer.out_ion_fd = buffer.ion_fd;
+        slot->buffer.out_sec_handle = buffer.sec_handle;
+        slot->buffer.secure = is_secure;
 
-        if (priv_handle.format == HAL_PIXEL_FORMAT_YCBCR_P010)
-            slot->data_pitch = slot->data_width * 2;
+        if (buffer.format == HAL_PIXEL_FORMAT_YCBCR_P010)
+            slot->buffer.data_pitch = slot->buffer.data_width * 2;
         else
-            slot->data_pitch = priv_handle.y_stride;
-        slot->handle_stride = priv_handle.y_stride;
-        slot->alloc_id = priv_handle.alloc_id;
-        slot->buffer_size = priv_handle.size;
-        slot->data_v_pitch = priv_handle.vstride;
-        slot->data_is_compress = isCompressData(&priv_handle);
-        slot->compression = m_buffer_param.compression;
-        if (m_buffer_param.compression && !isCompressData(&priv_handle))
+            slot->buffer.data_pitch = buffer.y_stride;
+        slot->buffer.handle_stride = buffer.y_stride;
+        slot->buffer.alloc_id = buffer.alloc_id;
+        slot->buffer.buffer_size = buffer.size;
+        slot->buffer.data_v_pitch = buffer.vstride;
+        slot->buffer.data_is_compress = buffer.is_compress;
+        slot->buffer.compression = m_buffer_param.compression;
+        if (m_buffer_param.compression && !buffer.is_compress)
         {
             QLOGE("%s(): Failed to allocate a compressed buffer!", __func__);
         }
         QLOGI("Alloc Slot(%d), handle=%p c=%d w=%d h=%d p=%d ys=%d vs=%d f=%d sec=%d sh=%x, usage=0x%x",
-            idx, slot->out_handle, slot->compression, slot->data_width, slot->data_height,
-            slot->data_pitch, slot->handle_stride, slot->data_v_pitch, slot->data_format,
-            slot->secure, slot->out_sec_handle,
-            priv_handle.usage);
-
-        // set debug name
-        if (isSupportDmaBuf())
-        {
-            if (ioctl(priv_handle.ion_fd, DMA_BUF_SET_NAME,
-                      (std::string("DBQ_") + std::to_string(m_id) + std::string("_") + std::to_string(idx)).c_str()))
-            {
-                HWC_LOGI("DMA_BUF_SET_NAME fail");
-            }
-        }
-
+            idx, slot->buffer.out_handle, slot->buffer.compression, slot->buffer.data_width, slot->buffer.data_height,
+            slot->buffer.data_pitch, slot->buffer.handle_stride, slot->buffer.data_v_pitch, slot->buffer.data_format,
+            slot->buffer.secure, slot->buffer.out_sec_handle,
+            buffer.usage);
     }
 
     return NO_ERROR;
@@ -322,17 +379,26 @@ status_t DisplayBufferQueue::dequeueBuffer(
 
     AutoMutex l(m_mutex);
 
+    m_last_dequeue_time = systemTime();
+
     unsigned int found_idx;
 
+    // every slot which becomes free broadcasts m_dequeue_condition, so wait for
+    // it instead of polling, and give up after DEQUEUE_FREE_SLOT_TIMEOUT_MS
+    const nsecs_t deadline = systemTime() + ms2ns(DEQUEUE_FREE_SLOT_TIMEOUT_MS);
+    bool waited = false;
+    bool first_scan = true;
     bool tryAgain = true;
     while (tryAgain)
     {
         bool found = false;
+        int free_count = 0;
         for (unsigned int i = 0; i < static_cast<unsigned int>(m_buffer_count); i++)
         {
             const int state = m_slots[i].state;
             if (state == BufferSlot::FREE)
             {
+                free_count++;
                 // return the oldest of the free buffers to avoid
                 // stalling the producer if possible.
                 if (!found)
@@ -340,23 +406,54 @@ status_t DisplayBufferQueue::dequeueBuffer(
                     found = true;
                     found_idx = i;
                 }
-                else if (m_slots[i].frame_num < m_slots[found_idx].frame_num)
+                else if (m_slots[i].buffer.frame_num < m_slots[found_idx].buffer.frame_num)
                 {
                     found_idx = i;
                 }
             }
         }
 
+        // the tuner sees each dequeue once, not every wake up of the wait
+        if (m_auto_buffer_count && first_scan)
+        {
+            first_scan = false;
+            const BufferCountTuner::Action action = m_count_tuner.onDequeue(
+                    free_count, m_buffer_count, m_base_buffer_count, MAX_BUFFER_SLOTS);
+            if (action == BufferCountTuner::GROW)
+            {
+                // the new slot is free, take it at the next round
+                QLOGI("dequeueBuffer: no free buffer, grow to %d slots", m_buffer_count + 1);
+                setBufferCountLocked(m_buffer_count + 1);
+                m_count_tuner.onResized();
+                continue;
+            }
+            if (action == BufferCountTuner::SHRINK)
+            {
+                shrinkBufferCountLocked(found ? static_cast<int>(found_idx) : -1);
+            }
+        }
+
         // if no buffer is found, wait for a buffer to be released
         tryAgain = !found;
         if (tryAgain)
         {
             if (CC_LIKELY(m_buffer_param.dequeue_block))
             {
-                QLOGW("dequeueBuffer: cannot find available buffer, wait...");
-                status_t res = m_dequeue_condition.waitRelative(m_mutex, ms2ns(16));
-                QLOGW("dequeueBuffer: wake up to find available buffer (%s)",
-                        (res == TIMED_OUT) ? "TIME OUT" : "WAKE");
+                const nsecs_t remaining = deadline - systemTime();
+                if (remaining <= 0)
+                {
+                    QLOGE("dequeueBuffer: cannot find available buffer in %dms",
+                            DEQUEUE_FREE_SLOT_TIMEOUT_MS);
+                    return -EBUSY;
+                }
+
+                if (!waited)
+                {
+                    QLOGW("dequeueBuffer: cannot find available buffer, wait...");
+                    waited = true;
+                }
+                HWC_ATRACE_NAME("dequeue_wait_slot");
+                m_dequeue_condition.waitRelative(m_mutex, remaining);
             }
             else
             {
@@ -380,37 +477,39 @@ status_t DisplayBufferQueue::dequeueBuffer(
     // buffer is now in DEQUEUED state
     m_slots[idx].state = BufferSlot::DEQUEUED;
 
-    buffer->out_handle           = m_slots[idx].out_handle;
-    buffer->out_ion_fd           = m_slots[idx].out_ion_fd;
-    buffer->out_sec_handle       = m_slots[idx].out_sec_handle;
-    buffer->data_size            = m_slots[idx].data_size;
-    buffer->data_pitch           = m_slots[idx].data_pitch;
-    buffer->data_v_pitch         = m_slots[idx].data_v_pitch;
-    buffer->data_format          = m_slots[idx].data_format;
-    buffer->data_width           = m_slots[idx].data_width;
-    buffer->data_height          = m_slots[idx].data_height;
-    buffer->data_is_compress     = m_slots[idx].data_is_compress;
-    buffer->handle_stride        = m_slots[idx].handle_stride;
-    buffer->data_info.src_crop.makeInvalid();
-    buffer->data_info.dst_crop.makeInvalid();
-    buffer->data_info.is_sharpen = false;
-    buffer->timestamp            = m_slots[idx].timestamp;
-    buffer->frame_num            = m_slots[idx].frame_num;
-    buffer->release_fence        = m_slots[idx].release_fence;
-    buffer->index                = static_cast<int>(idx);
-    buffer->ext_sel_layer        = -1;
-    m_slots[idx].release_fence   = -1;
-    buffer->alloc_id             = m_slots[idx].alloc_id;
-    buffer->buffer_size          = m_slots[idx].buffer_size;
-    buffer->compression          = m_slots[idx].compression;
-    buffer->secure               = m_slots[idx].secure;
+    // the producer fills the frame information again
+    DisplayBuffer& slot_buffer = m_slots[idx].buffer;
+    clearFrameInfo(&slot_buffer);
+    slot_buffer.index = static_cast<int>(idx);
+    *buffer = slot_buffer;
+    slot_buffer.release_fence = -1;
 
     DBG_LOGD("dequeueBuffer (idx=%d, fence=%d) (handle=%p, ion=%d) p=%d v_p=%d c=%d",
         idx, buffer->release_fence, buffer->out_handle, buffer->out_ion_fd, buffer->data_pitch, buffer->data_v_pitch, buffer->compression);
 
-    // wait release fence
-    if (!async)
+    if (waited)
+    {
+        QLOGW("dequeueBuffer: wake up to find available buffer (idx=%u)", idx);
+    }
+
+    if (buffer->release_fence < 0)
+    {
+        return NO_ERROR;
+    }
+
+    if (async)
+    {
+        // the caller passes the release fence to the engine as its input fence,
+        // drop it here if the consumer is already done with the buffer
+        if (SyncFence::queryFenceStatus(buffer->release_fence) == 1)
+        {
+            ::protectedClose(buffer->release_fence);
+            buffer->release_fence = -1;
+        }
+    }
+    else
     {
+        // fallback for the engine which cannot take an input fence
         sp<SyncFence> fence(new SyncFence(static_cast<uint64_t>(m_buffer_param.disp_id)));
         fence->wait(buffer->release_fence, 1000, DEBUG_LOG_TAG);
         buffer->release_fence = -1;
@@ -480,11 +579,11 @@ status_t DisplayBufferQueue::queueBuffer(DisplayBuffer* buffer)
             while (i != nullptr && i != m_queue.end())
             {
                 slot = &(m_slots[*i]);
-                QLOGD("    [idx:%d] handle:%p", *i, slot->out_handle);
+                QLOGD("    [idx:%d] handle:%p", *i, slot->buffer.out_handle);
                 ++i;
             }
 
-            QLOGD("NEW [idx:%u] handle:%p", idx, m_slots[idx].out_handle);
+            QLOGD("NEW [idx:%u] handle:%p", idx, m_slots[idx].buffer.out_handle);
         }
 
         if (m_is_synchronous)
@@ -522,26 +621,16 @@ status_t DisplayBufferQueue::queueBuffer(DisplayBuffer* buffer)
             listener = m_listener;
         }
 
-        m_slots[idx].src_handle           = buffer->src_handle;
-        m_slots[idx].data_info.src_crop   = buffer->data_info.src_crop;
-        m_slots[idx].data_info.dst_crop   = buffer->data_info.dst_crop;
-        m_slots[idx].data_info.is_sharpen = buffer->data_info.is_sharpen;
-        m_slots[idx].data_info.ethdr_meta = buffer->data_info.ethdr_meta;
-        m_slots[idx].dataspace            = buffer->dataspace;
-        m_slots[idx].timestamp            = buffer->timestamp;
-        m_slots[idx].state                = BufferSlot::QUEUED;
-        m_slots[idx].frame_num            = (++m_frame_counter);
-        m_slots[idx].alpha_enable         = buffer->alpha_enable;
-        m_slots[idx].alpha                = buffer->alpha;
-        m_slots[idx].blending             = buffer->blending;
-        m_slots[idx].sequence             = buffer->sequence;
-        m_slots[idx].acquire_fence        = buffer->acquire_fence;
-        m_slots[idx].ext_sel_layer        = buffer->ext_sel_layer;
-        m_slots[idx].compression          = buffer->compression;
-        m_slots[idx].hwc_layer_id         = buffer->hwc_layer_id;
+        // the producer only fills the frame information of the dequeued buffer
+        DisplayBuffer& slot_buffer = m_slots[idx].buffer;
+        slot_buffer = *buffer;
+        slot_buffer.index = static_cast<int>(idx);
+        slot_buffer.release_fence = -1;
+        slot_buffer.frame_num = (++m_frame_counter);
+        m_slots[idx].state = BufferSlot::QUEUED;
         DBG_LOGD("(%d) queueBuffer (idx=%d, fence=%d) c=%d p=%d v_p=%d",
-            m_buffer_param.disp_id, idx, m_slots[idx].acquire_fence, m_slots[idx].compression,
-            m_slots[idx].data_pitch, m_slots[idx].data_v_pitch);
+            m_buffer_param.disp_id, idx, m_slots[idx].buffer.acquire_fence, m_slots[idx].buffer.compression,
+            m_slots[idx].buffer.data_pitch, m_slots[idx].buffer.data_v_pitch);
 
         m_dequeue_condition.broadcast();
 
@@ -581,9 +670,9 @@ status_t DisplayBufferQueue::cancelBuffer(int index)
     QLOGD("cancelBuffer (%u)", idx);
 
     m_slots[idx].state = BufferSlot::FREE;
-    m_slots[idx].frame_num = 0;
-    m_slots[idx].acquire_fence = -1;
-    m_slots[idx].release_fence = -1;
+    m_slots[idx].buffer.frame_num = 0;
+    m_slots[idx].buffer.acquire_fence = -1;
+    m_slots[idx].buffer.release_fence = -1;
 
     m_dequeue_condition.broadcast();
     return NO_ERROR;
@@ -605,6 +694,136 @@ status_t DisplayBufferQueue::setSynchronousMode(bool enabled)
     return NO_ERROR;
 }
 
+status_t DisplayBufferQueue::setBufferCount(int count)
+{
+    AutoMutex l(m_mutex);
+
+    if (count < MIN_BUFFER_SLOTS || count > MAX_BUFFER_SLOTS)
+    {
+        QLOGE("setBufferCount: count out of range [%d, %d]: %d",
+              MIN_BUFFER_SLOTS, MAX_BUFFER_SLOTS, count);
+        return -EINVAL;
+    }
+
+    m_base_buffer_count = count;
+    m_count_tuner.reset();
+
+    // the auto mode may keep more slots, it shrinks by itself
+    if (m_auto_buffer_count && count < m_buffer_count)
+    {
+        return NO_ERROR;
+    }
+
+    return setBufferCountLocked(count);
+}
+
+status_t DisplayBufferQueue::setBufferCountLocked(int count)
+{
+    if (count == m_buffer_count)
+    {
+        return NO_ERROR;
+    }
+
+    if (count < m_buffer_count)
+    {
+        // the removed slots must not be owned by producer or consumer
+        for (int i = count; i < m_buffer_count; i++)
+        {
+            if (m_slots[i].state != BufferSlot::FREE)
+            {
+                QLOGW("setBufferCount: slot %d is busy (state=%d), keep %d slots",
+                      i, m_slots[i].state, m_buffer_count);
+                return -EBUSY;
+            }
+        }
+
+        for (int i = count; i < m_buffer_count; i++)
+        {
+            BufferSlot* slot = &m_slots[i];
+
+            if (slot->buffer.out_handle != nullptr)
+            {
+                QLOGI("Free Slot(%d), handle=%p, %u -> 0",
+                    i, slot->buffer.out_handle, slot->buffer.data_size);
+            }
+
+            // the next owner of the buffer waits for the release fence
+            DisplayBufferPool::getInstance().release(&slot->pool_buffer, slot->buffer.release_fence);
+            slot->buffer.release_fence = -1;
+
+            *slot = BufferSlot();
+        }
+    }
+
+    QLOGI("setBufferCount: %d -> %d", m_buffer_count, count);
+    m_buffer_count = count;
+
+    m_dequeue_condition.broadcast();
+    return NO_ERROR;
+}
+
+int DisplayBufferQueue::getBufferCount() const
+{
+    AutoMutex l(m_mutex);
+    return m_buffer_count;
+}
+
+void DisplayBufferQueue::setAutoBufferCount(bool enable)
+{
+    AutoMutex l(m_mutex);
+
+    if (m_auto_buffer_count != enable)
+    {
+        QLOGI("setAutoBufferCount: %d", enable);
+        m_auto_buffer_count = enable;
+        m_count_tuner.reset();
+    }
+}
+
+void DisplayBufferQueue::trimIdle()
+{
+    // the allocation which asks for the trim may come from this queue
+    if (m_mutex.tryLock() != NO_ERROR)
+    {
+        return;
+    }
+
+    if (systemTime() - m_last_dequeue_time >= ms2ns(QUEUE_IDLE_TRIM_MS))
+    {
+        for (int i = 0; i < m_buffer_count; i++)
+        {
+            BufferSlot* slot = &m_slots[i];
+            if (slot->state != BufferSlot::FREE || slot->buffer.out_handle == nullptr)
+            {
+                continue;
+            }
+
+            // the next dequeue of the slot takes a buffer from the pool again
+            QLOGI("Trim idle Slot(%d), handle=%p, %u -> 0",
+                  i, slot->buffer.out_handle, slot->buffer.data_size);
+            DisplayBufferPool::getInstance().release(&slot->pool_buffer, slot->buffer.release_fence);
+            slot->buffer.release_fence = -1;
+            slot->buffer.out_handle = NULL;
+            slot->buffer.data_size = 0;
+        }
+    }
+
+    m_mutex.unlock();
+}
+
+void DisplayBufferQueue::shrinkBufferCountLocked(int dequeue_idx)
+{
+    // only the last slot can be removed, wait until it is free and not dequeued now.
+    // setBufferCountLocked() gives its buffer to the pool with the release fence
+    const int last = m_buffer_count - 1;
+    if (last != dequeue_idx && m_slots[last].state == BufferSlot::FREE)
+    {
+        QLOGI("dequeueBuffer: spare slot is not used, shrink to %d slots", last);
+        setBufferCountLocked(last);
+        m_count_tuner.onResized();
+    }
+}
+
 void DisplayBufferQueue::dumpLocked(int /*idx*/)
 {
 }
@@ -646,38 +865,10 @@ status_t DisplayBufferQueue::acquireBuffer(
         // buffer is now in ACQUIRED state
         m_slots[idx].state = BufferSlot::ACQUIRED;
 
-        buffer->out_handle           = m_slots[idx].out_handle;
-        buffer->out_ion_fd           = m_slots[idx].out_ion_fd;
-        buffer->out_sec_handle       = m_slots[idx].out_sec_handle;
-        buffer->data_size            = m_slots[idx].data_size;
-        buffer->data_pitch           = m_slots[idx].data_pitch;
-        buffer->data_v_pitch         = m_slots[idx].data_v_pitch;
-        buffer->data_format          = m_slots[idx].data_format;
-        buffer->data_width           = m_slots[idx].data_width;
-        buffer->data_height          = m_slots[idx].data_height;
-        buffer->data_is_compress     = m_slots[idx].data_is_compress;
-        buffer->handle_stride        = m_slots[idx].handle_stride;
-        buffer->dataspace            = m_slots[idx].dataspace;
-        buffer->data_info.src_crop   = m_slots[idx].data_info.src_crop;
-        buffer->data_info.dst_crop   = m_slots[idx].data_info.dst_crop;
-        buffer->data_info.is_sharpen = m_slots[idx].data_info.is_sharpen;
-        buffer->data_info.ethdr_meta = m_slots[idx].data_info.ethdr_meta;
-        buffer->timestamp            = m_slots[idx].timestamp;
-        buffer->frame_num            = m_slots[idx].frame_num;
-        buffer->protect              = m_slots[idx].protect;
-        buffer->secure               = m_slots[idx].secure;
-        buffer->alpha_enable         = m_slots[idx].alpha_enable;
-        buffer->alpha                = m_slots[idx].alpha;
-        buffer->blending             = m_slots[idx].blending;
-        buffer->sequence             = m_slots[idx].sequence;
-        buffer->acquire_fence        = m_slots[idx].acquire_fence;
-        buffer->index                = static_cast<int>(idx);
-        buffer->ext_sel_layer        = m_slots[idx].ext_sel_layer;
-        m_slots[idx].acquire_fence = -1;
-        buffer->alloc_id             = m_slots[idx].alloc_id;
-        buffer->hwc_layer_id         = m_slots[idx].hwc_layer_id;
-        buffer->buffer_size          = m_slots[idx].buffer_size;
-        buffer->compression          = m_slots[idx].compression;
+        DisplayBuffer& slot_buffer = m_slots[idx].buffer;
+        slot_buffer.index = static_cast<int>(idx);
+        *buffer = slot_buffer;
+        slot_buffer.acquire_fence = -1;
 
         DBG_LOGD("acquireBuffer (idx=%d, fence=%d) c=%d p=%d v_p=%d",
             idx, buffer->acquire_fence, buffer->compression, buffer->data_pitch, buffer->data_v_pitch);
@@ -736,13 +927,13 @@ status_t DisplayBufferQueue::releaseBuffer(int index, int fence)
     }
 
     m_slots[index].state = BufferSlot::FREE;
-    if (m_slots[index].release_fence != -1)
+    if (m_slots[index].buffer.release_fence != -1)
     {
         QLOGW("release fence existed! buffer(%d) with state(%d) fence:%d",
             index, m_slots[index].state, fence);
-        ::protectedClose(m_slots[index].release_fence);
+        ::protectedClose(m_slots[index].buffer.release_fence);
     }
-    m_slots[index].release_fence = fence;
+    m_slots[index].buffer.release_fence = fence;
 
     DBG_LOGD("releaseBuffer (idx=%d, fence=%d)", index, fence);
 
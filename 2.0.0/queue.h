@@ -8,6 +8,8 @@
 
 #include "hwc_ui/Rect.h"
 #include "utils/tools.h"
+#include "buffer_count_tuner.h"
+#include "buffer_pool.h"
 
 using namespace android;
 using hwc::Rect;
@@ -19,6 +21,8 @@ class DisplayBufferQueue : public virtual RefBase
 {
 public:
     enum { NUM_BUFFER_SLOTS = 3 };
+    enum { MIN_BUFFER_SLOTS = 2 };
+    enum { MAX_BUFFER_SLOTS = 6 };
     enum { INVALID_BUFFER_SLOT = -1 };
     enum { NO_BUFFER_AVAILABLE = -1 };
 
@@ -207,7 +211,8 @@ public:
         bool compression;
     };
 
-    DisplayBufferQueue(int type, uint64_t id = UINT_MAX);
+    // buffer_count is the number of slots, in [MIN_BUFFER_SLOTS, MAX_BUFFER_SLOTS]
+    DisplayBufferQueue(int type, uint64_t id = UINT_MAX, int buffer_count = NUM_BUFFER_SLOTS);
     ~DisplayBufferQueue();
 
     uint64_t getId() { return m_id; }
@@ -227,6 +232,11 @@ public:
 
     // dequeueBuffer() gets the next buffer slot index for the client to use,
     // this one can get secure buffer.
+    // if async is true, buffer->release_fence is handed back to the caller who
+    // must pass it to the engine as the input fence of the output buffer, or
+    // close it. otherwise, dequeueBuffer() waits for it on the CPU.
+    // if there is no free slot and dequeue_block is set, it waits for a slot
+    // released by the consumer, -EBUSY is returned if none is released in time.
     status_t dequeueBuffer(DisplayBuffer* buffer, bool async, bool is_secure = false);
 
     // queueBuffer() returns a filled buffer to the DisplayBufferQueue.
@@ -238,6 +248,17 @@ public:
     // setSynchronousMode() set dequeueBuffer as sync or async
     status_t setSynchronousMode(bool enabled);
 
+    // setBufferCount() changes the number of slots, in [MIN_BUFFER_SLOTS, MAX_BUFFER_SLOTS].
+    // shrinking fails with -EBUSY if a removed slot is still in use
+    status_t setBufferCount(int count);
+
+    int getBufferCount() const;
+
+    // setAutoBufferCount() lets the queue add a slot instead of waiting when
+    // dequeueBuffer() keeps finding no free one, and remove it again once the
+    // extra slot has stayed unused for a while. it never goes below setBufferCount()
+    void setAutoBufferCount(bool enable);
+
     enum QUEUE_DUMP_CONDITION
     {
         QUEUE_DUMP_NONE          = 0,
@@ -266,44 +287,26 @@ private:
     // drainQueueLocked() drains the buffer queue when change to asynchronous mode
     status_t drainQueueLocked();
 
+    status_t setBufferCountLocked(int count);
+
+    // trimIdle() gives the buffers of the free slots back to DisplayBufferPool if
+    // nothing has been dequeued for a while, MemoryTracker calls it over the soft budget
+    void trimIdle();
+
+    // shrinkBufferCountLocked() removes the last slot if it is free,
+    // but never the slot of dequeue_idx
+    void shrinkBufferCountLocked(int dequeue_idx);
+
     // dumpLocked() is used to dump buffers
     void dumpLocked(int idx);
 
-    // BufferSlot is a buffer slot that contains DisplayBuffer information
-    // and holds a buffer state for buffer management
+    // BufferSlot is a buffer slot that holds the DisplayBuffer handed to
+    // the producer and the consumer, and its state for buffer management
     struct BufferSlot
     {
         BufferSlot()
             : state(BufferSlot::FREE)
             , pool_id(0)
-            , src_handle(NULL)
-            , out_handle(NULL)
-            , out_ion_fd(-1)
-            , out_sec_handle(0)
-            , data_size(0)
-            , data_pitch(0)
-            , data_v_pitch(0)
-            , data_format(0)
-            , data_is_compress(false)
-            , timestamp(0)
-            , frame_num(0)
-            , protect(false)
-            , secure(false)
-            , alpha_enable(0)
-            , alpha(0xFF)
-            , blending(0)
-            , sequence(0)
-            , acquire_fence(-1)
-            , release_fence(-1)
-            , ext_sel_layer(-1)
-            , dataspace(HAL_DATASPACE_UNKNOWN)
-            , data_width(0)
-            , data_height(0)
-            , handle_stride(0)
-            , alloc_id(UINT64_MAX)
-            , hwc_layer_id(UINT64_MAX)
-            , buffer_size(0)
-            , compression(false)
         { }
 
         enum BufferState {
@@ -319,94 +322,15 @@ private:
         // pool_id is used to identify if preallocated buffer pool could be used
         int pool_id;
 
-        // src_handle is the source buffer handle
-        buffer_handle_t src_handle;
-
-        // out_handle is the output buffer handle
-        buffer_handle_t out_handle;
-
-        // out_ion_fd is for normal buffer
-        int out_ion_fd;
-
-        // out_sec_handle is for secure buffer
-        SECHAND out_sec_handle;
-
-        // data_size is data size
-        unsigned int data_size;
-
-        // data_pitch is valid data stride
-        unsigned int data_pitch;
-
-        // data_v_pitch is valid data v stride
-        unsigned int data_v_pitch;
-
-        // data_format is data format
-        unsigned int data_format;
-
-        // data_info is for producer fill extra information
-        QueuedExtraInfo data_info;
+        // buffer is copied to the producer and the consumer as a whole,
+        // its release_fence is owned by the slot until the next dequeue
+        DisplayBuffer buffer;
 
-        // data_is_compress is data_is_compress
-        bool data_is_compress;
-
-        // timestamp is the current timestamp for this buffer
-        int64_t timestamp;
-
-        // frame_num is the number of the queued frame for this buffer.
-        uint64_t frame_num;
-
-        // protect means if this buffer is protected
-        bool protect;
-
-        // secure means if this buffer is secure
-        bool secure;
-
-        // alpha_enable is used for enabling constant alpha
-        unsigned int alpha_enable;
-
-        // alpha is used for setting the value of constant alpha
-        unsigned char alpha;
-
-        // blending is used for setting blending mode
-        int blending;
-
-        // sequence is used as a sequence number for profiling latency purpose
-        uint64_t sequence;
-
-        // acquire_fence is a fence descriptor
-        // used to signal buffer is filled by producer
-        int acquire_fence;
-
-        // release_fence is a fence descriptor
-        // used to signal buffer is used by consumer
-        int release_fence;
-
-        // smart layer index
-        int ext_sel_layer;
-
-        int32_t dataspace;
-
-        // data_width is the width of buffer
-        unsigned int data_width;
-
-        // data_width is the height of buffer
-        unsigned int data_height;
-
-        // handle_stride is the stride size from private handle
-        unsigned int handle_stride;
-
-        // alloc_id is the unique id from gralloc
-        uint64_t alloc_id;
-
-        uint64_t hwc_layer_id;
-
-        // buffer_size is total bytes allocated by gralloc
-        int buffer_size;
-
-        bool compression;
+        // pool_buffer is the buffer borrowed from DisplayBufferPool
+        DisplayBufferPool::Buffer pool_buffer;
     };
 
-    BufferSlot m_slots[NUM_BUFFER_SLOTS];
+    BufferSlot m_slots[MAX_BUFFER_SLOTS];
 
     // m_client_name is used to debug
     String8 m_client_name;
@@ -420,6 +344,15 @@ private:
     // m_buffer_ount is for the real buffer number in queue
     int m_buffer_count;
 
+    // m_base_buffer_count is the buffer number which the auto mode shrinks back to
+    int m_base_buffer_count;
+
+    // m_auto_buffer_count means the queue grows when the producer would wait
+    bool m_auto_buffer_count;
+
+    // m_count_tuner decides when the auto mode adds or removes a slot
+    BufferCountTuner m_count_tuner;
+
     // m_is_synchronous points whether we're in synchronous mode or not
     bool m_is_synchronous;
 
@@ -451,6 +384,12 @@ private:
     sp<ConsumerListener> m_listener;
 
     uint64_t m_id;
+
+    // m_last_dequeue_time tells if the queue is idle, see trimIdle()
+    nsecs_t m_last_dequeue_time;
+
+    // m_trim_callback_id is the idle trim callback registered in MemoryTracker
+    int m_trim_callback_id;
 };
 
 #endif // HWC_QUEUE_H_
@@ -0,0 +1,85 @@
+// Host test of the grow and shrink decisions of the auto buffer count.
+
+#include <gtest/gtest.h>
+
+#include "buffer_count_tuner.h"
+
+namespace {
+
+const int kGrowDequeues = 3;
+const int kGrowWindow = 10;
+const int kShrinkDequeues = 5;
+const int kBase = 3;
+const int kMax = 6;
+
+TEST(BufferCountTunerTest, GrowsAfterRepeatedStarvation)
+{
+    BufferCountTuner tuner(kGrowDequeues, kGrowWindow, kShrinkDequeues);
+    EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(0, kBase, kBase, kMax));
+    EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(1, kBase, kBase, kMax));
+    EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(0, kBase, kBase, kMax));
+    EXPECT_EQ(BufferCountTuner::GROW, tuner.onDequeue(0, kBase, kBase, kMax));
+
+    // the count starts again after a grow
+    EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(0, kBase + 1, kBase, kMax));
+}
+
+TEST(BufferCountTunerTest, StarvationExpiresAfterWindow)
+{
+    BufferCountTuner tuner(kGrowDequeues, kGrowWindow, kShrinkDequeues);
+    EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(0, kBase, kBase, kMax));
+    EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(0, kBase, kBase, kMax));
+    for (int i = 0; i < kGrowWindow; i++)
+    {
+        EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(1, kBase, kBase, kMax));
+    }
+    EXPECT_EQ(0, tuner.getStarvedCount());
+    EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(0, kBase, kBase, kMax));
+}
+
+TEST(BufferCountTunerTest, NeverGrowsPastMax)
+{
+    BufferCountTuner tuner(kGrowDequeues, kGrowWindow, kShrinkDequeues);
+    for (int i = 0; i < kGrowDequeues * 2; i++)
+    {
+        EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(0, kMax, kBase, kMax));
+    }
+}
+
+TEST(BufferCountTunerTest, ShrinksAfterSpareDequeues)
+{
+    BufferCountTuner tuner(kGrowDequeues, kGrowWindow, kShrinkDequeues);
+    for (int i = 0; i < kShrinkDequeues - 1; i++)
+    {
+        EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(2, kBase + 1, kBase, kMax));
+    }
+    EXPECT_EQ(BufferCountTuner::SHRINK, tuner.onDequeue(2, kBase + 1, kBase, kMax));
+
+    // the slot could not be removed, ask again
+    EXPECT_EQ(BufferCountTuner::SHRINK, tuner.onDequeue(2, kBase + 1, kBase, kMax));
+
+    tuner.onResized();
+    EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(2, kBase + 1, kBase, kMax));
+}
+
+TEST(BufferCountTunerTest, BusyDequeueRestartsShrink)
+{
+    BufferCountTuner tuner(kGrowDequeues, kGrowWindow, kShrinkDequeues);
+    for (int i = 0; i < kShrinkDequeues - 1; i++)
+    {
+        EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(2, kBase + 1, kBase, kMax));
+    }
+    EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(1, kBase + 1, kBase, kMax));
+    EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(2, kBase + 1, kBase, kMax));
+}
+
+TEST(BufferCountTunerTest, NeverShrinksBelowBase)
+{
+    BufferCountTuner tuner(kGrowDequeues, kGrowWindow, kShrinkDequeues);
+    for (int i = 0; i < kShrinkDequeues * 2; i++)
+    {
+        EXPECT_EQ(BufferCountTuner::KEEP, tuner.onDequeue(kBase, kBase, kBase, kMax));
+    }
+}
+
+}  // namespace
@@ -0,0 +1,128 @@
+// Host test of CowList, built with ThreadSanitizer by the hwc_cow_list_test
+// module so a race between snapshot readers and writers fails the test.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "utils/cow_list.h"
+
+namespace {
+
+TEST(CowListTest, KeepsItemsSorted)
+{
+    CowList<int> list;
+    EXPECT_EQ(0, list.add(3));
+    EXPECT_EQ(0, list.add(1));
+    EXPECT_EQ(1, list.add(2));
+    EXPECT_EQ(2, list.add(3));
+
+    CowList<int>::Snapshot items = list.snapshot();
+    ASSERT_EQ(3u, items->size());
+    EXPECT_TRUE(std::is_sorted(items->begin(), items->end()));
+}
+
+TEST(CowListTest, RemoveAndReset)
+{
+    CowList<int> list;
+    list.add(1);
+    list.add(2);
+
+    EXPECT_EQ(android::NAME_NOT_FOUND, list.remove(5));
+    EXPECT_EQ(1, list.remove(2));
+    EXPECT_EQ(1u, list.snapshot()->size());
+
+    list.reset(7);
+    ASSERT_EQ(1u, list.snapshot()->size());
+    EXPECT_EQ(7, list.snapshot()->front());
+
+    list.reset();
+    EXPECT_TRUE(list.snapshot()->empty());
+}
+
+TEST(CowListTest, SnapshotIsImmutable)
+{
+    CowList<int> list;
+    list.add(1);
+    CowList<int>::Snapshot before = list.snapshot();
+
+    list.add(2);
+    list.remove(1);
+
+    ASSERT_EQ(1u, before->size());
+    EXPECT_EQ(1, before->front());
+    ASSERT_EQ(1u, list.snapshot()->size());
+    EXPECT_EQ(2, list.snapshot()->front());
+}
+
+TEST(CowListTest, ConcurrentReadersAndWriters)
+{
+    constexpr int kReaders = 4;
+    constexpr int kWriters = 2;
+    constexpr int kRounds = 2000;
+
+    CowList<int> list;
+    // items below 1000 are never removed, every snapshot must hold them
+    for (int i = 0; i < 10; i++)
+    {
+        list.add(i);
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<int> bad_snapshots(0);
+
+    std::vector<std::thread> threads;
+    for (int r = 0; r < kReaders; r++)
+    {
+        threads.emplace_back([&]()
+        {
+            while (!stop.load())
+            {
+                CowList<int>::Snapshot items = list.snapshot();
+                int stable = 0;
+                for (int item : *items)
+                {
+                    stable += item < 1000 ? 1 : 0;
+                }
+                if (stable != 10 || !std::is_sorted(items->begin(), items->end()))
+                {
+                    bad_snapshots++;
+                }
+            }
+        });
+    }
+
+    for (int w = 0; w < kWriters; w++)
+    {
+        threads.emplace_back([&list, w]()
+        {
+            for (int i = 0; i < kRounds; i++)
+            {
+                const int item = 1000 + w * kRounds + i;
+                list.add(item);
+                if (i % 2)
+                {
+                    list.remove(item);
+                }
+            }
+        });
+    }
+
+    for (int i = kReaders; i < kReaders + kWriters; i++)
+    {
+        threads[static_cast<size_t>(i)].join();
+    }
+    stop.store(true);
+    for (int i = 0; i < kReaders; i++)
+    {
+        threads[static_cast<size_t>(i)].join();
+    }
+
+    EXPECT_EQ(0, bad_snapshots.load());
+    EXPECT_EQ(10u + kWriters * kRounds / 2, list.snapshot()->size());
+}
+
+} // namespace
@@ -0,0 +1,150 @@
+// Host test of the GLES range policies on synthetic layer stacks.
+
+#include <gtest/gtest.h>
+
+#include "gles_range_policy.h"
+
+namespace {
+
+GlesRangeLayer makeLayer(int32_t w, int32_t h, uint32_t bpp)
+{
+    GlesRangeLayer layer;
+    layer.right = w;
+    layer.bottom = h;
+    layer.bytes_per_pixel = bpp;
+    return layer;
+}
+
+// a full screen layer, five small ones and another full screen layer
+GlesRangeInput makeSmallLayersInput(int max_layer)
+{
+    GlesRangeInput input;
+    input.max_layer = max_layer;
+    input.layers.push_back(makeLayer(1080, 2400, 4));
+    for (int i = 0; i < 5; i++)
+    {
+        input.layers.push_back(makeLayer(100, 100, 4));
+    }
+    input.layers.push_back(makeLayer(1080, 2400, 4));
+    return input;
+}
+
+TEST(GlesRangePolicyTest, InputOverflow)
+{
+    GlesRangeInput input = makeSmallLayersInput(7);
+    EXPECT_FALSE(input.isOverflow());
+
+    input.max_layer = 6;
+    EXPECT_TRUE(input.isOverflow());
+
+    // the client target takes one layer for the range [1, 5]
+    input.gles_head = 1;
+    input.gles_tail = 5;
+    input.max_layer = 3;
+    EXPECT_FALSE(input.isOverflow());
+}
+
+TEST(GlesRangePolicyTest, RequiredRangeCoversMustClient)
+{
+    GlesRangeInput input = makeSmallLayersInput(4);
+    int32_t head = 0;
+    int32_t tail = 0;
+    input.getRequiredRange(&head, &tail);
+    EXPECT_EQ(-1, head);
+    EXPECT_EQ(-1, tail);
+
+    input.layers[4].must_client = true;
+    input.gles_head = 2;
+    input.gles_tail = 2;
+    input.getRequiredRange(&head, &tail);
+    EXPECT_EQ(2, head);
+    EXPECT_EQ(4, tail);
+}
+
+TEST(GlesRangePolicyTest, LegacyExtendsTowardTop)
+{
+    GlesRangeInput input = makeSmallLayersInput(4);
+    GlesRangePolicyLegacy policy;
+    int32_t head = -1;
+    int32_t tail = -1;
+    ASSERT_TRUE(policy.choose(input, &head, &tail));
+    EXPECT_EQ(3, head);
+    EXPECT_EQ(6, tail);
+}
+
+TEST(GlesRangePolicyTest, CostPicksSmallLayers)
+{
+    GlesRangeInput input = makeSmallLayersInput(4);
+    GlesRangePolicyCost policy;
+    int32_t head = -1;
+    int32_t tail = -1;
+    ASSERT_TRUE(policy.choose(input, &head, &tail));
+    EXPECT_GE(head, 1);
+    EXPECT_LE(tail, 5);
+    EXPECT_LE(static_cast<int>(input.layers.size()) - (tail - head + 1) + 1, input.max_layer);
+    EXPECT_LT(GlesRangePolicyCost::getCost(input, head, tail), GlesRangePolicyCost::getCost(input, 3, 6));
+}
+
+TEST(GlesRangePolicyTest, CostCoversMustClient)
+{
+    GlesRangeInput input = makeSmallLayersInput(4);
+    input.layers[6].must_client = true;
+    GlesRangePolicyCost policy;
+    int32_t head = -1;
+    int32_t tail = -1;
+    ASSERT_TRUE(policy.choose(input, &head, &tail));
+    EXPECT_EQ(6, tail);
+    EXPECT_EQ(-1, GlesRangePolicyCost::getCost(input, 1, 5));
+}
+
+TEST(GlesRangePolicyTest, CostSkipsMustDevice)
+{
+    GlesRangeInput input = makeSmallLayersInput(4);
+    input.layers[1].must_device = true;
+    GlesRangePolicyCost policy;
+    int32_t head = -1;
+    int32_t tail = -1;
+    ASSERT_TRUE(policy.choose(input, &head, &tail));
+    EXPECT_GT(head, 1);
+    EXPECT_EQ(-1, GlesRangePolicyCost::getCost(input, 1, 4));
+}
+
+TEST(GlesRangePolicyTest, ManagerKeepsRangeWithoutOverflow)
+{
+    GlesRangePolicyManager& manager = GlesRangePolicyManager::getInstance();
+    manager.setPolicy(GlesRangePolicyManager::POLICY_COST);
+
+    GlesRangeInput input = makeSmallLayersInput(7);
+    int32_t head = 0;
+    int32_t tail = 0;
+    ASSERT_TRUE(manager.choose(input, &head, &tail));
+    EXPECT_EQ(-1, head);
+    EXPECT_EQ(-1, tail);
+
+    input.gles_head = 6;
+    input.gles_tail = 6;
+    ASSERT_TRUE(manager.choose(input, &head, &tail));
+    EXPECT_EQ(6, head);
+    EXPECT_EQ(6, tail);
+
+    manager.setPolicy(GlesRangePolicyManager::POLICY_LEGACY);
+}
+
+TEST(GlesRangePolicyTest, ManagerFallsBackToLegacy)
+{
+    GlesRangePolicyManager& manager = GlesRangePolicyManager::getInstance();
+    manager.setPolicy(GlesRangePolicyManager::POLICY_COST);
+
+    // every range which fits holds the secure layer
+    GlesRangeInput input = makeSmallLayersInput(2);
+    input.layers[3].must_device = true;
+    int32_t head = -1;
+    int32_t tail = -1;
+    ASSERT_TRUE(manager.choose(input, &head, &tail));
+    EXPECT_EQ(1, head);
+    EXPECT_EQ(6, tail);
+
+    manager.setPolicy(GlesRangePolicyManager::POLICY_LEGACY);
+}
+
+}  // namespace
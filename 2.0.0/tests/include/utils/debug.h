@@ -0,0 +1,20 @@
+// Host replacement of utils/debug.h for the unit tests, the device header
+// pulls in ged and aee which have no host build.
+
+#ifndef HWC_TESTS_UTILS_DEBUG_H_
+#define HWC_TESTS_UTILS_DEBUG_H_
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#define HWC_LOGV(x, ...) do { } while (0)
+#define HWC_LOGD(x, ...) do { } while (0)
+#define HWC_LOGI(x, ...) fprintf(stderr, "[" DEBUG_LOG_TAG "] " x "\n", ##__VA_ARGS__)
+#define HWC_LOGW(x, ...) fprintf(stderr, "[" DEBUG_LOG_TAG "] " x "\n", ##__VA_ARGS__)
+#define HWC_LOGE(x, ...) fprintf(stderr, "[" DEBUG_LOG_TAG "] " x "\n", ##__VA_ARGS__)
+
+#ifndef CC_UNLIKELY
+#define CC_UNLIKELY(exp) (__builtin_expect(!!(exp), 0))
+#endif
+
+#endif
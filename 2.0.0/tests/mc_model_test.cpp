@@ -0,0 +1,342 @@
+// Host test of the mega-cycle models scored on the MC_FEATURE records of a
+// HWC2 call-stream trace. With HWC_MC_TRACE=<trace> it also scores the table,
+// extrapolate and linear models on a trace recorded on the device.
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "mc_model.h"
+#include "tools/hwc_record_reader.h"
+
+namespace {
+
+struct MCycleSample
+{
+    MCycleFeature feature;
+    int thread;
+    nsecs_t cpu_time;
+    uint32_t cpu_mhz;
+};
+
+// read the table and the samples of a trace, returns false if it has no table
+bool loadMCycleTrace(const std::string& path, std::list<HwcMCycleInfo>* table,
+                     std::vector<MCycleSample>* samples)
+{
+    HwcRecordFileHeader file_header;
+    const bool loaded = readRecordFile(path, &file_header,
+        [table, samples](const HwcRecordHeader& header, const std::vector<uint8_t>& payload)
+        {
+            if (header.type == HWC_RECORD_MC_TABLE)
+            {
+                HwcRecordMCycleTable table_header;
+                if (!readRecordPayload(payload, &table_header))
+                {
+                    return;
+                }
+                table->clear();
+                for (uint32_t i = 0; i < table_header.num_entries; i++)
+                {
+                    HwcRecordMCycleEntry entry;
+                    if (!readRecordPayload(payload, &entry,
+                                           sizeof(table_header) + sizeof(entry) * i))
+                    {
+                        break;
+                    }
+                    HwcMCycleInfo info = {};
+                    info.id = entry.id;
+                    info.main_mc = entry.main_mc;
+                    info.dispatcher_mc = entry.dispatcher_mc;
+                    info.ovl_mc = entry.ovl_mc;
+                    table->push_back(info);
+                }
+            }
+            else if (header.type == HWC_RECORD_MC_FEATURE)
+            {
+                HwcRecordMCycleFeature record;
+                if (!readRecordPayload(payload, &record))
+                {
+                    return;
+                }
+                MCycleSample sample;
+                sample.feature.num_ui_layers = record.num_ui_layers;
+                sample.feature.num_mdp_layers = record.num_mdp_layers;
+                sample.feature.num_mml_layers = record.num_mml_layers;
+                sample.feature.num_glai_layers = record.num_glai_layers;
+                sample.feature.num_dirty_layers = record.num_dirty_layers;
+                sample.feature.fbt_exist = record.flags & HWC_RECORD_MC_FBT;
+                sample.feature.secure = record.flags & HWC_RECORD_MC_SECURE;
+                sample.feature.mirror_src = record.flags & HWC_RECORD_MC_MIRROR_SRC;
+                sample.feature.mirror_dst = record.flags & HWC_RECORD_MC_MIRROR_DST;
+                sample.feature.is_virtual = record.flags & HWC_RECORD_MC_VIRTUAL;
+                sample.feature.pixels = record.pixels;
+                sample.thread = static_cast<int>(record.thread);
+                sample.cpu_time = record.cpu_ns;
+                sample.cpu_mhz = record.cpu_mhz;
+                samples->push_back(sample);
+            }
+        });
+    return loaded && !table->empty();
+}
+
+void scoreSamples(MCycleModelManager* manager, const std::vector<MCycleSample>& samples)
+{
+    manager->setScoring(true);
+    for (const MCycleSample& sample : samples)
+    {
+        manager->addSample(sample.feature, sample.thread, sample.cpu_time, sample.cpu_mhz);
+    }
+}
+
+double getMae(const MCycleModelManager& manager, int model, int thread)
+{
+    double mae = 0.0;
+    double bias = 0.0;
+    manager.getScore(model, thread, &mae, &bias);
+    return mae;
+}
+
+// writes a trace with the records of a recording on the device
+class TraceWriter
+{
+public:
+    explicit TraceWriter(const std::string& path)
+        : m_fp(fopen(path.c_str(), "wb"))
+    {
+        HwcRecordFileHeader header;
+        header.magic = HWC_RECORD_MAGIC;
+        header.version = HWC_RECORD_VERSION;
+        header.header_size = static_cast<uint16_t>(sizeof(header));
+        header.start_ts = 0;
+        write(&header, sizeof(header));
+    }
+
+    ~TraceWriter()
+    {
+        if (m_fp)
+        {
+            fclose(m_fp);
+        }
+    }
+
+    bool isOpen() const { return m_fp != nullptr; }
+
+    void writeTable(const std::list<HwcMCycleInfo>& table)
+    {
+        HwcRecordMCycleTable table_header;
+        table_header.num_entries = static_cast<uint32_t>(table.size());
+        std::vector<HwcRecordMCycleEntry> entries;
+        for (const HwcMCycleInfo& info : table)
+        {
+            HwcRecordMCycleEntry entry;
+            entry.id = info.id;
+            entry.main_mc = info.main_mc;
+            entry.dispatcher_mc = info.dispatcher_mc;
+            entry.ovl_mc = info.ovl_mc;
+            entries.push_back(entry);
+        }
+        const size_t size = sizeof(table_header) + sizeof(HwcRecordMCycleEntry) * entries.size();
+        writeHeader(HWC_RECORD_MC_TABLE, size);
+        write(&table_header, sizeof(table_header));
+        write(entries.data(), sizeof(HwcRecordMCycleEntry) * entries.size());
+    }
+
+    void writeSample(const MCycleFeature& feature, int thread, float mc, uint32_t cpu_mhz)
+    {
+        HwcRecordMCycleFeature record;
+        record.thread = static_cast<uint32_t>(thread);
+        record.cpu_mhz = cpu_mhz;
+        // mega cycles = seconds * MHz
+        record.cpu_ns = static_cast<int64_t>(static_cast<double>(mc) * 1e9 / cpu_mhz);
+        record.num_ui_layers = feature.num_ui_layers;
+        record.num_mdp_layers = feature.num_mdp_layers;
+        record.num_mml_layers = feature.num_mml_layers;
+        record.num_glai_layers = feature.num_glai_layers;
+        record.num_dirty_layers = feature.num_dirty_layers;
+        record.flags = feature.fbt_exist ? HWC_RECORD_MC_FBT : 0;
+        record.pixels = feature.pixels;
+        writeHeader(HWC_RECORD_MC_FEATURE, sizeof(record));
+        write(&record, sizeof(record));
+    }
+
+private:
+    void writeHeader(uint16_t type, size_t size)
+    {
+        HwcRecordHeader header;
+        header.type = type;
+        header.size = static_cast<uint16_t>(size);
+        header.display = 0;
+        header.layer = 0;
+        header.ts = 0;
+        write(&header, sizeof(header));
+    }
+
+    void write(const void* data, size_t size)
+    {
+        if (m_fp && size > 0)
+        {
+            fwrite(data, size, 1, m_fp);
+        }
+    }
+
+    FILE* m_fp;
+};
+
+HwcMCycleInfo makeInfo(int id, float dispatcher_mc, float ovl_mc)
+{
+    HwcMCycleInfo info = {};
+    info.id = id;
+    info.main_mc = 1.f;
+    info.dispatcher_mc = dispatcher_mc;
+    info.ovl_mc = ovl_mc;
+    return info;
+}
+
+// one mc per ui layer, the mm layer costs 2 mc more
+std::list<HwcMCycleInfo> makeTable()
+{
+    std::list<HwcMCycleInfo> table;
+    for (int ui = 1; ui <= 6; ui++)
+    {
+        table.push_back(makeInfo(HWC_MC_1U + ui - 1, static_cast<float>(ui), static_cast<float>(ui)));
+    }
+    for (int ui = 0; ui <= 5; ui++)
+    {
+        table.push_back(makeInfo(HWC_MC_0U_1M + ui, static_cast<float>(ui + 2), static_cast<float>(ui + 2)));
+    }
+    return table;
+}
+
+std::string getTempPath()
+{
+    const char* tmp = getenv("TMPDIR");
+    char path[256];
+    snprintf(path, sizeof(path), "%s/hwc_mc_model_test_%d.trace", tmp ? tmp : "/tmp",
+             static_cast<int>(getpid()));
+    return path;
+}
+
+TEST(MCycleModelTest, LookupFollowsTableScenarios)
+{
+    const std::list<HwcMCycleInfo> table = makeTable();
+
+    EXPECT_EQ(HWC_MC_3U, lookupScenarioMCInfo(table, 3, 0).id);
+    EXPECT_EQ(HWC_MC_6U, lookupScenarioMCInfo(table, 9, 0).id);
+    EXPECT_EQ(HWC_MC_0U_1M, lookupScenarioMCInfo(table, 0, 1).id);
+    EXPECT_EQ(HWC_MC_5U_1M, lookupScenarioMCInfo(table, 8, 2).id);
+}
+
+TEST(MCycleModelTest, ExtrapolateGrowsPastTheTable)
+{
+    const std::list<HwcMCycleInfo> table = makeTable();
+    MCycleModelTable table_model(table);
+    MCycleModelExtrapolate extrapolate_model(table);
+
+    MCycleFeature feature;
+    feature.num_ui_layers = 8;
+    EXPECT_FLOAT_EQ(6.f, table_model.predict(feature).dispatcher_mc);
+    EXPECT_FLOAT_EQ(8.f, extrapolate_model.predict(feature).dispatcher_mc);
+
+    feature.num_ui_layers = 2;
+    feature.num_mdp_layers = 3;
+    EXPECT_FLOAT_EQ(4.f, table_model.predict(feature).dispatcher_mc);
+    EXPECT_FLOAT_EQ(8.f, extrapolate_model.predict(feature).dispatcher_mc);
+}
+
+TEST(MCycleModelTest, NothingIsScoredWhileScoringIsOff)
+{
+    const std::list<HwcMCycleInfo> table = makeTable();
+    MCycleModelManager manager(table);
+
+    MCycleFeature feature;
+    feature.num_ui_layers = 2;
+    manager.addSample(feature, MCycleEstimator::THREAD_DISPATCHER, 1000000, 1000);
+
+    double mae = 0.0;
+    double bias = 0.0;
+    EXPECT_EQ(0u, manager.getScore(MCycleModelManager::MODEL_TABLE,
+                                   MCycleEstimator::THREAD_DISPATCHER, &mae, &bias));
+}
+
+TEST(MCycleModelTest, ScoresModelsOnRecordedSamples)
+{
+    const std::string path = getTempPath();
+    const std::list<HwcMCycleInfo> table = makeTable();
+    {
+        TraceWriter writer(path);
+        ASSERT_TRUE(writer.isOpen());
+        writer.writeTable(table);
+
+        // the real cost follows the table per layer, and also grows with the
+        // display pixels, which the table does not describe
+        for (int i = 0; i < 3000; i++)
+        {
+            MCycleFeature feature;
+            feature.num_ui_layers = 1 + i % 9;
+            feature.fbt_exist = true;
+            feature.num_dirty_layers = i % 3;
+            feature.pixels = (i % 2) ? 1080 * 2400 : 1440 * 3200;
+            const float mc = static_cast<float>(feature.num_ui_layers) +
+                             1.5f * static_cast<float>(feature.pixels) / 1e6f;
+            writer.writeSample(feature, MCycleEstimator::THREAD_DISPATCHER, mc, 1000);
+        }
+    }
+
+    std::list<HwcMCycleInfo> recorded_table;
+    std::vector<MCycleSample> samples;
+    ASSERT_TRUE(loadMCycleTrace(path, &recorded_table, &samples));
+    unlink(path.c_str());
+    EXPECT_EQ(table.size(), recorded_table.size());
+    ASSERT_EQ(3000u, samples.size());
+
+    MCycleModelManager manager(recorded_table);
+    scoreSamples(&manager, samples);
+
+    const int thread = MCycleEstimator::THREAD_DISPATCHER;
+    const double table_mae = getMae(manager, MCycleModelManager::MODEL_TABLE, thread);
+    const double extrapolate_mae = getMae(manager, MCycleModelManager::MODEL_EXTRAPOLATE, thread);
+    const double linear_mae = getMae(manager, MCycleModelManager::MODEL_LINEAR, thread);
+    EXPECT_LT(extrapolate_mae, table_mae);
+    EXPECT_LT(linear_mae, extrapolate_mae);
+}
+
+// HWC_MC_TRACE=<trace> scores the models on a trace recorded with
+// vendor.debug.hwc.record_call
+TEST(MCycleModelTest, ScoreRecordedTrace)
+{
+    const char* path = getenv("HWC_MC_TRACE");
+    if (path == nullptr)
+    {
+        GTEST_SKIP() << "set HWC_MC_TRACE to score a recorded trace";
+    }
+
+    std::list<HwcMCycleInfo> table;
+    std::vector<MCycleSample> samples;
+    ASSERT_TRUE(loadMCycleTrace(path, &table, &samples)) << path << " has no MC_TABLE record";
+
+    MCycleModelManager manager(table);
+    scoreSamples(&manager, samples);
+
+    static const char* const thread_name[MCycleEstimator::THREAD_NUM] = {"disp", "ovl"};
+    printf("%s: %zu samples, %zu table entries\n", path, samples.size(), table.size());
+    printf("  %-12s %-5s %8s %8s %8s\n", "model", "thread", "samples", "mae", "bias");
+    for (int model = 0; model < MCycleModelManager::MODEL_NUM; model++)
+    {
+        for (int thread = 0; thread < MCycleEstimator::THREAD_NUM; thread++)
+        {
+            double mae = 0.0;
+            double bias = 0.0;
+            const uint64_t count = manager.getScore(model, thread, &mae, &bias);
+            printf("  %-12s %-5s %8" PRIu64 " %8.3f %+8.3f\n", manager.getModelName(model),
+                   thread_name[thread], count, mae, bias);
+        }
+    }
+}
+
+} // namespace
@@ -0,0 +1,130 @@
+// Host test of the budgets of MemoryTracker.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "memory_tracker.h"
+
+namespace {
+
+class MemoryTrackerTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        MemoryTracker& tracker = MemoryTracker::getInstance();
+        for (uint64_t id : m_ids)
+        {
+            tracker.remove(id);
+        }
+        tracker.setBudget(0, 0);
+        tracker.setTrimCallback(nullptr);
+    }
+
+    void commit(uint64_t id, size_t bytes)
+    {
+        MemoryTracker::getInstance().commit(bytes, id, MemoryTracker::OWNER_BLT_QUEUE, 0, bytes);
+        m_ids.push_back(id);
+    }
+
+    std::vector<uint64_t> m_ids;
+};
+
+TEST_F(MemoryTrackerTest, ReservationCountsTowardHardBudget)
+{
+    MemoryTracker& tracker = MemoryTracker::getInstance();
+    tracker.setBudget(0, 100);
+
+    ASSERT_TRUE(tracker.reserve(60));
+    // the first allocation is not committed yet, but its bytes are reserved
+    EXPECT_FALSE(tracker.reserve(60));
+
+    tracker.cancel(60);
+    ASSERT_TRUE(tracker.reserve(60));
+    commit(1, 60);
+    EXPECT_FALSE(tracker.reserve(60));
+    EXPECT_TRUE(tracker.reserve(40));
+    tracker.cancel(40);
+}
+
+TEST_F(MemoryTrackerTest, ConcurrentReservesStayWithinHardBudget)
+{
+    MemoryTracker& tracker = MemoryTracker::getInstance();
+    tracker.setBudget(0, 1000);
+
+    std::atomic<int> granted(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; i++)
+    {
+        threads.emplace_back([&tracker, &granted]() {
+            for (int j = 0; j < 100; j++)
+            {
+                if (tracker.reserve(100))
+                {
+                    granted++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(10, granted.load());
+    tracker.cancel(1000);
+}
+
+TEST_F(MemoryTrackerTest, IdleQueuesAreTrimmedAfterPool)
+{
+    MemoryTracker& tracker = MemoryTracker::getInstance();
+    commit(1, 100);
+    tracker.setBudget(150, 0);
+
+    // the pool has nothing idle until the queue gives its buffer back
+    bool queue_trimmed = false;
+    std::vector<size_t> pool_requests;
+    tracker.setTrimCallback([&](size_t bytes) -> size_t {
+        pool_requests.push_back(bytes);
+        if (!queue_trimmed)
+        {
+            return 0;
+        }
+        tracker.remove(1);
+        return 100;
+    });
+    const int id = tracker.addIdleTrimCallback([&]() { queue_trimmed = true; });
+
+    ASSERT_TRUE(tracker.reserve(100));
+    EXPECT_TRUE(queue_trimmed);
+    ASSERT_EQ(2u, pool_requests.size());
+    EXPECT_EQ(50u, pool_requests[0]);
+    EXPECT_EQ(50u, pool_requests[1]);
+    tracker.cancel(100);
+
+    tracker.removeIdleTrimCallback(id);
+}
+
+TEST_F(MemoryTrackerTest, PoolTrimIsEnough)
+{
+    MemoryTracker& tracker = MemoryTracker::getInstance();
+    commit(1, 100);
+    tracker.setBudget(150, 0);
+
+    tracker.setTrimCallback([&](size_t bytes) -> size_t {
+        tracker.remove(1);
+        return bytes;
+    });
+    bool queue_trimmed = false;
+    const int id = tracker.addIdleTrimCallback([&]() { queue_trimmed = true; });
+
+    ASSERT_TRUE(tracker.reserve(100));
+    EXPECT_FALSE(queue_trimmed);
+    tracker.cancel(100);
+
+    tracker.removeIdleTrimCallback(id);
+}
+
+}  // namespace
@@ -0,0 +1,203 @@
+// Device test of the release fences which DisplayBufferQueue hands back to
+// the producer, the consumer side signals them with sw_sync timelines.
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include <android/sync.h>
+#include <sw_sync.h>
+#include <utils/Timers.h>
+
+#include "../queue.h"
+
+namespace {
+
+class DisplayBufferQueueTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        m_timeline = sw_sync_timeline_create();
+        if (m_timeline < 0)
+        {
+            GTEST_SKIP() << "sw_sync is not available";
+        }
+
+        m_queue = new DisplayBufferQueue(DisplayBufferQueue::QUEUE_TYPE_BLT, 0,
+                                         DisplayBufferQueue::MIN_BUFFER_SLOTS);
+        setDequeueBlock(false);
+    }
+
+    void TearDown() override
+    {
+        m_queue = nullptr;
+        if (m_timeline >= 0)
+        {
+            close(m_timeline);
+        }
+    }
+
+    void setDequeueBlock(bool block)
+    {
+        DisplayBufferQueue::BufferParam param;
+        param.disp_id = 0;
+        param.width = 64;
+        param.height = 64;
+        param.format = HAL_PIXEL_FORMAT_RGBA_8888;
+        param.size = 64 * 64 * 4;
+        param.dequeue_block = block;
+        m_queue->setBufferParam(param);
+    }
+
+    // queueAll() fills every slot, so a dequeue only gets a slot which the consumer releases
+    void queueAll()
+    {
+        for (int i = 0; i < DisplayBufferQueue::MIN_BUFFER_SLOTS; i++)
+        {
+            DisplayBufferQueue::DisplayBuffer buffer;
+            ASSERT_EQ(NO_ERROR, m_queue->dequeueBuffer(&buffer, true));
+            ASSERT_EQ(NO_ERROR, m_queue->queueBuffer(&buffer));
+        }
+    }
+
+    // releaseOne() acquires the oldest buffer and releases it with a fence
+    // which signals at the next timeline step
+    void releaseOne()
+    {
+        DisplayBufferQueue::DisplayBuffer buffer;
+        ASSERT_EQ(NO_ERROR, m_queue->acquireBuffer(&buffer, true));
+        m_fence_value++;
+        const int fence = sw_sync_fence_create(m_timeline, "hwc_queue_test", m_fence_value);
+        ASSERT_GE(fence, 0);
+        ASSERT_EQ(NO_ERROR, m_queue->releaseBuffer(buffer.index, fence));
+    }
+
+    int m_timeline = -1;
+    unsigned int m_fence_value = 0;
+    sp<DisplayBufferQueue> m_queue;
+};
+
+TEST_F(DisplayBufferQueueTest, AsyncDequeueForwardsPendingReleaseFence)
+{
+    queueAll();
+    releaseOne();
+
+    DisplayBufferQueue::DisplayBuffer buffer;
+    ASSERT_EQ(NO_ERROR, m_queue->dequeueBuffer(&buffer, true));
+    ASSERT_GE(buffer.release_fence, 0);
+    EXPECT_EQ(-1, sync_wait(buffer.release_fence, 0));
+    EXPECT_EQ(ETIME, errno);
+
+    sw_sync_timeline_inc(m_timeline, 1);
+    EXPECT_EQ(0, sync_wait(buffer.release_fence, 0));
+    close(buffer.release_fence);
+    EXPECT_EQ(NO_ERROR, m_queue->cancelBuffer(buffer.index));
+}
+
+TEST_F(DisplayBufferQueueTest, AsyncDequeueDropsSignaledReleaseFence)
+{
+    queueAll();
+    releaseOne();
+    sw_sync_timeline_inc(m_timeline, 1);
+
+    DisplayBufferQueue::DisplayBuffer buffer;
+    ASSERT_EQ(NO_ERROR, m_queue->dequeueBuffer(&buffer, true));
+    EXPECT_EQ(-1, buffer.release_fence);
+    EXPECT_EQ(NO_ERROR, m_queue->cancelBuffer(buffer.index));
+}
+
+TEST_F(DisplayBufferQueueTest, SyncDequeueWaitsForReleaseFence)
+{
+    queueAll();
+    releaseOne();
+
+    std::thread consumer([this]() {
+        usleep(50 * 1000);
+        sw_sync_timeline_inc(m_timeline, 1);
+    });
+
+    const nsecs_t start = systemTime();
+    DisplayBufferQueue::DisplayBuffer buffer;
+    ASSERT_EQ(NO_ERROR, m_queue->dequeueBuffer(&buffer, false));
+    EXPECT_GE(systemTime() - start, ms2ns(40));
+    EXPECT_EQ(-1, buffer.release_fence);
+    consumer.join();
+    EXPECT_EQ(NO_ERROR, m_queue->cancelBuffer(buffer.index));
+}
+
+TEST_F(DisplayBufferQueueTest, NonBlockingDequeueFailsWithoutFreeSlot)
+{
+    queueAll();
+
+    DisplayBufferQueue::DisplayBuffer buffer;
+    EXPECT_EQ(-EBUSY, m_queue->dequeueBuffer(&buffer, true));
+}
+
+TEST_F(DisplayBufferQueueTest, BlockingDequeueWaitsForReleasedSlot)
+{
+    queueAll();
+    setDequeueBlock(true);
+
+    std::thread consumer([this]() {
+        usleep(50 * 1000);
+        releaseOne();
+    });
+
+    DisplayBufferQueue::DisplayBuffer buffer;
+    EXPECT_EQ(NO_ERROR, m_queue->dequeueBuffer(&buffer, true));
+    consumer.join();
+    if (buffer.release_fence >= 0)
+    {
+        close(buffer.release_fence);
+    }
+    EXPECT_EQ(NO_ERROR, m_queue->cancelBuffer(buffer.index));
+}
+
+TEST_F(DisplayBufferQueueTest, BlockingDequeueTimesOut)
+{
+    queueAll();
+    setDequeueBlock(true);
+
+    const nsecs_t start = systemTime();
+    DisplayBufferQueue::DisplayBuffer buffer;
+    EXPECT_EQ(-EBUSY, m_queue->dequeueBuffer(&buffer, true));
+    EXPECT_GE(systemTime() - start, ms2ns(900));
+}
+
+TEST_F(DisplayBufferQueueTest, PooledBufferKeepsReleaseFence)
+{
+    queueAll();
+    releaseOne();
+
+    // the buffers of the destroyed queue go to DisplayBufferPool, the next queue
+    // with the same parameters takes them with their release fences
+    m_queue = new DisplayBufferQueue(DisplayBufferQueue::QUEUE_TYPE_BLT, 1,
+                                     DisplayBufferQueue::MIN_BUFFER_SLOTS);
+    setDequeueBlock(false);
+
+    int pending = 0;
+    DisplayBufferQueue::DisplayBuffer buffers[DisplayBufferQueue::MIN_BUFFER_SLOTS];
+    for (auto& buffer : buffers)
+    {
+        ASSERT_EQ(NO_ERROR, m_queue->dequeueBuffer(&buffer, true));
+        if (buffer.release_fence >= 0)
+        {
+            EXPECT_EQ(-1, sync_wait(buffer.release_fence, 0));
+            close(buffer.release_fence);
+            pending++;
+        }
+    }
+    EXPECT_EQ(1, pending);
+
+    sw_sync_timeline_inc(m_timeline, 1);
+    for (auto& buffer : buffers)
+    {
+        EXPECT_EQ(NO_ERROR, m_queue->cancelBuffer(buffer.index));
+    }
+}
+
+}  // namespace
@@ -0,0 +1,369 @@
+#define DEBUG_LOG_TAG "HostGralloc"
+
+// GrallocDevice and gralloc_extra of the host replay (MTK_HWC_USE_STUB_DEVICE).
+// A buffer is a native_handle with one fd on /dev/null, so the fd can be
+// dup()'ed and closed like an ion fd, and the ints below describe it. Nothing
+// is ever mapped, HWC only reads the handle info.
+
+#include "grallocdev.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <mutex>
+
+#include <cutils/native_handle.h>
+#include <ui/gralloc_extra.h>
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+#define HOST_BUFFER_MAGIC 0x48574342
+#define HOST_BUFFER_STRIDE_ALIGN 16
+
+enum
+{
+    HOST_BUFFER_MAGIC_IDX = 0,
+    HOST_BUFFER_WIDTH,
+    HOST_BUFFER_HEIGHT,
+    HOST_BUFFER_STRIDE,
+    HOST_BUFFER_VSTRIDE,
+    HOST_BUFFER_FORMAT,
+    HOST_BUFFER_USAGE_LO,
+    HOST_BUFFER_USAGE_HI,
+    HOST_BUFFER_SIZE,
+    HOST_BUFFER_ID_LO,
+    HOST_BUFFER_ID_HI,
+    HOST_BUFFER_INT_NUM,
+};
+
+namespace {
+
+// the extra info which HWC writes back with gralloc_extra_perform()
+struct HostBufferExtra
+{
+    gralloc_extra_ion_sf_info_t sf_info;
+    gralloc_extra_ion_hwc_info_t hwc_info;
+    SECHAND sec_handle;
+};
+
+std::mutex g_extra_lock;
+std::map<buffer_handle_t, HostBufferExtra> g_extras;
+uint64_t g_next_alloc_id = 1;
+
+const int* getHostInts(buffer_handle_t handle)
+{
+    if (handle == nullptr || handle->numFds != 1 || handle->numInts != HOST_BUFFER_INT_NUM ||
+        handle->data[handle->numFds + HOST_BUFFER_MAGIC_IDX] != HOST_BUFFER_MAGIC)
+    {
+        return nullptr;
+    }
+    return &handle->data[handle->numFds];
+}
+
+uint64_t getTrackerId(buffer_handle_t handle)
+{
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(handle));
+}
+
+} // namespace
+
+GrallocDevice& GrallocDevice::getInstance()
+{
+    static GrallocDevice gInstance;
+    return gInstance;
+}
+
+GrallocDevice::GrallocDevice()
+{
+}
+
+GrallocDevice::~GrallocDevice()
+{
+    for (auto& buf : m_buffers)
+    {
+        native_handle_t* handle = const_cast<native_handle_t*>(buf.first);
+        native_handle_close(handle);
+        native_handle_delete(handle);
+    }
+    m_buffers.clear();
+}
+
+status_t GrallocDevice::alloc(AllocParam& param)
+{
+    const unsigned int stride = ALIGN_CEIL(param.width, HOST_BUFFER_STRIDE_ALIGN);
+    const size_t bpp = getBitsPerPixel(param.format);
+    const size_t reserved = static_cast<size_t>(param.width) * param.height * bpp / 8;
+    if (!MemoryTracker::getInstance().reserve(reserved))
+    {
+        HWC_LOGE("%s: over the memory budget (%u x %u) format %d owner %d", __func__,
+                 param.width, param.height, param.format, param.owner);
+        return NO_MEMORY;
+    }
+
+    native_handle_t* handle = native_handle_create(1, HOST_BUFFER_INT_NUM);
+    const int fd = handle ? open("/dev/null", O_RDONLY | O_CLOEXEC) : -1;
+    if (fd < 0)
+    {
+        if (handle)
+        {
+            native_handle_delete(handle);
+        }
+        MemoryTracker::getInstance().cancel(reserved);
+        HWC_LOGE("%s: Failed to allocate (%u x %u) format %d", __func__,
+                 param.width, param.height, param.format);
+        return NO_MEMORY;
+    }
+
+    const size_t bytes = static_cast<size_t>(stride) * param.height * bpp / 8;
+    uint64_t alloc_id = 0;
+    {
+        std::lock_guard<std::mutex> lock(g_extra_lock);
+        alloc_id = g_next_alloc_id++;
+        HostBufferExtra extra;
+        memset(&extra, 0, sizeof(extra));
+        g_extras[handle] = extra;
+    }
+
+    handle->data[0] = fd;
+    int* ints = &handle->data[1];
+    ints[HOST_BUFFER_MAGIC_IDX] = HOST_BUFFER_MAGIC;
+    ints[HOST_BUFFER_WIDTH] = static_cast<int>(param.width);
+    ints[HOST_BUFFER_HEIGHT] = static_cast<int>(param.height);
+    ints[HOST_BUFFER_STRIDE] = static_cast<int>(stride);
+    ints[HOST_BUFFER_VSTRIDE] = static_cast<int>(param.height);
+    ints[HOST_BUFFER_FORMAT] = static_cast<int>(param.format);
+    ints[HOST_BUFFER_USAGE_LO] = static_cast<int>(param.usage & 0xffffffff);
+    ints[HOST_BUFFER_USAGE_HI] = static_cast<int>(param.usage >> 32);
+    ints[HOST_BUFFER_SIZE] = static_cast<int>(bytes);
+    ints[HOST_BUFFER_ID_LO] = static_cast<int>(alloc_id & 0xffffffff);
+    ints[HOST_BUFFER_ID_HI] = static_cast<int>(alloc_id >> 32);
+
+    MemoryTracker::getInstance().commit(reserved, getTrackerId(handle), param.owner, param.disp_id,
+                                        bytes);
+
+    AutoMutex l(m_buffers_mutex);
+    m_buffers[handle] = nullptr;
+    param.handle = handle;
+    param.stride = static_cast<int>(stride);
+    HWC_LOGV("%s: add hnd(%p) id:%" PRIu64, __func__, handle, alloc_id);
+    return NO_ERROR;
+}
+
+status_t GrallocDevice::free(buffer_handle_t handle)
+{
+    AutoMutex l(m_buffers_mutex);
+    if (m_buffers.find(handle) == m_buffers.end())
+    {
+        HWC_LOGE("Failed to free buffer handle(%p): can't find handle in table", handle);
+        return INVALID_OPERATION;
+    }
+
+    m_buffers.erase(handle);
+    MemoryTracker::getInstance().remove(getTrackerId(handle));
+    {
+        std::lock_guard<std::mutex> lock(g_extra_lock);
+        g_extras.erase(handle);
+    }
+
+    native_handle_t* hnd = const_cast<native_handle_t*>(handle);
+    native_handle_close(hnd);
+    native_handle_delete(hnd);
+    return NO_ERROR;
+}
+
+void GrallocDevice::setOwner(buffer_handle_t handle, MemoryTracker::Owner owner, int disp_id)
+{
+    MemoryTracker::getInstance().setOwner(getTrackerId(handle), owner, disp_id);
+}
+
+void GrallocDevice::dump() const
+{
+    AutoMutex l(m_buffers_mutex);
+    HWC_LOGD("%s: %zu host buffers", __func__, m_buffers.size());
+}
+
+int gralloc_extra_query(buffer_handle_t handle, GRALLOC_EXTRA_ATTRIBUTE_QUERY attribute,
+                        void* out_pointer)
+{
+    const int* ints = getHostInts(handle);
+    if (ints == nullptr || out_pointer == nullptr)
+    {
+        return -EINVAL;
+    }
+
+    switch (attribute)
+    {
+        case GRALLOC_EXTRA_GET_WIDTH:
+        case GRALLOC_EXTRA_GET_BYTE_2ND_STRIDE:
+            *static_cast<unsigned int*>(out_pointer) = static_cast<unsigned int>(
+                    attribute == GRALLOC_EXTRA_GET_WIDTH ? ints[HOST_BUFFER_WIDTH] : ints[HOST_BUFFER_STRIDE]);
+            break;
+
+        case GRALLOC_EXTRA_GET_HEIGHT:
+            *static_cast<unsigned int*>(out_pointer) = static_cast<unsigned int>(ints[HOST_BUFFER_HEIGHT]);
+            break;
+
+        case GRALLOC_EXTRA_GET_STRIDE:
+            *static_cast<unsigned int*>(out_pointer) = static_cast<unsigned int>(ints[HOST_BUFFER_STRIDE]);
+            break;
+
+        case GRALLOC_EXTRA_GET_VERTICAL_STRIDE:
+        case GRALLOC_EXTRA_GET_VERTICAL_2ND_STRIDE:
+            *static_cast<unsigned int*>(out_pointer) = static_cast<unsigned int>(ints[HOST_BUFFER_VSTRIDE]);
+            break;
+
+        case GRALLOC_EXTRA_GET_FORMAT:
+            *static_cast<unsigned int*>(out_pointer) = static_cast<unsigned int>(ints[HOST_BUFFER_FORMAT]);
+            break;
+
+        case GRALLOC_EXTRA_GET_ALLOC_SIZE:
+            *static_cast<int*>(out_pointer) = ints[HOST_BUFFER_SIZE];
+            break;
+
+        case GRALLOC_EXTRA_GET_USAGE:
+            // gralloc_extra only gives the low 32 bits of the usage
+            *static_cast<int*>(out_pointer) = ints[HOST_BUFFER_USAGE_LO];
+            break;
+
+        case GRALLOC_EXTRA_GET_ID:
+            *static_cast<uint64_t*>(out_pointer) =
+                    (static_cast<uint64_t>(static_cast<uint32_t>(ints[HOST_BUFFER_ID_HI])) << 32) |
+                    static_cast<uint32_t>(ints[HOST_BUFFER_ID_LO]);
+            break;
+
+        case GRALLOC_EXTRA_GET_ION_FD:
+            *static_cast<int*>(out_pointer) = handle->data[0];
+            break;
+
+        case GRALLOC_EXTRA_GET_META_DMA_FD:
+            *static_cast<int*>(out_pointer) = -1;
+            break;
+
+        case GRALLOC_EXTRA_GET_ORIENTATION:
+            *static_cast<uint32_t*>(out_pointer) = 0;
+            break;
+
+        case GRALLOC_EXTRA_GET_SECURE_HANDLE:
+        case GRALLOC_EXTRA_GET_SECURE_HANDLE_HWC:
+        {
+            std::lock_guard<std::mutex> lock(g_extra_lock);
+            *static_cast<SECHAND*>(out_pointer) = g_extras[handle].sec_handle;
+            break;
+        }
+
+        case GRALLOC_EXTRA_GET_IOCTL_ION_SF_INFO:
+        {
+            std::lock_guard<std::mutex> lock(g_extra_lock);
+            *static_cast<gralloc_extra_ion_sf_info_t*>(out_pointer) = g_extras[handle].sf_info;
+            break;
+        }
+
+        case GRALLOC_EXTRA_GET_HWC_INFO:
+        {
+            std::lock_guard<std::mutex> lock(g_extra_lock);
+            *static_cast<gralloc_extra_ion_hwc_info_t*>(out_pointer) = g_extras[handle].hwc_info;
+            break;
+        }
+
+        case GRALLOC_EXTRA_GET_PQ_MIRA_VISION_INFO:
+            memset(out_pointer, 0, sizeof(ge_pq_mira_vision_info_t));
+            break;
+
+        case GRALLOC_EXTRA_GET_AI_PQ_INFO:
+            memset(out_pointer, 0, sizeof(ge_ai_pq_info_t));
+            break;
+
+        case GRALLOC_EXTRA_GET_NN_MODEL_INFO:
+            memset(out_pointer, 0, sizeof(ge_nn_model_info_t));
+            break;
+
+        case GRALLOC_EXTRA_GET_FRAME_NUMBER_INFO:
+            memset(out_pointer, 0, sizeof(ge_frame_number_info_t));
+            break;
+
+        case GRALLOC_EXTRA_GET_PQ_SCLTM_INFO:
+            memset(out_pointer, 0, sizeof(ge_pq_scltm_info_t));
+            break;
+
+        case GRALLOC_EXTRA_GET_FBT_CACHE_INFO:
+            memset(out_pointer, 0, sizeof(ge_fbt_cache_info_t));
+            break;
+
+        case GRALLOC_EXTRA_GET_HDR_INFO:
+            memset(out_pointer, 0, sizeof(ge_hdr_info_t));
+            break;
+
+        case GRALLOC_EXTRA_GET_HDR10P_INFO:
+            memset(out_pointer, 0, sizeof(ge_hdr10p_dynamic_metadata_t));
+            break;
+
+        case GRALLOC_EXTRA_GET_META_DMA_LAYOUT:
+        {
+            gralloc_meta_dma_layout_t* layout = static_cast<gralloc_meta_dma_layout_t*>(out_pointer);
+            memset(layout, 0, sizeof(*layout));
+            layout->block[GRALLOC_META_DMA_BLOCK_DV].offset = -1;
+            break;
+        }
+
+        case GRALLOC_EXTRA_GET_IOCTL_ION_DEBUG:
+        {
+            gralloc_extra_ion_debug_t* info = static_cast<gralloc_extra_ion_debug_t*>(out_pointer);
+            memset(info, 0, sizeof(*info));
+            snprintf(info->name, sizeof(info->name), "host-%d", ints[HOST_BUFFER_ID_LO]);
+            break;
+        }
+
+        default:
+            // e.g. GRALLOC_EXTRA_GET_FB_MVA, the caller falls back to the ion fd
+            return -ENOSYS;
+    }
+
+    return GRALLOC_EXTRA_OK;
+}
+
+int gralloc_extra_perform(buffer_handle_t handle, GRALLOC_EXTRA_ATTRIBUTE_PERFORM attribute,
+                          void* in_pointer)
+{
+    if (getHostInts(handle) == nullptr)
+    {
+        return -EINVAL;
+    }
+
+    std::lock_guard<std::mutex> lock(g_extra_lock);
+    HostBufferExtra& extra = g_extras[handle];
+    switch (attribute)
+    {
+        case GRALLOC_EXTRA_SET_IOCTL_ION_SF_INFO:
+            extra.sf_info = *static_cast<gralloc_extra_ion_sf_info_t*>(in_pointer);
+            break;
+
+        case GRALLOC_EXTRA_SET_HWC_INFO:
+            extra.hwc_info = *static_cast<gralloc_extra_ion_hwc_info_t*>(in_pointer);
+            break;
+
+        case GRALLOC_EXTRA_ALLOC_SECURE_BUFFER_HWC:
+            // a non-zero handle is all the secure path checks
+            extra.sec_handle = static_cast<SECHAND>(handle->data[1 + HOST_BUFFER_ID_LO]);
+            break;
+
+        case GRALLOC_EXTRA_FREE_SEC_BUFFER_HWC:
+            extra.sec_handle = 0;
+            break;
+
+        default:
+            return -ENOSYS;
+    }
+
+    return GRALLOC_EXTRA_OK;
+}
+
+int gralloc_extra_sf_set_status(gralloc_extra_ion_sf_info_t* sf_info, int mask, int value)
+{
+    sf_info->status = static_cast<decltype(sf_info->status)>(
+            (static_cast<unsigned int>(sf_info->status) & ~static_cast<unsigned int>(mask)) |
+            (static_cast<unsigned int>(value) & static_cast<unsigned int>(mask)));
+    return GRALLOC_EXTRA_OK;
+}
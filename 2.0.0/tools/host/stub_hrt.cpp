@@ -0,0 +1,91 @@
+#define DEBUG_LOG_TAG "StubHRT"
+
+#include "stub_hrt.h"
+
+#include "hwc2.h"
+#include "overlay.h"
+#include "utils/debug.h"
+
+void StubHrt::fillLayerConfigList()
+{
+    for (uint64_t disp_id : m_disp_id_list)
+    {
+        HWCDisplay* display = m_displays[disp_id].get();
+        if (CC_UNLIKELY(display == nullptr))
+        {
+            HWC_LOGE("%s(): Failed to get display %" PRIu64, __FUNCTION__, disp_id);
+            HWC_ASSERT(0);
+            continue;
+        }
+
+        m_layer_config_list[disp_id].clear();
+        if (!display->isConnected())
+            continue;
+
+        const std::vector<sp<HWCLayer> >& layers = display->getVisibleLayersSortedByZ();
+        m_layer_config_list[disp_id].reserve(layers.size());
+        for (auto& layer : layers)
+        {
+            const PrivateHandle& priv_handle = layer->getPrivateHandle();
+
+            StubHrtLayer config;
+            config.frame = layer->getDisplayFrame();
+            config.format = priv_handle.format;
+            config.type = layer->getHwlayerType();
+            config.usage = priv_handle.usage;
+            m_layer_config_list[disp_id].push_back(config);
+        }
+    }
+}
+
+void StubHrt::fillDispLayer()
+{
+    for (uint64_t disp_id : m_disp_id_list)
+    {
+        HWCDisplay* display = m_displays[disp_id].get();
+        if (CC_UNLIKELY(display == nullptr))
+        {
+            HWC_LOGE("%s(): Failed to get display %" PRIu64, __FUNCTION__, disp_id);
+            HWC_ASSERT(0);
+            continue;
+        }
+
+        int32_t gles_head = -1, gles_tail = -1;
+        display->getGlesRange(&gles_head, &gles_tail);
+        m_hwc_gles_head[disp_id] = gles_head;
+        m_hwc_gles_tail[disp_id] = gles_tail;
+    }
+}
+
+bool StubHrt::queryValidLayer()
+{
+    simpleLayeringRule();
+    return true;
+}
+
+void StubHrt::printQueryValidLayerResult()
+{
+    for (uint64_t disp_id : m_disp_id_list)
+    {
+        HWCDisplay* display = m_displays[disp_id].get();
+        if (CC_UNLIKELY(display == nullptr))
+        {
+            HWC_LOGE("%s(): Failed to get display %" PRIu64, __FUNCTION__, disp_id);
+            HWC_ASSERT(0);
+            continue;
+        }
+
+        if (m_layer_config_list[disp_id].empty())
+            continue;
+
+        int32_t gles_head = -1, gles_tail = -1;
+        display->getGlesRange(&gles_head, &gles_tail);
+
+        m_hrt_result[disp_id].str("");
+        m_hrt_result[disp_id] << "[HRT STUB]";
+        m_hrt_result[disp_id] << " layers:" << m_layer_config_list[disp_id].size();
+        m_hrt_result[disp_id] << " hwc_gles:" << m_hwc_gles_head[disp_id] << "," << m_hwc_gles_tail[disp_id];
+        m_hrt_result[disp_id] << " gles:" << gles_head << "," << gles_tail;
+        printLog(m_hrt_result[disp_id].str());
+    }
+}
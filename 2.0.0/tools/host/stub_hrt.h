@@ -0,0 +1,48 @@
+#ifndef HWC_STUB_HRT_H
+#define HWC_STUB_HRT_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "hrt_common.h"
+#include "display.h"
+
+// layer of the stub hrt, the part of drm_mtk_layer_config that HWC fills
+struct StubHrtLayer
+{
+    hwc_rect_t frame;
+    unsigned int format;
+    int32_t type;
+    uint64_t usage;
+};
+
+// StubHrt takes the place of DrmHrt in the host replay (MTK_HWC_USE_STUB_DEVICE).
+// It walks the layers the same way DrmHrt does before the ioctl, and then
+// plays the driver by fitting the layers into the ovl with simpleLayeringRule().
+class StubHrt : public HrtCommon
+{
+public:
+    StubHrt()
+    {
+        memset(m_hwc_gles_head, -1, sizeof(m_hwc_gles_head));
+        memset(m_hwc_gles_tail, -1, sizeof(m_hwc_gles_tail));
+    }
+    ~StubHrt() {}
+
+    bool isEnabled() const { return true; }
+
+    void printQueryValidLayerResult();
+
+    void fillLayerConfigList();
+
+    void fillDispLayer();
+
+    bool queryValidLayer();
+
+private:
+    std::vector<StubHrtLayer> m_layer_config_list[DisplayManager::MAX_DISPLAYS];
+    int m_hwc_gles_head[DisplayManager::MAX_DISPLAYS];
+    int m_hwc_gles_tail[DisplayManager::MAX_DISPLAYS];
+};
+
+#endif
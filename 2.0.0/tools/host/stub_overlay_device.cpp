@@ -0,0 +1,252 @@
+#define DEBUG_LOG_TAG "StubDev"
+
+#include "stub_overlay_device.h"
+
+#include <chrono>
+#include <thread>
+
+#include <utils/Timers.h>
+
+#include "overlay.h"
+#include "utils/debug.h"
+
+#define STUB_CRTC_ID 1
+#define STUB_CONNECTOR_ID 2
+
+StubPanelConfig StubOverlayDevice::s_panel;
+
+StubOverlayDevice& StubOverlayDevice::getInstance()
+{
+    static StubOverlayDevice gInstance;
+    return gInstance;
+}
+
+StubOverlayDevice::StubOverlayDevice()
+    : m_vsync_base(systemTime(SYSTEM_TIME_MONOTONIC))
+    , m_commit_count(0)
+{
+    for (size_t i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
+    {
+        m_fence_index[i] = 0;
+    }
+}
+
+void StubOverlayDevice::setPanelConfig(const StubPanelConfig& config)
+{
+    s_panel = config;
+    if (s_panel.fps == 0)
+    {
+        s_panel.fps = 60;
+    }
+}
+
+unsigned int StubOverlayDevice::getHwVersion()
+{
+    return s_panel.platform;
+}
+
+uint64_t StubOverlayDevice::getCommitCount() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_commit_count;
+}
+
+nsecs_t StubOverlayDevice::getPeriod() const
+{
+    return static_cast<nsecs_t>(1e9 / s_panel.fps);
+}
+
+bool StubOverlayDevice::isDisplaySupportedWidthAndHeight(unsigned int width, unsigned int height)
+{
+    return width <= getMaxOverlayWidth() && height <= getMaxOverlayHeight();
+}
+
+unsigned int StubOverlayDevice::getMaxOverlayInputNum()
+{
+    return s_panel.max_layers;
+}
+
+uint32_t StubOverlayDevice::getMaxOverlayHeight()
+{
+    return s_panel.height > s_panel.width ? s_panel.height : s_panel.width;
+}
+
+uint32_t StubOverlayDevice::getMaxOverlayWidth()
+{
+    return getMaxOverlayHeight();
+}
+
+status_t StubOverlayDevice::createOverlaySession(
+    uint64_t dpy, uint32_t /*drm_id_crtc*/, uint32_t /*width*/, uint32_t /*height*/,
+    HWC_DISP_MODE /*mode*/)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+    return NO_ERROR;
+}
+
+void StubOverlayDevice::destroyOverlaySession(uint64_t dpy, uint32_t /*drm_id_crtc*/)
+{
+    CHECK_DPY_RET_VOID(dpy);
+}
+
+status_t StubOverlayDevice::triggerOverlaySession(uint64_t dpy, uint32_t /*drm_id_crtc*/,
+    int /*present_fence_idx*/, int /*ovlp_layer_num*/, int /*prev_present_fence_fd*/,
+    hwc2_config_t /*config*/, const uint32_t& /*hrt_weight*/, const uint32_t& /*hrt_idx*/,
+    unsigned int /*num*/, OverlayPortParam* const* /*params*/,
+    sp<ColorTransform> /*color_transform*/, TriggerOverlayParam /*trigger_param*/)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_commit_count++;
+    return NO_ERROR;
+}
+
+void StubOverlayDevice::disableOverlaySession(uint64_t dpy, uint32_t /*drm_id_crtc*/,
+                                              OverlayPortParam* const* /*params*/,
+                                              unsigned int /*num*/)
+{
+    CHECK_DPY_RET_VOID(dpy);
+}
+
+status_t StubOverlayDevice::setOverlaySessionMode(uint64_t dpy, HWC_DISP_MODE /*mode*/)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+    return NO_ERROR;
+}
+
+HWC_DISP_MODE StubOverlayDevice::getOverlaySessionMode(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/)
+{
+    return HWC_DISP_SESSION_DIRECT_LINK_MODE;
+}
+
+status_t StubOverlayDevice::getOverlaySessionInfo(uint64_t dpy, uint32_t /*drm_id_crtc*/,
+                                                  SessionInfo* info)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    info->maxLayerNum = s_panel.max_layers;
+    info->isHwVsyncAvailable = 1;
+    info->displayType = HWC_DISP_IF_TYPE_DSI0;
+    info->displayWidth = s_panel.width;
+    info->displayHeight = s_panel.height;
+    info->displayFormat = 2;
+    info->displayMode = HWC_DISP_IF_MODE_VIDEO;
+    info->vsyncFPS = s_panel.fps * 100;
+    info->physicalWidth = s_panel.width;
+    info->physicalHeight = s_panel.height;
+    info->physicalWidthUm = 0;
+    info->physicalHeightUm = 0;
+    info->density = 0;
+    info->isConnected = 1;
+    info->isHDCPSupported = 0;
+    return NO_ERROR;
+}
+
+unsigned int StubOverlayDevice::getAvailableOverlayInput(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/)
+{
+    return s_panel.max_layers;
+}
+
+void StubOverlayDevice::prepareOverlayInput(uint64_t dpy, OverlayPrepareParam* param)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    param->fence_index = ++m_fence_index[dpy];
+    param->fence_fd = -1;
+}
+
+void StubOverlayDevice::prepareOverlayOutput(uint64_t dpy, OverlayPrepareParam* param)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    param->fence_index = ++m_fence_index[dpy];
+    param->fence_fd = -1;
+    param->if_fence_index = 0;
+    param->if_fence_fd = -1;
+}
+
+void StubOverlayDevice::prepareOverlayPresentFence(uint64_t dpy, OverlayPrepareParam* param)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    param->fence_index = ++m_fence_index[dpy];
+    param->fence_fd = -1;
+}
+
+status_t StubOverlayDevice::waitVSync(uint64_t dpy, uint32_t /*drm_id_crtc*/, nsecs_t* ts)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    const nsecs_t period = getPeriod();
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    const nsecs_t next = now + period - (now - m_vsync_base) % period;
+    std::this_thread::sleep_for(std::chrono::nanoseconds(next - now));
+
+    *ts = next;
+    return NO_ERROR;
+}
+
+status_t StubOverlayDevice::waitRefreshRequest(unsigned int* type)
+{
+    *type = HWC_WAIT_FOR_REFRESH;
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_refresh_cond.wait_for(lock, std::chrono::seconds(1));
+    return TIMED_OUT;
+}
+
+int32_t StubOverlayDevice::getWidth(uint64_t /*dpy*/, uint32_t /*drm_id_connector*/,
+                                    hwc2_config_t /*config*/)
+{
+    return static_cast<int32_t>(s_panel.width);
+}
+
+int32_t StubOverlayDevice::getHeight(uint64_t /*dpy*/, uint32_t /*drm_id_connector*/,
+                                     hwc2_config_t /*config*/)
+{
+    return static_cast<int32_t>(s_panel.height);
+}
+
+int32_t StubOverlayDevice::getRefresh(uint64_t /*dpy*/, uint32_t /*drm_id_connector*/,
+                                      hwc2_config_t /*config*/)
+{
+    return static_cast<int32_t>(s_panel.fps);
+}
+
+int32_t StubOverlayDevice::getCurrentRefresh(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/)
+{
+    return static_cast<int32_t>(s_panel.fps);
+}
+
+void StubOverlayDevice::dump(const uint64_t& dpy, String8* dump_str)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    dump_str->appendFormat("----------STUBDEV----------\n");
+    dump_str->appendFormat("panel %ux%u@%u layers:%u commits:%" PRIu64 "\n",
+            s_panel.width, s_panel.height, s_panel.fps, s_panel.max_layers, getCommitCount());
+}
+
+void StubOverlayDevice::getCreateDisplayInfos(std::vector<CreateDisplayInfo>& create_display_infos)
+{
+    CreateDisplayInfo info;
+    info.is_internal = true;
+    info.disp_type = HWC2_DISPLAY_TYPE_PHYSICAL;
+    info.drm_id_crtc_default = STUB_CRTC_ID;
+    info.drm_id_connector = STUB_CONNECTOR_ID;
+    info.drm_id_crtc_pipe = HWC_DISPLAY_PRIMARY;
+
+    create_display_infos.clear();
+    create_display_infos.push_back(info);
+}
+
+int32_t StubOverlayDevice::getKernelLogoSize(int32_t* width, int32_t* height)
+{
+    *width = static_cast<int32_t>(s_panel.width);
+    *height = static_cast<int32_t>(s_panel.height);
+    return 0;
+}
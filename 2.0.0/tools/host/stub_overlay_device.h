@@ -0,0 +1,155 @@
+#ifndef HWC_STUB_OVERLAY_DEVICE_H
+#define HWC_STUB_OVERLAY_DEVICE_H
+
+#include <condition_variable>
+#include <mutex>
+
+#include "dev_interface.h"
+
+// ---------------------------------------------------------------------------
+
+// panel of the stub device, set by the host replay before HWCMediator is created
+struct StubPanelConfig
+{
+    StubPanelConfig()
+        : platform(0x6983)
+        , width(1080)
+        , height(2400)
+        , fps(60)
+        , max_layers(12)
+    { }
+
+    unsigned int platform;
+    unsigned int width;
+    unsigned int height;
+    unsigned int fps;
+    unsigned int max_layers;
+};
+
+// StubOverlayDevice takes the place of DrmDevice in the host replay
+// (MTK_HWC_USE_STUB_DEVICE). It reports one internal panel, accepts every
+// commit at once and gives no fences, so only the CPU work of HWC is measured.
+class StubOverlayDevice : public IOverlayDevice
+{
+public:
+    static StubOverlayDevice& getInstance();
+    ~StubOverlayDevice() {}
+
+    static void setPanelConfig(const StubPanelConfig& config);
+
+    static unsigned int getHwVersion();
+
+    uint64_t getCommitCount() const;
+
+    int32_t getType() { return OVL_DEVICE_TYPE_OVL; }
+    void initOverlay() {}
+    bool isDispRszSupported() { return false; }
+    bool isDispRpoSupported() { return false; }
+    bool isDisp3X4DisplayColorTransformSupported() { return true; }
+    bool isDispAodForceDisable() { return true; }
+    bool isPartialUpdateSupported() { return false; }
+    bool isFenceWaitSupported() { return true; }
+    bool isConstantAlphaForRGBASupported() { return true; }
+    bool isDispSelfRefreshSupported() { return false; }
+    bool isDisplayHrtSupport() { return true; }
+    bool isDisplaySupportedWidthAndHeight(unsigned int width, unsigned int height);
+    unsigned int getMaxOverlayInputNum();
+    uint32_t getMaxOverlayHeight();
+    uint32_t getMaxOverlayWidth();
+    int32_t getDisplayOutputRotated() { return 0; }
+    uint32_t getRszMaxWidthInput() { return 0; }
+    uint32_t getRszMaxHeightInput() { return 0; }
+    void enableDisplayFeature(uint32_t /*flag*/) {}
+    void disableDisplayFeature(uint32_t /*flag*/) {}
+
+    status_t createOverlaySession(
+        uint64_t dpy, uint32_t drm_id_crtc, uint32_t width, uint32_t height,
+        HWC_DISP_MODE mode = HWC_DISP_SESSION_DIRECT_LINK_MODE);
+    void destroyOverlaySession(uint64_t dpy, uint32_t drm_id_crtc);
+
+    // counts the commit, the frame is on the panel at once
+    status_t triggerOverlaySession(uint64_t dpy, uint32_t drm_id_crtc, int present_fence_idx,
+                                   int ovlp_layer_num, int prev_present_fence_fd, hwc2_config_t config,
+                                   const uint32_t& hrt_weight, const uint32_t& hrt_idx,
+                                   unsigned int num, OverlayPortParam* const* params,
+                                   sp<ColorTransform> color_transform,
+                                   TriggerOverlayParam trigger_param);
+
+    void disableOverlaySession(uint64_t dpy, uint32_t drm_id_crtc,
+                               OverlayPortParam* const* params, unsigned int num);
+    status_t setOverlaySessionMode(uint64_t dpy, HWC_DISP_MODE mode);
+    HWC_DISP_MODE getOverlaySessionMode(uint64_t dpy, uint32_t drm_id_crtc);
+    status_t getOverlaySessionInfo(uint64_t dpy, uint32_t drm_id_crtc, SessionInfo* info);
+    unsigned int getAvailableOverlayInput(uint64_t dpy, uint32_t drm_id_crtc);
+
+    // the fences of the stub are always -1, only the timeline index moves
+    void prepareOverlayInput(uint64_t dpy, OverlayPrepareParam* param);
+    void updateOverlayInputs(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/,
+                             OverlayPortParam* const* /*params*/, unsigned int /*num*/,
+                             sp<ColorTransform> /*color_transform*/) {}
+    void prepareOverlayOutput(uint64_t dpy, OverlayPrepareParam* param);
+    void disableOverlayOutput(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/) {}
+    void enableOverlayOutput(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/, OverlayPortParam* /*param*/) {}
+    void prepareOverlayPresentFence(uint64_t dpy, OverlayPrepareParam* param);
+
+    // sleeps to the next period of the panel
+    status_t waitVSync(uint64_t dpy, uint32_t drm_id_crtc, nsecs_t *ts);
+
+    void setPowerMode(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/, int /*mode*/) {}
+
+    // the proposal of HWC is always valid, see StubHrt
+    bool queryValidLayer(void* /*ptr*/) { return true; }
+
+    status_t waitAllJobDone(const uint64_t /*dpy*/) { return NO_ERROR; }
+    int32_t getSupportedColorMode() { return HAL_COLOR_MODE_NATIVE; }
+
+    // the stub never asks for a refresh, it wakes up once a second to let the thread exit
+    status_t waitRefreshRequest(unsigned int* type);
+
+    int32_t getWidth(uint64_t dpy, uint32_t drm_id_connector, hwc2_config_t config);
+    int32_t getHeight(uint64_t dpy, uint32_t drm_id_connector, hwc2_config_t config);
+    int32_t getRefresh(uint64_t dpy, uint32_t drm_id_connector, hwc2_config_t config);
+    uint32_t getNumConfigs(uint64_t /*dpy*/, uint32_t /*drm_id_connector*/) { return 1; }
+    void dump(const uint64_t& dpy, String8* dump_str);
+    int32_t updateDisplayResolution(uint64_t /*dpy*/) { return 0; }
+    int32_t getCurrentRefresh(uint64_t dpy, uint32_t drm_id_crtc);
+    void submitMML(uint64_t /*dpy*/, struct mml_submit& /*params*/) {}
+    void enableDisplayDriverLog(uint32_t /*param*/) {}
+    void getCreateDisplayInfos(std::vector<CreateDisplayInfo>& create_display_infos);
+    int32_t updateConnectorMode(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/) { return 0; }
+    int32_t getSpportedConnectorMode(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/, uint32_t* /*modeinfo*/)
+    {
+        return -ENODEV;
+    }
+    int32_t getConnectorEDID(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/, uint32_t* /*edid*/)
+    {
+        return -ENODEV;
+    }
+    int32_t setHDMIMode(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/, uint32_t /*mode*/, uint32_t /*value*/)
+    {
+        return -ENODEV;
+    }
+    int32_t getHDMIMode(uint64_t /*dpy*/, uint32_t /*drm_id_crtc*/, uint32_t /*mode*/, uint32_t* /*value*/)
+    {
+        return -ENODEV;
+    }
+    bool getEthdrSupport(uint64_t /*dpy*/) { return false; }
+    int32_t getDolbyInfo() { return 0; }
+    int32_t getKernelLogoSize(int32_t* width, int32_t* height);
+
+private:
+    StubOverlayDevice();
+
+    nsecs_t getPeriod() const;
+
+private:
+    static StubPanelConfig s_panel;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_refresh_cond;
+    nsecs_t m_vsync_base;
+    uint32_t m_fence_index[DisplayManager::MAX_DISPLAYS];
+    uint64_t m_commit_count;
+};
+
+#endif
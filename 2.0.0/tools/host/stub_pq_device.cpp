@@ -0,0 +1,25 @@
+#define DEBUG_LOG_TAG "StubPq"
+
+#include "stub_pq_device.h"
+
+#include "utils/debug.h"
+
+StubPqDevice& StubPqDevice::getInstance()
+{
+    static StubPqDevice gInstance;
+    return gInstance;
+}
+
+StubPqDevice::StubPqDevice()
+{
+    m_use_ioctl = true;
+}
+
+void StubPqDevice::checkAndOpenIoctl()
+{
+}
+
+bool StubPqDevice::setColorTransformViaIoctl(const float* /*matrix*/, const int32_t& /*hint*/)
+{
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef HWC_STUB_PQ_DEVICE_H
+#define HWC_STUB_PQ_DEVICE_H
+
+#include "pq_interface.h"
+
+using namespace android;
+
+// StubPqDevice takes the place of PqDeviceDrm in the host replay
+// (MTK_HWC_USE_STUB_DEVICE), there is no pq node and every matrix is taken
+class StubPqDevice : public IPqDevice
+{
+public:
+    static StubPqDevice& getInstance();
+
+private:
+    StubPqDevice();
+    ~StubPqDevice() {}
+    void checkAndOpenIoctl();
+    bool setColorTransformViaIoctl(const float* matrix, const int32_t& hint);
+};
+
+#endif
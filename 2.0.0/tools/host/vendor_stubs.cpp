@@ -0,0 +1,306 @@
+#define DEBUG_LOG_TAG "HostStub"
+
+// Stand-ins for the vendor libraries which have no host build, for the host
+// replay (MTK_HWC_USE_STUB_DEVICE). The replay only measures the CPU work of
+// HWC, so every blit is refused, logs go nowhere and fences are plain fds.
+// The headers are included first so the definitions keep their linkage.
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <android/sync.h>
+#include <BufferAllocator/BufferAllocator.h>
+#include <composer_ext_intf/device_interface.h>
+#include <DpAsyncBlitStream.h>
+#include <DpAsyncBlitStream2.h>
+#include <ged/ged_log.h>
+#include <libladder.h>
+#include <MMLUtil.h>
+
+// ---------------------------------------------------------------------------
+// libdpframework, MDP is never available so HWC does not plan any MDP layer
+
+DpAsyncBlitStream::DpAsyncBlitStream()
+{
+}
+
+DpAsyncBlitStream::~DpAsyncBlitStream()
+{
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::createJob(uint32_t& jobID, int32_t& fenceFD)
+{
+    jobID = 0;
+    fenceFD = -1;
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::cancelJob(uint32_t /*jobID*/)
+{
+    return DP_STATUS_RETURN_SUCCESS;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::setConfigBegin(uint32_t /*jobID*/, int32_t /*enhancePos*/,
+                                                 int32_t /*enhanceDir*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::setSrcBuffer(int32_t /*fileDesc*/, uint32_t* /*sizeList*/,
+                                               uint32_t /*planeNumber*/, int32_t /*fenceFd*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::setSrcConfig(int32_t /*width*/, int32_t /*height*/,
+                                               int32_t /*yPitch*/, int32_t /*uvPitch*/,
+                                               DpColorFormat /*format*/, DP_PROFILE_ENUM /*profile*/,
+                                               DpInterlaceFormat /*field*/, DpSecure /*secure*/,
+                                               bool /*doFlush*/, uint32_t /*compress*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::setSrcCrop(uint32_t /*portIndex*/, DpRect /*roi*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::setDstBuffer(uint32_t /*portIndex*/, int32_t /*fileDesc*/,
+                                               uint32_t* /*sizeList*/, uint32_t /*planeNumber*/,
+                                               int32_t /*fenceFd*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::setDstConfig(uint32_t /*portIndex*/, int32_t /*width*/,
+                                               int32_t /*height*/, int32_t /*yPitch*/,
+                                               int32_t /*uvPitch*/, DpColorFormat /*format*/,
+                                               DP_PROFILE_ENUM /*profile*/,
+                                               DpInterlaceFormat /*field*/, DpRect* /*pROI*/,
+                                               DpSecure /*secure*/, bool /*doFlush*/,
+                                               uint32_t /*compress*/, int32_t /*vertPitch*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::setOrientation(uint32_t /*portIndex*/, uint32_t /*transform*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::setPQParameter(uint32_t /*portIndex*/,
+                                                 const DpPqParam& /*pqParam*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::setUser(uint32_t /*eID*/)
+{
+    return DP_STATUS_RETURN_SUCCESS;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::setConfigEnd()
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream::invalidate(struct timeval* /*endTime*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+int32_t DpAsyncBlitStream::queryPaddingSide(uint32_t /*transform*/)
+{
+    return 0;
+}
+
+DpAsyncBlitStream2::DpAsyncBlitStream2()
+{
+}
+
+DpAsyncBlitStream2::~DpAsyncBlitStream2()
+{
+}
+
+bool DpAsyncBlitStream2::queryHWSupport(uint32_t /*srcWidth*/, uint32_t /*srcHeight*/,
+                                        uint32_t /*dstWidth*/, uint32_t /*dstHeight*/,
+                                        int32_t /*Orientation*/, DpColorFormat /*srcFormat*/,
+                                        DpColorFormat /*dstFormat*/, DpPqParam* /*PqParam*/,
+                                        DpRect* /*srcCrop*/, uint32_t /*compress*/)
+{
+    return false;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::createJob(uint32_t& jobID, int32_t& fenceFD)
+{
+    jobID = 0;
+    fenceFD = -1;
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::setConfigBegin(uint32_t /*jobID*/, int32_t /*enhancePos*/,
+                                                  int32_t /*enhanceDir*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::setSrcBuffer(int32_t /*fileDesc*/, uint32_t* /*sizeList*/,
+                                                uint32_t /*planeNumber*/, int32_t /*fenceFd*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::setSrcConfig(int32_t /*width*/, int32_t /*height*/,
+                                                int32_t /*yPitch*/, int32_t /*uvPitch*/,
+                                                DpColorFormat /*format*/, DP_PROFILE_ENUM /*profile*/,
+                                                DpInterlaceFormat /*field*/, DpSecure /*secure*/,
+                                                bool /*doFlush*/, uint32_t /*compress*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::setSrcCrop(uint32_t /*portIndex*/, DpRect /*roi*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::setDstBuffer(uint32_t /*portIndex*/, int32_t /*fileDesc*/,
+                                                uint32_t* /*sizeList*/, uint32_t /*planeNumber*/,
+                                                int32_t /*fenceFd*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::setDstConfig(uint32_t /*portIndex*/, int32_t /*width*/,
+                                                int32_t /*height*/, int32_t /*yPitch*/,
+                                                int32_t /*uvPitch*/, DpColorFormat /*format*/,
+                                                DP_PROFILE_ENUM /*profile*/,
+                                                DpInterlaceFormat /*field*/, DpRect* /*pROI*/,
+                                                DpSecure /*secure*/, bool /*doFlush*/,
+                                                uint32_t /*compress*/, int32_t /*vertPitch*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::setOrientation(uint32_t /*portIndex*/, uint32_t /*transform*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::setPQParameter(uint32_t /*portIndex*/,
+                                                  const DpPqParam& /*pqParam*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::setUser(uint32_t /*eID*/)
+{
+    return DP_STATUS_RETURN_SUCCESS;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::setConfigEnd()
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+DP_STATUS_ENUM DpAsyncBlitStream2::invalidate(struct timeval* /*endTime*/)
+{
+    return DP_STATUS_UNKNOWN_ERROR;
+}
+
+// ---------------------------------------------------------------------------
+// libmml
+
+bool queryHWSupport(mml_frame_info* /*info*/)
+{
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// libged, the host has no ged log
+
+GED_LOG_HANDLE ged_log_connect(const char* /*pszName*/)
+{
+    return nullptr;
+}
+
+void ged_log_disconnect(GED_LOG_HANDLE /*hLogHandle*/)
+{
+}
+
+GED_ERROR ged_log_tpt_print(GED_LOG_HANDLE /*hLogHandle*/, const char* /*fmt*/, ...)
+{
+    return GED_OK;
+}
+
+// ---------------------------------------------------------------------------
+// libladder
+
+bool UnwindCurThreadBT(std::string* strBT)
+{
+    if (strBT)
+    {
+        strBT->clear();
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// libdmabufheap, the fake buffers are never ion buffers
+
+bool BufferAllocator::CheckIonSupport()
+{
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// libcomposer_ext, there is no service manager on the host
+
+int ComposerExt::DeviceInterface::registerDevice(ComposerExt::ClientContext* /*context*/)
+{
+    return -ENODEV;
+}
+
+// ---------------------------------------------------------------------------
+// libsync, the fences of the host are ordinary fds
+
+int sync_wait(int fd, int timeout)
+{
+    struct pollfd fds;
+    fds.fd = fd;
+    fds.events = POLLIN;
+    fds.revents = 0;
+
+    int ret = 0;
+    do
+    {
+        ret = poll(&fds, 1, timeout);
+    } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+
+    if (ret == 0)
+    {
+        errno = ETIME;
+        return -1;
+    }
+    return ret > 0 ? 0 : -1;
+}
+
+int sync_merge(const char* /*name*/, int fd1, int fd2)
+{
+    // the host fences are signaled from the start, either one will do
+    return dup(fd1 >= 0 ? fd1 : fd2);
+}
+
+struct sync_file_info* sync_file_info(int32_t /*fd*/)
+{
+    return nullptr;
+}
+
+void sync_file_info_free(struct sync_file_info* /*info*/)
+{
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// Reader of the HWC2 call-stream trace shared by the host decoder and the
+// on-device replay driver. It only depends on libc and the STL.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../hwc_record_format.h"
+
+template <typename T>
+bool readRecordPayload(const std::vector<uint8_t>& payload, T* out, size_t offset = 0)
+{
+    if (payload.size() < offset + sizeof(T))
+    {
+        return false;
+    }
+    memcpy(out, payload.data() + offset, sizeof(T));
+    return true;
+}
+
+// call on_record for every record of the trace at path, returns false if the
+// file is not a trace this reader understands
+inline bool readRecordFile(const std::string& path, HwcRecordFileHeader* file_header,
+        const std::function<void(const HwcRecordHeader&, const std::vector<uint8_t>&)>& on_record)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "failed to open %s\n", path.c_str());
+        return false;
+    }
+
+    if (fread(file_header, sizeof(*file_header), 1, fp) != 1 ||
+        file_header->magic != HWC_RECORD_MAGIC ||
+        file_header->version < HWC_RECORD_MIN_VERSION ||
+        file_header->version > HWC_RECORD_VERSION)
+    {
+        fprintf(stderr, "%s is not a HWC call trace of version %d..%d\n", path.c_str(),
+                HWC_RECORD_MIN_VERSION, HWC_RECORD_VERSION);
+        fclose(fp);
+        return false;
+    }
+    if (file_header->header_size > sizeof(*file_header))
+    {
+        fseek(fp, file_header->header_size - static_cast<long>(sizeof(*file_header)), SEEK_CUR);
+    }
+
+    uint64_t records = 0;
+    HwcRecordHeader header;
+    std::vector<uint8_t> payload;
+    while (fread(&header, sizeof(header), 1, fp) == 1)
+    {
+        payload.resize(header.size);
+        if (header.size > 0 && fread(payload.data(), header.size, 1, fp) != 1)
+        {
+            fprintf(stderr, "%s: truncated record after %" PRIu64 " records\n", path.c_str(), records);
+            break;
+        }
+        records++;
+        on_record(header, payload);
+    }
+
+    fclose(fp);
+    return true;
+}
@@ -0,0 +1,490 @@
+// Host-side replayer of the HWC2 call-stream trace written by HwcCallRecorder.
+//
+// usage: hwc_replay [-v] [-d <display>] <trace> [<trace to compare>]
+//
+// The trace is replayed into a per-display layer stack, every presentDisplay
+// closes one frame. It reports the frame and layer statistics of the stream
+// and the per-stage CPU time of validate, HRT, dispatch, overlay commit and
+// present recorded on the device. With two traces, the stages are printed
+// side by side so a performance change can be bisected between two builds.
+// To run a trace through the composer itself, see hwc_replay_driver.cpp.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hwc_record_reader.h"
+
+namespace {
+
+const char* const g_stage_name[HWC_RECORD_STAGE_NUM] =
+{
+    "validate",
+    "hrt",
+    "dispatch",
+    "ovl_commit",
+    "present",
+};
+
+struct ReplayLayer
+{
+    ReplayLayer()
+        : comp_type(0)
+        , z(0)
+        , alpha(1.0f)
+        , transform(0)
+        , dataspace(0)
+        , blend(0)
+        , visible_rects(0)
+        , damage_rects(0)
+        , brightness(1.0f)
+        , metadata_keys(0)
+        , color_transform(false)
+        , sideband(false)
+        , buffer_changed(false)
+    {
+        memset(&buffer, 0, sizeof(buffer));
+        memset(&frame, 0, sizeof(frame));
+        memset(&crop, 0, sizeof(crop));
+    }
+
+    int32_t comp_type;
+    uint32_t z;
+    float alpha;
+    int32_t transform;
+    int32_t dataspace;
+    int32_t blend;
+    uint32_t visible_rects;
+    uint32_t damage_rects;
+    float brightness;
+    uint32_t metadata_keys;
+    bool color_transform;
+    bool sideband;
+    bool buffer_changed;
+    HwcRecordBuffer buffer;
+    HwcRecordRect frame;
+    HwcRecordFRect crop;
+};
+
+struct StageStat
+{
+    std::vector<int64_t> cpu_ns;
+    std::vector<int64_t> wall_ns;
+};
+
+struct DisplayReplay
+{
+    DisplayReplay()
+        : frames(0)
+        , layer_sum(0)
+        , max_layers(0)
+        , buffer_updates(0)
+        , changed_types(0)
+        , state_calls(0)
+        , client_target_updates(0)
+        , color_transform_calls(0)
+        , cursor_calls(0)
+        , mc_samples(0)
+        , first_present(0)
+        , last_present(0)
+    {
+    }
+
+    std::map<uint64_t, ReplayLayer> layers;
+
+    uint64_t frames;
+    uint64_t layer_sum;
+    size_t max_layers;
+    uint64_t buffer_updates;
+    uint64_t changed_types;
+    uint64_t state_calls;
+    uint64_t client_target_updates;
+    uint64_t color_transform_calls;
+    uint64_t cursor_calls;
+    uint64_t mc_samples;    // scored by hwc_mc_model_test
+    int64_t first_present;
+    int64_t last_present;
+
+    StageStat stage[HWC_RECORD_STAGE_NUM];
+};
+
+struct Replay
+{
+    Replay()
+        : records(0)
+        , unknown_records(0)
+        , verbose(false)
+        , filter_display(-1)
+    {
+    }
+
+    std::string path;
+    uint64_t records;
+    uint64_t unknown_records;
+    bool verbose;
+    int64_t filter_display;
+    std::map<uint32_t, DisplayReplay> displays;
+};
+
+template <typename T>
+bool readPayload(const std::vector<uint8_t>& payload, T* out)
+{
+    return readRecordPayload(payload, out);
+}
+
+uint32_t readRegionRects(const std::vector<uint8_t>& payload)
+{
+    HwcRecordRegion region;
+    if (!readPayload(payload, &region))
+    {
+        return 0;
+    }
+    return region.total_rects;
+}
+
+void closeFrame(Replay* replay, uint32_t display, DisplayReplay* disp, int64_t ts)
+{
+    size_t num_layers = disp->layers.size();
+    disp->frames++;
+    disp->layer_sum += num_layers;
+    disp->max_layers = std::max(disp->max_layers, num_layers);
+    if (disp->first_present == 0)
+    {
+        disp->first_present = ts;
+    }
+    disp->last_present = ts;
+
+    if (replay->verbose)
+    {
+        printf("frame %" PRIu64 " dpy:%u ts:%" PRId64 " layers:%zu\n", disp->frames, display, ts, num_layers);
+    }
+
+    for (auto& it : disp->layers)
+    {
+        ReplayLayer& layer = it.second;
+        if (replay->verbose)
+        {
+            printf("  id:%" PRIu64 " z:%u type:%d buf:%ux%u fmt:%#x%s frame[%d,%d,%d,%d] alpha:%.2f tr:%d vis:%u dmg:%u"
+                   " bright:%.2f meta:%u%s%s\n",
+                   it.first, layer.z, layer.comp_type, layer.buffer.width, layer.buffer.height,
+                   layer.buffer.format, layer.buffer_changed ? "*" : "",
+                   layer.frame.left, layer.frame.top, layer.frame.right, layer.frame.bottom,
+                   static_cast<double>(layer.alpha), layer.transform, layer.visible_rects, layer.damage_rects,
+                   static_cast<double>(layer.brightness), layer.metadata_keys,
+                   layer.color_transform ? " ct" : "", layer.sideband ? " sideband" : "");
+        }
+        layer.buffer_changed = false;
+    }
+}
+
+void applyRecord(Replay* replay, const HwcRecordHeader& header, const std::vector<uint8_t>& payload)
+{
+    replay->records++;
+    if (replay->filter_display >= 0 && header.display != replay->filter_display)
+    {
+        return;
+    }
+
+    DisplayReplay& disp = replay->displays[header.display];
+    if ((header.type >= HWC_RECORD_SET_BUFFER && header.type <= HWC_RECORD_SET_Z_ORDER) ||
+        (header.type >= HWC_RECORD_SET_CURSOR_POSITION && header.type <= HWC_RECORD_SET_COLOR_TRANSFORM))
+    {
+        disp.state_calls++;
+    }
+
+    switch (header.type)
+    {
+        case HWC_RECORD_CREATE_LAYER:
+            disp.layers[header.layer] = ReplayLayer();
+            break;
+
+        case HWC_RECORD_DESTROY_LAYER:
+            disp.layers.erase(header.layer);
+            break;
+
+        case HWC_RECORD_SET_BUFFER:
+        {
+            ReplayLayer& layer = disp.layers[header.layer];
+            if (readPayload(payload, &layer.buffer))
+            {
+                layer.buffer_changed = true;
+                disp.buffer_updates++;
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_DAMAGE:
+            disp.layers[header.layer].damage_rects = readRegionRects(payload);
+            break;
+
+        case HWC_RECORD_SET_VISIBLE_REGION:
+            disp.layers[header.layer].visible_rects = readRegionRects(payload);
+            break;
+
+        case HWC_RECORD_SET_BLEND:
+            readPayload(payload, &disp.layers[header.layer].blend);
+            break;
+
+        case HWC_RECORD_SET_COLOR:
+            break;
+
+        case HWC_RECORD_SET_COMP_TYPE:
+            readPayload(payload, &disp.layers[header.layer].comp_type);
+            break;
+
+        case HWC_RECORD_SET_DATASPACE:
+            readPayload(payload, &disp.layers[header.layer].dataspace);
+            break;
+
+        case HWC_RECORD_SET_DISPLAY_FRAME:
+            readPayload(payload, &disp.layers[header.layer].frame);
+            break;
+
+        case HWC_RECORD_SET_PLANE_ALPHA:
+            readPayload(payload, &disp.layers[header.layer].alpha);
+            break;
+
+        case HWC_RECORD_SET_SOURCE_CROP:
+            readPayload(payload, &disp.layers[header.layer].crop);
+            break;
+
+        case HWC_RECORD_SET_TRANSFORM:
+            readPayload(payload, &disp.layers[header.layer].transform);
+            break;
+
+        case HWC_RECORD_SET_Z_ORDER:
+            readPayload(payload, &disp.layers[header.layer].z);
+            break;
+
+        case HWC_RECORD_ACCEPT_CHANGES:
+            break;
+
+        case HWC_RECORD_SET_CURSOR_POSITION:
+            disp.cursor_calls++;
+            break;
+
+        case HWC_RECORD_SET_SIDEBAND_STREAM:
+            disp.layers[header.layer].sideband = true;
+            break;
+
+        case HWC_RECORD_SET_PER_FRAME_METADATA:
+        case HWC_RECORD_SET_PER_FRAME_METADATA_BLOBS:
+        {
+            HwcRecordMetadata metadata;
+            if (readPayload(payload, &metadata))
+            {
+                disp.layers[header.layer].metadata_keys = metadata.total_keys;
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_LAYER_COLOR_TRANSFORM:
+            disp.layers[header.layer].color_transform = true;
+            break;
+
+        case HWC_RECORD_SET_LAYER_BRIGHTNESS:
+            readPayload(payload, &disp.layers[header.layer].brightness);
+            break;
+
+        case HWC_RECORD_SET_CLIENT_TARGET:
+            disp.client_target_updates++;
+            break;
+
+        case HWC_RECORD_SET_COLOR_TRANSFORM:
+            disp.color_transform_calls++;
+            break;
+
+        case HWC_RECORD_MC_TABLE:
+            break;
+
+        case HWC_RECORD_MC_FEATURE:
+            disp.mc_samples++;
+            break;
+
+        case HWC_RECORD_VALIDATE:
+        case HWC_RECORD_PRESENT:
+        case HWC_RECORD_STAGE:
+        {
+            HwcRecordTiming timing;
+            if (!readPayload(payload, &timing) || timing.stage >= HWC_RECORD_STAGE_NUM)
+            {
+                replay->unknown_records++;
+                break;
+            }
+            disp.stage[timing.stage].cpu_ns.push_back(timing.cpu_ns);
+            disp.stage[timing.stage].wall_ns.push_back(timing.wall_ns);
+
+            if (header.type == HWC_RECORD_VALIDATE && timing.result > 0)
+            {
+                disp.changed_types += static_cast<uint64_t>(timing.result);
+            }
+            else if (header.type == HWC_RECORD_PRESENT && timing.result >= 0)
+            {
+                closeFrame(replay, header.display, &disp, header.ts);
+            }
+            break;
+        }
+
+        default:
+            replay->unknown_records++;
+            break;
+    }
+}
+
+bool loadTrace(Replay* replay)
+{
+    HwcRecordFileHeader file_header;
+    return readRecordFile(replay->path, &file_header,
+        [replay](const HwcRecordHeader& header, const std::vector<uint8_t>& payload)
+        {
+            applyRecord(replay, header, payload);
+        });
+}
+
+struct Summary
+{
+    size_t count;
+    double avg_us;
+    double p50_us;
+    double p95_us;
+    double max_us;
+};
+
+Summary summarize(std::vector<int64_t> samples)
+{
+    Summary sum = {samples.size(), 0, 0, 0, 0};
+    if (samples.empty())
+    {
+        return sum;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double total = 0;
+    for (int64_t v : samples)
+    {
+        total += static_cast<double>(v);
+    }
+    sum.avg_us = total / static_cast<double>(samples.size()) / 1000.0;
+    sum.p50_us = static_cast<double>(samples[samples.size() / 2]) / 1000.0;
+    sum.p95_us = static_cast<double>(samples[samples.size() * 95 / 100]) / 1000.0;
+    sum.max_us = static_cast<double>(samples.back()) / 1000.0;
+    return sum;
+}
+
+void printReplay(const Replay& replay)
+{
+    printf("%s: %" PRIu64 " records (%" PRIu64 " unknown)\n",
+           replay.path.c_str(), replay.records, replay.unknown_records);
+
+    for (const auto& it : replay.displays)
+    {
+        const DisplayReplay& disp = it.second;
+        const double duration_s = static_cast<double>(disp.last_present - disp.first_present) / 1e9;
+        printf(" display %u: frames:%" PRIu64 " fps:%.1f avg_layers:%.1f max_layers:%zu"
+               " buffer_updates:%" PRIu64 " state_calls:%" PRIu64 " changed_types:%" PRIu64
+               " client_target:%" PRIu64 " color_transform:%" PRIu64 " cursor:%" PRIu64
+               " mc_samples:%" PRIu64 "\n",
+               it.first, disp.frames,
+               duration_s > 0 ? static_cast<double>(disp.frames - 1) / duration_s : 0.0,
+               disp.frames ? static_cast<double>(disp.layer_sum) / static_cast<double>(disp.frames) : 0.0,
+               disp.max_layers, disp.buffer_updates, disp.state_calls, disp.changed_types,
+               disp.client_target_updates, disp.color_transform_calls, disp.cursor_calls,
+               disp.mc_samples);
+
+        printf("  %-10s %8s %10s %10s %10s %10s %10s\n",
+               "stage", "count", "cpu_avg", "cpu_p50", "cpu_p95", "cpu_max", "wall_avg");
+        for (int i = 0; i < HWC_RECORD_STAGE_NUM; i++)
+        {
+            Summary cpu = summarize(disp.stage[i].cpu_ns);
+            Summary wall = summarize(disp.stage[i].wall_ns);
+            printf("  %-10s %8zu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                   g_stage_name[i], cpu.count, cpu.avg_us, cpu.p50_us, cpu.p95_us, cpu.max_us, wall.avg_us);
+        }
+    }
+}
+
+void printCompare(const Replay& base, const Replay& target)
+{
+    printf("\ncompare cpu_avg(us): %s -> %s\n", base.path.c_str(), target.path.c_str());
+    for (const auto& it : base.displays)
+    {
+        auto target_it = target.displays.find(it.first);
+        if (target_it == target.displays.end())
+        {
+            continue;
+        }
+
+        printf(" display %u:\n", it.first);
+        for (int i = 0; i < HWC_RECORD_STAGE_NUM; i++)
+        {
+            Summary a = summarize(it.second.stage[i].cpu_ns);
+            Summary b = summarize(target_it->second.stage[i].cpu_ns);
+            printf("  %-10s %10.1f %10.1f %+8.1f%%\n", g_stage_name[i], a.avg_us, b.avg_us,
+                   a.avg_us > 0 ? (b.avg_us - a.avg_us) * 100.0 / a.avg_us : 0.0);
+        }
+    }
+}
+
+void usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-v] [-d <display>] <trace> [<trace to compare>]\n", name);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    int64_t filter_display = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "vd:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'v':
+                verbose = true;
+                break;
+            case 'd':
+                filter_display = atoll(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    const int num_traces = argc - optind;
+    if (num_traces < 1 || num_traces > 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Replay> replays(static_cast<size_t>(num_traces));
+    for (size_t i = 0; i < replays.size(); i++)
+    {
+        replays[i].path = argv[optind + static_cast<int>(i)];
+        replays[i].verbose = verbose;
+        replays[i].filter_display = filter_display;
+        if (!loadTrace(&replays[i]))
+        {
+            return 1;
+        }
+        printReplay(replays[i]);
+    }
+
+    if (replays.size() == 2)
+    {
+        printCompare(replays[0], replays[1]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,822 @@
+// Replay driver of the HWC2 call-stream trace written by HwcCallRecorder.
+//
+// usage: hwc_replay_driver [-p] [-n <loops>] [-d <display>] [-o <output>] <trace>
+//        hwc_replay_host [-p] [-n <loops>] [-d <display>] [-o <output>] [-m <w>x<h>@<fps>] <trace>
+//
+// Unlike the host decoder in hwc_replay.cpp, it feeds the recorded calls into
+// HWCMediator, so validate, HRT, dispatch and the overlay commit really run
+// with the recorded layer stacks. Buffers are allocated by GrallocDevice with
+// the recorded size, format and usage, and keyed by the recorded handle, so the
+// buffer changes of the trace are kept. Acquire fences are not replayed.
+//
+// It takes the place of SurfaceFlinger, so the composer service must be stopped
+// first. With -p the presents follow the recorded timestamps, otherwise the
+// frames are pushed as fast as the composer accepts them.
+//
+// The replay itself is recorded into <output> (<trace>.replay by default), and
+// the CPU time of validate, HRT, dispatch, the overlay commit and present is
+// reported next to the recorded one. Validate and present are measured here,
+// the other stages come from the HWC_RECORD_STAGE records of both traces.
+//
+// hwc_replay_host is the same driver built for the host with
+// MTK_HWC_USE_STUB_DEVICE, HWCMediator runs on the stub overlay device, hrt,
+// pq device and gralloc of tools/host, and -m sets the panel of the stub.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <utils/Timers.h>
+
+#include "../grallocdev.h"
+#include "../hwc2.h"
+#include "../hwcdisplay.h"
+#include "../hwclayer.h"
+#include "../hwc_recorder.h"
+#include "../utils/tools.h"
+#include "hwc_record_reader.h"
+
+#ifdef MTK_HWC_USE_STUB_DEVICE
+#include "host/stub_overlay_device.h"
+#endif
+
+namespace {
+
+const char* const g_stage_name[HWC_RECORD_STAGE_NUM] =
+{
+    "validate",
+    "hrt",
+    "dispatch",
+    "ovl_commit",
+    "present",
+};
+
+struct TimeStat
+{
+    std::vector<int64_t> wall_ns;
+    std::vector<int64_t> cpu_ns;
+    std::vector<int64_t> recorded_ns;
+};
+
+struct DriverDisplay
+{
+    DriverDisplay()
+        : powered(false)
+        , recorded_client_target(UINT64_MAX)
+        , frames(0)
+        , errors(0)
+    {
+    }
+
+    bool powered;
+    uint64_t recorded_client_target;
+    std::map<uint64_t, hwc2_layer_t> layers;
+
+    uint64_t frames;
+    uint64_t errors;
+    TimeStat stage[HWC_RECORD_STAGE_NUM];
+};
+
+struct Driver
+{
+    Driver()
+        : pace(false)
+        , filter_display(-1)
+        , trace_start(0)
+        , replay_start(0)
+        , alloc_failures(0)
+    {
+    }
+
+    bool pace;
+    int64_t filter_display;
+    int64_t trace_start;
+    nsecs_t replay_start;
+    uint64_t alloc_failures;
+
+    std::map<uint32_t, DriverDisplay> displays;
+    std::map<uint64_t, buffer_handle_t> buffers;
+};
+
+std::mutex g_hotplug_lock;
+std::condition_variable g_hotplug_cond;
+std::set<hwc2_display_t> g_connected;
+
+void onHotplug(hwc2_callback_data_t /*data*/, hwc2_display_t display, int32_t connected)
+{
+    std::lock_guard<std::mutex> lock(g_hotplug_lock);
+    if (connected == HWC2_CONNECTION_CONNECTED)
+    {
+        g_connected.insert(display);
+    }
+    else
+    {
+        g_connected.erase(display);
+    }
+    g_hotplug_cond.notify_all();
+}
+
+void onRefresh(hwc2_callback_data_t /*data*/, hwc2_display_t /*display*/)
+{
+}
+
+bool waitConnected(hwc2_display_t display)
+{
+    std::unique_lock<std::mutex> lock(g_hotplug_lock);
+    return g_hotplug_cond.wait_for(lock, std::chrono::seconds(2),
+                                   [display] { return g_connected.count(display) > 0; });
+}
+
+buffer_handle_t getBuffer(Driver* driver, const HwcRecordBuffer& rec)
+{
+    if (rec.handle == 0 || rec.width == 0 || rec.height == 0)
+    {
+        return nullptr;
+    }
+
+    auto it = driver->buffers.find(rec.handle);
+    if (it != driver->buffers.end())
+    {
+        return it->second;
+    }
+
+    GrallocDevice::AllocParam param;
+    param.width = rec.width;
+    param.height = rec.height;
+    param.format = rec.format;
+    param.usage = rec.usage | GRALLOC_USAGE_HW_COMPOSER;
+    if (GrallocDevice::getInstance().alloc(param) != NO_ERROR)
+    {
+        driver->alloc_failures++;
+        param.handle = nullptr;
+    }
+    driver->buffers[rec.handle] = param.handle;
+    return param.handle;
+}
+
+hwc_region_t readRegion(const std::vector<uint8_t>& payload, size_t offset, std::vector<hwc_rect_t>* rects)
+{
+    hwc_region_t region = {0, nullptr};
+    HwcRecordRegion header;
+    if (!readRecordPayload(payload, &header, offset))
+    {
+        return region;
+    }
+
+    offset += sizeof(header);
+    rects->clear();
+    for (uint32_t i = 0; i < header.num_rects; i++)
+    {
+        HwcRecordRect rect;
+        if (!readRecordPayload(payload, &rect, offset + sizeof(rect) * i))
+        {
+            break;
+        }
+        rects->push_back({rect.left, rect.top, rect.right, rect.bottom});
+    }
+    region.numRects = rects->size();
+    region.rects = rects->data();
+    return region;
+}
+
+bool getLayer(DriverDisplay* disp, uint64_t recorded, hwc2_layer_t* out)
+{
+    auto it = disp->layers.find(recorded);
+    if (it == disp->layers.end())
+    {
+        return false;
+    }
+    *out = it->second;
+    return true;
+}
+
+void closeFences(hwc2_display_t display)
+{
+    HWCMediator& hwc = HWCMediator::getInstance();
+    uint32_t num = 0;
+    hwc.displayGetReleaseFence(nullptr, display, &num, nullptr, nullptr);
+    if (num == 0)
+    {
+        return;
+    }
+
+    std::vector<hwc2_layer_t> layers(num);
+    std::vector<int32_t> fences(num, -1);
+    hwc.displayGetReleaseFence(nullptr, display, &num, layers.data(), fences.data());
+    for (uint32_t i = 0; i < num; i++)
+    {
+        protectedClose(fences[i]);
+    }
+}
+
+void pace(Driver* driver, int64_t recorded_ts)
+{
+    if (!driver->pace || driver->trace_start == 0)
+    {
+        return;
+    }
+
+    const nsecs_t target = driver->replay_start + (recorded_ts - driver->trace_start);
+    const nsecs_t now = systemTime();
+    if (target > now)
+    {
+        usleep(static_cast<useconds_t>((target - now) / 1000));
+    }
+}
+
+void driveRecord(Driver* driver, const HwcRecordHeader& header, const std::vector<uint8_t>& payload)
+{
+    if (driver->filter_display >= 0 && header.display != driver->filter_display)
+    {
+        return;
+    }
+
+    HWCMediator& hwc = HWCMediator::getInstance();
+    const hwc2_display_t dpy = header.display;
+    DriverDisplay& disp = driver->displays[header.display];
+    if (!disp.powered)
+    {
+        if (!waitConnected(dpy))
+        {
+            fprintf(stderr, "display %u is not connected yet\n", header.display);
+        }
+        hwc.displaySetPowerMode(nullptr, dpy, HWC2_POWER_MODE_ON);
+        disp.powered = true;
+    }
+
+    hwc2_layer_t layer = 0;
+    int32_t err = HWC2_ERROR_NONE;
+    switch (header.type)
+    {
+        case HWC_RECORD_CREATE_LAYER:
+            err = hwc.displayCreateLayer(nullptr, dpy, &layer);
+            if (err == HWC2_ERROR_NONE)
+            {
+                disp.layers[header.layer] = layer;
+            }
+            break;
+
+        case HWC_RECORD_DESTROY_LAYER:
+            if (getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.displayDestroyLayer(nullptr, dpy, layer);
+                disp.layers.erase(header.layer);
+            }
+            break;
+
+        case HWC_RECORD_SET_BUFFER:
+        {
+            HwcRecordBuffer rec;
+            if (readRecordPayload(payload, &rec) && getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerSetBuffer(nullptr, dpy, layer, getBuffer(driver, rec), -1);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_DAMAGE:
+        case HWC_RECORD_SET_VISIBLE_REGION:
+        {
+            std::vector<hwc_rect_t> rects;
+            hwc_region_t region = readRegion(payload, 0, &rects);
+            if (getLayer(&disp, header.layer, &layer))
+            {
+                err = header.type == HWC_RECORD_SET_DAMAGE ?
+                      hwc.layerSetSurfaceDamage(nullptr, dpy, layer, region) :
+                      hwc.layerStateSetVisibleRegion(nullptr, dpy, layer, region);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_BLEND:
+        {
+            int32_t mode;
+            if (readRecordPayload(payload, &mode) && getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerStateSetBlendMode(nullptr, dpy, layer, mode);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_COLOR:
+        {
+            HwcRecordColor rec;
+            if (readRecordPayload(payload, &rec) && getLayer(&disp, header.layer, &layer))
+            {
+                hwc_color_t color = {rec.r, rec.g, rec.b, rec.a};
+                err = hwc.layerStateSetColor(nullptr, dpy, layer, color);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_COMP_TYPE:
+        {
+            int32_t type;
+            if (readRecordPayload(payload, &type) && getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerStateSetCompositionType(nullptr, dpy, layer, type);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_DATASPACE:
+        {
+            int32_t dataspace;
+            if (readRecordPayload(payload, &dataspace) && getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerStateSetDataSpace(nullptr, dpy, layer, dataspace);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_DISPLAY_FRAME:
+        {
+            HwcRecordRect rec;
+            if (readRecordPayload(payload, &rec) && getLayer(&disp, header.layer, &layer))
+            {
+                hwc_rect_t frame = {rec.left, rec.top, rec.right, rec.bottom};
+                err = hwc.layerStateSetDisplayFrame(nullptr, dpy, layer, frame);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_PLANE_ALPHA:
+        {
+            float alpha;
+            if (readRecordPayload(payload, &alpha) && getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerStateSetPlaneAlpha(nullptr, dpy, layer, alpha);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_SOURCE_CROP:
+        {
+            HwcRecordFRect rec;
+            if (readRecordPayload(payload, &rec) && getLayer(&disp, header.layer, &layer))
+            {
+                hwc_frect_t crop = {rec.left, rec.top, rec.right, rec.bottom};
+                err = hwc.layerStateSetSourceCrop(nullptr, dpy, layer, crop);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_TRANSFORM:
+        {
+            int32_t transform;
+            if (readRecordPayload(payload, &transform) && getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerStateSetTransform(nullptr, dpy, layer, transform);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_Z_ORDER:
+        {
+            uint32_t z;
+            if (readRecordPayload(payload, &z) && getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerStateSetZOrder(nullptr, dpy, layer, z);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_CURSOR_POSITION:
+        {
+            HwcRecordPoint point;
+            if (!readRecordPayload(payload, &point))
+            {
+                break;
+            }
+            if (header.layer == disp.recorded_client_target)
+            {
+                // the expected present time of SurfaceFlinger, shift it to the replay clock
+                pace(driver, header.ts);
+                const nsecs_t ts = static_cast<nsecs_t>(static_cast<uint64_t>(point.x) << 32 |
+                                                        static_cast<uint32_t>(point.y));
+                const nsecs_t shifted = ts - driver->trace_start + driver->replay_start;
+                layer = hwc.getHWCDisplay(dpy)->getClientTarget()->getId();
+                err = hwc.layerSetCursorPosition(nullptr, dpy, layer,
+                                                 static_cast<int32_t>(static_cast<uint64_t>(shifted) >> 32),
+                                                 static_cast<int32_t>(shifted & 0xffffffff));
+            }
+            else if (getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerSetCursorPosition(nullptr, dpy, layer, point.x, point.y);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_SIDEBAND_STREAM:
+            // the stream handle cannot be recreated, the call only matters for the layer state
+            if (getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerStateSetSidebandStream(nullptr, dpy, layer, nullptr);
+            }
+            break;
+
+        case HWC_RECORD_SET_PER_FRAME_METADATA:
+        {
+            HwcRecordMetadata metadata;
+            if (!readRecordPayload(payload, &metadata) || !getLayer(&disp, header.layer, &layer))
+            {
+                break;
+            }
+            std::vector<int32_t> keys;
+            std::vector<float> values;
+            for (uint32_t i = 0; i < metadata.num_keys; i++)
+            {
+                HwcRecordMetadataValue value;
+                if (!readRecordPayload(payload, &value, sizeof(metadata) + sizeof(value) * i))
+                {
+                    break;
+                }
+                keys.push_back(value.key);
+                values.push_back(value.value);
+            }
+            err = hwc.layerStateSetPerFrameMetadata(nullptr, dpy, layer, static_cast<uint32_t>(keys.size()),
+                                                    keys.data(), values.data());
+            break;
+        }
+
+        case HWC_RECORD_SET_PER_FRAME_METADATA_BLOBS:
+        {
+            HwcRecordMetadata metadata;
+            if (!readRecordPayload(payload, &metadata) || !getLayer(&disp, header.layer, &layer))
+            {
+                break;
+            }
+            std::vector<int32_t> keys;
+            std::vector<uint32_t> sizes;
+            size_t data_offset = sizeof(metadata) + sizeof(HwcRecordMetadataBlob) * metadata.num_keys;
+            std::vector<uint8_t> blobs;
+            for (uint32_t i = 0; i < metadata.num_keys; i++)
+            {
+                HwcRecordMetadataBlob blob;
+                if (!readRecordPayload(payload, &blob, sizeof(metadata) + sizeof(blob) * i) ||
+                    data_offset + blob.stored > payload.size())
+                {
+                    break;
+                }
+                // a capped blob is replayed with its recorded part only
+                keys.push_back(blob.key);
+                sizes.push_back(blob.stored);
+                blobs.insert(blobs.end(), payload.begin() + static_cast<long>(data_offset),
+                             payload.begin() + static_cast<long>(data_offset + blob.stored));
+                data_offset += blob.stored;
+            }
+            err = hwc.layerStateSetPerFrameMetadataBlobs(nullptr, dpy, layer, static_cast<uint32_t>(keys.size()),
+                                                         keys.data(), sizes.data(), blobs.data());
+            break;
+        }
+
+        case HWC_RECORD_SET_LAYER_COLOR_TRANSFORM:
+        {
+            HwcRecordMatrix rec;
+            if (readRecordPayload(payload, &rec) && getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerStateSetLayerColorTransform(nullptr, dpy, layer, rec.matrix);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_LAYER_BRIGHTNESS:
+        {
+            float brightness;
+            if (readRecordPayload(payload, &brightness) && getLayer(&disp, header.layer, &layer))
+            {
+                err = hwc.layerSetLayerBrightness(nullptr, dpy, layer, brightness);
+            }
+            break;
+        }
+
+        case HWC_RECORD_SET_CLIENT_TARGET:
+        {
+            HwcRecordClientTarget rec;
+            if (!readRecordPayload(payload, &rec))
+            {
+                break;
+            }
+            disp.recorded_client_target = header.layer;
+            std::vector<hwc_rect_t> rects;
+            hwc_region_t damage = readRegion(payload, sizeof(rec), &rects);
+            err = hwc.displaySetClientTarget(nullptr, dpy, getBuffer(driver, rec.buffer), -1,
+                                             rec.dataspace, damage);
+            break;
+        }
+
+        case HWC_RECORD_SET_COLOR_TRANSFORM:
+        {
+            HwcRecordColorTransform rec;
+            if (readRecordPayload(payload, &rec))
+            {
+                err = hwc.displaySetColorTransform(nullptr, dpy, rec.matrix, rec.hint);
+            }
+            break;
+        }
+
+        case HWC_RECORD_ACCEPT_CHANGES:
+            err = hwc.displayAcceptChanges(nullptr, dpy);
+            break;
+
+        case HWC_RECORD_VALIDATE:
+        {
+            HwcRecordTiming timing;
+            if (!readRecordPayload(payload, &timing))
+            {
+                break;
+            }
+            uint32_t num_types = 0;
+            uint32_t num_requests = 0;
+            const nsecs_t start = systemTime();
+            const nsecs_t cpu_start = systemTime(SYSTEM_TIME_THREAD);
+            err = hwc.displayValidateDisplay(nullptr, dpy, &num_types, &num_requests);
+            TimeStat& stat = disp.stage[HWC_RECORD_STAGE_VALIDATE];
+            stat.cpu_ns.push_back(systemTime(SYSTEM_TIME_THREAD) - cpu_start);
+            stat.wall_ns.push_back(systemTime() - start);
+            stat.recorded_ns.push_back(timing.cpu_ns);
+            if (err == HWC2_ERROR_HAS_CHANGES)
+            {
+                err = HWC2_ERROR_NONE;
+            }
+            break;
+        }
+
+        case HWC_RECORD_PRESENT:
+        {
+            HwcRecordTiming timing;
+            if (!readRecordPayload(payload, &timing))
+            {
+                break;
+            }
+            pace(driver, header.ts);
+            int32_t retire_fence = -1;
+            const nsecs_t start = systemTime();
+            const nsecs_t cpu_start = systemTime(SYSTEM_TIME_THREAD);
+            err = hwc.displayPresent(nullptr, dpy, &retire_fence);
+            TimeStat& stat = disp.stage[HWC_RECORD_STAGE_PRESENT];
+            stat.cpu_ns.push_back(systemTime(SYSTEM_TIME_THREAD) - cpu_start);
+            stat.wall_ns.push_back(systemTime() - start);
+            stat.recorded_ns.push_back(timing.cpu_ns);
+            protectedClose(retire_fence);
+            closeFences(dpy);
+            disp.frames++;
+            break;
+        }
+
+        case HWC_RECORD_STAGE:
+        {
+            // the stages of the recorded run, the replayed ones are read back from the output
+            HwcRecordTiming timing;
+            if (readRecordPayload(payload, &timing) && timing.stage < HWC_RECORD_STAGE_NUM &&
+                timing.stage != HWC_RECORD_STAGE_VALIDATE && timing.stage != HWC_RECORD_STAGE_PRESENT)
+            {
+                disp.stage[timing.stage].recorded_ns.push_back(timing.cpu_ns);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    if (err != HWC2_ERROR_NONE)
+    {
+        disp.errors++;
+    }
+}
+
+double averageUs(const std::vector<int64_t>& samples)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+    double total = 0;
+    for (int64_t v : samples)
+    {
+        total += static_cast<double>(v);
+    }
+    return total / static_cast<double>(samples.size()) / 1000.0;
+}
+
+double percentileUs(std::vector<int64_t> samples, size_t percent)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return static_cast<double>(samples[samples.size() * percent / 100]) / 1000.0;
+}
+
+// collect the HRT, dispatch and overlay commit time of the replay from its own trace
+bool readReplayStages(Driver* driver, const char* path)
+{
+    HwcRecordFileHeader file_header;
+    return readRecordFile(path, &file_header,
+        [driver](const HwcRecordHeader& header, const std::vector<uint8_t>& payload)
+        {
+            HwcRecordTiming timing;
+            if (header.type != HWC_RECORD_STAGE || !readRecordPayload(payload, &timing) ||
+                timing.stage >= HWC_RECORD_STAGE_NUM ||
+                timing.stage == HWC_RECORD_STAGE_VALIDATE || timing.stage == HWC_RECORD_STAGE_PRESENT)
+            {
+                return;
+            }
+            if (driver->filter_display >= 0 && header.display != driver->filter_display)
+            {
+                return;
+            }
+            TimeStat& stat = driver->displays[header.display].stage[timing.stage];
+            stat.cpu_ns.push_back(timing.cpu_ns);
+            stat.wall_ns.push_back(timing.wall_ns);
+        });
+}
+
+#ifdef MTK_HWC_USE_STUB_DEVICE
+bool parsePanel(const char* arg, StubPanelConfig* panel)
+{
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int fps = 0;
+    if (sscanf(arg, "%ux%u@%u", &width, &height, &fps) != 3 || width == 0 || height == 0 || fps == 0)
+    {
+        return false;
+    }
+    panel->width = width;
+    panel->height = height;
+    panel->fps = fps;
+    return true;
+}
+#endif
+
+void printStat(const char* name, const TimeStat& stat)
+{
+    printf("  %-10s %8zu %10.1f %10.1f %10.1f %10.1f %12.1f\n", name, stat.cpu_ns.size(),
+           averageUs(stat.cpu_ns), percentileUs(stat.cpu_ns, 50), percentileUs(stat.cpu_ns, 95),
+           averageUs(stat.wall_ns), averageUs(stat.recorded_ns));
+}
+
+void usage(const char* name)
+{
+#ifdef MTK_HWC_USE_STUB_DEVICE
+    fprintf(stderr, "usage: %s [-p] [-n <loops>] [-d <display>] [-o <output>] [-m <w>x<h>@<fps>] <trace>\n",
+            name);
+#else
+    fprintf(stderr, "usage: %s [-p] [-n <loops>] [-d <display>] [-o <output>] <trace>\n", name);
+#endif
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Driver driver;
+    int loops = 1;
+    std::string output;
+#ifdef MTK_HWC_USE_STUB_DEVICE
+    StubPanelConfig panel;
+    const char* optstring = "pn:d:o:m:";
+#else
+    const char* optstring = "pn:d:o:";
+#endif
+
+    int opt;
+    while ((opt = getopt(argc, argv, optstring)) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                driver.pace = true;
+                break;
+            case 'n':
+                loops = std::max(1, atoi(optarg));
+                break;
+            case 'd':
+                driver.filter_display = atoll(optarg);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+#ifdef MTK_HWC_USE_STUB_DEVICE
+            case 'm':
+                if (!parsePanel(optarg, &panel))
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+#endif
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (argc - optind != 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (output.empty())
+    {
+        output = std::string(argv[optind]) + ".replay";
+    }
+    if (output == argv[optind])
+    {
+        fprintf(stderr, "the output must not be the trace itself\n");
+        return 1;
+    }
+
+#ifdef MTK_HWC_USE_STUB_DEVICE
+    // the stub device is created with HWCMediator, so the panel is set first
+    StubOverlayDevice::setPanelConfig(panel);
+#endif
+
+    HWCMediator& hwc = HWCMediator::getInstance();
+    hwc.open();
+    hwc.deviceRegisterCallback(nullptr, HWC2_CALLBACK_REFRESH, nullptr,
+                               reinterpret_cast<hwc2_function_pointer_t>(onRefresh));
+    hwc.deviceRegisterCallback(nullptr, HWC2_CALLBACK_HOTPLUG, nullptr,
+                               reinterpret_cast<hwc2_function_pointer_t>(onHotplug));
+
+    HwcCallRecorder::getInstance().setOutputPath(output.c_str());
+    for (int i = 0; i < loops; i++)
+    {
+        HwcRecordFileHeader file_header;
+        driver.replay_start = systemTime();
+        driver.trace_start = 0;
+        const bool ok = readRecordFile(argv[optind], &file_header,
+            [&driver](const HwcRecordHeader& header, const std::vector<uint8_t>& payload)
+            {
+                if (driver.trace_start == 0)
+                {
+                    driver.trace_start = header.ts;
+                }
+                driveRecord(&driver, header, payload);
+            });
+        if (!ok)
+        {
+            HwcCallRecorder::getInstance().setOutputPath("");
+            return 1;
+        }
+
+        // the next loop creates its own layers
+        for (auto& it : driver.displays)
+        {
+            for (auto& layer : it.second.layers)
+            {
+                hwc.displayDestroyLayer(nullptr, it.first, layer.second);
+            }
+            it.second.layers.clear();
+        }
+    }
+
+    // stopping the recorder joins its writer, so the output is complete
+    HwcCallRecorder::getInstance().setOutputPath("");
+    if (!readReplayStages(&driver, output.c_str()))
+    {
+        fprintf(stderr, "failed to read the stages of the replay from %s\n", output.c_str());
+    }
+
+    printf("%s: %d loop(s), %zu buffers (%" PRIu64 " failed to allocate), replay trace %s\n",
+           argv[optind], loops, driver.buffers.size(), driver.alloc_failures, output.c_str());
+    for (const auto& it : driver.displays)
+    {
+        const DriverDisplay& disp = it.second;
+        printf(" display %u: frames:%" PRIu64 " errors:%" PRIu64 "\n", it.first, disp.frames, disp.errors);
+        printf("  %-10s %8s %10s %10s %10s %10s %12s\n",
+               "stage", "count", "cpu_avg", "cpu_p50", "cpu_p95", "wall_avg", "recorded_cpu");
+        for (int stage = 0; stage < HWC_RECORD_STAGE_NUM; stage++)
+        {
+            printStat(g_stage_name[stage], disp.stage[stage]);
+        }
+    }
+
+    for (auto& it : driver.displays)
+    {
+        hwc.displaySetPowerMode(nullptr, it.first, HWC2_POWER_MODE_OFF);
+    }
+    for (auto& it : driver.buffers)
+    {
+        if (it.second != nullptr)
+        {
+            GrallocDevice::getInstance().free(it.second);
+        }
+    }
+    hwc.close();
+    return 0;
+}
@@ -0,0 +1,205 @@
+#define DEBUG_LOG_TAG "UCLAMP"
+
+#include "uclamp_controller.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+#include "platform_wrap.h"
+
+// the frame should end at this ratio of its target, it leaves a margin for jitter
+#define UCLAMP_SETPOINT_RATIO 0.85f
+
+// PI gains, the output is in buckets of uclamp_cpu_table
+#define UCLAMP_KP 2.f
+#define UCLAMP_KI 0.25f
+#define UCLAMP_INTEGRAL_LIMIT 4.f
+#define UCLAMP_MAX_UP_STEPS 4
+#define UCLAMP_MAX_DOWN_STEPS 2
+
+// a lower bucket is taken after it is requested for this many frames
+#define UCLAMP_DOWN_HOLD_FRAMES 4
+
+// a frame ending before this ratio of its target has more uclamp than it needs
+#define UCLAMP_OVER_PROVISION_RATIO 0.5f
+
+static std::atomic<bool> g_feedback_enable(true);
+
+// ---------------------------------------------------------------------------
+
+UClampController::UClampController()
+    : m_integral(0.f)
+    , m_correction(0)
+    , m_cur_bucket(-1)
+    , m_cur_uclamp(UINT32_MAX)
+    , m_frame_count(0)
+    , m_down_request_frame(-1)
+    , m_miss_count(0)
+    , m_over_provision_count(0)
+    , m_set_count(0)
+    , m_hold_count(0)
+    , m_max_overrun(0)
+{
+}
+
+void UClampController::setFeedbackEnable(bool enable)
+{
+    g_feedback_enable.store(enable, std::memory_order_relaxed);
+}
+
+bool UClampController::isFeedbackEnabled()
+{
+    return g_feedback_enable.load(std::memory_order_relaxed);
+}
+
+int UClampController::getBucketNum() const
+{
+    // bucket 0 is no floor, the others are the entries of uclamp_cpu_table
+    return static_cast<int>(Platform::getInstance().m_config.uclamp_cpu_table.size()) + 1;
+}
+
+int UClampController::uclampToBucket(uint32_t uclamp) const
+{
+    if (uclamp == 0)
+    {
+        return 0;
+    }
+
+    int bucket = 1;
+    for (auto& pair : Platform::getInstance().m_config.uclamp_cpu_table)
+    {
+        if (pair.uclamp >= uclamp)
+        {
+            return bucket;
+        }
+        bucket++;
+    }
+
+    // cpuMHzToUClamp() returns UINT32_MAX above the table, keep the last entry
+    return getBucketNum() - 1;
+}
+
+uint32_t UClampController::bucketToUClamp(int bucket) const
+{
+    const auto& table = Platform::getInstance().m_config.uclamp_cpu_table;
+    if (bucket <= 0 || table.empty())
+    {
+        return 0;
+    }
+
+    int i = 1;
+    for (auto& pair : table)
+    {
+        if (i == bucket)
+        {
+            return pair.uclamp;
+        }
+        i++;
+    }
+    return table.back().uclamp;
+}
+
+bool UClampController::apply(pid_t tid, uint32_t open_loop_uclamp)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    const int correction = isFeedbackEnabled() ? m_correction : 0;
+    int bucket = uclampToBucket(open_loop_uclamp) + correction;
+    bucket = std::max(0, std::min(bucket, getBucketNum() - 1));
+
+    if (bucket >= m_cur_bucket)
+    {
+        m_down_request_frame = -1;
+        if (bucket == m_cur_bucket)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // hold the current bucket for a while, the next frame may need it again
+        if (m_down_request_frame < 0)
+        {
+            m_down_request_frame = static_cast<int64_t>(m_frame_count);
+        }
+        if (static_cast<int64_t>(m_frame_count) - m_down_request_frame < UCLAMP_DOWN_HOLD_FRAMES)
+        {
+            m_hold_count++;
+            return false;
+        }
+        m_down_request_frame = -1;
+    }
+
+    m_cur_bucket = bucket;
+    m_cur_uclamp = bucketToUClamp(bucket);
+    m_set_count++;
+    uclamp_task(tid, m_cur_uclamp);
+    return true;
+}
+
+void UClampController::onFrameDone(nsecs_t work_time, nsecs_t target_time)
+{
+    if (target_time <= 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    m_frame_count++;
+    if (work_time > target_time)
+    {
+        m_miss_count++;
+        m_max_overrun = std::max(m_max_overrun, work_time - target_time);
+    }
+    else if (m_cur_bucket > 0 &&
+             static_cast<float>(work_time) < static_cast<float>(target_time) * UCLAMP_OVER_PROVISION_RATIO)
+    {
+        m_over_provision_count++;
+    }
+
+    if (!isFeedbackEnabled())
+    {
+        m_integral = 0.f;
+        m_correction = 0;
+        return;
+    }
+
+    // normalized error, > 0 means the frame ended after the setpoint
+    float error = (static_cast<float>(work_time) - static_cast<float>(target_time) * UCLAMP_SETPOINT_RATIO) /
+                  static_cast<float>(target_time);
+    error = std::max(-1.f, std::min(error, 2.f));
+
+    m_integral = std::max(-UCLAMP_INTEGRAL_LIMIT, std::min(m_integral + error, UCLAMP_INTEGRAL_LIMIT));
+
+    const float output = UCLAMP_KP * error + UCLAMP_KI * m_integral;
+    m_correction = std::max(-UCLAMP_MAX_DOWN_STEPS,
+                            std::min(static_cast<int>(lroundf(output)), UCLAMP_MAX_UP_STEPS));
+}
+
+uint32_t UClampController::getUClamp() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_cur_uclamp;
+}
+
+void UClampController::dump(android::String8* dump_str, const char* name) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_frame_count == 0 && m_set_count == 0)
+    {
+        return;
+    }
+
+    dump_str->appendFormat("  uclamp(%s): cur:%u corr:%+d i:%.2f frames:%" PRIu64 " miss:%" PRIu64
+                           " over:%" PRIu64 " set:%" PRIu64 " hold:%" PRIu64 " max_overrun:%" PRId64 "us%s\n",
+                           name, m_cur_uclamp, m_correction, static_cast<double>(m_integral), m_frame_count,
+                           m_miss_count, m_over_provision_count, m_set_count, m_hold_count,
+                           ns2us(m_max_overrun), isFeedbackEnabled() ? "" : " (feedback off)");
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <sys/types.h>
+#include <utils/Timers.h>
+
+#include <mutex>
+
+// ---------------------------------------------------------------------------
+
+namespace android
+{
+class String8;
+}
+
+// UClampController closes the loop around the open-loop uclamp computed by
+// the calculatePerf() paths. Every frame the measured work time is compared
+// with the time the thread was allowed to take, and a PI term moves the uclamp
+// floor up or down by buckets of uclamp_cpu_table, down to no floor at all
+// and up to the last entry of the table. uclamp_task() is called
+// only when the bucket changes, and a lower bucket is only taken after it has
+// been requested for a few frames.
+class UClampController
+{
+public:
+    UClampController();
+
+    static void setFeedbackEnable(bool enable);
+    static bool isFeedbackEnabled();
+
+    // apply open_loop_uclamp plus the feedback correction to tid,
+    // return true if uclamp_task() is called
+    bool apply(pid_t tid, uint32_t open_loop_uclamp);
+
+    // feed the work time of a frame and the time it was allowed to take
+    void onFrameDone(nsecs_t work_time, nsecs_t target_time);
+
+    // the uclamp currently set to the thread, UINT32_MAX if not set yet
+    uint32_t getUClamp() const;
+
+    void dump(android::String8* dump_str, const char* name) const;
+
+private:
+    int getBucketNum() const;
+    int uclampToBucket(uint32_t uclamp) const;
+    uint32_t bucketToUClamp(int bucket) const;
+
+private:
+    mutable std::mutex m_lock;
+
+    float m_integral;
+    int m_correction;
+
+    int m_cur_bucket;
+    uint32_t m_cur_uclamp;
+    uint64_t m_frame_count;
+    int64_t m_down_request_frame;
+
+    // statistics
+    uint64_t m_miss_count;
+    uint64_t m_over_provision_count;
+    uint64_t m_set_count;
+    uint64_t m_hold_count;
+    nsecs_t m_max_overrun;
+};
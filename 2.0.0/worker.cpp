@@ -204,3 +204,20 @@ void LayerComposer::nullop()
 
     m_mm_handler->nullop();
 }
+
+void LayerComposer::dump(String8* dump_str)
+{
+    if (dump_str == NULL)
+    {
+        return;
+    }
+
+    if (m_glai_handler)
+    {
+        char buff[1024] = {0};
+        if (m_glai_handler->dump(buff, static_cast<int>(sizeof(buff)), 0) > 0)
+        {
+            dump_str->append(buff);
+        }
+    }
+}
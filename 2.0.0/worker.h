@@ -2,6 +2,7 @@
 #define HWC_WORKER_H_
 
 #include <utils/threads.h>
+#include <utils/String8.h>
 
 #include <semaphore.h>
 #include <string>
@@ -73,6 +74,9 @@ public:
 
     virtual void nullop();
 
+    // dump() is used to dump debug data of layer handlers
+    void dump(String8* dump_str);
+
 private:
     // m_disp_id is used to identify this thread is used by which display
     uint64_t m_disp_id;
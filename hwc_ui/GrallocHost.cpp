@@ -0,0 +1,61 @@
+#include <hwc_ui/GrallocHost.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+namespace hwc {
+
+int GrallocHostMapper::createDescriptor(void* /*bufferDescriptorInfo*/,
+                                        void* /*outBufferDescriptor*/) const {
+    return -ENOSYS;
+}
+
+int GrallocHostMapper::importBuffer(const android::hardware::hidl_handle& rawHandle,
+                                    buffer_handle_t* outBufferHandle) const {
+    if (rawHandle.getNativeHandle() == nullptr) {
+        return -EINVAL;
+    }
+    // the fake handles live until the replay frees them, no clone is needed
+    *outBufferHandle = rawHandle.getNativeHandle();
+    return 0;
+}
+
+void GrallocHostMapper::freeBuffer(buffer_handle_t /*bufferHandle*/) const {
+}
+
+int GrallocHostMapper::validateBufferSize(buffer_handle_t /*bufferHandle*/, uint32_t /*width*/,
+                                          uint32_t /*height*/, hwc::PixelFormat /*format*/,
+                                          uint32_t /*layerCount*/, uint64_t /*usage*/,
+                                          uint32_t /*stride*/) const {
+    return 0;
+}
+
+void GrallocHostMapper::getTransportSize(buffer_handle_t bufferHandle, uint32_t* outNumFds,
+                                         uint32_t* outNumInts) const {
+    *outNumFds = static_cast<uint32_t>(bufferHandle->numFds);
+    *outNumInts = static_cast<uint32_t>(bufferHandle->numInts);
+}
+
+int GrallocHostMapper::lock(buffer_handle_t /*bufferHandle*/, uint64_t /*usage*/,
+                            const Rect& /*bounds*/, int acquireFence, void** /*outData*/,
+                            int32_t* /*outBytesPerPixel*/, int32_t* /*outBytesPerStride*/) const {
+    if (acquireFence >= 0) {
+        close(acquireFence);
+    }
+    return -ENOSYS;
+}
+
+int GrallocHostMapper::lock(buffer_handle_t /*bufferHandle*/, uint64_t /*usage*/,
+                            const Rect& /*bounds*/, int acquireFence,
+                            android_ycbcr* /*ycbcr*/) const {
+    if (acquireFence >= 0) {
+        close(acquireFence);
+    }
+    return -ENOSYS;
+}
+
+int GrallocHostMapper::unlock(buffer_handle_t /*bufferHandle*/) const {
+    return -1;
+}
+
+} // namespace hwc
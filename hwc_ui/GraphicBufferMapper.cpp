@@ -32,8 +32,12 @@
 #include <utils/Trace.h>
 
 #include <hwc_ui/Gralloc.h>
+#ifdef MTK_HWC_USE_STUB_DEVICE
+#include <hwc_ui/GrallocHost.h>
+#else
 #include <hwc_ui/Gralloc2.h>
 #include <hwc_ui/Gralloc4.h>
+#endif
 
 #include <system/graphics.h>
 
@@ -47,6 +51,11 @@ GraphicBufferMapper& GraphicBufferMapper::getInstance()
 }
 
 GraphicBufferMapper::GraphicBufferMapper() {
+#ifdef MTK_HWC_USE_STUB_DEVICE
+    // the host replay has no mapper HAL, and no metadata either
+    mMapper = std::make_unique<const GrallocHostMapper>();
+    mMapperVersion = Version::INVALID;
+#else
     mMapper = std::make_unique<const Gralloc4Mapper>();
     if (mMapper->isLoaded()) {
         mMapperVersion = Version::GRALLOC_4;
@@ -59,6 +68,7 @@ GraphicBufferMapper::GraphicBufferMapper() {
     }
 
     mMapperVersion = Version::INVALID;
+#endif
 }
 
 void GraphicBufferMapper::dumpBuffer(buffer_handle_t bufferHandle, std::string& result,
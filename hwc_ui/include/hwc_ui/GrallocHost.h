@@ -0,0 +1,44 @@
+#ifndef HWC_UI_GRALLOC_HOST_H
+#define HWC_UI_GRALLOC_HOST_H
+
+#include <hwc_ui/Gralloc.h>
+#include <hwc_ui/Rect.h>
+
+namespace hwc {
+
+// GrallocHostMapper takes the place of the IMapper HAL in the host replay
+// (MTK_HWC_USE_STUB_DEVICE). The buffers are the fake handles of the host
+// GrallocDevice, so import hands back the raw handle and there is no metadata.
+class GrallocHostMapper : public GrallocMapper {
+public:
+    GrallocHostMapper() = default;
+
+    bool isLoaded() const override { return true; }
+
+    int createDescriptor(void* bufferDescriptorInfo, void* outBufferDescriptor) const override;
+
+    int importBuffer(const android::hardware::hidl_handle& rawHandle,
+                     buffer_handle_t* outBufferHandle) const override;
+
+    void freeBuffer(buffer_handle_t bufferHandle) const override;
+
+    int validateBufferSize(buffer_handle_t bufferHandle, uint32_t width, uint32_t height,
+                           hwc::PixelFormat format, uint32_t layerCount, uint64_t usage,
+                           uint32_t stride) const override;
+
+    void getTransportSize(buffer_handle_t bufferHandle, uint32_t* outNumFds,
+                          uint32_t* outNumInts) const override;
+
+    int lock(buffer_handle_t bufferHandle, uint64_t usage, const Rect& bounds,
+             int acquireFence, void** outData, int32_t* outBytesPerPixel,
+             int32_t* outBytesPerStride) const override;
+
+    int lock(buffer_handle_t bufferHandle, uint64_t usage, const Rect& bounds,
+             int acquireFence, android_ycbcr* ycbcr) const override;
+
+    int unlock(buffer_handle_t bufferHandle) const override;
+};
+
+} // namespace hwc
+
+#endif // HWC_UI_GRALLOC_HOST_H
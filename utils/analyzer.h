@@ -1,8 +1,7 @@
 #ifndef UTILS_ANALYZER_H_
 #define UTILS_ANALYZER_H_
 
-#include <utils/SortedVector.h>
-#include <utils/Mutex.h>
+#include "cow_list.h"
 
 // We should define how to notify listeners by ourself because the signature of
 // a notify function is arbitrary
@@ -16,23 +15,20 @@ public:
 
     ssize_t addListener(const ListenerType& listener)
     {
-        AutoMutex l(m_mutex);
         return m_listeners.add(listener);
     }
 
     ssize_t removeListener(const ListenerType& listener)
     {
-        AutoMutex l(m_mutex);
         return m_listeners.remove(listener);
     }
 
 protected:
-    android::SortedVector<ListenerType>& getListeners() { return m_listeners; }
+    // the snapshot stays unchanged even if a listener is added or removed
+    typename CowList<ListenerType>::Snapshot getListeners() const { return m_listeners.snapshot(); }
 
 private:
-    android::Mutex m_mutex;
-
-    android::SortedVector<ListenerType> m_listeners;
+    CowList<ListenerType> m_listeners;
 };
 
 // DefaultListenedObject defines a well-defined notify function.
@@ -43,10 +39,10 @@ class DefaultListenedObject : public ListenedObject<ListenerType>
 public:
     void notifyListeners(MsgType const & msg)
     {
-        android::SortedVector<ListenerType> const& listeners = this->getListeners();
-        for (uint32_t i = 0; i < listeners.size(); ++i)
+        auto listeners = this->getListeners();
+        for (auto& listener : *listeners)
         {
-            listeners[i]->notify(msg);
+            listener->notify(msg);
         }
     }
 };
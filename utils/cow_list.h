@@ -0,0 +1,113 @@
+#ifndef UTILS_COW_LIST_H_
+#define UTILS_COW_LIST_H_
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <utils/Errors.h>
+
+// CowList is a sorted set of items which is read much more often than it is
+// changed, e.g. the listeners of vsync, hotplug and refresh.
+// Writers are serialized, copy the current snapshot, modify the copy and
+// publish it by swapping the snapshot pointer. Readers take an immutable
+// snapshot and may iterate it while the list is changed.
+// snapshot() is not lock-free: it takes a short mutex, m_items_lock, to copy
+// the snapshot pointer. A writer holds that mutex only for the pointer swap,
+// never while the items are copied, so a reader waits at most for one
+// shared_ptr copy or swap. A reader never waits for the writer lock.
+// A reader may still see an item for a while after it has been removed, so
+// an item must stay valid as long as a snapshot holds it, e.g. sp<>.
+template<class T>
+class CowList
+{
+public:
+    typedef std::vector<T> Items;
+    typedef std::shared_ptr<const Items> Snapshot;
+
+    CowList()
+        : m_items(std::make_shared<const Items>())
+    {}
+
+    Snapshot snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(m_items_lock);
+        return m_items;
+    }
+
+    // add() replaces an equal item, return the index of the item
+    ssize_t add(const T& item)
+    {
+        std::lock_guard<std::mutex> lock(m_write_lock);
+        std::shared_ptr<Items> items = std::make_shared<Items>(*snapshot());
+
+        auto it = std::lower_bound(items->begin(), items->end(), item);
+        const ssize_t index = it - items->begin();
+        if (it != items->end() && !(item < *it))
+        {
+            *it = item;
+        }
+        else
+        {
+            items->insert(it, item);
+        }
+
+        publish(items);
+        return index;
+    }
+
+    // remove() returns the index of the removed item or NAME_NOT_FOUND
+    ssize_t remove(const T& item)
+    {
+        std::lock_guard<std::mutex> lock(m_write_lock);
+        Snapshot cur = snapshot();
+
+        auto it = std::lower_bound(cur->begin(), cur->end(), item);
+        if (it == cur->end() || item < *it)
+        {
+            return android::NAME_NOT_FOUND;
+        }
+        const ssize_t index = it - cur->begin();
+
+        std::shared_ptr<Items> items = std::make_shared<Items>(*cur);
+        items->erase(items->begin() + index);
+
+        publish(items);
+        return index;
+    }
+
+    // replace all items with the given one, or clear the list with an empty T
+    void reset(const T& item = T())
+    {
+        std::lock_guard<std::mutex> lock(m_write_lock);
+        std::shared_ptr<Items> items = std::make_shared<Items>();
+        if (item != T())
+        {
+            items->push_back(item);
+        }
+        publish(items);
+    }
+
+private:
+    // swap in the new snapshot, the old one is released outside the lock
+    // in case this is its last reference
+    void publish(const std::shared_ptr<Items>& items)
+    {
+        Snapshot old(items);
+        {
+            std::lock_guard<std::mutex> lock(m_items_lock);
+            m_items.swap(old);
+        }
+    }
+
+    // serialize the writers, readers never take it
+    std::mutex m_write_lock;
+
+    // only guards the copy and the swap of m_items, never held while the
+    // items are copied or destroyed
+    mutable std::mutex m_items_lock;
+    Snapshot m_items;
+};
+
+#endif // UTILS_COW_LIST_H_
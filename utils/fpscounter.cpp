@@ -1,5 +1,6 @@
 #define DEBUG_LOG_TAG "FPSCOUNTER"
 
+#include <math.h>
 #include <stdint.h>
 #include <errno.h>
 #include <sys/types.h>
@@ -19,6 +20,57 @@
 
 namespace android {
 
+//--------------------------------------------------------------------------------------------------
+void FrameTimeHistogram::reset() {
+    mCount = 0;
+    memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+uint32_t FrameTimeHistogram::toIndex(uint32_t us) {
+    if (us < LINEAR_COUNT) {
+        return us;
+    }
+
+    // keep the SUB_BUCKET_BITS bits below the most significant one
+    const uint32_t msb = 31 - static_cast<uint32_t>(__builtin_clz(us));
+    const uint32_t shift = msb - SUB_BUCKET_BITS;
+    return shift * SUB_BUCKET_COUNT + (us >> shift);
+}
+
+uint32_t FrameTimeHistogram::toMiddleUs(uint32_t index) {
+    if (index < LINEAR_COUNT) {
+        return index;
+    }
+
+    const uint32_t shift = index / SUB_BUCKET_COUNT - 1;
+    const uint64_t low = static_cast<uint64_t>(index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT) << shift;
+    return static_cast<uint32_t>(low + ((1ULL << shift) >> 1));
+}
+
+void FrameTimeHistogram::add(const nsecs_t& duration) {
+    const nsecs_t us = ns2us(duration);
+    const uint32_t clamped = us <= 0 ? 0 : (us >= UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(us));
+    mBuckets[toIndex(clamped)]++;
+    mCount++;
+}
+
+nsecs_t FrameTimeHistogram::getPercentile(float percentile) const {
+    if (mCount == 0) {
+        return -1;
+    }
+
+    const double target = ceil(static_cast<double>(mCount) * static_cast<double>(percentile) / 100.0);
+    const uint64_t rank = target < 1.0 ? 1 : static_cast<uint64_t>(target);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += mBuckets[i];
+        if (seen >= rank) {
+            return us2ns(static_cast<nsecs_t>(toMiddleUs(i)));
+        }
+    }
+    return us2ns(static_cast<nsecs_t>(UINT32_MAX));
+}
+
 //--------------------------------------------------------------------------------------------------
 bool FpsCounter::reset() {
     mFps = 0.0;
@@ -35,6 +87,18 @@ bool FpsCounter::reset() {
     mLastTime = -1;
     mLastDuration = -1;
 
+    mBudget = 0;
+    mOverBudgetCounting = 0;
+    mOverBudgetTotal = 0;
+    mHistogramCounting.reset();
+    mHistogramTotal.reset();
+
+    mP50 = -1;
+    mP90 = -1;
+    mP99 = -1;
+    mP999 = -1;
+    mOverBudget = 0;
+
     // read property as default log interval setting
     char value[PROPERTY_VALUE_MAX] = {0};
     property_get("vendor.debug.hwc.stc_interval", value, "1000");
@@ -47,6 +111,17 @@ bool FpsCounter::update() {
     return update(systemTime(SYSTEM_TIME_MONOTONIC));
 }
 
+void FpsCounter::restart() {
+    // the results of the finished intervals and the totals are kept
+    mFrames = 0;
+    mLastLogTime = -1;
+    mLastTime = -1;
+    mMaxDurationCounting = -1;
+    mMinDurationCounting = -1;
+    mOverBudgetCounting = 0;
+    mHistogramCounting.reset();
+}
+
 bool FpsCounter::update(const nsecs_t& timestamp) {
     if ((-1 == mLastLogTime) || (-1 == mLastTime) || (mLastTime >= timestamp)) {
         mLastLogTime = mLastTime = timestamp;
@@ -64,6 +139,12 @@ bool FpsCounter::update(const nsecs_t& timestamp) {
     if ((-1 == mMinDurationCounting) || (mLastDuration < mMinDurationCounting)) {
         mMinDurationCounting = mLastDuration;
     }
+    mHistogramCounting.add(mLastDuration);
+    mHistogramTotal.add(mLastDuration);
+    if (mBudget > 0 && mLastDuration > mBudget) {
+        mOverBudgetCounting++;
+        mOverBudgetTotal++;
+    }
 
     // check if reach statistics interval, print result and reset for next
     nsecs_t duration = timestamp - mLastLogTime;
@@ -74,6 +155,11 @@ bool FpsCounter::update(const nsecs_t& timestamp) {
         mLastLogDuration = duration;
         mMaxDuration = mMaxDurationCounting;
         mMinDuration = mMinDurationCounting;
+        mP50 = mHistogramCounting.getPercentile(50.f);
+        mP90 = mHistogramCounting.getPercentile(90.f);
+        mP99 = mHistogramCounting.getPercentile(99.f);
+        mP999 = mHistogramCounting.getPercentile(99.9f);
+        mOverBudget = mOverBudgetCounting;
 
         // write to ring buffer
         mRingBuffer.WriteToBuffer(*this);
@@ -83,6 +169,8 @@ bool FpsCounter::update(const nsecs_t& timestamp) {
         mLastLogTime = timestamp;
         mMaxDurationCounting = -1;
         mMinDurationCounting = -1;
+        mOverBudgetCounting = 0;
+        mHistogramCounting.reset();
 
         return true;
     }
@@ -97,6 +185,11 @@ void FpsCounter::RingBufferFps::WriteToBuffer(const FpsCounter& obj) {
     now.mMaxDuration     = obj.getMaxDuration();
     now.mMinDuration     = obj.getMinDuration();
     now.mLastLogDuration = obj.getLastLogDuration();
+    now.mP50             = obj.getP50();
+    now.mP90             = obj.getP90();
+    now.mP99             = obj.getP99();
+    now.mP999            = obj.getP999();
+    now.mOverBudget      = obj.getOverBudget();
     if (mBufSize >= mIdx) mIdx = mIdx % mBufSize;
 
     if (mIdx < mBufSize) {
@@ -105,9 +198,9 @@ void FpsCounter::RingBufferFps::WriteToBuffer(const FpsCounter& obj) {
     }
 }
 
-void FpsCounter::dump(String8* result, const char* prefix) {
+void FpsCounter::dump(String8* result, const char* prefix, const char* name) {
     std::vector<RingBufferFps::BufContent>& RingBuf = mRingBuffer.getBuf();
-    result->appendFormat("%s FPS ring buffer:\n", prefix);
+    result->appendFormat("%s %s ring buffer:\n", prefix, name);
 
     for (size_t i = 0; i < RingBuf.size(); i++) {
         if (0 != RingBuf[i].mFps && 0 != RingBuf[i].mLastLogDuration) {
@@ -120,12 +213,18 @@ void FpsCounter::dump(String8* result, const char* prefix) {
             {
                 HWC_LOGE("%s(), strftime fail", __FUNCTION__);
             }
-            result->appendFormat("%s (%zu) %-9s%-3d fps=%-5.2f dur=%-13.2f max=%-13.2f min=%-5.2f\n",
+            result->appendFormat("%s (%zu) %-9s%-3d fps=%-5.2f dur=%-13.2f max=%-13.2f min=%-5.2f"
+                " p50=%-6.2f p90=%-6.2f p99=%-6.2f p99.9=%-6.2f over=%u\n",
                 prefix, i, buffer, static_cast<int>(RingBuf[i].mTv.tv_usec/1e3),
                 static_cast<double>(RingBuf[i].mFps),
                 RingBuf[i].mLastLogDuration / 1e6,
                 RingBuf[i].mMaxDuration / 1e6,
-                RingBuf[i].mMinDuration / 1e6);
+                RingBuf[i].mMinDuration / 1e6,
+                RingBuf[i].mP50 / 1e6,
+                RingBuf[i].mP90 / 1e6,
+                RingBuf[i].mP99 / 1e6,
+                RingBuf[i].mP999 / 1e6,
+                RingBuf[i].mOverBudget);
             }
         }
         else
@@ -134,6 +233,13 @@ void FpsCounter::dump(String8* result, const char* prefix) {
         }
     }
 
+    result->appendFormat("%s %s lifetime: frames=%u p50=%.2f p90=%.2f p99=%.2f p99.9=%.2f over=%u budget=%.2f\n",
+        prefix, name, mHistogramTotal.getCount(),
+        mHistogramTotal.getPercentile(50.f) / 1e6,
+        mHistogramTotal.getPercentile(90.f) / 1e6,
+        mHistogramTotal.getPercentile(99.f) / 1e6,
+        mHistogramTotal.getPercentile(99.9f) / 1e6,
+        mOverBudgetTotal, mBudget / 1e6);
 }
 
 // ----------------------------------------------------------------------------
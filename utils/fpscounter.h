@@ -8,6 +8,40 @@
 namespace android {
 // ----------------------------------------------------------------------------
 
+// log-bucketed histogram of frame durations, HDR-histogram style
+// * durations are kept in microseconds, exact below 32us and then 16 buckets
+//   per power of two, a percentile is reported as the middle of its bucket
+//   so it is off by 1/32 at most
+// * fixed storage, add() never allocates
+class FrameTimeHistogram {
+public:
+    enum {
+        SUB_BUCKET_BITS  = 4,
+        SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS,
+        LINEAR_COUNT     = SUB_BUCKET_COUNT * 2,
+        // enough for any uint32_t microseconds
+        BUCKET_COUNT     = (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT,
+    };
+
+    FrameTimeHistogram() { reset(); }
+
+    void reset();
+    void add(const nsecs_t& duration);
+
+    inline uint32_t getCount() const { return mCount; }
+
+    // the duration that percentile% of the frames do not exceed, -1 if there
+    // is no frame
+    nsecs_t getPercentile(float percentile) const;
+
+private:
+    static uint32_t toIndex(uint32_t us);
+    static uint32_t toMiddleUs(uint32_t index);
+
+    uint32_t    mCount;
+    uint32_t    mBuckets[BUCKET_COUNT];
+};
+
 // tool class for FPS statistics, provide AVG, MAX, MIN message
 // * AVG for FPS in a given duration
 // * MAX and MIN for stability reference
@@ -31,6 +65,20 @@ private:
     nsecs_t     mLastTime;
     nsecs_t     mLastDuration;
 
+    // for percentiles, per interval and since reset()
+    nsecs_t     mBudget;
+    uint32_t    mOverBudgetCounting;
+    uint32_t    mOverBudgetTotal;
+    FrameTimeHistogram mHistogramCounting;
+    FrameTimeHistogram mHistogramTotal;
+
+    // percentiles of the last interval
+    nsecs_t     mP50;
+    nsecs_t     mP90;
+    nsecs_t     mP99;
+    nsecs_t     mP999;
+    uint32_t    mOverBudget;
+
     // Ring buffer for dump
     class RingBufferFps {
     public:
@@ -44,7 +92,12 @@ private:
               : mFps(0),
                 mMaxDuration(0),
                 mMinDuration(0),
-                mLastLogDuration(0) {
+                mLastLogDuration(0),
+                mP50(0),
+                mP90(0),
+                mP99(0),
+                mP999(0),
+                mOverBudget(0) {
                     memset(&mTv, 0, sizeof(struct timeval));
             }
             float   mFps;
@@ -52,6 +105,11 @@ private:
             nsecs_t mMaxDuration;
             nsecs_t mMinDuration;
             nsecs_t mLastLogDuration;
+            nsecs_t mP50;
+            nsecs_t mP90;
+            nsecs_t mP99;
+            nsecs_t mP999;
+            uint32_t mOverBudget;
         };
         void   WriteToBuffer(const FpsCounter&);
         inline std::vector<BufContent>&  getBuf() { return mBuf;}
@@ -75,6 +133,10 @@ public:
     bool update(const nsecs_t& time);
     bool update();
 
+    // forget the last frame and the interval in progress, the next update()
+    // starts counting again, for a source which pauses, e.g. vsync turned off
+    void restart();
+
     // get result
     inline float   getFps()             const{ return mFps;             }
     inline nsecs_t getMaxDuration()     const{ return mMaxDuration;     }
@@ -83,8 +145,22 @@ public:
     inline nsecs_t getLastDuration()    const{ return mLastDuration;    }
     inline nsecs_t getLastLogTime()     const{ return mLastLogTime;     }
 
+    // percentiles of the last interval
+    inline nsecs_t getP50()             const{ return mP50;             }
+    inline nsecs_t getP90()             const{ return mP90;             }
+    inline nsecs_t getP99()             const{ return mP99;             }
+    inline nsecs_t getP999()            const{ return mP999;            }
+    inline uint32_t getOverBudget()     const{ return mOverBudget;      }
+
+    // since reset()
+    inline const FrameTimeHistogram& getHistogram() const{ return mHistogramTotal; }
+    inline uint32_t getOverBudgetTotal() const{ return mOverBudgetTotal; }
+
+    // a frame longer than budget is counted as over budget, 0 to disable
+    inline void setBudget(const nsecs_t& budget) { mBudget = budget; }
+
     // dump
-    void dump (String8* result, const char* prefix);
+    void dump (String8* result, const char* prefix, const char* name = "FPS");
 };
 
 // ----------------------------------------------------------------------------
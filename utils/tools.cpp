@@ -37,6 +37,7 @@
 #include "DpAsyncBlitStream.h"
 
 #include "dispatcher.h"
+#include "mc_model.h"
 #include "platform_wrap.h"
 
 // for CheckIonSupport
@@ -275,6 +276,7 @@ BlackBuffer::BlackBuffer()
     param.height = 128;
     param.format = HAL_PIXEL_FORMAT_RGB_565;
     param.usage  = static_cast<uint64_t>(BufferUsage::CPU_WRITE_RARELY);
+    param.owner  = MemoryTracker::OWNER_FILL_BUFFER;
 
     // allocate
     if (NO_ERROR != GrallocDevice::getInstance().alloc(param))
@@ -388,6 +390,7 @@ WhiteBuffer::WhiteBuffer()
     param.height = 128;
     param.format = HAL_PIXEL_FORMAT_RGB_565;
     param.usage  = static_cast<uint64_t>(BufferUsage::CPU_WRITE_RARELY);
+    param.owner  = MemoryTracker::OWNER_FILL_BUFFER;
 
     // allocate
     if (NO_ERROR != GrallocDevice::getInstance().alloc(param))
@@ -1884,88 +1887,31 @@ uint32_t cpuMHzToUClamp(uint32_t cpu_mhz)
 
 const HwcMCycleInfo& getScenarioMCInfo(DispatcherJob* job)
 {
-    if (CC_UNLIKELY(Platform::getInstance().m_config.hwc_mcycle_table.empty()))
-    {
-        HWC_LOGE("hwc_mcycle_table empty");
-        HWC_ASSERT(0);
-    }
-
     if (CC_UNLIKELY(!job))
     {
+        if (CC_UNLIKELY(Platform::getInstance().m_config.hwc_mcycle_table.empty()))
+        {
+            HWC_LOGE("hwc_mcycle_table empty");
+            HWC_ASSERT(0);
+        }
         return Platform::getInstance().m_config.hwc_mcycle_table.back();
     }
 
     int num_ui = job->num_ui_layers + (job->fbt_exist ? 1 : 0);
     int num_mm = job->num_mm_layers + job->num_glai_layers; // TODO: glai
     // TODO: mm w/ different PQ
-    int cur_id;
-
-    if (num_mm)
-    {
-        switch (num_ui)
-        {
-            case 0:
-                cur_id = HWC_MC_0U_1M;
-                break;
-            case 1:
-                cur_id = HWC_MC_1U_1M;
-                break;
-            case 2:
-                cur_id = HWC_MC_2U_1M;
-                break;
-            case 3:
-                cur_id = HWC_MC_3U_1M;
-                break;
-            case 4:
-                cur_id = HWC_MC_4U_1M;
-                break;
-            case 5:
-                cur_id = HWC_MC_5U_1M;
-                break;
-            default:
-                cur_id = HWC_MC_5U_1M;
-                break;
-        }
-    }
-    else
-    {
-        switch (num_ui)
-        {
-            case 1:
-                cur_id = HWC_MC_1U;
-                break;
-            case 2:
-                cur_id = HWC_MC_2U;
-                break;
-            case 3:
-                cur_id = HWC_MC_3U;
-                break;
-            case 4:
-                cur_id = HWC_MC_4U;
-                break;
-            case 5:
-                cur_id = HWC_MC_5U;
-                break;
-            case 6:
-                cur_id = HWC_MC_6U;
-                break;
-            default:
-                cur_id = HWC_MC_6U;
-                break;
-        }
-    }
+    return getScenarioMCInfo(num_ui, num_mm);
+}
 
-    for (auto& p : Platform::getInstance().m_config.hwc_mcycle_table)
+const HwcMCycleInfo& getScenarioMCInfo(int num_ui, int num_mm)
+{
+    if (CC_UNLIKELY(Platform::getInstance().m_config.hwc_mcycle_table.empty()))
     {
-        if (p.id != cur_id)
-        {
-            continue;
-        }
-
-        return p;
+        HWC_LOGE("hwc_mcycle_table empty");
+        HWC_ASSERT(0);
     }
 
-    return Platform::getInstance().m_config.hwc_mcycle_table.back();
+    return lookupScenarioMCInfo(Platform::getInstance().m_config.hwc_mcycle_table, num_ui, num_mm);
 }
 
 int mapComposerExtDisplayType(ComposerExt::DisplayType& dpy, hwc2_display_t* disp_id)
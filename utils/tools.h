@@ -1466,6 +1466,9 @@ void changeCpuSet(pid_t tid, unsigned int cpu_set);
 uint32_t calculateCpuMHz(float mc, nsecs_t remain_time);
 uint32_t cpuMHzToUClamp(uint32_t cpu_mhz);
 const HwcMCycleInfo& getScenarioMCInfo(DispatcherJob* job);
+// table entry of num_ui ui layers (fbt included) and num_mm mm layers,
+// capped to the largest scenario of the table
+const HwcMCycleInfo& getScenarioMCInfo(int num_ui, int num_mm);
 
 int mapComposerExtDisplayType(ComposerExt::DisplayType& dpy, hwc2_display_t* disp_id);
 